@@ -44,9 +44,10 @@
 /*
  * This file provides Autonomous System identification for IP addresses
  *
- * It reads a file in MRT format to create a data structure (a binary
- * tree) that records which ASNs are announcing particular ranges.
- * IP addresses can then checked to determine if they are in a given ASN.
+ * It reads a file in MRT format to create a data structure (a DIR-24-8
+ * lookup table) that records which ASNs are announcing particular ranges.
+ * IP addresses can then checked to determine if they are in a given ASN
+ * or mapped to the ASN announcing them.
  *
  * MRT format is currently described in draft-ietf-grow-mrt-03.txt
  *
@@ -89,15 +90,15 @@ uint32_t maskval[32] = {
 
 /*
  * --------------------------------------------------------------------------
- * tree building
+ * prefix list
  * --------------------------------------------------------------------------
  *
- * for performance reasons we want a nice bushy tree to search, but
- * unfortunately the MRT file turns up pretty much in (ascending) order.
- * So we first perform an insertion sort to build a chained list
- * of prefixes, then, once completed, we turn that into an optimal tree.
+ * the MRT file turns up pretty much in (ascending) order, so we
+ * perform an insertion sort to build a chained list of prefixes
+ * where duplicate announcements are merged. once completed, the
+ * list is turned into the lookup table (see below) and freed.
  *
- * note that the tree is ordered left to right, with low prefix addresses
+ * note that the list is ordered left to right, with low prefix addresses
  * to the left and high prefix addresses to the right. Where the prefix
  * matches the most specific address (the highest subnet, the biggest
  * mask value) is the leftmost.
@@ -106,10 +107,11 @@ uint32_t maskval[32] = {
 typedef struct prefix prefix_t;
 
 struct prefix {
-    struct prefix *left;	/* left (lower)   part of tree */
-    struct prefix *right;	/* right (higher) part of tree */
+    struct prefix *left;	/* left (lower)   part of list */
+    struct prefix *right;	/* right (higher) part of list */
     uint32_t addr;		/* start of CIDR range         */
     uint32_t mask;		/* subnet mask                 */
+    uint8_t len;		/* subnet length               */
     asn_t as0;			/* AS announcing this route    */
     asn_t as1;			/* another announcing AS (!)   */
 };
@@ -117,36 +119,26 @@ struct prefix {
 prefix_t *base = NULL;
 
 static void
-free_prefix_tree(prefix_t * ptr)
+free_prefix_list(void)
 {
-    if (ptr->left)
-	free_prefix_tree(ptr->left);
-    if (ptr->right)
-	free_prefix_tree(ptr->right);
-    free(ptr);
-}
-
+    prefix_t *ptr;
 
-static void
-init_prefix_tree(void)
-{
-    if (base) {
-	free_prefix_tree(base->left);
-	free_prefix_tree(base->right);
+    while (base) {
+	ptr = base->left;
+	free(base);
+	base = ptr;
     }
-
-    base = NULL;
 }
 
 static void
 add_new_prefix(const uint32_t prefix, const uint32_t mask,
 	       const uint8_t subnet, const asn_t origin)
 {
-    prefix_t *ptr;
+    prefix_t *ptr, *prev;
 
     /* walk chain (following "left/lower" links) to locate insertion point */
 
-    for (ptr = base; ptr; ptr = ptr->left) {
+    for (prev = NULL, ptr = base; ptr; prev = ptr, ptr = ptr->left) {
 	if (prefix == ptr->addr) {
 	    if (mask == ptr->mask) {
 
@@ -196,6 +188,7 @@ add_new_prefix(const uint32_t prefix, const uint32_t mask,
 
     node->addr = prefix;
     node->mask = mask;
+    node->len  = subnet;
     node->as0  = origin;
     node->as1  = 0;
 
@@ -205,7 +198,7 @@ add_new_prefix(const uint32_t prefix, const uint32_t mask,
 	node->right = ptr->right;
 	ptr->right = node;
     } else
-	node->right = NULL;
+	node->right = prev;	/* new lowest prefix, append to the chain */
 
     if (node->right)
 	node->right->left = node;
@@ -213,74 +206,189 @@ add_new_prefix(const uint32_t prefix, const uint32_t mask,
 	base = node;
 }
 
-/* build_tree : recursive tree-building */
+/*
+ * --------------------------------------------------------------------------
+ * lookup table
+ * --------------------------------------------------------------------------
+ *
+ * the prefixes are stored in a DIR-24-8 table (see "Routing Lookups
+ * in Hardware at Memory Access Speeds" by P. Gupta et al.). the first
+ * table has one entry for each /24. if no prefix longer than /24
+ * covers that range, the entry contains the route directly. otherwise
+ * it points to a block of 256 entries in the second table, one for each
+ * address. a lookup thus takes one or two memory accesses.
+ *
+ * routes are the distinct (as0, as1) pairs and entries refer to them
+ * by index (0 means no route).
+ *
+ * the table is built by the SUPERVISOR when reading the configuration
+ * and is never modified afterwards, so all processes share the same
+ * pages. the first table is allocated with calloc() and only the pages
+ * covered by a prefix are ever touched. a new table is built aside and
+ * then replaced in one pointer store.
+ */
 
-static prefix_t *
-build_tree(prefix_t * const ptr, const int count)
-{
-    prefix_t *temp = ptr;
+#define TBL24_SIZE	(1 << 24)
+#define TBL8_EXT	0x80000000	/* entry points to the second table */
 
-    switch (count) {
-    case 0:
-	panic("asn: zero length tree range!");
+typedef struct asn_route {
+    asn_t as0;
+    asn_t as1;
+} asn_route_t;
 
-    case 1:			/* just a single item, so return it */
-	temp->left = NULL;
-	temp->right = NULL;
-	break;
+typedef struct asn_table {
+    uint32_t *tbl24;		/* entries for each /24                */
+    uint32_t *tbl8;		/* blocks of 256 entries               */
+    uint32_t tbl8_count;	/* number of blocks in use             */
+    uint32_t tbl8_max;		/* number of blocks allocated          */
+    asn_route_t *routes;	/* distinct routes, 0 is unused        */
+    uint32_t route_count;
+    uint32_t route_max;
+} asn_table_t;
 
-    case 2:			/* two items, so make rightmost one higher level */
-	ptr->right = NULL;
+static asn_table_t * volatile asn_table = NULL;
 
-	ptr->left->left = NULL;
-	ptr->left->right = NULL;
-	break;
+static void
+free_asn_table(asn_table_t * t)
+{
+    free(t->tbl24);
+    free(t->tbl8);
+    free(t->routes);
+    free(t);
+}
 
-    case 3:			/* three items, so can make nicely balanced tree */
-	temp = ptr->left;
+/*
+ * -- route_index
+ *
+ * return the index of a route, adding it if not present. while
+ * building the table, routes with the same as0 are chained from
+ * heads[as0] via next[] (both indexed by route, 0 ends the chain).
+ */
+static uint32_t
+route_index(asn_table_t * t, uint32_t * heads, uint32_t ** next,
+	    asn_t as0, asn_t as1)
+{
+    uint32_t i;
 
-	ptr->left = NULL;
-	ptr->right = NULL;
+    for (i = heads[as0]; i != 0; i = (*next)[i]) {
+	if (t->routes[i].as1 == as1)
+	    return i;
+    }
 
-	temp->left->left = NULL;
-	temp->left->right = NULL;
+    if (t->route_count == t->route_max) {
+	t->route_max *= 2;
+	t->routes = safe_realloc(t->routes,
+				 t->route_max * sizeof(asn_route_t));
+	*next = safe_realloc(*next, t->route_max * sizeof(uint32_t));
+    }
 
-	break;
+    i = t->route_count++;
+    t->routes[i].as0 = as0;
+    t->routes[i].as1 = as1;
+    (*next)[i] = heads[as0];
+    heads[as0] = i;
+    return i;
+}
 
-    default:
-	{
-	    /* otherwise split in half and deal with the two halves */
+static int
+cmp_prefix_len(const void * a, const void * b)
+{
+    const prefix_t *x = *(prefix_t * const *) a;
+    const prefix_t *y = *(prefix_t * const *) b;
 
-	    int i;
-	    for (i = 0; i < count / 2; i++)
-		temp = temp->left;
+    return (int) x->len - (int) y->len;
+}
 
-	    temp->left = build_tree(temp->left, (count - i) - 1);
-	    temp->right = build_tree(ptr, i);
+/*
+ * -- build_asn_table
+ *
+ * build the lookup table from the prefix list. prefixes are added
+ * in order of increasing length so that more specific prefixes
+ * overwrite the ones that contain them.
+ */
+static asn_table_t *
+build_asn_table(void)
+{
+    asn_table_t *t;
+    prefix_t **sorted, *ptr;
+    uint32_t *heads, *next;
+    int count, i;
+
+    t = safe_calloc(1, sizeof(asn_table_t));
+    t->tbl24 = safe_calloc(TBL24_SIZE, sizeof(uint32_t));
+    t->route_max = 1024;
+    t->routes = safe_calloc(t->route_max, sizeof(asn_route_t));
+    t->route_count = 1;
+
+    for (count = 0, ptr = base; ptr; ptr = ptr->left)
+	count++;
+    if (count == 0)
+	return t;
+
+    heads = safe_calloc(65536, sizeof(uint32_t));
+    next = safe_calloc(t->route_max, sizeof(uint32_t));
+    sorted = safe_calloc(count, sizeof(prefix_t *));
+    for (i = 0, ptr = base; ptr; ptr = ptr->left)
+	sorted[i++] = ptr;
+    qsort(sorted, count, sizeof(prefix_t *), cmp_prefix_len);
+
+    for (i = 0; i < count; i++) {
+	uint32_t route, first, last, j, *block;
+
+	ptr = sorted[i];
+	route = route_index(t, heads, &next, ptr->as0, ptr->as1);
+
+	if (ptr->len <= 24) {
+	    first = ptr->addr >> 8;
+	    last = first + (1 << (24 - ptr->len));
+	    for (j = first; j < last; j++)
+		t->tbl24[j] = route;
+	    continue;
+	}
 
-	    break;
+	/* longer than /24, use (or create) a block in the second table */
+	first = ptr->addr >> 8;
+	if (!(t->tbl24[first] & TBL8_EXT)) {
+	    if (t->tbl8_count == t->tbl8_max) {
+		t->tbl8_max = t->tbl8_max ? t->tbl8_max * 2 : 64;
+		t->tbl8 = safe_realloc(t->tbl8,
+				       t->tbl8_max * 256 * sizeof(uint32_t));
+	    }
+	    block = &t->tbl8[t->tbl8_count * 256];
+	    for (j = 0; j < 256; j++)
+		block[j] = t->tbl24[first];
+	    t->tbl24[first] = TBL8_EXT | t->tbl8_count++;
 	}
+
+	block = &t->tbl8[(t->tbl24[first] & ~TBL8_EXT) * 256];
+	for (j = ptr->addr & 0xFF; j < (ptr->addr & 0xFF) +
+		(1u << (32 - ptr->len)); j++)
+	    block[j] = route;
     }
 
-    return temp;
+    free(sorted);
+    free(next);
+    free(heads);
+    return t;
 }
 
-/* make_prefix_tree: build tree from flat chain */
-
-static void
-make_prefix_tree(void)
+/*
+ * -- asn_route
+ *
+ * find the route for an address. returns NULL if there is none.
+ */
+static inline const asn_route_t *
+asn_route(const asn_table_t * t, const uint32_t addr)
 {
-    /* count items in tree */
+    uint32_t e;
 
-    prefix_t *ptr;
-    int count = 0;
+    if (t == NULL)
+	return NULL;
 
-    for (ptr = base; ptr; ptr = ptr->left)
-	count++;
-
-    /* recursive build of tree */
-
-    base = build_tree(base, count);
+    e = t->tbl24[addr >> 8];
+    if (e & TBL8_EXT)
+	e = t->tbl8[(e & ~TBL8_EXT) * 256 + (addr & 0xFF)];
+    return (e == 0) ? NULL : &t->routes[e];
 }
 
 /*
@@ -342,9 +450,9 @@ asn_readfile(const char *filename)
     else
 	asn_file = NULL;
 
-    /* initialise the prefix tree */
+    /* initialise the prefix list */
 
-    init_prefix_tree();
+    free_prefix_list();
 
     /* AS 65535 deemed to be the RFC1918 addresses:
      *          10.0.0.0/8
@@ -358,12 +466,13 @@ asn_readfile(const char *filename)
 
     /* now see what in the global routing table file... */
 
+    if (filename && (fd = open(filename, O_RDONLY)) < 0) {
+	logmsg(LOGWARN, "asn: error while opening file %s: %s\n",
+	       filename, strerror(errno));
+	filename = NULL;	/* just keep the private ranges */
+    }
+
     if (filename) {
-	if ((fd = open(filename, O_RDONLY)) < 0) {
-	    logmsg(LOGWARN, "asn: error while opening file %s: %s\n",
-		   filename, strerror(errno));
-	    return;
-	}
 
 	for (;;) {
 	    uint16_t type;
@@ -551,7 +660,17 @@ asn_readfile(const char *filename)
 	close(fd);
     }
 
-    make_prefix_tree();
+    /* build the new table and replace the current one */
+
+    {
+	asn_table_t *old = asn_table;
+
+	asn_table = build_asn_table();
+	if (old)
+	    free_asn_table(old);
+    }
+
+    free_prefix_list();
 }
 
 /*
@@ -563,43 +682,26 @@ asn_readfile(const char *filename)
 int
 asn_test(const uint32_t addr, const asn_t asn)
 {
-    prefix_t *ptr = base;
-
-    while (ptr) {
-	uint32_t a = addr & ptr->mask;
-
-	if (a > ptr->addr)
-	    ptr = ptr->right;
-	else if (a < ptr->addr)
-	    ptr = ptr->left;
-	else {
-	    /* matched the address, but may also match other nearby
-	     * entries as well... so check for these cases */
-
-	    if (ptr->right) {
-		uint32_t r = addr & ptr->right->mask;
-		if ((r == ptr->right->addr) && (r > a)) {
-		    ptr = ptr->right;
-		    continue;
-		}
-	    }
+    const asn_route_t *r = asn_route(asn_table, addr);
 
-	    if (ptr->left) {
-		uint32_t l = addr & ptr->left->mask;
-		if ((l == ptr->left->addr) && (a >= l)) {
-		    ptr = ptr->left;
-		    continue;
-		}
-	    }
+    return (r != NULL && (asn == r->as0 || asn == r->as1));
+}
 
-	    if (asn == ptr->as0 || asn == ptr->as1)
-		return 1;
-	    else
-		return 0;
-	}
-    }
+/*
+ * --------------------------------------------------------------------------
+ * asn_lookup: AS announcing the longest prefix matching an address
+ * --------------------------------------------------------------------------
+ *
+ * returns 0 if the address is not covered by any prefix. addr is
+ * in host byte order.
+ */
+
+asn_t
+asn_lookup(const uint32_t addr)
+{
+    const asn_route_t *r = asn_route(asn_table, addr);
 
-    return 0;
+    return (r == NULL) ? 0 : r->as0;
 }
 
 /* end of asn.c */
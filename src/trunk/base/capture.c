@@ -45,6 +45,7 @@
 #include "comopriv.h"
 #include "sniffers.h"
 #include "ipc.h"
+#include "hashfn.h"		/* pktkey_t */
 
 #include "ppbuf.c"
 
@@ -153,10 +154,21 @@ cleanup()
 }
 
 
+/*
+ * capture tables are not allocated in the module shared map (that is
+ * destroyed once EXPORT is done with an interval). they come from the
+ * main shared memory and, once EXPORT returns them, they are kept in a
+ * per-module pool to be reused in the next intervals. two spare tables
+ * are enough for one table in CAPTURE and one in flight to EXPORT.
+ */
+#define CA_TBLPOOL_MAX		2
+
+
 /* 
  * -- create_table 
  * 
- * allocates and initializes a hash table
+ * allocates and initializes a hash table. a table from the 
+ * recycle pool is used if there is one of the right size. 
  */
 static ctable_t *
 create_table(module_t * mdl, timestamp_t ivl)
@@ -165,18 +177,40 @@ create_table(module_t * mdl, timestamp_t ivl)
     size_t len;
 
     len = sizeof(ctable_t) + mdl->ca_hashsize * sizeof(void *);
-    ct = alc_malloc(&(mdl->alc), len);
-    if (ct == NULL)
-	return NULL;
 
-    ct->bytes += len;
+    while ((ct = mdl->ca_tblpool) != NULL) {
+	mdl->ca_tblpool = ct->next;
+	mdl->ca_tblpool_len--;
+	if (ct->size == mdl->ca_hashsize)
+	    break;
+	mem_free(ct);		/* hash size has changed */
+    }
+
+    if (ct != NULL) {
+	/* 
+	 * only the buckets between first_full and last_full have 
+	 * been used. EXPORT leaves them empty but it skips the table
+	 * if the module was not active, so clear them anyway. 
+	 */
+	if (ct->first_full <= ct->last_full) 
+	    bzero(&ct->bucket[ct->first_full], 
+		  (ct->last_full - ct->first_full + 1) * sizeof(void *)); 
+    } else { 
+	ct = mem_calloc(1, len);
+	if (ct == NULL)
+	    return NULL;
+    } 
+
+    ct->bytes = len;
 
     ct->size = mdl->ca_hashsize;
     ct->first_full = ct->size;	/* all records are empty */
     ct->last_full = 0;		/* all records are empty */
     ct->records = 0;
     ct->live_buckets = 0;
+    ct->filled_records = 0;
     ct->flexible = 0;
+    ct->next = NULL;
 
     /*
      * save the timestamp indicating with flush interval this 
@@ -188,6 +222,45 @@ create_table(module_t * mdl, timestamp_t ivl)
 }
 
 
+/* 
+ * -- recycle_table 
+ * 
+ * put a table processed by EXPORT back in the module pool or 
+ * free it if the pool is full or the module is gone. 
+ */
+static void
+recycle_table(module_t * mdl, ctable_t * ct)
+{
+    if (mdl->status != MDL_ACTIVE || ct->size != mdl->ca_hashsize ||
+	mdl->ca_tblpool_len >= CA_TBLPOOL_MAX) {
+	mem_free(ct);
+	return;
+    }
+
+    ct->next = mdl->ca_tblpool;
+    mdl->ca_tblpool = ct;
+    mdl->ca_tblpool_len++;
+}
+
+
+/* 
+ * -- destroy_tblpool 
+ * 
+ * free all the tables in the recycle pool of a module
+ */
+static void
+destroy_tblpool(module_t * mdl)
+{
+    ctable_t *ct;
+
+    while ((ct = mdl->ca_tblpool) != NULL) {
+	mdl->ca_tblpool = ct->next;
+	mem_free(ct);
+    }
+    mdl->ca_tblpool_len = 0;
+}
+
+
 /*
  * -- flush_state
  *
@@ -248,6 +321,8 @@ flush_state(module_t * mdl, tailq_t * em_tables)
 
     TQ_APPEND(em_tables, em, next);
     map.stats->table_queue++;
+    if (map.stats->table_queue > map.stats->table_queue_peak) 
+	map.stats->table_queue_peak = map.stats->table_queue; 
 
     /* reset the state of the module */
     mdl->ca_hashtable = NULL;
@@ -256,6 +331,116 @@ flush_state(module_t * mdl, tailq_t * em_tables)
 }
 
 
+/*
+ * -- expire_table
+ *
+ * flush the capture table of a module if time ts is past the end
+ * of its interval. the table is gone afterwards unless it is empty,
+ * in which case it is just moved to the interval of ts.
+ */
+static void
+expire_table(module_t * mdl, timestamp_t ts, tailq_t * exp_tables)
+{
+    ctable_t *ct = mdl->ca_hashtable;
+
+    if (ts < ct->ivl + mdl->flush_ivl)
+	return;
+
+    if (ct->records || ct->flexible) {
+	/*
+	 * even if the table doesn't contain any record, if
+	 * the flexible flag is set it will be flushed to
+	 * guarantee that export can call store_records for
+	 * the previously seen tables belonging to the same
+	 * interval.
+	 */
+	ct->ts = ct->ivl + mdl->flush_ivl;
+	flush_state(mdl, exp_tables);
+    } else {
+	/* 
+	 * the table that would have been flushed if it
+	 * contained some record must be updated to refer to
+	 * the right ivl value.
+	 */
+	ct->ivl = ts - (ts % mdl->flush_ivl);
+    }
+}
+
+
+/*
+ * -- advance_clock
+ *
+ * packets dropped by the filter in ppbuf_capture() never reach the
+ * modules but they still tell us how far the sniffers have gone.
+ * without them a module whose packets are filtered out would keep
+ * its table open until the next packet it wants shows up.
+ * the clock is the oldest of the sniffers' last seen packets,
+ * bounded by the packets still waiting in the ppbufs, so that no
+ * packet can come later for an interval that is flushed here.
+ * returns the new time (at least ts).
+ */
+static timestamp_t
+advance_clock(timestamp_t ts, tailq_t * exp_tables)
+{
+    source_t *src;
+    timestamp_t clock = ~0;
+    int idx;
+
+    for (src = map.sources; src; src = src->next) {
+	ppbuf_t *ppbuf = src->sniff->ppbuf;
+	timestamp_t t;
+
+	if (src->sniff->flags & SNIFF_INACTIVE)
+	    continue;
+
+	t = MAX(ppbuf->drop_ts, ppbuf->last_pkt_ts);
+	if (ppbuf->count > 0) {
+	    pkt_t *pkt;
+
+	    pkt = ppbuf->pp[(ppbuf->woff - ppbuf->count + ppbuf->size) %
+			    ppbuf->size];
+	    t = MIN(t, pkt->ts);
+	}
+	clock = MIN(clock, t);
+    }
+
+    if (clock == (timestamp_t) ~0 || clock <= ts)
+	return ts;
+
+    for (idx = 0; idx <= map.module_last; idx++) {
+	module_t *mdl = &map.modules[idx];
+
+	if (mdl->status == MDL_ACTIVE && mdl->ca_hashtable)
+	    expire_table(mdl, clock, exp_tables);
+    }
+
+    return clock;
+}
+
+
+/*
+ * -- send_expired
+ *
+ * send to EXPORT information on the memory to be read, 
+ * where to free it and what module it refers to. 
+ */
+static void
+send_expired(tailq_t * exp_tables)
+{
+    expiredmap_t *first_exp_table;
+
+    first_exp_table = TQ_HEAD(exp_tables);
+    if (first_exp_table != NULL) {
+	int ret;
+
+	ret = ipc_send(sibling(EXPORT), IPC_FLUSH,
+		       &first_exp_table, sizeof(expiredmap_t *));
+	if (ret != IPC_OK)
+	    panic("IPC_FLUSH failed!");
+    }
+}
+
+
 /*
  * -- capture_pkt
  *
@@ -267,12 +452,14 @@ flush_state(module_t * mdl, tailq_t * em_tables)
  *
  */
 static void
-capture_pkt(module_t * mdl, batch_t * batch, char *which, tailq_t * exp_tables)
+capture_pkt(module_t * mdl, batch_t * batch, char *which, pktkey_t * keys,
+	    tailq_t * exp_tables)
 {
     pkt_t *pkt, **pktptr;
     int i, c, l;
     int new_record;
     int record_size;		/* effective record size */
+    uint64_t t0;		/* start of a callback, for cbhist */
 
     record_size = mdl->callbacks.ca_recordsize + sizeof(rec_t);
 
@@ -287,32 +474,11 @@ capture_pkt(module_t * mdl, batch_t * batch, char *which, tailq_t * exp_tables)
 	    uint bucket;
 
 	    pkt = *pktptr;
+	    pktkey_cur = &keys[c];
 
 	    /* flush the current flow table, if needed */
-	    if (mdl->ca_hashtable) {
-		ctable_t *ct = mdl->ca_hashtable;
-
-		if (pkt->ts >= ct->ivl + mdl->flush_ivl) {
-		    if (ct->records || ct->flexible) {
-			/*
-			 * even if the table doesn't contain any record, if
-			 * the flexible flag is set it will be flushed to
-			 * guarantee that export can call store_records for
-			 * the previously seen tables belonging to the same
-			 * interval.
-			 */
-			ct->ts = ct->ivl + mdl->flush_ivl;
-			flush_state(mdl, exp_tables);
-		    } else {
-			/* 
-			 * the table that would have been flushed if it
-			 * contained some record must be updated to refer to
-			 * the right ivl value.
-			 */
-			ct->ivl = pkt->ts - (pkt->ts % mdl->flush_ivl);
-		    }
-		}
-	    }
+	    if (mdl->ca_hashtable)
+		expire_table(mdl, pkt->ts, exp_tables);
 	    if (!mdl->ca_hashtable) {
 		timestamp_t ivl;
 		ivl = pkt->ts - (pkt->ts % mdl->flush_ivl);
@@ -327,7 +493,9 @@ capture_pkt(module_t * mdl, batch_t * batch, char *which, tailq_t * exp_tables)
 		    continue;
 		}
 		if (mdl->callbacks.flush != NULL) {
+		    t0 = cbhist_cycles();
 		    mdl->fstate = mdl->callbacks.flush(mdl);
+		    cbhist_record(map.stats, mdl, CB_FLUSH, t0);
 		}
 	    }
 	    mdl->ca_hashtable->ts = pkt->ts;
@@ -340,15 +508,27 @@ capture_pkt(module_t * mdl, batch_t * batch, char *which, tailq_t * exp_tables)
 	     * make it unacceptable for the classifier.
 	     * (if check() is not provided, we take the packet anyway)
 	     */
-	    if (mdl->callbacks.check && !mdl->callbacks.check(mdl, pkt))
-		continue;
+	    if (mdl->callbacks.check) {
+		int ok;
+
+		t0 = cbhist_cycles();
+		ok = mdl->callbacks.check(mdl, pkt);
+		cbhist_record(map.stats, mdl, CB_CHECK, t0);
+		if (!ok)
+		    continue;
+	    }
 
 	    /*
 	     * find the entry where the information related to
 	     * this packet reside
 	     * (if hash() is not provided, it defaults to 0)
 	     */
-	    hash = (mdl->callbacks.hash) ? mdl->callbacks.hash(mdl, pkt) : 0;
+	    hash = 0;
+	    if (mdl->callbacks.hash) {
+		t0 = cbhist_cycles();
+		hash = mdl->callbacks.hash(mdl, pkt);
+		cbhist_record(map.stats, mdl, CB_HASH, t0);
+	    }
 	    bucket = hash % mdl->ca_hashtable->size;
 
 	    /*
@@ -361,8 +541,13 @@ capture_pkt(module_t * mdl, batch_t * batch, char *which, tailq_t * exp_tables)
 	    if (bucket > mdl->ca_hashtable->last_full)
 		mdl->ca_hashtable->last_full = bucket;
 
+	    /* 
+	     * the match() histogram counts the scan of the entire 
+	     * bucket, i.e. all the match() calls for this packet. 
+	     */
 	    prev = NULL;
 	    cand = mdl->ca_hashtable->bucket[bucket];
+	    t0 = cbhist_cycles();
 	    while (cand) {
 		/* if match() is not provided, any record matches */
 		if (mdl->callbacks.match == NULL ||
@@ -371,6 +556,8 @@ capture_pkt(module_t * mdl, batch_t * batch, char *which, tailq_t * exp_tables)
 		prev = cand;
 		cand = cand->next;
 	    }
+	    if (mdl->callbacks.match != NULL)
+		cbhist_record(map.stats, mdl, CB_MATCH, t0);
 
 	    if (cand != NULL) {
 		/*
@@ -446,12 +633,16 @@ capture_pkt(module_t * mdl, batch_t * batch, char *which, tailq_t * exp_tables)
 		new_record = 1;
 	    }
 	    start_tsctimer(map.stats->ca_updatecb_timer);
+	    t0 = cbhist_cycles();
 	    cand->full = mdl->callbacks.update(mdl, pkt, cand, new_record);
+	    cbhist_record(map.stats, mdl, CB_UPDATE, t0);
 	    end_tsctimer(map.stats->ca_updatecb_timer);
 	}
 	pktptr = batch->pkts1;
 	l = batch->pkts1_len;
     } while (c < batch->count);
+
+    pktkey_cur = NULL;
 }
 
 
@@ -543,9 +734,11 @@ static timestamp_t
 batch_process(batch_t * batch)
 {
     char *which;
+    pktkey_t *keys;
     int idx;
     tailq_t exp_tables = { NULL, NULL };
-    expiredmap_t *first_exp_table;
+    timestamp_t ts;
+    pmcsample_t pmc;
 
     /*
      * Select which classifiers need to see which packets The batch_filter()
@@ -562,6 +755,12 @@ batch_process(batch_t * batch)
     which = batch_filter(batch);
     end_tsctimer(map.stats->ca_filter_timer);
 
+    /*
+     * parse the headers and hash the flow key of each packet once
+     * for all the modules (see pktkey.c).
+     */
+    keys = pktkey_batch(batch);
+
     /*
      * Now browse through the classifiers and perform the capture
      * actions needed.
@@ -583,7 +782,9 @@ batch_process(batch_t * batch)
 	       batch->count, map.modules[idx].name);
 
 	start_tsctimer(map.stats->ca_module_timer);
-	capture_pkt(mdl, batch, which, &exp_tables);
+	pmc_start(&pmc);
+	capture_pkt(mdl, batch, which, keys, &exp_tables);
+	pmc_stop(&pmc, mdl, PMC_CAPTURE, batch->count);
 	end_tsctimer(map.stats->ca_module_timer);
 	which += batch->count;	/* next module, new list of packets */
     }
@@ -615,30 +816,22 @@ batch_process(batch_t * batch)
 		continue;
 	    mdl->ca_hashtable->flexible = 1;
 	    if (mdl->callbacks.flush != NULL) {
+		uint64_t t0 = cbhist_cycles();
+
 		mdl->fstate = mdl->callbacks.flush(mdl);
+		cbhist_record(map.stats, mdl, CB_FLUSH, t0);
 	    }
 	}
     }
 
-    /*
-     * send to EXPORT information on the memory to be read, 
-     * where to free it and what module it refers to. 
-     */
-    first_exp_table = TQ_HEAD(&exp_tables);
-    if (first_exp_table != NULL) {
-	int ret;
-
-	ret = ipc_send(sibling(EXPORT), IPC_FLUSH,
-		       &first_exp_table, sizeof(expiredmap_t *));
-	if (ret != IPC_OK)
-	    panic("IPC_FLUSH failed!");
-    }
-
     /*  
      * get batch timestamp, i.e. the timestamp of the last packet 
-     * of the batch. 
+     * of the batch, or later if the filter has dropped newer packets.
      */
-    return batch->last_pkt_ts;
+    ts = advance_clock(batch->last_pkt_ts, &exp_tables);
+
+    send_expired(&exp_tables);
+    return ts;
 }
 
 
@@ -676,6 +869,106 @@ cabuf_init(size_t size)
 }  
 
 
+/*
+ * -- update_filters
+ *
+ * compute the union of the filters of the active modules and push 
+ * it down to the sniffers, so that the packets no module wants do not
+ * make it into a batch. if filter-pushdown is on, sniffers with a 
+ * setfilter() callback get the union as a libpcap expression; the 
+ * packets of the other sniffers are matched against the module 
+ * filters in ppbuf_capture(). 
+ * nothing is filtered if a module wants all packets or if there are
+ * capture clients, as we do not know what they are interested in. 
+ * this is called every time a module or a capture client comes or goes.
+ */
+static void
+update_filters(void)
+{
+    source_t *src;
+    char *expr = NULL;
+    int idx, all, pushdown;
+
+    s_filters = safe_realloc(s_filters, map.module_max * sizeof(void *));
+    s_filters_count = 0;
+
+    all = (s_active_modules == 0 || s_cabuf.clients_count > 0);
+    pushdown = 1;
+    for (idx = 0; idx <= map.module_last && !all; idx++) {
+	module_t *mdl = &map.modules[idx];
+	char *x;
+
+	if (mdl->status != MDL_ACTIVE)
+	    continue;
+
+	if (mdl->filter_tree == NULL) {
+	    all = 1;
+	    break;
+	}
+
+	s_filters[s_filters_count++] = mdl->filter_tree;
+
+	/* 
+	 * build the libpcap expression as long as all filters 
+	 * can be translated. 
+	 */
+	if (!pushdown)
+	    continue;
+	x = tree_to_pcap(mdl->filter_tree);
+	if (x == NULL) {
+	    pushdown = 0;
+	    free(expr);
+	    expr = NULL;
+	} else if (expr == NULL) {
+	    expr = x;
+	} else {
+	    char *y;
+
+	    asprintf(&y, "%s or %s", expr, x);
+	    free(expr);
+	    free(x);
+	    expr = y;
+	}
+    }
+
+    if (all) 
+	s_filters_count = -1;
+
+    /* 
+     * the pkts filtered by the sniffers are never seen and cannot move 
+     * the flush clock (see advance_clock()), hence this is opt-in.
+     */
+    if (all || !map.filter_pushdown) {
+	free(expr);
+	expr = NULL;
+    }
+
+    logmsg(LOGCAPTURE, "packet filter: %s\n", 
+	   all? "none" : (expr? expr : "in CAPTURE"));
+
+    for (src = map.sources; src; src = src->next) {
+	sniffer_t *sniff = src->sniff;
+
+	if (sniff->flags & SNIFF_INACTIVE)
+	    continue;
+
+	sniff->ppbuf->filter = !all;
+	if (src->cb->setfilter == NULL)
+	    continue;
+
+	if (expr != NULL && src->cb->setfilter(sniff, expr) == 0) {
+	    sniff->ppbuf->filter = 0;
+	    continue;
+	}
+
+	/* make sure an old (narrower) filter is not left behind */
+	src->cb->setfilter(sniff, NULL);
+    }
+
+    free(expr);
+}
+
+
 /* 
  * -- ca_ipc_module_add
  * 
@@ -782,6 +1075,7 @@ ca_ipc_module_add(procname_t sender, void *pack, size_t sz)
     }
 
     s_active_modules++;
+    update_filters();
 }
 
 
@@ -811,7 +1105,9 @@ ca_ipc_module_del(procname_t sender, void *buf,
 	s_active_modules--;
     }
 
+    destroy_tblpool(mdl);
     remove_module(&map, mdl);
+    update_filters();
 }
 
 
@@ -860,6 +1156,9 @@ ca_ipc_flush(procname_t sender, void *buf, size_t len)
     while (em) {
 	expiredmap_t *em_next = em->next;
 
+	/* keep the table for the next intervals */
+	recycle_table(em->mdl, em->ct);
+
 	/* ok, move freed memory into the main memory */
 	memmap_destroy(em->shared_map);
 
@@ -963,6 +1262,7 @@ cabuf_cl_destroy(int id, cabuf_cl_t * cl)
     free(cl);
 
     map.stats->ca_clients = s_cabuf.clients_count;
+    update_filters();
 }
 
 
@@ -1061,6 +1361,9 @@ ca_ipc_cca_open(procname_t sender, __attribute__((__unused__)) void *buf,
     s_cabuf.clients_count++;
     FD_SET(fd, &s_cabuf.clients_fds);
 
+    /* the client may want any packet */
+    update_filters();
+
     m.open_res.id = id;
     m.open_res.sampling = cl->sampling;
     sz = sizeof(m.open_res);
@@ -1700,6 +2003,7 @@ capture_mainloop(int accept_fd, int supervisor_fd,
     /* initialize the timers */
 
     init_timers();
+    pmc_open();
 
     /* start all the sniffers */
     for (src = map.sources; src; src = src->next) {
@@ -1767,14 +2071,11 @@ capture_mainloop(int accept_fd, int supervisor_fd,
 		    flush_state(mdl, &exp_tables);
 	    }
 
-	    if (TQ_HEAD(&exp_tables)) {
-		expiredmap_t *x = TQ_HEAD(&exp_tables);
-		if (ipc_send(sibling(EXPORT),IPC_FLUSH,&x,sizeof(x)) != IPC_OK)
-		    panic("IPC_FLUSH failed!");
-	    }
+	    send_expired(&exp_tables);
 
 	    if (map.exit_when_done == 1 && done_msg_sent == 0) {
 		done_msg_sent = 1;
+		gettimeofday(&map.stats->ca_done, NULL);
 		/* inform export that no more message will come */
 		if (ipc_send(sibling(EXPORT), IPC_DONE, NULL, 0) != IPC_OK)
 		    panic("IPC_DONE failed!");
@@ -1954,6 +2255,12 @@ capture_mainloop(int accept_fd, int supervisor_fd,
 		batch->ref_mask &= ~1LL;
 	    else
 		batch_free(batch);
+	} else {
+	    tailq_t exp_tables = { NULL, NULL };
+
+	    /* all packets may have been filtered out */
+	    map.stats->ts = advance_clock(map.stats->ts, &exp_tables);
+	    send_expired(&exp_tables);
 	}
 
 	/* 
@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2004-2006, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+#include <string.h>
+#include <strings.h>
+
+#include "como.h"
+#include "comopriv.h"
+
+/*
+ * Callback latency histograms.
+ *
+ * CAPTURE and EXPORT time every callback of every module with the
+ * TSC (QUERY times load() and print()) and add the sample to a
+ * histogram in shared memory (see cbhist_record() in comopriv.h).
+ * The histograms are allocated once by SUPERVISOR, one set of
+ * CB_MAX per module slot, and cleared whenever a module is
+ * (re)initialized in that slot. They can be read at any time with
+ * the "profile" service.
+ */
+
+static const char * cbhist_names[CB_MAX] = {
+    "check", "hash", "match", "update", "flush",
+    "export", "action", "store", "load", "print"
+};
+
+
+/*
+ * -- cbhist_init
+ *
+ * allocate the histograms for the modules in shared memory.
+ * called by SUPERVISOR before forking the other processes.
+ */
+void
+cbhist_init(stats_t * st, int modules)
+{
+    st->cbhist = mem_calloc(modules * CB_MAX, sizeof(cbhist_t));
+    st->cbhist_max = (st->cbhist != NULL)? modules : 0;
+}
+
+
+/*
+ * -- cbhist_reset
+ *
+ * clear the histograms of a module. the slot may have been used
+ * by a module that has been removed.
+ */
+void
+cbhist_reset(stats_t * st, module_t * mdl)
+{
+    if (mdl->index >= st->cbhist_max)
+	return;
+
+    bzero(&st->cbhist[mdl->index * CB_MAX], CB_MAX * sizeof(cbhist_t));
+}
+
+
+/*
+ * -- cbhist_get
+ *
+ * return the histogram of a callback of a module (or NULL)
+ */
+cbhist_t *
+cbhist_get(stats_t * st, module_t * mdl, cbtype_t cb)
+{
+    if (mdl->index >= st->cbhist_max)
+	return NULL;
+
+    return &st->cbhist[mdl->index * CB_MAX + cb];
+}
+
+
+/*
+ * -- cbhist_lower
+ *
+ * smallest value that falls in bucket b. this is the inverse of
+ * cbhist_bucket().
+ */
+uint64_t
+cbhist_lower(int b)
+{
+    int msb;
+
+    if (b < CBH_SUB)
+	return (uint64_t) b;
+
+    msb = (b >> CBH_SUBBITS) + CBH_SUBBITS - 1;
+    return (1ULL << msb) |
+	   ((uint64_t) (b & (CBH_SUB - 1)) << (msb - CBH_SUBBITS));
+}
+
+
+/*
+ * -- cbhist_percentile
+ *
+ * return the p-th percentile (0 < p <= 100) of the samples. the
+ * value is the lower bound of the bucket where the percentile falls
+ * and is never larger than the maximum.
+ */
+uint64_t
+cbhist_percentile(cbhist_t * h, double p)
+{
+    uint64_t n, want, seen;
+    int b;
+
+    /* take a snapshot of the count, the writer may be running */
+    n = h->n;
+    if (n == 0)
+	return 0;
+
+    want = (uint64_t) (n * p / 100.0);
+    if (want == 0)
+	want = 1;
+
+    seen = 0;
+    for (b = 0; b < CBH_BUCKETS; b++) {
+	seen += h->bucket[b];
+	if (seen >= want)
+	    break;
+    }
+
+    if (b == CBH_BUCKETS || cbhist_lower(b) > h->max)
+	return h->max;
+    return cbhist_lower(b);
+}
+
+
+/*
+ * -- cbhist_name
+ *
+ */
+const char *
+cbhist_name(cbtype_t cb)
+{
+    return cbhist_names[cb];
+}
@@ -0,0 +1,712 @@
+/*
+ * Copyright (c) 2004-2006, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>		/* inet_ntop, inet_pton */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#include "como.h"
+#include "comopriv.h"
+#include "storage.h"
+#include "query.h"
+
+/*
+ * Columnar output. 
+ * 
+ * For modules with a record schema (callbacks.schema), EXPORT also 
+ * writes the records in the bytestream <output>.col. Records are 
+ * grouped in blocks of up to COL_BLOCK_RECORDS records or 
+ * COL_BLOCK_SPAN seconds. A block is made of a header and one 
+ * column per field: 
+ * 
+ *    +--------+---------+---------------+------------+-----+
+ *    | header | colinfo | ... colinfo   | column 0   | ... |
+ *    +--------+---------+---------------+------------+-----+
+ * 
+ * Values in the columns are in host byte order with the size of the 
+ * field type. The header of each column has the min and max values 
+ * in the block. 
+ * 
+ * Queries with a "fields=f1,f2,..." argument are answered from this 
+ * bytestream (see column_query()). Only the columns of those fields, 
+ * of the timestamp and of the fields in "where=field:min:max" arguments 
+ * are read, and blocks that cannot match the time interval or the 
+ * where ranges are skipped looking at the header only. 
+ */
+
+/* global state */
+extern struct _como map;
+
+#define COL_MAGIC		0x43424c4b	/* 'CBLK' */
+#define COL_BLOCK_RECORDS	4096
+#define COL_BLOCK_SPAN		TIME2TS(60, 0)
+
+typedef struct colinfo {
+    uint32_t	ofs;		/* offset of the column in the block */
+    uint32_t	width;		/* bytes per value */
+    uint64_t	min;
+    uint64_t	max;
+} colinfo_t;
+
+typedef struct colblock {
+    uint32_t	magic;
+    uint32_t	size;		/* block size, header included */
+    uint32_t	records;	/* no. of records */
+    uint32_t	fields;		/* no. of columns */
+    colinfo_t	col[0];
+} colblock_t;
+
+/* columnar output of a module in EXPORT */
+struct _colstore {
+    char *	output;		/* bytestream name */
+    int		file;		/* output file */
+    off_t	offset;		/* current offset in the output file */
+    int		fields;		/* no. of fields in the schema */
+    size_t	recsize;	/* size of the records */
+    char *	rows;		/* records of the current block */
+    int		count;		/* no. of records in the current block */
+    timestamp_t	first_ts;	/* timestamp of the first record */
+};
+
+
+static int 
+col_width(fieldtype_t type) 
+{
+    switch (type) { 
+    case FIELD_UINT8: 
+	return 1; 
+    case FIELD_UINT16: 
+	return 2; 
+    case FIELD_UINT32: 
+    case FIELD_IPV4: 
+	return 4; 
+    default: 
+	return 8; 
+    } 
+}
+
+
+/* 
+ * -- col_field
+ * 
+ * read field f of a record in host byte order 
+ */
+static uint64_t 
+col_field(field_t * f, char * rec) 
+{
+    uint64_t v64; 
+    uint32_t v32; 
+    uint16_t v16; 
+
+    switch (col_width(f->type)) { 
+    case 1: 
+	return (uint8_t) rec[f->offset]; 
+    case 2: 
+	memcpy(&v16, rec + f->offset, 2); 
+	return ntohs(v16); 
+    case 4: 
+	memcpy(&v32, rec + f->offset, 4); 
+	return ntohl(v32); 
+    default: 
+	memcpy(&v64, rec + f->offset, 8); 
+	return NTOHLL(v64); 
+    } 
+}
+
+
+/* 
+ * -- col_get, col_put
+ * 
+ * access the i-th value of a column 
+ */
+static uint64_t 
+col_get(char * col, int width, int i) 
+{
+    switch (width) { 
+    case 1: 
+	return ((uint8_t *) col)[i]; 
+    case 2: 
+	return ((uint16_t *) col)[i]; 
+    case 4: 
+	return ((uint32_t *) col)[i]; 
+    default: 
+	return ((uint64_t *) col)[i]; 
+    } 
+}
+
+static void 
+col_put(char * col, int width, int i, uint64_t v) 
+{
+    switch (width) { 
+    case 1: 
+	((uint8_t *) col)[i] = v; 
+	break; 
+    case 2: 
+	((uint16_t *) col)[i] = v; 
+	break; 
+    case 4: 
+	((uint32_t *) col)[i] = v; 
+	break; 
+    default: 
+	((uint64_t *) col)[i] = v; 
+	break; 
+    } 
+}
+
+
+/* 
+ * -- column_init
+ * 
+ * open the columnar bytestream of the module. called by EXPORT. 
+ * 
+ */
+void
+column_init(module_t * mdl) 
+{
+    colstore_t * cs; 
+    field_t * f; 
+
+    mdl->columns = NULL; 
+    if (mdl->callbacks.schema == NULL) 
+	return; 
+
+    cs = safe_calloc(1, sizeof(colstore_t)); 
+    for (f = mdl->callbacks.schema; f->name != NULL; f++) 
+	cs->fields++; 
+    cs->recsize = mdl->callbacks.st_recordsize; 
+    cs->rows = safe_malloc(COL_BLOCK_RECORDS * cs->recsize); 
+
+    asprintf(&cs->output, "%s.col", mdl->output); 
+    logmsg(V_LOGEXPORT, "module %s: opening file %s\n", mdl->name, cs->output);
+    cs->file = csopen(cs->output, CS_WRITER, mdl->streamsize);
+    if (cs->file < 0)
+	panic("cannot open file %s for %s", cs->output, mdl->name);
+    cs->offset = csgetofs(cs->file);
+
+    mdl->columns = cs; 
+}
+
+
+/* 
+ * -- col_flush
+ * 
+ * write the records of the current block in columnar format 
+ * 
+ */
+static void
+col_flush(module_t * mdl, colstore_t * cs) 
+{
+    colblock_t * blk; 
+    field_t * f; 
+    ssize_t size, bsize; 
+    uint32_t ofs; 
+    int i, j; 
+
+    if (cs->count == 0) 
+	return; 
+
+    size = sizeof(colblock_t) + cs->fields * sizeof(colinfo_t); 
+    for (f = mdl->callbacks.schema; f->name != NULL; f++) 
+	size += (col_width(f->type) * cs->count + 7) & ~7; 
+
+    bsize = size; 
+    blk = (colblock_t *) csmap(cs->file, cs->offset, &bsize); 
+    if (blk == NULL)
+	panic("fail csmap for module %s", mdl->name);
+    if (bsize < size) {
+	logmsg(LOGWARN, "cannot write to disk for module %s (%s)\n",
+	       mdl->name, cs->output);
+	cs->count = 0; 
+	return; 
+    }
+
+    blk->magic = COL_MAGIC; 
+    blk->size = size; 
+    blk->records = cs->count; 
+    blk->fields = cs->fields; 
+
+    ofs = sizeof(colblock_t) + cs->fields * sizeof(colinfo_t); 
+    for (i = 0, f = mdl->callbacks.schema; i < cs->fields; i++, f++) { 
+	colinfo_t * ci = &blk->col[i]; 
+	char * col = (char *) blk + ofs; 
+
+	ci->ofs = ofs; 
+	ci->width = col_width(f->type); 
+	ci->min = ~0ULL; 
+	ci->max = 0; 
+	for (j = 0; j < cs->count; j++) { 
+	    uint64_t v = col_field(f, cs->rows + j * cs->recsize); 
+
+	    col_put(col, ci->width, j, v); 
+	    if (v < ci->min) 
+		ci->min = v; 
+	    if (v > ci->max) 
+		ci->max = v; 
+	} 
+	ofs += (ci->width * cs->count + 7) & ~7; 
+    } 
+
+    cs->offset += size; 
+    cscommit(cs->file, cs->offset);
+    cs->count = 0; 
+}
+
+
+/* 
+ * -- column_store
+ * 
+ * add the records just written by store() to the current block. 
+ * called by EXPORT. 
+ * 
+ */
+void
+column_store(module_t * mdl, char * ptr, size_t len) 
+{
+    colstore_t * cs = mdl->columns; 
+    timestamp_t ts; 
+    size_t sz; 
+
+    if (cs == NULL) 
+	return; 
+
+    while (len > 0) { 
+	sz = mdl->callbacks.load(mdl, ptr, len, &ts); 
+	if (sz == 0) 
+	    break; 
+
+	if (cs->count > 0 && ts >= cs->first_ts + COL_BLOCK_SPAN) 
+	    col_flush(mdl, cs); 
+
+	if (sz == cs->recsize) { 
+	    if (cs->count == 0) 
+		cs->first_ts = ts; 
+	    memcpy(cs->rows + cs->count * cs->recsize, ptr, sz); 
+	    if (++cs->count == COL_BLOCK_RECORDS) 
+		col_flush(mdl, cs); 
+	} 
+
+	ptr += sz; 
+	len -= sz; 
+    } 
+}
+
+
+/* 
+ * -- column_destroy
+ * 
+ * write the current block and close the bytestream 
+ * 
+ */
+void
+column_destroy(module_t * mdl) 
+{
+    colstore_t * cs = mdl->columns; 
+
+    if (cs == NULL) 
+	return; 
+
+    col_flush(mdl, cs); 
+    csclose(cs->file, cs->offset); 
+    free(cs->output); 
+    free(cs->rows); 
+    free(cs); 
+    mdl->columns = NULL; 
+}
+
+
+/*
+ * Query side
+ */
+
+typedef struct colquery {
+    module_t *	mdl; 
+    int		fields;		/* no. of fields in the schema */
+    int		nproj;		/* no. of projected fields */
+    int *	proj;		/* projected fields */
+    int		nwhere;		/* no. of where ranges */
+    int *	where;		/* fields of the where ranges */
+    uint64_t *	lo;		/* ranges (inclusive) */
+    uint64_t *	hi;
+    char *	need;		/* columns to read */
+    char **	cols;		/* columns of the current block */
+    colinfo_t *	info;		/* headers of the current block */
+} colquery_t;
+
+
+static int
+col_lookup(module_t * mdl, const char * name, size_t len) 
+{
+    field_t * f; 
+    int i; 
+
+    for (i = 0, f = mdl->callbacks.schema; f->name != NULL; i++, f++) { 
+	if (strlen(f->name) == len && strncmp(f->name, name, len) == 0) 
+	    return i; 
+    } 
+    return -1; 
+}
+
+
+/* 
+ * -- col_value
+ * 
+ * parse a value of a where argument (IPv4 addresses in dotted 
+ * notation, timestamps in seconds). 
+ */
+static uint64_t
+col_value(field_t * f, const char * s) 
+{
+    struct in_addr addr; 
+
+    if (f->type == FIELD_IPV4 && inet_pton(AF_INET, s, &addr) == 1) 
+	return ntohl(addr.s_addr); 
+    if (f->type == FIELD_TIME) 
+	return TIME2TS(strtoul(s, NULL, 10), 0); 
+    return strtoull(s, NULL, 0); 
+}
+
+
+/* 
+ * -- col_free
+ * 
+ * release whatever col_parse() and the query have allocated. 
+ * 
+ */
+static void
+col_free(colquery_t * q) 
+{
+    int i; 
+
+    for (i = 0; q->cols && i < q->fields; i++) 
+	free(q->cols[i]); 
+    free(q->cols); 
+    free(q->info); 
+    free(q->proj); 
+    free(q->need); 
+    free(q->where); 
+    free(q->lo); 
+    free(q->hi); 
+}
+
+
+/* 
+ * -- col_parse
+ * 
+ * parse the fields and where arguments of the query. returns 0 if 
+ * the query does not have a "fields" argument or it is not valid. 
+ * 
+ */
+static int
+col_parse(colquery_t * q, qreq_t * req) 
+{
+    field_t * schema = req->mdl->callbacks.schema; 
+    int i; 
+
+    memset(q, 0, sizeof(colquery_t)); 
+    q->mdl = req->mdl; 
+    while (schema[q->fields].name != NULL) 
+	q->fields++; 
+
+    q->proj = safe_calloc(q->fields, sizeof(int)); 
+    q->need = safe_calloc(q->fields, 1); 
+    q->need[0] = 1; 		/* always need the timestamp */
+
+    for (i = 0; req->args && req->args[i]; i++) { 
+	char * a = req->args[i]; 
+
+	if (strncmp(a, "fields=", 7) == 0) { 
+	    char * p = a + 7; 
+
+	    while (*p && q->nproj < q->fields) { 
+		size_t len = strcspn(p, ","); 
+		int k = col_lookup(q->mdl, p, len); 
+
+		if (k < 0) 
+		    goto invalid; 
+		q->proj[q->nproj++] = k; 
+		q->need[k] = 1; 
+		p += len; 
+		if (*p == ',') 
+		    p++; 
+	    } 
+	} else if (strncmp(a, "where=", 6) == 0) { 
+	    char * p = a + 6; 
+	    char * lo, * hi; 
+	    int k; 
+
+	    lo = strchr(p, ':'); 
+	    if (lo == NULL) 
+		goto invalid; 
+	    k = col_lookup(q->mdl, p, lo - p); 
+	    if (k < 0) 
+		goto invalid; 
+	    lo++; 
+	    hi = strchr(lo, ':'); 
+
+	    q->where = safe_realloc(q->where, (q->nwhere + 1) * sizeof(int)); 
+	    q->lo = safe_realloc(q->lo, (q->nwhere + 1) * sizeof(uint64_t)); 
+	    q->hi = safe_realloc(q->hi, (q->nwhere + 1) * sizeof(uint64_t)); 
+	    q->where[q->nwhere] = k; 
+	    q->lo[q->nwhere] = col_value(&schema[k], lo); 
+	    q->hi[q->nwhere] = hi ? col_value(&schema[k], hi + 1) : 
+				    q->lo[q->nwhere]; 
+	    q->need[k] = 1; 
+	    q->nwhere++; 
+	} 
+    } 
+
+    if (q->nproj == 0) 
+	goto invalid; 
+
+    q->cols = safe_calloc(q->fields, sizeof(char *)); 
+    q->info = safe_calloc(q->fields, sizeof(colinfo_t)); 
+    return 1; 
+
+invalid: 
+    col_free(q); 
+    return 0; 
+}
+
+
+/* 
+ * -- col_header
+ * 
+ * read the header of the block at ofs. returns 1 on success, 
+ * 0 at the end of the bytestream, -1 if there is no valid block 
+ * at ofs (i.e., lost sync). 
+ * 
+ */
+static int
+col_header(colquery_t * q, int fd, off_t ofs, uint32_t * size, 
+	   uint32_t * records) 
+{
+    colblock_t * blk; 
+    ssize_t len; 
+
+    len = sizeof(colblock_t) + q->fields * sizeof(colinfo_t); 
+    blk = (colblock_t *) csmap(fd, ofs, &len); 
+    if (blk == NULL) 
+	return (len == 0) ? 0 : -1; 
+    if (len < (ssize_t) sizeof(colblock_t) || blk->magic != COL_MAGIC || 
+	    blk->fields != (uint32_t) q->fields) 
+	return -1; 
+    if (len < (ssize_t) (sizeof(colblock_t) + q->fields * sizeof(colinfo_t)))
+	return -1; 
+
+    *size = blk->size; 
+    *records = blk->records; 
+    memcpy(q->info, blk->col, q->fields * sizeof(colinfo_t)); 
+    return 1; 
+}
+
+
+/* 
+ * -- col_print
+ * 
+ * append the value of a field to the output line 
+ */
+static int
+col_print(char * s, field_t * f, uint64_t v) 
+{
+    struct in_addr addr; 
+    char ip[INET_ADDRSTRLEN]; 
+
+    switch (f->type) { 
+    case FIELD_TIME: 
+	return sprintf(s, "%u.%06u", TS2SEC(v), TS2USEC(v)); 
+    case FIELD_IPV4: 
+	addr.s_addr = htonl((uint32_t) v); 
+	inet_ntop(AF_INET, &addr, ip, sizeof(ip)); 
+	return sprintf(s, "%s", ip); 
+    default: 
+	return sprintf(s, "%llu", (unsigned long long) v); 
+    } 
+}
+
+
+/* 
+ * -- column_query
+ * 
+ * answer a query with a "fields" argument from the columnar output 
+ * of the module. the output is one line per record with the values of 
+ * the requested fields. returns 0 if the query cannot be answered this 
+ * way (no schema, no fields argument) and the caller should go on as 
+ * usual. 
+ * 
+ */
+int
+column_query(qreq_t * req, int client_fd) 
+{
+    field_t * schema = req->mdl->callbacks.schema; 
+    colquery_t q; 
+    timestamp_t start_ts, end_ts; 
+    char * output, * buf; 
+    off_t ofs; 
+    size_t blen; 
+    int fd, mode, i, ret; 
+
+    if (schema == NULL || req->format != QFORMAT_CUSTOM) 
+	return 0; 
+    if (!col_parse(&q, req)) 
+	return 0; 
+
+    start_ts = TIME2TS(req->start, 0);
+    end_ts = TIME2TS(req->end, 0);
+
+    asprintf(&output, "%s.col", req->mdl->output); 
+    mode = req->wait ? CS_READER : CS_READER_NOBLOCK; 
+    fd = csopen(output, mode, 0); 
+    if (fd < 0) 
+	panic("opening file %s", output);
+
+    buf = safe_malloc(65536); 
+    blen = sprintf(buf, "#"); 
+    for (i = 0; i < q.nproj; i++) 
+	blen += sprintf(buf + blen, " %s", schema[q.proj[i]].name); 
+    blen += sprintf(buf + blen, "\n"); 
+
+    /* 
+     * find the file to start from looking at the first block 
+     * of each file (as module_db_seek_by_ts() does for records)
+     */
+    ofs = csgetofs(fd); 
+    for (;;) { 
+	uint32_t size, records; 
+
+	ret = col_header(&q, fd, ofs, &size, &records); 
+	if (ret <= 0 || q.info[0].min >= start_ts) { 
+	    ofs = csseek(fd, CS_SEEK_FILE_PREV); 
+	    if (ofs == -1) 
+		ofs = csgetofs(fd); 
+	    break; 
+	} 
+	ofs = csseek(fd, CS_SEEK_FILE_NEXT); 
+	if (ofs == -1) { 
+	    ofs = csgetofs(fd); 
+	    break; 
+	} 
+    } 
+
+    for (;;) { 
+	uint32_t size, records, r; 
+	int skip; 
+
+	ret = col_header(&q, fd, ofs, &size, &records); 
+	if (ret == 0) 
+	    break; 
+	if (ret < 0) { 
+	    ofs = csseek(fd, CS_SEEK_FILE_NEXT); 
+	    if (ofs == -1) 
+		break; 
+	    continue; 
+	} 
+
+	if (q.info[0].min >= end_ts) 
+	    break; 
+
+	/* skip the block if no record can match */
+	skip = (q.info[0].max < start_ts); 
+	for (i = 0; i < q.nwhere && !skip; i++) { 
+	    colinfo_t * ci = &q.info[q.where[i]]; 
+	    skip = (ci->max < q.lo[i] || ci->min > q.hi[i]); 
+	} 
+	if (skip) { 
+	    ofs += size; 
+	    continue; 
+	} 
+
+	/* read the columns we need */
+	for (i = 0; i < q.fields; i++) { 
+	    ssize_t len; 
+	    char * col; 
+
+	    if (!q.need[i]) 
+		continue; 
+	    len = q.info[i].width * records; 
+	    col = csmap(fd, ofs + q.info[i].ofs, &len); 
+	    if (col == NULL || len < (ssize_t) (q.info[i].width * records)) 
+		panic("reading from file %s ofs %lld", output, ofs); 
+	    q.cols[i] = safe_realloc(q.cols[i], len); 
+	    memcpy(q.cols[i], col, len); 
+	} 
+
+	for (r = 0; r < records; r++) { 
+	    uint64_t ts = col_get(q.cols[0], q.info[0].width, r); 
+
+	    if (ts < start_ts || ts >= end_ts) 
+		continue; 
+	    for (i = 0; i < q.nwhere; i++) { 
+		uint64_t v; 
+
+		v = col_get(q.cols[q.where[i]], q.info[q.where[i]].width, r); 
+		if (v < q.lo[i] || v > q.hi[i]) 
+		    break; 
+	    } 
+	    if (i < q.nwhere) 
+		continue; 
+
+	    for (i = 0; i < q.nproj; i++) { 
+		int k = q.proj[i]; 
+
+		if (i > 0) 
+		    buf[blen++] = ' '; 
+		blen += col_print(buf + blen, &schema[k], 
+				  col_get(q.cols[k], q.info[k].width, r)); 
+	    } 
+	    buf[blen++] = '\n'; 
+
+	    /* keep room for one more line */
+	    if (blen > 65536 - (size_t) q.nproj * 32) { 
+		if (como_writen(client_fd, buf, blen) < 0) 
+		    err(EXIT_FAILURE, "sending data to the client"); 
+		blen = 0; 
+	    } 
+	} 
+
+	ofs += size; 
+    } 
+
+    if (blen > 0 && como_writen(client_fd, buf, blen) < 0) 
+	err(EXIT_FAILURE, "sending data to the client"); 
+
+    csclose(fd, 0); 
+    col_free(&q); 
+    free(buf); 
+    free(output); 
+    return 1; 
+}
@@ -106,6 +106,7 @@ welcome_message()
 	break; 
 
     case RUNMODE_INLINE: 
+    case RUNMODE_INLINE_RAW: 
 	logmsg(LOGUI, "CoMo v%s (source %s %s; module %s)\n", 
 	       COMO_VERSION, map.sources->cb->name, map.sources->device, 
 	       map.modules[0].name); 
@@ -145,6 +146,13 @@ main(int argc, char *argv[])
     configure(&map, argc, argv);
     welcome_message();
 
+    /* 
+     * split the trace files among several pipelines. only the 
+     * shards return from here, we exit when their output is merged. 
+     */
+    if (map.shards > 1) 
+	shard_run(); 
+
     /*
      * Initialize the shared memory region.
      * All processes will be able to see it.
@@ -162,6 +170,11 @@ main(int argc, char *argv[])
     map.stats = mem_calloc(1, sizeof(stats_t)); 
     gettimeofday(&map.stats->start, NULL); 
     map.stats->first_ts = ~0;
+    cbhist_init(map.stats, map.module_max); 
+    map.stats->exmem = mem_calloc(map.module_max, sizeof(exmem_t)); 
+    map.stats->exmem_max = (map.stats->exmem != NULL)? map.module_max : 0; 
+    if (map.perf_counters) 
+	pmc_init(map.stats, map.module_max); 
 
     /* prepare the SUPERVISOR. STORAGE and CAPTURE sockets */
     supervisor_fd = ipc_listen(SUPERVISOR); 
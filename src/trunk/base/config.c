@@ -81,7 +81,12 @@ enum tokens {
     TOK_VIRTUAL,
     TOK_ALIAS,
     TOK_ASNFILE,
-    TOK_LIVE_THRESH
+    TOK_LIVE_THRESH,
+    TOK_QCACHESIZE,
+    TOK_SHARDS,
+    TOK_PERFCOUNTERS,
+    TOK_FILTERPUSHDOWN,
+    TOK_STATSFILE
 };
 
 
@@ -155,6 +160,11 @@ keyword_t keywords[] = {
     { "alias",       TOK_ALIAS,       2, CTX_GLOBAL },
     { "asnfile",     TOK_ASNFILE,     1, CTX_GLOBAL },
     { "live-thresh", TOK_LIVE_THRESH, 1, CTX_GLOBAL },
+    { "query-cache", TOK_QCACHESIZE,  2, CTX_GLOBAL },
+    { "shards",      TOK_SHARDS,      2, CTX_GLOBAL },
+    { "perf-counters",TOK_PERFCOUNTERS,2, CTX_GLOBAL },
+    { "filter-pushdown",TOK_FILTERPUSHDOWN,2, CTX_GLOBAL },
+    { "stats-file",  TOK_STATSFILE,   2, CTX_GLOBAL },
     { NULL,          0,               0, 0 }    /* terminator */
 };
 
@@ -735,6 +745,28 @@ do_config(struct _como * m, int argc, char *argv[])
 	m->live_thresh = TIME2TS(0, atoi(argv[1]));
 	break;
 
+    case TOK_QCACHESIZE:
+	m->qcache_size = parse_size(argv[1]); 
+	break;
+
+    case TOK_SHARDS:
+	m->shards = atoi(argv[1]); 
+	if (m->shards < 1) 
+	    m->shards = 1; 
+	break;
+
+    case TOK_PERFCOUNTERS:
+	m->perf_counters = (strcmp(argv[1], "on") == 0); 
+	break;
+
+    case TOK_FILTERPUSHDOWN:
+	m->filter_pushdown = (strcmp(argv[1], "on") == 0); 
+	break;
+
+    case TOK_STATSFILE:
+	safe_dup(&m->stats_file, argv[1]);
+	break;
+
     default:
 	sprintf(errstr, "unknown keyword %s\n", argv[0]);
 	return errstr; 
@@ -1201,6 +1233,8 @@ init_map(struct _como * m)
     m->logflags = DEFAULT_LOGFLAGS;
     m->mem_size = DEFAULT_MEMORY;
     m->maxfilesize = DEFAULT_FILESIZE;
+    m->qcache_size = DEFAULT_QCACHE_SIZE;
+    m->shards = 1;
     m->module_max = DEFAULT_MODULE_MAX;
     m->module_last = -1; 
     m->modules = safe_calloc(m->module_max, sizeof(module_t));
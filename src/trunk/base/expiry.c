@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2004-2006, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "como.h"
+#include "comopriv.h"
+
+/*
+ * Expiry timers of export records.
+ *
+ * Modules that keep sessions in EXPORT (e.g., sessions, scanner-detector) 
+ * used to return ACT_GO from action() so that EXPORT visits all the 
+ * records at every flush interval only to find out that a few of them 
+ * had timed out. Modules with the has_expiry capability can instead 
+ * arm a timer on each export record with expiry_set(). EXPORT then 
+ * calls action() only on the records whose timer has expired (see 
+ * store_records() in export.c). 
+ *
+ * The timers are kept in a hierarchical timer wheel with EXPIRY_LEVELS 
+ * levels of EXPIRY_SLOTS slots each. A tick is 1/64 of a second, so 
+ * the wheel covers 2^32 ticks (about two years). Timers further away 
+ * than that sit in an overflow list. Level 0 slots hold the timers of 
+ * one tick; a slot of level l holds the timers of 2^(8*l) ticks and is 
+ * moved to the lower levels (cascaded) when the current tick enters 
+ * its range. Arming, re-arming and disarming a timer are O(1). 
+ *
+ * Timers never fire early: the expiry time is rounded up to the next 
+ * tick. They may fire up to one tick late. 
+ *
+ * The timer of a record is the exnode_t in front of its rec_t (see 
+ * create_record() in export.c). 
+ */
+
+#define EXPIRY_BITS	8
+#define EXPIRY_SLOTS	(1 << EXPIRY_BITS)
+#define EXPIRY_MASK	(EXPIRY_SLOTS - 1)
+#define EXPIRY_LEVELS	4
+#define EXPIRY_TICK	26		/* 2^26 in 32.32 fixed point = 1/64s */
+
+struct _expiry {
+    uint64_t	now;			/* current tick */
+    int		started;		/* set after the first advance */
+    int		cascading;		/* set while cascading a slot */
+    uint32_t	count[EXPIRY_LEVELS + 1]; /* timers per level + overflow */
+    exnode_t *	slot[EXPIRY_LEVELS][EXPIRY_SLOTS];
+    exnode_t *	overflow;		/* timers beyond the last level */
+    exnode_t *	fired;			/* expired timers */
+    uint32_t	nfired;
+};
+
+
+static __inline__ void
+node_link(exnode_t ** head, exnode_t * n)
+{
+    n->next = *head;
+    if (n->next != NULL)
+	n->next->pprev = &n->next;
+    *head = n;
+    n->pprev = head;
+}
+
+static __inline__ void
+node_unlink(exnode_t * n)
+{
+    *n->pprev = n->next;
+    if (n->next != NULL)
+	n->next->pprev = n->pprev;
+    n->next = NULL;
+    n->pprev = NULL;
+}
+
+
+/*
+ * -- node_insert
+ *
+ * put an armed timer in the right slot given the current tick
+ */
+static void
+node_insert(expiry_t * ex, exnode_t * n)
+{
+    uint64_t e, delta;
+    int l;
+
+    if (!ex->started) {
+	/* we do not know the current time yet */
+	n->level = EXPIRY_LEVELS;
+	ex->count[EXPIRY_LEVELS]++;
+	node_link(&ex->overflow, n);
+	return;
+    }
+
+    /* round up to the next tick */
+    e = (n->when >> EXPIRY_TICK) + 
+	((n->when & ((1ULL << EXPIRY_TICK) - 1)) != 0);
+
+    /* 
+     * timers that are already due go in the next slot, or in 
+     * the current one when cascading as it is about to fire 
+     */
+    if (e <= ex->now)
+	e = ex->now + (ex->cascading ? 0 : 1);
+
+    delta = e - ex->now;
+    for (l = 0; l < EXPIRY_LEVELS; l++) {
+	if (delta < (1ULL << (EXPIRY_BITS * (l + 1)))) {
+	    n->level = l;
+	    ex->count[l]++;
+	    node_link(&ex->slot[l][(e >> (EXPIRY_BITS * l)) & EXPIRY_MASK], n);
+	    return;
+	}
+    }
+
+    n->level = EXPIRY_LEVELS;
+    ex->count[EXPIRY_LEVELS]++;
+    node_link(&ex->overflow, n);
+}
+
+
+/*
+ * -- reinsert
+ *
+ * move all the timers of a list to the slots they belong to now
+ */
+static void
+reinsert(expiry_t * ex, exnode_t ** head, int level)
+{
+    exnode_t * n, * next;
+
+    n = *head;
+    *head = NULL;
+    ex->cascading = 1;
+    for (; n != NULL; n = next) {
+	next = n->next;
+	ex->count[level]--;
+	node_insert(ex, n);
+    }
+    ex->cascading = 0;
+}
+
+
+/*
+ * -- fire
+ *
+ * move all the timers of a list to the list of expired timers
+ */
+static void
+fire(expiry_t * ex, exnode_t ** head, int level)
+{
+    exnode_t * n;
+
+    while ((n = *head) != NULL) {
+	node_unlink(n);
+	ex->count[level]--;
+	n->level = EXPIRY_FIRED;
+	node_link(&ex->fired, n);
+	ex->nfired++;
+    }
+}
+
+
+expiry_t *
+expiry_new(void)
+{
+    return safe_calloc(1, sizeof(expiry_t));
+}
+
+
+/*
+ * -- expiry_destroy
+ *
+ * free the wheel. the nodes belong to the export records and 
+ * are freed with them.
+ */
+void
+expiry_destroy(expiry_t * ex)
+{
+    free(ex);
+}
+
+
+/*
+ * -- expiry_remove
+ *
+ * disarm a timer (armed or expired)
+ */
+void
+expiry_remove(expiry_t * ex, exnode_t * n)
+{
+    if (n->level == EXPIRY_IDLE)
+	return;
+
+    if (n->level == EXPIRY_FIRED)
+	ex->nfired--;
+    else
+	ex->count[n->level]--;
+    node_unlink(n);
+    n->level = EXPIRY_IDLE;
+}
+
+
+/*
+ * -- expiry_arm
+ *
+ * arm (or re-arm) a timer to expire at time when. 
+ * when = 0 disarms the timer.
+ */
+void
+expiry_arm(expiry_t * ex, exnode_t * n, timestamp_t when)
+{
+    expiry_remove(ex, n);
+    n->when = when;
+    if (when != 0)
+	node_insert(ex, n);
+}
+
+
+/*
+ * -- expiry_advance
+ *
+ * move the wheel to time ts and return the number of expired 
+ * timers (see expiry_fired()). ts = ~0 expires all timers.
+ */
+int
+expiry_advance(expiry_t * ex, timestamp_t ts)
+{
+    uint64_t t = ts >> EXPIRY_TICK;
+    int l, i;
+
+    if (ts == ~(timestamp_t) 0) {
+	for (l = 0; l < EXPIRY_LEVELS; l++)
+	    for (i = 0; i < EXPIRY_SLOTS; i++)
+		fire(ex, &ex->slot[l][i], l);
+	fire(ex, &ex->overflow, EXPIRY_LEVELS);
+	return ex->nfired;
+    }
+
+    if (!ex->started) {
+	/* 
+	 * start at the current tick. the timers armed until now 
+	 * that are already due end up in the current slot (as when 
+	 * cascading) and fire right away. 
+	 */
+	ex->now = t;
+	ex->started = 1;
+	reinsert(ex, &ex->overflow, EXPIRY_LEVELS);
+	fire(ex, &ex->slot[0][ex->now & EXPIRY_MASK], 0);
+    }
+
+    while (ex->now < t) {
+	uint64_t next;
+
+	/* 
+	 * skip the ticks where nothing can fire or cascade, i.e. 
+	 * up to the next boundary of the first non-empty level
+	 */
+	for (l = 0; l <= EXPIRY_LEVELS && ex->count[l] == 0; l++)
+	    ;
+	if (l > EXPIRY_LEVELS) {
+	    ex->now = t;
+	    break;
+	}
+	if (l > 0) {
+	    next = ex->now | ((1ULL << (EXPIRY_BITS * l)) - 1);
+	    if (next >= t) {
+		ex->now = t;
+		break;
+	    }
+	    ex->now = next;
+	}
+
+	ex->now++;
+
+	/* cascade the higher levels at the slot boundaries */
+	if ((ex->now & EXPIRY_MASK) == 0) {
+	    for (l = 1; l < EXPIRY_LEVELS; l++) {
+		i = (ex->now >> (EXPIRY_BITS * l)) & EXPIRY_MASK;
+		reinsert(ex, &ex->slot[l][i], l);
+		if (i != 0)
+		    break;
+	    }
+	    if (l == EXPIRY_LEVELS)
+		reinsert(ex, &ex->overflow, EXPIRY_LEVELS);
+	}
+
+	fire(ex, &ex->slot[0][ex->now & EXPIRY_MASK], 0);
+    }
+
+    return ex->nfired;
+}
+
+
+/*
+ * -- expiry_fired
+ *
+ * list of expired timers. they stay in the list until they are 
+ * removed or re-armed.
+ */
+exnode_t *
+expiry_fired(expiry_t * ex)
+{
+    return ex->fired;
+}
+
+
+/*
+ * -- expiry_set
+ *
+ * arm the expiry timer of export record efh at time when (0 to 
+ * disarm it). to be called by modules with the has_expiry 
+ * capability from the export() or action() callbacks. 
+ */
+void
+expiry_set(void * self, void * efh, timestamp_t when)
+{
+    module_t * mdl = (module_t *) self;
+
+    if (mdl->ex_expiry == NULL)
+	panicx("module %s calls expiry_set without has_expiry\n", mdl->name);
+    expiry_arm(mdl->ex_expiry, EXREC_NODE(efh), when);
+}
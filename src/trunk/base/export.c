@@ -90,8 +90,17 @@ create_record(module_t * mdl, uint32_t hash)
 	mdl->ex_array = ea;
     } 
 
-    /* allocate the new record */
-    rp = safe_calloc(1, mdl->callbacks.ex_recordsize + sizeof(rec_t));
+    /* allocate the new record (with its timer if the module uses them) */
+    if (mdl->ex_expiry != NULL) { 
+	exnode_t * n; 
+
+	n = slab_alloc(mdl->ex_slab); 
+	n->level = EXPIRY_IDLE; 
+	n->index = et->records; 
+	rp = EXNODE_REC(n); 
+    } else { 
+	rp = slab_alloc(mdl->ex_slab); 
+    } 
     ea->record[et->records] = rp;
     et->records++;
     if (et->bucket[hash] == NULL) 
@@ -118,6 +127,7 @@ export_record(module_t * mdl, rec_t * rp)
     etable_t *et; 
     rec_t *cand; 
     uint32_t hash;
+    uint64_t t0;
     int isnew; 
 
     start_tsctimer(map.stats->ex_export_timer); 
@@ -156,7 +166,9 @@ export_record(module_t * mdl, rec_t * rp)
     /* 
      * update the export record. 
      */
+    t0 = cbhist_cycles();
     mdl->callbacks.export(mdl, cand, rp, isnew);
+    cbhist_record(map.stats, mdl, CB_EXPORT, t0);
 
     /*
      * move the record to the front of the bucket in the  
@@ -190,12 +202,13 @@ call_store(module_t * mdl, rec_t *rp)
 {
     char *dst = NULL;
     int ret, done = 0;
+    uint64_t t0;
     
     ssize_t bsize = mdl->callbacks.st_recordsize; 
 
     start_tsctimer(map.stats->ex_mapping_timer); 
     
-    if (map.runmode == RUNMODE_INLINE) {
+    if (map.runmode != RUNMODE_NORMAL) {
 	/* running inline */
 	dst = alloca(bsize); /* NOTE: might be replaced with a heap allocated
 				area using a static variable to keep track of
@@ -217,7 +230,9 @@ call_store(module_t * mdl, rec_t *rp)
 	}
 
 	/* call the store() callback */
+	t0 = cbhist_cycles();
 	ret = mdl->callbacks.store(mdl, rp, dst);
+	cbhist_record(map.stats, mdl, CB_STORE, t0);
 	if (ret < 0) {
 	    logmsg(LOGWARN, "store() of %s fails\n", mdl->name);
 	    return ret;
@@ -234,8 +249,14 @@ call_store(module_t * mdl, rec_t *rp)
 	     * update the offset and commit the bytes written to 
 	     * disk so far so that they are available to readers 
 	     */
+	    rollup_store(mdl, dst, ret); 
+	    column_store(mdl, dst, ret); 
 	    mdl->offset += ret;
 	    cscommit(mdl->file, mdl->offset);
+	} else if (map.runmode == RUNMODE_INLINE_RAW) { 
+	    /* send the records as they are, the reader will load them */
+	    if (como_writen(map.inline_fd, dst, ret) < 0) 
+		panic("writing records of %s", mdl->name); 
 	} else {
 	    char * p;
 	    size_t left;
@@ -350,21 +371,30 @@ process_table(ctable_t * ct, module_t * mdl)
 }
 
 /** 
- * -- destroy_record
+ * -- free_record
  * 
- * remove the export record from the hash table and 
- * free the memory. 
+ * free an export record and its timer (if any)
  */
 static void 
-destroy_record(int i, module_t * mdl) 
+free_record(module_t * mdl, rec_t * rp) 
 {
-    etable_t * et = mdl->ex_hashtable; 
-    earray_t * ea = mdl->ex_array; 
-    rec_t * rp; 
+    if (mdl->ex_expiry != NULL) { 
+	expiry_remove(mdl->ex_expiry, EXREC_NODE(rp)); 
+	slab_free(mdl->ex_slab, EXREC_NODE(rp)); 
+    } else { 
+	slab_free(mdl->ex_slab, rp);
+    } 
+}
 
-    rp = ea->record[i];
 
-    /* unlink this record from the hash table */
+/** 
+ * -- unlink_record
+ * 
+ * remove the export record from the hash table 
+ */
+static void 
+unlink_record(etable_t * et, rec_t * rp) 
+{
     et->records--; 
     if (rp->next != NULL) 
 	rp->next->prev = rp->prev; 
@@ -375,6 +405,24 @@ destroy_record(int i, module_t * mdl)
 	if (rp->next == NULL) 
 	    et->live_buckets--; 
     } 
+}
+
+
+/** 
+ * -- destroy_record
+ * 
+ * remove the export record from the hash table and 
+ * free the memory. 
+ */
+static void 
+destroy_record(int i, module_t * mdl) 
+{
+    etable_t * et = mdl->ex_hashtable; 
+    earray_t * ea = mdl->ex_array; 
+    rec_t * rp; 
+
+    rp = ea->record[i];
+    unlink_record(et, rp); 
 
     /* remove this record from the array keeping all 
      * used entries compact 
@@ -383,7 +431,94 @@ destroy_record(int i, module_t * mdl)
     ea->record[i] = ea->record[ea->first_full];
     ea->record[ea->first_full] = NULL;
     ea->first_full++;
-    free(rp);
+    free_record(mdl, rp);
+}
+
+
+/** 
+ * -- discard_record
+ * 
+ * same as destroy_record() but for records found via their 
+ * timer. the last record in the array takes the place of 
+ * this one. 
+ */
+static void 
+discard_record(module_t * mdl, rec_t * rp) 
+{
+    etable_t * et = mdl->ex_hashtable; 
+    earray_t * ea = mdl->ex_array; 
+    uint32_t i; 
+
+    i = EXREC_NODE(rp)->index; 
+    unlink_record(et, rp); 
+
+    ea->record[i] = ea->record[et->records]; 
+    EXREC_NODE(ea->record[i])->index = i; 
+    ea->record[et->records] = NULL; 
+    free_record(mdl, rp);
+}
+
+
+/**
+ * -- store_expired
+ * 
+ * same as store_records() for modules with the has_expiry 
+ * capability. only the records whose timer has expired are 
+ * passed to action(). a record that is not discarded stays 
+ * in the table without a timer unless the module re-arms it. 
+ */
+static void
+store_expired(module_t * mdl, timestamp_t ivl, timestamp_t ts) 
+{
+    expiry_t * ex = mdl->ex_expiry; 
+    exnode_t * n; 
+    rec_t ** recs; 
+    uint64_t t0;
+    int count, i, what; 
+
+    count = expiry_advance(ex, ts); 
+    if (count == 0) 
+	return; 
+
+    recs = safe_malloc(count * sizeof(rec_t *)); 
+    for (i = 0, n = expiry_fired(ex); n != NULL; n = n->next) 
+	recs[i++] = EXNODE_REC(n); 
+
+    /* check if we need to sort the records */
+    if (mdl->callbacks.compare != NULL)  
+	qsort(recs, count, sizeof(rec_t*), mdl->callbacks.compare); 
+
+    for (i = 0; i < count; i++) { 
+	n = EXREC_NODE(recs[i]); 
+
+	/* the module may have re-armed it in the meantime */
+	if (n->level != EXPIRY_FIRED) 
+	    continue; 
+	expiry_remove(ex, n); 
+
+	t0 = cbhist_cycles();
+	what = mdl->callbacks.action(mdl, recs[i], ivl, ts, i);
+	cbhist_record(map.stats, mdl, CB_ACTION, t0);
+	assert( (what | ACT_MASK) == ACT_MASK );
+
+	if ((what & ACT_STORE) || (what & ACT_STORE_BATCH)) {
+	    /* 
+	     * store failed, try again at the next interval 
+	     * as store_records() would do
+	     */
+	    if (call_store(mdl, recs[i]) < 0) { 
+		expiry_arm(ex, n, n->when); 
+		continue;
+	    } 
+	}
+
+	if (what & ACT_DISCARD)
+	    discard_record(mdl, recs[i]);
+	if (what & ACT_STOP)
+	    break;
+    } 
+
+    free(recs); 
 }
 
 
@@ -408,6 +543,7 @@ store_records(module_t * mdl, timestamp_t ivl, timestamp_t ts)
     etable_t * et = mdl->ex_hashtable; 
     earray_t * ea = mdl->ex_array;
     uint32_t i, max;
+    uint64_t t0;
     int what;
 
     if (mdl->callbacks.export == NULL)
@@ -416,11 +552,22 @@ store_records(module_t * mdl, timestamp_t ivl, timestamp_t ts)
     /* check the global action to be done on the 
      * export records at this time. 
      */
+    t0 = cbhist_cycles();
     what = mdl->callbacks.action(mdl, NULL, ivl, ts, 0); 
+    cbhist_record(map.stats, mdl, CB_ACTION, t0);
     assert( (what | ACT_MASK) == ACT_MASK );
     if (what & ACT_STOP) 
 	return; 
 
+    /* 
+     * modules with timers only look at the expired records, 
+     * except for the last call that sweeps the entire table 
+     */
+    if (mdl->ex_expiry != NULL && ts != ~(timestamp_t) 0) { 
+	store_expired(mdl, ivl, ts); 
+	return; 
+    } 
+
     /* check if we need to sort the records */
     if (mdl->callbacks.compare != NULL)  
 	qsort(ea->record, et->records, sizeof(rec_t*), mdl->callbacks.compare); 
@@ -434,7 +581,9 @@ store_records(module_t * mdl, timestamp_t ivl, timestamp_t ts)
         if (ea->record[i] == NULL) 
             panicx("EXPORT array should be compact!");
 
+	t0 = cbhist_cycles();
 	what = mdl->callbacks.action(mdl, ea->record[i], ivl, ts, i);
+	cbhist_record(map.stats, mdl, CB_ACTION, t0);
 	/* only bits in the mask are valid */
 	logmsg(V_LOGEXPORT, "action %d returns 0x%x (%s%s%s%s)\n",
 		i, what,
@@ -467,43 +616,55 @@ store_records(module_t * mdl, timestamp_t ivl, timestamp_t ts)
 		et->records * sizeof(rec_t *));
     bzero(&ea->record[et->records], (ea->size - et->records) * sizeof(rec_t*));
     ea->first_full = 0;
+
+    /* records have moved, update the positions in their timers */
+    if (mdl->ex_expiry != NULL) 
+	for (i = 0; i < et->records; i++) 
+	    EXREC_NODE(ea->record[i])->index = i; 
 }
 
 
 /* 
- * -- ex_ipc_module_add
- * 
- * handle IPC_MODULE_ADD messages by unpacking the module, 
- * activating it and initializing the data structures it 
- * needs to run in EXPORT. 
+ * -- update_exmem
  * 
+ * update the export memory usage of a module in the shared 
+ * statistics. if the table is empty give the memory back. 
  */
 static void
-ex_ipc_module_add(procname_t src, void * pack, size_t sz) 
+update_exmem(module_t * mdl) 
 {
-    module_t tmp; 
-    module_t * mdl;
-    int len;
+    etable_t * et = mdl->ex_hashtable; 
+    earray_t * ea = mdl->ex_array;
+    exmem_t * em; 
 
-    /* only the parent process should send this message */
-    assert(src == map.parent);
+    if (et->records == 0) 
+	slab_clear(mdl->ex_slab); 
 
-    /* unpack the received module info */
-    if (unpack_module(pack, sz, &tmp)) {
-        logmsg(LOGWARN, "error when unpack module in IPC_MODULE_ADD\n");
-        return;
-    }
+    if (mdl->index >= map.stats->exmem_max) 
+	return; 
 
-    /* find an empty slot in the modules array */
-    mdl = copy_module(&map, &tmp, tmp.node, tmp.index, NULL); 
+    em = &map.stats->exmem[mdl->index]; 
+    em->records = et->records; 
+    em->bytes = slab_usage(mdl->ex_slab) + 
+		sizeof(etable_t) + et->size * sizeof(rec_t *) + 
+		sizeof(earray_t) + ea->size * sizeof(rec_t *); 
+    if (em->bytes > em->peak) 
+	em->peak = em->bytes; 
+}
 
-    /* free memory from the tmp module */
-    clean_module(&tmp); 
 
-    if (activate_module(mdl, map.libdir)) {
-        logmsg(LOGWARN, "error when activating module %s\n", mdl->name);
-        return;
-    }
+/* 
+ * -- export_init_module
+ * 
+ * initialize the data structures a module needs to run in 
+ * EXPORT: export hash table, record array and output file 
+ * (or the print format if running inline). 
+ * 
+ */
+void
+export_init_module(module_t * mdl) 
+{
+    int len;
 
     /*
      * initialize hash table and record array
@@ -517,6 +678,20 @@ ex_ipc_module_add(procname_t src, void * pack, size_t sz)
     mdl->ex_array = safe_calloc(1, len);
     mdl->ex_array->size = mdl->ex_hashsize;
 
+    /* timers for the modules that expire records on their own */
+    mdl->ex_expiry = NULL;
+    if (mdl->callbacks.capabilities.has_expiry && mdl->callbacks.export) 
+	mdl->ex_expiry = expiry_new(); 
+
+    /* export records (and their timers) */
+    len = sizeof(rec_t) + mdl->callbacks.ex_recordsize; 
+    if (mdl->ex_expiry != NULL) 
+	len += sizeof(exnode_t); 
+    mdl->ex_slab = slab_new(len); 
+    if (mdl->index < map.stats->exmem_max) 
+	bzero(&map.stats->exmem[mdl->index], sizeof(exmem_t)); 
+    update_exmem(mdl); 
+
     /*
      * open output file unless we are running in inline mode 
      */
@@ -526,7 +701,9 @@ ex_ipc_module_add(procname_t src, void * pack, size_t sz)
 	if (mdl->file < 0)
 	    panic("cannot open file %s for %s", mdl->output, mdl->name);
 	mdl->offset = csgetofs(mdl->file);
-    } else { 
+	rollup_init(mdl); 
+	column_init(mdl); 
+    } else if (map.runmode == RUNMODE_INLINE) { 
 	char * x[] = {NULL}; 
 	char ** p = mdl->args? mdl->args : x; 
 
@@ -537,6 +714,91 @@ ex_ipc_module_add(procname_t src, void * pack, size_t sz)
 	    handle_print_fail(mdl);
     }
 }
+
+
+/* 
+ * -- export_process_table
+ * 
+ * process a capture table flushed by CAPTURE (i.e., update the 
+ * export table) and then store or discard the export records 
+ * according to the action() callback. 
+ * 
+ */
+void
+export_process_table(module_t * mdl, ctable_t * ct)
+{
+    pmcsample_t pmc;
+
+    pmc_start(&pmc);
+    if (ct->records) {
+	/* process capture table and update export table */
+	start_tsctimer(map.stats->ex_table_timer);
+	process_table(ct, mdl);
+	end_tsctimer(map.stats->ex_table_timer);
+    } else {
+	assert(ct->flexible);
+    }
+
+    /* process export table, storing/discarding records */
+    start_tsctimer(map.stats->ex_store_timer);
+    store_records(mdl, ct->ivl, ct->ts);
+    end_tsctimer(map.stats->ex_store_timer);
+    update_exmem(mdl);
+    pmc_stop(&pmc, mdl, PMC_EXPORT, 0);
+}
+
+
+/* 
+ * -- export_flush_module
+ * 
+ * no more tables will come for this module. store all the 
+ * records the module is willing to store. 
+ * 
+ */
+void
+export_flush_module(module_t * mdl)
+{
+    store_records(mdl, ~0, ~0);
+    update_exmem(mdl);
+}
+
+
+/* 
+ * -- ex_ipc_module_add
+ * 
+ * handle IPC_MODULE_ADD messages by unpacking the module, 
+ * activating it and initializing the data structures it 
+ * needs to run in EXPORT. 
+ * 
+ */
+static void
+ex_ipc_module_add(procname_t src, void * pack, size_t sz) 
+{
+    module_t tmp; 
+    module_t * mdl;
+
+    /* only the parent process should send this message */
+    assert(src == map.parent);
+
+    /* unpack the received module info */
+    if (unpack_module(pack, sz, &tmp)) {
+        logmsg(LOGWARN, "error when unpack module in IPC_MODULE_ADD\n");
+        return;
+    }
+
+    /* find an empty slot in the modules array */
+    mdl = copy_module(&map, &tmp, tmp.node, tmp.index, NULL); 
+
+    /* free memory from the tmp module */
+    clean_module(&tmp); 
+
+    if (activate_module(mdl, map.libdir)) {
+        logmsg(LOGWARN, "error when activating module %s\n", mdl->name);
+        return;
+    }
+
+    export_init_module(mdl);
+}
  
 
 /* 
@@ -554,7 +816,7 @@ ex_ipc_module_del(procname_t sender, void * buf,
     module_t * mdl;
     etable_t * et; 
     earray_t * ea;
-    uint32_t i, rec_size;
+    uint32_t rec_size;
     int idx;
 
     /* only the parent process should send this message */
@@ -573,14 +835,16 @@ ex_ipc_module_del(procname_t sender, void * buf,
     mdl->ex_hashtable = NULL;
 
     /*
-     * drop records
+     * drop records (and their timers) all at once
      */
-    for (i = 0; i < ea->size; i++) {
-        if (ea->record[i]) {
-            free(ea->record[i]);
-            ea->record[i] = NULL;
-        }
-    }
+    slab_destroy(mdl->ex_slab); 
+    mdl->ex_slab = NULL; 
+    if (mdl->ex_expiry != NULL) { 
+	expiry_destroy(mdl->ex_expiry); 
+	mdl->ex_expiry = NULL; 
+    } 
+    if (mdl->index < map.stats->exmem_max) 
+	bzero(&map.stats->exmem[mdl->index], sizeof(exmem_t)); 
 
     /*
      * drop export array
@@ -588,6 +852,8 @@ ex_ipc_module_del(procname_t sender, void * buf,
     free(ea);
     mdl->ex_array = NULL;
     csclose(mdl->file, mdl->offset);
+    rollup_destroy(mdl); 
+    column_destroy(mdl); 
     remove_module(&map, mdl);
 }
 
@@ -624,19 +890,7 @@ ex_ipc_flush(procname_t sender, void *buf, size_t len)
 	if (mdl->status != MDL_ACTIVE)
 	    continue;
 
-	if (em->ct->records) {
-	    /* process capture table and update export table */
-	    start_tsctimer(map.stats->ex_table_timer);
-	    process_table(em->ct, mdl);
-	    end_tsctimer(map.stats->ex_table_timer);
-	} else {
-	    assert(em->ct->flexible);
-	}
-
-	/* process export table, storing/discarding records */
-	start_tsctimer(map.stats->ex_store_timer);
-	store_records(mdl, em->ct->ivl, em->ct->ts);
-	end_tsctimer(map.stats->ex_store_timer);
+	export_process_table(mdl, em->ct);
     }
 
     /*
@@ -693,7 +947,7 @@ ex_ipc_done(procname_t sender, __attribute__((__unused__)) void * buf,
 	 * try to store all records we have before reporting to be 
 	 * done. 
 	 */
-	store_records(mdl, ~0, ~0);
+	export_flush_module(mdl);
     }
 
     if (map.runmode == RUNMODE_INLINE) {
@@ -777,6 +1031,7 @@ export_mainloop(__attribute__((__unused__)) int in_fd, int parent_fd,
  
     /* allocate the timers */
     init_timers();
+    pmc_open();
 
     /*
      * The real main loop. First process the flow_table's we 
@@ -454,6 +454,82 @@ tree_to_string(treenode_t *tree)
     return s;
 }
 
+/*
+ * -- tree_to_pcap
+ *
+ * Translate an expression tree into a libpcap filter expression that
+ * accepts exactly the same packets. This is used to push the module
+ * filters down to the sniffers. Returns NULL if the tree contains
+ * predicates libpcap cannot express (ASN, NetFlow, 802.11 fields).
+ *
+ */
+char *
+tree_to_pcap(treenode_t *tree)
+{
+    char *s = NULL, *l, *r;
+    char addr[INET_ADDRSTRLEN];
+    const char *dir;
+    uint8_t *m;
+
+    if (!tree) return NULL;
+
+    switch (tree->type) {
+    case Tand:
+    case Tor:
+        l = tree_to_pcap(tree->left);
+        r = (l != NULL)? tree_to_pcap(tree->right) : NULL;
+        if (r != NULL)
+            asprintf(&s, "(%s %s %s)", l,
+                     (tree->type == Tand)? "and" : "or", r);
+        free(l);
+        free(r);
+        return s;
+    case Tnot:
+        l = tree_to_pcap(tree->left);
+        if (l != NULL)
+            asprintf(&s, "(not %s)", l);
+        free(l);
+        return s;
+    case Tpred:
+        break;
+    default:
+        return NULL;
+    }
+
+    switch (tree->pred_type) {
+    case Tip:
+        dir = (tree->data->ipaddr.direction == 0)? "src " :
+              (tree->data->ipaddr.direction == 1)? "dst " : "";
+        inet_ntop(AF_INET, &tree->data->ipaddr.ip, addr, sizeof(addr));
+        asprintf(&s, "(ip %snet %s/%d)", dir, addr,
+                 __builtin_popcount(tree->data->ipaddr.nm));
+        break;
+    case Tport:
+        /* CoMo only looks at TCP and UDP ports over IPv4 */
+        dir = (tree->data->ports.direction == 0)? "src" : "dst";
+        asprintf(&s, "(ip and (tcp %s portrange %d-%d or "
+                 "udp %s portrange %d-%d))",
+                 dir, tree->data->ports.lowport, tree->data->ports.highport,
+                 dir, tree->data->ports.lowport, tree->data->ports.highport);
+        break;
+    case Tproto:
+        if (tree->data->proto == ETHERTYPE_IP)
+            s = safe_strdup("ip");
+        else
+            asprintf(&s, "(ip proto %d)", tree->data->proto);
+        break;
+    case Tether:
+        dir = (tree->data->ether.direction == 0)? "src" :
+              (tree->data->ether.direction == 1)? "dst" : "host";
+        m = tree->data->ether.mac;
+        asprintf(&s, "(ether %s %02x:%02x:%02x:%02x:%02x:%02x)", dir,
+                 m[0], m[1], m[2], m[3], m[4], m[5]);
+        break;
+    }
+
+    return s;
+}
+
 /*
  * -- tree_print_indent
  *
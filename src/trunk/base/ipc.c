@@ -331,6 +331,36 @@ ipc_connect(procname_t dst)
 }
 
 
+/* 
+ * -- ipc_disconnect
+ * 
+ * close the socket to a destination and forget about it. 
+ * used by processes that inherited a connection from their 
+ * parent and need to open their own (see query-parallel.c). 
+ * 
+ */
+void
+ipc_disconnect(procname_t dst) 
+{
+    ipc_dest_t * x, * prev; 
+
+    prev = NULL; 
+    for (x = ipc_dests; x && x->name != dst; prev = x, x = x->next)
+	;
+
+    if (x == NULL) 
+	return; 
+
+    if (prev == NULL) 
+	ipc_dests = x->next; 
+    else 
+	prev->next = x->next; 
+
+    close(x->fd); 
+    free(x); 
+}
+
+
 /* 
  * -- ipc_send
  * 
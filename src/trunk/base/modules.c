@@ -97,6 +97,25 @@ lookup_builtin_module(const char *name)
 
 #endif
 
+/*
+ * -- set_recordsizes
+ *
+ * replace the record sizes in the callbacks with the ones set 
+ * by init() for this instance of the module, if any. 
+ *
+ */
+static void
+set_recordsizes(module_t * mdl)
+{
+    if (mdl->ca_recordsize > 0) 
+	mdl->callbacks.ca_recordsize = mdl->ca_recordsize; 
+    if (mdl->ex_recordsize > 0) 
+	mdl->callbacks.ex_recordsize = mdl->ex_recordsize; 
+    if (mdl->st_recordsize > 0) 
+	mdl->callbacks.st_recordsize = mdl->st_recordsize; 
+}
+
+
 /*
  * -- activate_module
  *
@@ -198,6 +217,7 @@ activate_module(module_t * mdl, __attribute__((__unused__)) char * libdir)
     
     /* store the callbacks */
     mdl->callbacks = *cb;
+    set_recordsizes(mdl); 
     mdl->status = MDL_ACTIVE; 
 #ifdef ENABLE_SHARED_MODULES
     mdl->cb_handle = handle;
@@ -340,7 +360,10 @@ copy_module(como_t * m, module_t * src, int node, int idx, char **extra_args)
     mdl->output = safe_strdup(src->output);
     mdl->source = safe_strdup(src->source);
     mdl->ca_hashtable = NULL;
+    mdl->ca_tblpool = NULL;
+    mdl->ca_tblpool_len = 0;
     mdl->ex_hashtable = NULL;
+    mdl->ex_expiry = NULL;
  
     mdl->args = NULL; 
     if (src->args || extra_args) {
@@ -640,6 +663,7 @@ init_module(module_t * mdl)
 	mdl->flush_ivl = mdl->callbacks.init(mdl, mdl->args);
 	if (mdl->flush_ivl == 0)
 	    panicx("could not initialize %s\n", mdl->name);
+	set_recordsizes(mdl); 
 	
 	/*
 	 * save the initial map in init_map and set shared map to NULL
@@ -828,6 +852,7 @@ module_db_record_get(int fd, off_t * ofs, module_t * mdl, ssize_t *len,
 {
     ssize_t sz; 
     char * ptr; 
+    uint64_t t0;
 
     /* 
      * mmap len bytes starting from last ofs. 
@@ -842,7 +867,9 @@ module_db_record_get(int fd, off_t * ofs, module_t * mdl, ssize_t *len,
 	return NULL;
 
     /* give the record to load() */
+    t0 = cbhist_cycles();
     sz = mdl->callbacks.load(mdl, ptr, *len, ts); 
+    cbhist_record(map.stats, mdl, CB_LOAD, t0);
     *ofs += sz; 
 
     /*
@@ -874,6 +901,7 @@ module_db_record_print(module_t * mdl, char * ptr, char **args, int client_fd)
 {
     char * out; 
     size_t len; 
+    uint64_t t0;
 #if 0
     FIXME: DEBUG only
     {
@@ -882,7 +910,9 @@ module_db_record_print(module_t * mdl, char * ptr, char **args, int client_fd)
 	    logmsg(V_LOGQUERY, "print arg #%d: %s\n", i, args[i]);
     }
 #endif
+    t0 = cbhist_cycles();
     out = mdl->callbacks.print(mdl, ptr, &len, args);
+    cbhist_record(map.stats, mdl, CB_PRINT, t0);
     if (out == NULL) {
 	errno = ENODATA;
     	return -1;
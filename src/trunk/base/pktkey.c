@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2004-2006, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+#include <sys/types.h>
+#include <string.h>
+
+#include "como.h"
+#include "comopriv.h"
+#include "hashfn.h"
+
+/*
+ * Per-packet flow keys.
+ *
+ * Most modules parse the same IP/TCP/UDP headers in hash() and match()
+ * and hash the same 5-tuple or address. CAPTURE instead fills a 
+ * pktkey_t for each packet of a batch once, right after batch_filter(), 
+ * and points pktkey_cur to the key of the packet that is being passed 
+ * to the modules. Modules read it with the PKTKEY() macro. Outside 
+ * CAPTURE (e.g., in query-ondemand) PKTKEY() falls back to pktkey_get() 
+ * that computes the key on the spot. 
+ */
+
+pktkey_t * pktkey_cur = NULL;
+
+
+/*
+ * -- pktkey_batch
+ *
+ * compute the flow keys of all the packets in a batch. the keys are
+ * in the same order as the packets. the array is reused across
+ * batches, it is valid until the next call.
+ */
+pktkey_t *
+pktkey_batch(batch_t * batch)
+{
+    static pktkey_t *keys;
+    static int size;
+    pkt_t **pktptr;
+    int i, c, l;
+
+    if (size < batch->count) {
+	size = batch->count;
+	keys = safe_realloc(keys, size * sizeof(pktkey_t));
+    }
+
+    c = 0;
+    pktptr = batch->pkts0;
+    l = MIN(batch->pkts0_len, batch->count);
+    do {
+	for (i = 0; i < l; i++, pktptr++, c++)
+	    pktkey_fill(&keys[c], *pktptr);
+	pktptr = batch->pkts1;
+	l = batch->pkts1_len;
+    } while (c < batch->count);
+
+    return keys;
+}
+
+
+/*
+ * -- pktkey_get
+ *
+ * compute the flow key of a packet that does not come from a
+ * CAPTURE batch. the key is valid until the next call.
+ */
+pktkey_t *
+pktkey_get(pkt_t * pkt)
+{
+    static pktkey_t key;
+
+    pktkey_fill(&key, pkt);
+    return &key;
+}
@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2004-2006, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+
+#ifdef linux
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "como.h"
+#include "comopriv.h"
+
+/* global state */
+extern struct _como map;
+
+/*
+ * Hardware performance counters.
+ *
+ * When "perf-counters" is on, CAPTURE and EXPORT open a group of
+ * perf events (cycles, instructions, LLC misses, branch misses) on
+ * themselves. The counters are read before and after each module
+ * processes a batch (CAPTURE) or a table (EXPORT) and the difference
+ * is added to the totals of the module in shared memory. The status
+ * service prints the IPC and the misses per packet from the totals.
+ *
+ * The counters are read from user space with rdpmc when the kernel
+ * allows it (cap_user_rdpmc in the mmap'ed page of each event),
+ * with read() otherwise.
+ */
+
+#ifdef linux
+
+static struct {
+    uint32_t	type;
+    uint64_t	config;
+} pmc_events[PMC_MAX] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+static int pmc_fd[PMC_MAX] = { -1, -1, -1, -1 };
+static struct perf_event_mmap_page * pmc_page[PMC_MAX];
+
+#endif
+
+static int pmc_proc = -1;		/* PMC_CAPTURE, PMC_EXPORT or -1 */
+
+
+/*
+ * -- pmc_init
+ *
+ * allocate the counter totals in shared memory. called by
+ * SUPERVISOR before forking the other processes.
+ */
+void
+pmc_init(stats_t * st, int modules)
+{
+    st->pmc = mem_calloc(modules * PMC_PROCS, sizeof(pmcstat_t));
+    st->pmc_max = (st->pmc != NULL)? modules : 0;
+}
+
+
+/*
+ * -- pmc_reset
+ *
+ * clear the totals of a module (the slot may have been used by a
+ * module that has been removed).
+ */
+void
+pmc_reset(stats_t * st, module_t * mdl)
+{
+    if (mdl->index >= st->pmc_max)
+	return;
+
+    bzero(&st->pmc[mdl->index * PMC_PROCS], PMC_PROCS * sizeof(pmcstat_t));
+}
+
+
+#ifdef linux
+
+/*
+ * -- rdpmc
+ *
+ */
+static __inline__ uint64_t
+rdpmc(uint32_t counter)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    uint32_t lo, hi;
+
+    __asm__ __volatile__("rdpmc" : "=a" (lo), "=d" (hi) : "c" (counter));
+    return ((uint64_t) hi << 32) | lo;
+#else
+    return 0;
+#endif
+}
+
+
+/*
+ * -- pmc_read
+ *
+ * read one counter. the mmap'ed page is protected by a sequence
+ * lock, retry if the kernel updated it while we were reading.
+ */
+static uint64_t
+pmc_read(int i)
+{
+    struct perf_event_mmap_page * pc = pmc_page[i];
+    uint64_t count;
+    uint32_t seq, idx;
+
+    if (pc == NULL) {
+	if (read(pmc_fd[i], &count, sizeof(count)) != sizeof(count))
+	    return 0;
+	return count;
+    }
+
+    do {
+	seq = pc->lock;
+	__sync_synchronize();
+	idx = pc->index;
+	count = pc->offset;
+	if (idx != 0) {
+	    int64_t pmc = (int64_t) rdpmc(idx - 1);
+
+	    /* sign extend the pmc_width bits of the counter */
+	    pmc <<= 64 - pc->pmc_width;
+	    pmc >>= 64 - pc->pmc_width;
+	    count += pmc;
+	}
+	__sync_synchronize();
+    } while (pc->lock != seq);
+
+    return count;
+}
+
+#endif
+
+
+/*
+ * -- pmc_open
+ *
+ * open the counters for this process. on failure the counters are
+ * just not read, CoMo keeps running.
+ */
+void
+pmc_open(void)
+{
+#ifdef linux
+    struct perf_event_attr attr;
+    int i;
+
+    if (!map.perf_counters || map.stats->pmc_max == 0)
+	return;
+
+    for (i = 0; i < PMC_MAX; i++) {
+	void * p;
+
+	bzero(&attr, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = pmc_events[i].type;
+	attr.config = pmc_events[i].config;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	pmc_fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, 
+			    (i == 0)? -1 : pmc_fd[0], 0);
+	if (pmc_fd[i] < 0) {
+	    logmsg(LOGWARN, "cannot open perf counter %d: %s\n",
+		   i, strerror(errno));
+	    while (--i >= 0) {
+		if (pmc_page[i] != NULL) 
+		    munmap(pmc_page[i], getpagesize());
+		pmc_page[i] = NULL;
+		close(pmc_fd[i]);
+		pmc_fd[i] = -1;
+	    }
+	    return;
+	}
+
+	/* the first page tells us if we can use rdpmc */
+	p = mmap(NULL, getpagesize(), PROT_READ, MAP_SHARED, pmc_fd[i], 0);
+	if (p == MAP_FAILED) 
+	    continue;
+	pmc_page[i] = p;
+	if (!pmc_page[i]->cap_user_rdpmc) {
+	    munmap(p, getpagesize());
+	    pmc_page[i] = NULL;
+	}
+    }
+
+    pmc_proc = (getprocclass(map.whoami) == CAPTURE)? 
+		PMC_CAPTURE : PMC_EXPORT;
+    logmsg(LOGUI, "perf counters enabled (%s)\n", 
+	   pmc_page[0] != NULL? "rdpmc" : "read");
+#endif
+}
+
+
+/*
+ * -- pmc_start
+ *
+ * take a reading of all counters
+ */
+void
+pmc_start(pmcsample_t * s)
+{
+#ifdef linux
+    int i;
+
+    if (pmc_proc < 0)
+	return;
+
+    for (i = 0; i < PMC_MAX; i++)
+	s->v[i] = pmc_read(i);
+#endif
+}
+
+
+/*
+ * -- pmc_stop
+ *
+ * take another reading and add the difference with the one in s
+ * to the totals of module mdl.
+ */
+void
+pmc_stop(pmcsample_t * s, module_t * mdl, int proc, uint64_t pkts)
+{
+#ifdef linux
+    pmcstat_t * st;
+    int i;
+
+    if (pmc_proc < 0 || mdl->index >= map.stats->pmc_max)
+	return;
+
+    st = &map.stats->pmc[mdl->index * PMC_PROCS + proc];
+    st->pkts += pkts;
+    for (i = 0; i < PMC_MAX; i++)
+	st->count[i] += pmc_read(i) - s->v[i];
+#endif
+}
@@ -46,11 +46,22 @@ struct ppbuf {
     int		size;		/* number of allocated items in pp array */
     pkt_t **	pp;
     timestamp_t	last_pkt_ts;
+    timestamp_t	drop_ts;	/* last pkt dropped by the filter */
     int		id;		/* sniffer id */
+    int		filter;		/* set if CAPTURE must filter the pkts */
     ppbuf_list_entry_t	next;
 };
 
 
+/*
+ * filters of the active modules (see update_filters() in capture.c).
+ * the packets of sniffers that cannot filter by themselves are matched
+ * against them and dropped if no module is interested.
+ */
+static treenode_t ** s_filters;
+static int s_filters_count = -1;	/* -1 if all pkts are wanted */
+
+
 /**
  * -- ppbuf_new
  * 
@@ -111,6 +122,19 @@ ppbuf_capture(ppbuf_t * ppbuf, pkt_t * pkt)
 			   TS2SEC(pkt->ts),
 			   TS2USEC(pkt->ts));
     }
+    if (ppbuf->filter && s_filters_count >= 0) {
+	int i;
+
+	for (i = 0; i < s_filters_count; i++) 
+	    if (evaluate(s_filters[i], pkt))
+		break;
+	if (i == s_filters_count) {
+	    /* no module wants this packet but time moves on anyway */
+	    ppbuf->drop_ts = pkt->ts;
+	    return 0;
+	}
+    }
+
     ppbuf->captured++;
     assert(ppbuf->captured <= ppbuf->size);
 
@@ -0,0 +1,415 @@
+/*
+ * Copyright (c) 2004-2006, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+
+#include "como.h"
+#include "comopriv.h"
+#include "query.h"
+#include "hashfn.h"
+
+/*
+ * Query result cache. 
+ * 
+ * The output of a query on an interval for which all the records are 
+ * already in the bytestream (i.e., the query stopped on a record after 
+ * the end of the interval) does not change until STORAGE deletes the 
+ * file with the first record of the interval to make room for new data. 
+ * 
+ * Such output is kept in a file in the work directory named after a 
+ * hash of the query (module, bytestream, arguments, filter, format, 
+ * start, end). 
+ * The file also stores the full query key and the offset of the first 
+ * record of the interval. On a lookup, the entry is valid only if the 
+ * seek on the start of the query still returns the same offset: if 
+ * the file of that record has been deleted the seek moves forward. 
+ * 
+ * Entries are evicted in LRU order (using the modification time of 
+ * the files, updated on each hit) when the total size of the cache 
+ * goes over map.qcache_size. 
+ * 
+ * Only sequential queries on the output of a module are cached 
+ * (i.e., no "source" and no "workers"). 
+ */
+
+/* global state */
+extern struct _como map;
+
+#define QC_MAGIC	0x71636163	/* 'qcac' */
+#define QC_DIR		"qcache"
+
+typedef struct qc_hdr {
+    uint32_t	magic;
+    uint32_t	keylen;		/* bytes of the key after the header */
+    uint64_t	ofs;		/* first record of the interval */
+    uint64_t	size;		/* bytes of output after the key */
+} qc_hdr_t;
+
+/* the entry we are filling, if any */
+static char * s_key; 
+static size_t s_keylen; 
+static char * s_path; 
+static char * s_tmppath; 
+
+
+static int
+qc_strcmp(const void * a, const void * b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b); 
+}
+
+
+/* 
+ * -- qc_key
+ * 
+ * build the canonical key of a query (arguments sorted) and the 
+ * name of the file in the cache. returns 0 if the query cannot 
+ * be cached. 
+ * 
+ */
+static int
+qc_key(qreq_t * req) 
+{
+    char ** args; 
+    char * p; 
+    size_t len; 
+    int nargs, i; 
+
+    if (map.qcache_size == 0 || req->source != NULL || req->workers > 1) 
+	return 0; 
+
+    if (s_key != NULL) 
+	return 1; 
+
+    for (nargs = 0; req->args && req->args[nargs]; nargs++)
+	; 
+    args = safe_calloc(nargs + 1, sizeof(char *)); 
+    memcpy(args, req->args, nargs * sizeof(char *)); 
+    qsort(args, nargs, sizeof(char *), qc_strcmp); 
+
+    len = strlen(req->module) + strlen(req->output) + 64; 
+    if (req->filter_cmp) 
+	len += strlen(req->filter_cmp); 
+    for (i = 0; i < nargs; i++) 
+	len += strlen(args[i]) + 1; 
+
+    s_key = p = safe_malloc(len); 
+    p += sprintf(p, "%s\n%s\n%s\n%d\n%u\n%u\n", req->module, req->output, 
+		 req->filter_cmp ? req->filter_cmp : "", 
+		 req->format, req->start, req->end); 
+    for (i = 0; i < nargs; i++) 
+	p += sprintf(p, "%s\n", args[i]); 
+    s_keylen = p - s_key; 
+    free(args); 
+
+    asprintf(&s_path, "%s/%s/%016llx", map.workdir, QC_DIR, 
+	     (unsigned long long) hashfn_xx64(0, s_key, s_keylen)); 
+    return 1; 
+}
+
+
+/* 
+ * -- qc_entry
+ * 
+ * entry stat, used to sort the cache in LRU order 
+ * 
+ */
+typedef struct qc_entry {
+    char *	path; 
+    time_t	mtime; 
+    off_t	size; 
+} qc_entry_t; 
+
+static int
+qc_entry_cmp(const void * a, const void * b)
+{
+    const qc_entry_t * x = a; 
+    const qc_entry_t * y = b; 
+
+    return (x->mtime > y->mtime) - (x->mtime < y->mtime); 
+}
+
+
+/* 
+ * -- qc_evict
+ * 
+ * remove the least recently used entries until the cache 
+ * is below the configured size. 
+ * 
+ */
+static void
+qc_evict(void) 
+{
+    qc_entry_t * entries; 
+    struct dirent * d; 
+    char * dirname; 
+    DIR * dir; 
+    off_t total; 
+    int n, max, i; 
+
+    asprintf(&dirname, "%s/%s", map.workdir, QC_DIR); 
+    dir = opendir(dirname); 
+    if (dir == NULL) { 
+	free(dirname); 
+	return; 
+    } 
+
+    entries = NULL; 
+    n = max = 0; 
+    total = 0; 
+    while ((d = readdir(dir)) != NULL) { 
+	struct stat st; 
+	char * path; 
+
+	if (d->d_name[0] == '.' || strchr(d->d_name, '.') != NULL) 
+	    continue; 	/* skip temporary files */
+
+	asprintf(&path, "%s/%s", dirname, d->d_name); 
+	if (stat(path, &st) < 0) { 
+	    free(path); 
+	    continue; 
+	} 
+
+	if (n == max) { 
+	    max = max ? max * 2 : 64; 
+	    entries = safe_realloc(entries, max * sizeof(qc_entry_t)); 
+	} 
+	entries[n].path = path; 
+	entries[n].mtime = st.st_mtime; 
+	entries[n].size = st.st_size; 
+	total += st.st_size; 
+	n++; 
+    } 
+    closedir(dir); 
+
+    qsort(entries, n, sizeof(qc_entry_t), qc_entry_cmp); 
+    for (i = 0; i < n; i++) { 
+	if (total > (off_t) map.qcache_size) { 
+	    logmsg(V_LOGQUERY, "query cache: evicting %s\n", entries[i].path); 
+	    unlink(entries[i].path); 
+	    total -= entries[i].size; 
+	} 
+	free(entries[i].path); 
+    } 
+
+    free(entries); 
+    free(dirname); 
+}
+
+
+/* 
+ * -- qc_send
+ * 
+ * send the output stored in a cache file (after the key) 
+ * to the client. 
+ * 
+ */
+static void
+qc_send(int fd, off_t start, size_t size, int client_fd) 
+{
+    char * base; 
+
+    if (size == 0) 
+	return; 
+
+    base = mmap(NULL, start + size, PROT_READ, MAP_PRIVATE, fd, 0); 
+    if (base == MAP_FAILED) 
+	panic("mapping query cache file"); 
+    if (como_writen(client_fd, base + start, size) < 0) 
+	err(EXIT_FAILURE, "sending data to the client"); 
+    munmap(base, start + size); 
+}
+
+
+/* 
+ * -- qcache_send
+ * 
+ * look for the query in the cache. ofs is the offset of the first 
+ * record of the interval. if there is a valid entry send it to the 
+ * client and return 1. return 0 otherwise. 
+ * 
+ */
+int
+qcache_send(qreq_t * req, off_t ofs, int client_fd) 
+{
+    qc_hdr_t hdr; 
+    char * key; 
+    int fd, ok; 
+
+    if (!qc_key(req)) 
+	return 0; 
+
+    /* the stats are shared by all QUERY processes */
+    __sync_fetch_and_add(&map.stats->qc_lookups, 1); 
+
+    fd = open(s_path, O_RDONLY); 
+    if (fd < 0) 
+	return 0; 
+
+    ok = 0; 
+    key = NULL; 
+    if (read(fd, &hdr, sizeof(hdr)) == sizeof(hdr) && 
+	    hdr.magic == QC_MAGIC && hdr.keylen == s_keylen) { 
+	key = safe_malloc(s_keylen); 
+	ok = read(fd, key, s_keylen) == (ssize_t) s_keylen && 
+	     memcmp(key, s_key, s_keylen) == 0; 
+    } 
+
+    if (ok && hdr.ofs != (uint64_t) ofs) { 
+	/* the data the entry was built from is gone */
+	logmsg(V_LOGQUERY, "query cache: stale entry %s\n", s_path); 
+	unlink(s_path); 
+	ok = 0; 
+    } 
+
+    if (ok) { 
+	/* move to the front of the LRU */
+	utimes(s_path, NULL); 
+	qc_send(fd, sizeof(hdr) + s_keylen, hdr.size, client_fd); 
+	__sync_fetch_and_add(&map.stats->qc_hits, 1); 
+	logmsg(V_LOGQUERY, "query cache: hit %s\n", s_path); 
+    } 
+
+    free(key); 
+    close(fd); 
+    return ok; 
+}
+
+
+/* 
+ * -- qcache_create
+ * 
+ * open a new cache entry for the query. the output of the query 
+ * has to be written to the returned descriptor and then passed to 
+ * qcache_done(). returns -1 if the query cannot be cached. 
+ * 
+ * the client gets nothing until qcache_done(), so only queries on a 
+ * closed interval are cached, i.e. CAPTURE has already flushed the 
+ * table with the end of the interval (or it is done with all the 
+ * sniffers). such queries cannot block on new records whatever the 
+ * value of wait. live and streaming queries go to the client. 
+ * 
+ */
+int
+qcache_create(qreq_t * req, off_t ofs) 
+{
+    qc_hdr_t hdr; 
+    char * dirname; 
+    int fd; 
+
+    if (map.stats->ca_done.tv_sec == 0 && 
+	TIME2TS(req->end, 0) + req->mdl->flush_ivl > map.stats->ts) 
+	return -1; 
+
+    if (!qc_key(req)) 
+	return -1; 
+
+    asprintf(&dirname, "%s/%s", map.workdir, QC_DIR); 
+    if (mkdir(dirname, S_IRWXU) < 0 && errno != EEXIST) { 
+	logmsg(LOGWARN, "query cache: cannot create %s: %s\n", 
+	       dirname, strerror(errno)); 
+	free(dirname); 
+	return -1; 
+    } 
+    free(dirname); 
+
+    /* write to a temporary file, other queries may be doing the same */
+    asprintf(&s_tmppath, "%s.%d", s_path, getpid()); 
+    fd = open(s_tmppath, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR); 
+    if (fd < 0) { 
+	logmsg(LOGWARN, "query cache: cannot create %s: %s\n", 
+	       s_tmppath, strerror(errno)); 
+	return -1; 
+    } 
+
+    memset(&hdr, 0, sizeof(hdr)); 
+    hdr.magic = QC_MAGIC; 
+    hdr.keylen = s_keylen; 
+    hdr.ofs = ofs; 
+    if (como_writen(fd, (char *) &hdr, sizeof(hdr)) < 0 || 
+	    como_writen(fd, s_key, s_keylen) < 0) { 
+	close(fd); 
+	unlink(s_tmppath); 
+	return -1; 
+    } 
+
+    return fd; 
+}
+
+
+/* 
+ * -- qcache_done
+ * 
+ * send the output written to the cache entry to the client. if 
+ * keep is set the entry is added to the cache, otherwise it is 
+ * discarded (e.g., the interval was not closed yet). 
+ * 
+ */
+void
+qcache_done(int fd, int keep, int client_fd) 
+{
+    qc_hdr_t hdr; 
+    off_t start, end; 
+
+    start = sizeof(hdr) + s_keylen; 
+    end = lseek(fd, 0, SEEK_END); 
+    if (end < start) 
+	panic("query cache file %s", s_tmppath); 
+
+    qc_send(fd, start, end - start, client_fd); 
+
+    if (keep && pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr)) { 
+	hdr.size = end - start; 
+	if (pwrite(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) && 
+		rename(s_tmppath, s_path) == 0) { 
+	    logmsg(V_LOGQUERY, "query cache: stored %s\n", s_path); 
+	    close(fd); 
+	    qc_evict(); 
+	    return; 
+	} 
+    } 
+
+    close(fd); 
+    unlink(s_tmppath); 
+}
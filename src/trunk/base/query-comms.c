@@ -375,6 +375,12 @@ parse_timestr(char * str, timestamp_t * base)
  *           the final timestamp is reached (indefinitely if the final
  *           timestamp is not given) or give up when the data is not
  *           yet available
+ * - workers: the number of processes that share the query. The interval
+ *           is split in as many partitions as the number of workers
+ *           (see query-parallel.c)
+ * - fields: comma separated list of record fields. The query is answered
+ *           from the columnar output of the module (see column.c). It
+ *           can be followed by where=field:min:max arguments
  * To query the node's status the Request-Line is:
  * GET /status HTTP/1.1
  * To access a service the Request-Line comes in the format:
@@ -401,6 +407,7 @@ query_parse(qreq_t * q, char * buf, timestamp_t now)
     q->end = ~0;
     q->format = QFORMAT_CUSTOM;
     q->wait = 1;
+    q->workers = 1;
 
     /* 
      * do a first pass to figure out how much space we need
@@ -568,6 +575,12 @@ query_parse(qreq_t * q, char * buf, timestamp_t now)
 			    q->wait = 0;
 			}
 			copy_value = 0;
+		    /* workers */
+		    } else if (strcmp(name + 1, "orkers") == 0) {
+			q->workers = atoi(value);
+			if (q->workers < 1) 
+			    q->workers = 1;
+			copy_value = 0;
 		    }
 		    break;
 		case 't':
@@ -30,280 +30,385 @@
  * $Id$
  */
 
-#include <sys/types.h>		/* fork */
-#include <unistd.h>		/* fork */
+#include <sys/types.h>
+#include <unistd.h>
 #include <string.h>
 #include <assert.h>
-#include <signal.h>
 #include <err.h>
 #include <errno.h>
 
 #include "como.h"
 #include "comopriv.h"
+#include "storage.h"
 #include "query.h"
 #include "ipc.h"
 
+/*
+ * On-demand queries (i.e., queries with a "source" module) run the 
+ * module inside the query process. The records of the source module 
+ * are read from STORAGE and turned into packets by its replay() callback. 
+ * The packets then go through the same check()/hash()/match()/update() 
+ * steps of CAPTURE and the resulting tables are handed to the EXPORT 
+ * code (export()/action()/store()) that prints the records to the 
+ * client as in inline mode. 
+ * 
+ * There is no fork and no IPC involved. The capture tables, and all 
+ * the memory the module allocates while in the capture callbacks, come 
+ * from a private memory region sized from the module configuration 
+ * and released in one go after each flush interval. 
+ */
 
 /* global state */
 extern struct _como map;
 
-/*
- * -- qd_ipc_sync()
- *
- * on receipt of an IPC_SYNC just send a start message. 
- * the processes already have all modules. 
- *
+#define QD_MIN_MEMSIZE		4	/* MB */
+#define QD_MAX_PKTSIZE		(sizeof(pkt_t) + 65536)
+
+
+/* 
+ * -- query_ondemand_memsize 
+ * 
+ * size of the memory region (in MB) for the capture state of the 
+ * module. we want at least twice what a full table would take if each 
+ * bucket held one record. never go above the configured memory size. 
+ * 
  */
-static void
-qd_ipc_sync(procname_t sender, __attribute__((__unused__)) void * b,
-            __attribute__((__unused__)) size_t l)
+uint
+query_ondemand_memsize(module_t * mdl)
 {
-    char * pack;
-    int sz;
+    size_t sz; 
+    uint mb; 
 
-    /* 
-     * prepare the module for transmission and 
-     * send it to the new process 
-     */ 
-    pack = pack_module(map.inline_mdl, &sz);
-    ipc_send(sender, IPC_MODULE_ADD, pack, sz);
-    free(pack);
-
-    ipc_send(sender, IPC_MODULE_START, &map.stats, sizeof(void *));
-}
+    sz = sizeof(ctable_t) + mdl->ca_hashsize * sizeof(void *); 
+    sz += mdl->ca_hashsize * (sizeof(rec_t) + mdl->callbacks.ca_recordsize); 
+    sz *= 2; 
 
-#if 0
-/*
- * -- qd_ipc_record
- *
- * prints a record to screen. this is used only when running
- * in inline mode
- *
- */  
-static void
-qd_ipc_record(__attribute__((__unused__)) procname_t sender,
-	void * buf, size_t len)
-{
-    int ret; 
+    mb = QD_MIN_MEMSIZE; 
+    while (((size_t) mb << 20) < sz && mb < map.mem_size) 
+	mb <<= 1; 
 
-    /* NOTE: len includes \0 */
-    ret = como_writen(client_fd, (char *) buf, len - 1);
-    if (ret < 0)
-	errx(EXIT_FAILURE, "sending data to the client");
+    return mb; 
 }
-#endif
 
-/*
- * -- qd_ipc_done  
- *
- * EXPORT should send this message to report that there are
- * no more records to be processed. 
- *
+
+/* 
+ * -- qd_flush
+ * 
+ * process the current capture table in EXPORT fashion and then 
+ * release all the capture memory of the module. EXPORT allocations 
+ * must persist so they are done in private memory. 
+ * 
  */
 static void
-qd_ipc_done(procname_t sender, __attribute__((__unused__)) void * b,
-        __attribute__((__unused__)) size_t l)
+qd_flush(module_t * mdl)
 {
-    ipc_send(child(CAPTURE, getprocid(sender)), IPC_EXIT, NULL, 0);
-    ipc_send(sender, IPC_EXIT, NULL, 0);
-    ipc_finish();
-    exit(EXIT_SUCCESS);
+    map.mem_type = COMO_PRIVATE_MEM; 
+    export_process_table(mdl, mdl->ca_hashtable); 
+    map.mem_type = COMO_SHARED_MEM; 
+
+    memmap_destroy(mdl->shared_map); 
+    mdl->ca_hashtable = NULL;
+    mdl->fstate = NULL; 
+    mdl->shared_map = NULL; 
 }
 
 
-/*
- * -- defchld
+/* 
+ * -- qd_capture_pkt
  * 
- * handle dead children
+ * run one packet through the capture callbacks of the module. 
+ * this is the same as capture_pkt() in capture.c for a single 
+ * module and a single packet, with the tables flushed synchronously.
  * 
  */
 static void
-defchld(__attribute__((__unused__)) int si_code)
+qd_capture_pkt(module_t * mdl, pkt_t * pkt)
 {
-    if (handle_children())
-	exit(EXIT_FAILURE);
+    ctable_t * ct; 
+    rec_t *prev, *cand;
+    uint32_t hash;
+    uint bucket;
+    int record_size, new_record;
+
+    record_size = mdl->callbacks.ca_recordsize + sizeof(rec_t);
+
+    /* flush the current flow table, if needed */
+    ct = mdl->ca_hashtable; 
+    if (ct != NULL && pkt->ts >= ct->ivl + mdl->flush_ivl) {
+	if (ct->records || ct->flexible) { 
+	    ct->ts = ct->ivl + mdl->flush_ivl;
+	    qd_flush(mdl); 
+	} else { 
+	    ct->ivl = pkt->ts - (pkt->ts % mdl->flush_ivl);
+	} 
+    }
+
+    if (mdl->ca_hashtable == NULL) {
+	size_t len; 
+
+	mdl->shared_map = memmap_new(allocator_shared(), 64,
+				     POLICY_HOLD_IN_USE_BLOCKS);
+
+	len = sizeof(ctable_t) + mdl->ca_hashsize * sizeof(void *);
+	ct = alc_calloc(&(mdl->alc), 1, len);
+	if (ct == NULL) 
+	    panicx("out of memory for %s", mdl->name); 
+
+	ct->bytes = len; 
+	ct->size = mdl->ca_hashsize;
+	ct->first_full = ct->size;
+	ct->ivl = pkt->ts - (pkt->ts % mdl->flush_ivl);
+	mdl->ca_hashtable = ct; 
+
+	if (mdl->callbacks.flush != NULL) 
+	    mdl->fstate = mdl->callbacks.flush(mdl);
+    }
+    ct = mdl->ca_hashtable; 
+    ct->ts = pkt->ts;
+
+    if (!evaluate(mdl->filter_tree, pkt))
+	return; 
+
+    if (mdl->callbacks.check && !mdl->callbacks.check(mdl, pkt))
+	return;
+
+    hash = (mdl->callbacks.hash) ? mdl->callbacks.hash(mdl, pkt) : 0;
+    bucket = hash % ct->size;
+
+    if (bucket < ct->first_full)
+	ct->first_full = bucket;
+    if (bucket > ct->last_full)
+	ct->last_full = bucket;
+
+    prev = NULL;
+    for (cand = ct->bucket[bucket]; cand; prev = cand, cand = cand->next) { 
+	if (mdl->callbacks.match == NULL || 
+	    mdl->callbacks.match(mdl, pkt, cand))
+	    break;
+    }
+
+    new_record = 0; 
+    if (cand != NULL) {
+	/* move to the front, if needed */
+	if (ct->bucket[bucket] != cand) {
+	    prev->next = cand->next;
+	    cand->next = ct->bucket[bucket];
+	    ct->bucket[bucket] = cand;
+	}
+
+	/* if the record is full, chain a new one in front of it */
+	if (cand->full) {
+	    rec_t *x;
+
+	    x = alc_malloc(&(mdl->alc), record_size);
+	    if (x == NULL)
+		panicx("out of memory for %s", mdl->name); 
+	    ct->bytes += record_size;
+
+	    x->hash = hash;
+	    x->next = cand->next;
+	    x->prev = cand;
+	    cand->next = x;
+	    ct->bucket[bucket] = x;
+	    ct->filled_records++;
+
+	    new_record = 1;
+	    cand = x;
+	} 
+    } else {
+	cand = alc_malloc(&(mdl->alc), record_size);
+	if (cand == NULL)
+	    panicx("out of memory for %s", mdl->name); 
+	ct->bytes += record_size;
+
+	cand->hash = hash;
+	cand->prev = NULL; 
+	cand->next = ct->bucket[bucket];
+
+	ct->records++;
+	ct->bucket[bucket] = cand;
+	if (cand->next == NULL)
+	    ct->live_buckets++;
+
+	new_record = 1;
+    }
+
+    cand->full = mdl->callbacks.update(mdl, pkt, cand, new_record);
 }
 
 
 /* 
- * -- query_ondemand
+ * -- query_ondemand_module
  * 
- * this function will create a new map with just one module 
- * (the one we are querying) and a sniffer-como set to receive
- * packets from the source module(s). it will then fork CAPTURE 
- * and EXPORT, have them run in inline mode and behave as a SUPERVISOR. 
+ * create and initialize a new instance of the module we are querying 
+ * (req->mdl) in a new memory region. the module configuration and 
+ * its capture state live in that region, so each process running 
+ * the module must create its own instance. 
  * 
  */ 
-void 
-query_ondemand(int fd, qreq_t * req, int node_id) 
+module_t *
+query_ondemand_module(qreq_t * req) 
 {
-    node_t * node; 
-    source_t * src; 
-    char sniffstr[2048];
-    int len, idx, nargs; 
-    int ondemand_fd; 
-    procname_t tag; 
-    fd_set valid_fds;
-    int max_fd, capture_fd;
-    
-    /* catch some signals */
-    signal(SIGCHLD, defchld);		/* catch SIGCHLD (defunct children) */
+    module_t * mdl; 
 
     /* 
-     * the first thing to do is adapt the map to our needs. 
-     * first set it to run in inline mode. then, set the sniffer 
-     * to be sniffer-como to the module that we use as source. 
+     * copy the module we want to run and activate it. 
+     * NOTE: use the query arguments as extra module arguments
      */
-
-    /* inline mode */
-    map.runmode = RUNMODE_INLINE;
-    map.exit_when_done = 1;
+    mdl = copy_module(&map, req->mdl, -1, -1, req->args); 
+    if (req->filter_str) 
+	mdl->filter_str = safe_strdup(req->filter_str);
+    map.inline_mdl = mdl; 
+ 
+    if (activate_module(mdl, map.libdir))
+	panicx("cannot activate %s", mdl->name); 
 
     /* 
-     * store the output file descriptor in a the map in order to make it
-     * accessible to EXPORT
+     * private memory region for the capture state. 
+     * it must be ready before init() runs.
      */
+    memory_init(query_ondemand_memsize(mdl));
+
+    if (init_module(mdl))		
+        panicx("cannot initialize module %s\n", mdl->name);
+    mdl->status = MDL_ACTIVE; 
+    parse_filter(mdl->filter_str, &(mdl->filter_tree), NULL);
+
+    /* export table (and header, if any) */
+    export_init_module(mdl); 
+    return mdl; 
+}
+
+
+/* 
+ * -- query_ondemand_init
+ * 
+ * create the instance of the module we are querying that will run 
+ * in this process. the records are printed to the client as EXPORT 
+ * does when running in inline mode. it returns the new module after 
+ * printing the header. 
+ * 
+ */ 
+module_t *
+query_ondemand_init(int fd, qreq_t * req) 
+{
+    map.runmode = RUNMODE_INLINE;
     map.inline_fd = fd;
 
-    node = &map.node[node_id];
+    return query_ondemand_module(req); 
+}
 
-    /* disable all modules */
-    for (idx = 0; idx < map.module_last; idx++)
-	if (map.modules[idx].status == MDL_ACTIVE)
-	    map.modules[idx].status = MDL_DISABLED;
-    /* enable the source module for record replaying */
-    req->src->status = MDL_ACTIVE_REPLAY;
 
-    /* initialize the shared memory */
-    memory_init(16);		/* XXX 16MB fixed memory size... check this! */
-    
-    /* 
-     * copy the module we want to run,
-     * activate it and initialize it 
-     * NOTE: use the query arguments as extra module arguments
-     */
-    map.inline_mdl = copy_module(&map, req->mdl, -1, -1, req->args); 
-    if (req->filter_str) {
-	map.inline_mdl->filter_str = safe_strdup(req->filter_str);
-    }
- 
-    if (activate_module(map.inline_mdl, map.libdir))
-	panicx("cannot activate %s", map.inline_mdl->name); 
-
-    if (init_module(map.inline_mdl))		
-        panicx("cannot initialize module %s\n", map.inline_mdl->name);
-   
-    /* remove all current sources (i.e. sniffers) */
-    while (map.sources) { 
-	src = map.sources; 
-	map.sources = src->next; 
-	free(src); 
-    } 
-    map.source_count = 0;
-
-//#define REMOTE_QUERY
-#ifdef REMOTE_QUERY
-    /* now configure a new sniffer-como */
-    len = snprintf(sniffstr, sizeof(sniffstr), 
-        "http://localhost:%d/?module=%s&start=%d&end=%d&format=como&wait=no", 
-	node->query_port, req->source, req->start, req->end); 
-
-    /* add the arguments */
-    for (nargs = 0; req->args[nargs]; nargs++) {
-	if (strncmp("format=", req->args[nargs], 7) == 0)
+/* 
+ * -- query_ondemand_run
+ * 
+ * replay the records of the source module from offset ofs and run 
+ * the packets through mdl. stop at the end of the data, at the first 
+ * record after end_ts or at offset end_ofs (if not -1). all records 
+ * are flushed to EXPORT (and to the client) before returning. 
+ * 
+ */
+void
+query_ondemand_run(module_t * mdl, module_t * src, int file_fd, off_t ofs, 
+		   off_t end_ofs, timestamp_t end_ts)
+{
+    timestamp_t ts; 
+    char * pktbuf; 
+
+    pktbuf = safe_malloc(QD_MAX_PKTSIZE); 
+
+    /* the capture callbacks run with shared memory semantics */
+    map.mem_type = COMO_SHARED_MEM; 
+
+    while (ofs >= 0) { 
+	char * ptr; 
+	ssize_t len; 
+	int left; 
+
+	if (end_ofs >= 0 && ofs >= end_ofs) 
+	    break; 
+
+	len = src->callbacks.st_recordsize;
+	ptr = module_db_record_get(file_fd, &ofs, src, &len, &ts);
+	if (ptr == NULL) {
+	    if (len == 0) 
+		break;
+	    panic("reading from file %s ofs %lld len %d",
+		  src->output, ofs, len);
+	}
+
+	if (ptr == GR_LOSTSYNC) {
+	    ofs = csseek(file_fd, CS_SEEK_FILE_NEXT);
+	    logmsg(V_LOGQUERY, "lost sync, trying next file %s/%016llx\n", 
+		   src->output, ofs); 
 	    continue;
-	len += snprintf(sniffstr + len, sizeof(sniffstr) - len, 
-			"&%s", req->args[nargs]); 
-    }
-    
-    /* create the entry in the map */
-    add_sniffer(&map, "como", sniffstr, NULL); 
-#else
-    /* now configure a new sniffer-ondemand */
-    nargs = 0;
-
-    /* XXX we always go for the master node. virtual nodes are currently
-     *     not saving anything to disk and always queried on demand.  
-     */ 
-    len = snprintf(sniffstr, sizeof(sniffstr), "node=0 start=%lld end=%lld",
-		   TIME2TS(req->start, 0), TIME2TS(req->end, 0));
-    add_sniffer(&map, "ondemand", req->source, sniffstr);
-#endif
-
-    map.stats = mem_calloc(1, sizeof(stats_t)); 
-    gettimeofday(&map.stats->start, NULL); 
-    map.stats->first_ts = ~0;
-
-    /* prepare a socket to listen to children processes */
-    ondemand_fd = ipc_listen(map.whoami); 
-
-    /* register various IPC handlers */
-    ipc_clear();
-    ipc_register(IPC_SYNC, qd_ipc_sync);
-    ipc_register(IPC_DONE, qd_ipc_done); 
-
-    /* now start a new CAPTURE process */ 
-    tag = child(CAPTURE, fd); 
-    capture_fd = ipc_listen(tag); 
-    start_child(tag, COMO_SHARED_MEM, capture_mainloop, capture_fd, 0);
-
-    /* now start a new EXPORT process */ 
-    tag = child(EXPORT, fd); 
-    start_child(tag, COMO_PRIVATE_MEM, export_mainloop, -1, 0); 
-    
-    /* get ready for the mainloop */
-    FD_ZERO(&valid_fds);
-    max_fd = 0;
-    max_fd = add_fd(fd, &valid_fds, max_fd);
-    max_fd = add_fd(ondemand_fd, &valid_fds, max_fd);
-
-    for (;;) {
-        fd_set r;
-        int i, n_ready;
-   
-        r = valid_fds;
-        n_ready = select(max_fd, &r, NULL, NULL, NULL);
-        /* first check if the client is still there */
-	if (FD_ISSET(fd, &r)) {
-	    char t;
-	    int ret;
-	    ret = read(fd, &t, 1);
-	    if (ret <= 0) {
-		/* client is gone */
-		errx(EXIT_FAILURE, "client is gone");
-	    }
 	}
-        for (i = 0; n_ready > 0 && i < max_fd; i++) {
-            int ipcr; 
-
-            if (!FD_ISSET(i, &r))
-                continue;
-
-            n_ready--;
-            if (i == ondemand_fd) {
-                int x;
-                x = accept(i, NULL, NULL);
-                if (x < 0) 
-                    panic("accept fd[%d] got %d (%s)", i, x);
-                else 
-                    max_fd = add_fd(x, &valid_fds, max_fd);
-                continue;
-            }
-            ipcr = ipc_handle(i);
-            switch (ipcr) {
-            case IPC_ERR: 
-                /* an error. close the socket */
-                panicx("error on IPC handle from %d", i);
-            case IPC_EOF:
-                close(i);
-                max_fd = del_fd(i, &valid_fds, max_fd);
-                break;
-            }
-        }
+
+	if (ts >= end_ts) 
+	    break;
+
+	/* replay the record and process the packets one by one */
+	left = 0; 
+	do {
+	    size_t l = QD_MAX_PKTSIZE; 
+
+	    left = src->callbacks.replay(src, ptr, pktbuf, &l, left); 
+	    if (left < 0) 
+		panicx("module \"%s\" failed to replay\n", src->name);
+	    if (l == 0) 
+		break; 
+
+	    qd_capture_pkt(mdl, (pkt_t *) pktbuf); 
+	} while (left > 0); 
     }
-}
 
+    /* flush the last table and all export records */
+    if (mdl->ca_hashtable != NULL) { 
+	if (mdl->ca_hashtable->records || mdl->ca_hashtable->flexible) 
+	    qd_flush(mdl); 
+    } 
+
+    map.mem_type = COMO_PRIVATE_MEM; 
+    export_flush_module(mdl); 
 
+    free(pktbuf); 
+}
 
 
+/* 
+ * -- query_ondemand
+ * 
+ * run the module we are querying (req->mdl) over the records stored 
+ * by the source module (req->src) in the interval of the query and 
+ * send the output of print() to the client. 
+ * 
+ */ 
+void 
+query_ondemand(int fd, qreq_t * req, __attribute__((__unused__)) int node_id) 
+{
+    module_t * mdl, * src; 
+    off_t ofs; 
+    int file_fd, mode; 
+
+    mdl = query_ondemand_init(fd, req); 
+
+    /* open the output of the source module */
+    src = req->src; 
+    ipc_connect(STORAGE);
+    mode = req->wait ? CS_READER : CS_READER_NOBLOCK; 
+    file_fd = csopen(src->output, mode, 0); 
+    if (file_fd < 0) 
+	panic("opening file %s", src->output);
+
+    ofs = module_db_seek_by_ts(src, file_fd, TIME2TS(req->start, 0));
+    query_ondemand_run(mdl, src, file_fd, ofs, -1, TIME2TS(req->end, 0)); 
+
+    /* print the footer */
+    if (module_db_record_print(mdl, NULL, NULL, fd) < 0) {
+	if (errno == ENODATA) 
+	    panicx("module \"%s\" failed to print\n", mdl->name);
+	err(EXIT_FAILURE, "sending data to the client");
+    }
 
+    csclose(file_fd, 0);
+}
@@ -0,0 +1,434 @@
+/*
+ * Copyright (c) 2004-2006, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <stdio.h>		/* tmpfile */
+#include <unistd.h>
+#include <string.h>
+#include <err.h>
+#include <errno.h>
+
+#include "como.h"
+#include "comopriv.h"
+#include "storage.h"
+#include "query.h"
+#include "ipc.h"
+
+/*
+ * Parallel queries (i.e., queries with "workers=N", N > 1). 
+ * 
+ * The interval of the query is split in up to N partitions made of 
+ * whole files of the bytestream being read (the output of the module 
+ * for historical queries, the output of the source module for on-demand 
+ * ones). Each partition is processed by a worker process forked from 
+ * the query process. Workers have their own connection to STORAGE and, 
+ * for on-demand queries, their own module state and capture memory. 
+ * 
+ * Workers write their output to an unlinked temporary file. The query 
+ * process waits for them in partition order and then: 
+ * 
+ *   . historical queries: sends the files to the client as they are. 
+ *     the header and footer are printed by the query process so print() 
+ *     must not keep state across records for the output to be the same 
+ *     as a sequential query. 
+ * 
+ *   . on-demand queries: workers send the records written by store() 
+ *     (RUNMODE_INLINE_RAW) and the query process prints them. a flush 
+ *     interval that spans two partitions results in two sets of records 
+ *     for the same interval. if the module has a merge() callback they 
+ *     are folded together, otherwise they are printed one after the other. 
+ */
+
+/* global state */
+extern struct _como map;
+
+#define QP_MAX_WORKERS		16
+
+typedef struct qp_part {
+    off_t	start;		/* offset of the first record */
+    off_t	end;		/* offset after the partition, -1 if last */
+    int		out_fd;		/* output of the worker */
+    pid_t	pid;		/* worker process */
+} qp_part_t;
+
+
+/* 
+ * -- qp_partition
+ * 
+ * split the bytestream of mdl from offset ofs (as returned by the seek 
+ * on the start of the query) up to the first file that starts after 
+ * end_ts in at most n partitions. partitions are made of whole files 
+ * with the exception of the first that starts at ofs. returns the 
+ * number of partitions. 
+ * 
+ */
+static int
+qp_partition(module_t * mdl, int file_fd, off_t ofs, timestamp_t end_ts, 
+	     qp_part_t * parts, int n)
+{
+    off_t * files; 
+    int nfiles, i; 
+
+    /* the first file starts at ofs, then all the following ones */
+    files = safe_malloc(sizeof(off_t)); 
+    files[0] = ofs; 
+    nfiles = 1; 
+
+    for (;;) { 
+	timestamp_t ts; 
+	ssize_t len; 
+	off_t x, y; 
+	char * ptr; 
+
+	x = y = csseek(file_fd, CS_SEEK_FILE_NEXT); 
+	if (x < 0) 
+	    break; 
+
+	len = mdl->callbacks.st_recordsize;
+	ptr = module_db_record_get(file_fd, &y, mdl, &len, &ts);
+	if (ptr == NULL || ptr == GR_LOSTSYNC || ts >= end_ts) 
+	    break; 
+
+	files = safe_realloc(files, (nfiles + 1) * sizeof(off_t)); 
+	files[nfiles++] = x; 
+    } 
+
+    if (n > nfiles) 
+	n = nfiles; 
+
+    for (i = 0; i < n; i++) { 
+	parts[i].start = files[i * nfiles / n]; 
+	parts[i].end = (i == n - 1) ? -1 : files[(i + 1) * nfiles / n]; 
+    } 
+
+    free(files); 
+    return n; 
+}
+
+
+/* 
+ * -- qp_fork
+ * 
+ * fork a worker for partition idx. the worker gets its own name and 
+ * its own connection to STORAGE (the one inherited from the query 
+ * process cannot be shared). returns 0 in the worker. 
+ * 
+ */
+static pid_t
+qp_fork(int client_fd, qp_part_t * part, int idx)
+{
+    FILE * f; 
+
+    /* 
+     * the temporary file is created here so that we can still 
+     * read it after the worker is gone. 
+     */
+    f = tmpfile(); 
+    if (f == NULL) 
+	panic("creating temporary file for query worker"); 
+    part->out_fd = dup(fileno(f)); 
+    fclose(f); 
+
+    part->pid = fork(); 
+    if (part->pid < 0) 
+	panic("forking query worker"); 
+    if (part->pid > 0) 
+	return part->pid; 
+
+    map.parent = map.whoami; 
+    map.whoami = child(QUERY, client_fd * QP_MAX_WORKERS + idx); 
+    setproctitle(getprocfullname(map.whoami));
+
+    ipc_disconnect(STORAGE); 
+    ipc_connect(STORAGE); 
+    return 0; 
+}
+
+
+/* 
+ * -- qp_wait
+ * 
+ * wait for the worker of a partition and rewind its output. 
+ * 
+ */
+static void
+qp_wait(qp_part_t * part) 
+{
+    int status; 
+
+    if (waitpid(part->pid, &status, 0) < 0) 
+	panic("waiting for query worker %d", part->pid); 
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) 
+	panicx("query worker %d failed", part->pid); 
+    if (lseek(part->out_fd, 0, SEEK_SET) < 0) 
+	panic("rewinding output of query worker %d", part->pid); 
+}
+
+
+/* 
+ * -- query_parallel
+ * 
+ * historical query with more than one worker. file_fd is the 
+ * output of req->mdl, positioned at offset ofs by the seek on the 
+ * start of the query. the header has already been printed and the 
+ * footer is up to the caller. 
+ * 
+ */
+void
+query_parallel(int client_fd, qreq_t * req, int file_fd, off_t ofs) 
+{
+    qp_part_t parts[QP_MAX_WORKERS]; 
+    timestamp_t end_ts; 
+    char buf[65536]; 
+    int mode, n, i; 
+
+    end_ts = TIME2TS(req->end, 0);
+    n = qp_partition(req->mdl, file_fd, ofs, end_ts, parts, 
+		     MIN(req->workers, QP_MAX_WORKERS)); 
+    logmsg(V_LOGQUERY, "query split in %d partitions\n", n); 
+
+    mode = req->wait ? CS_READER : CS_READER_NOBLOCK; 
+    for (i = 0; i < n; i++) { 
+	int fd; 
+
+	if (qp_fork(client_fd, &parts[i], i) != 0) 
+	    continue; 
+
+	/* worker */
+	fd = csopen(req->output, mode, 0); 
+	if (fd < 0) 
+	    panic("opening file %s", req->output);
+	query_send_records(req, fd, parts[i].start, parts[i].end, end_ts, 
+			   parts[i].out_fd); 
+	csclose(fd, 0); 
+	exit(EXIT_SUCCESS); 
+    } 
+
+    /* send the output of the workers in order */
+    for (i = 0; i < n; i++) { 
+	ssize_t len; 
+
+	qp_wait(&parts[i]); 
+	while ((len = read(parts[i].out_fd, buf, sizeof(buf))) > 0) { 
+	    if (como_writen(client_fd, buf, len) < 0) 
+		err(EXIT_FAILURE, "sending data to the client"); 
+	} 
+	if (len < 0) 
+	    panic("reading output of query worker %d", parts[i].pid); 
+	close(parts[i].out_fd); 
+    } 
+}
+
+
+/* 
+ * -- qp_print
+ * 
+ * print a record of the on-demand module to the client. 
+ * 
+ */
+static void
+qp_print(module_t * mdl, char * ptr, int client_fd) 
+{
+    if (module_db_record_print(mdl, ptr, NULL, client_fd) < 0) {
+	if (errno == ENODATA) 
+	    panicx("module \"%s\" failed to print\n", mdl->name);
+	err(EXIT_FAILURE, "sending data to the client");
+    }
+}
+
+
+/* 
+ * -- qp_print_held
+ * 
+ * print and release the records held by the query process. 
+ * 
+ */
+static void
+qp_print_held(module_t * mdl, char ** held, int nheld, int client_fd) 
+{
+    int i; 
+
+    for (i = 0; i < nheld; i++) { 
+	qp_print(mdl, held[i], client_fd); 
+	free(held[i]); 
+    } 
+}
+
+
+/* 
+ * -- query_parallel_ondemand
+ * 
+ * on-demand query with more than one worker. 
+ * 
+ */
+void
+query_parallel_ondemand(int client_fd, qreq_t * req) 
+{
+    qp_part_t parts[QP_MAX_WORKERS]; 
+    module_t * mdl, * src; 
+    timestamp_t end_ts, held_ivl; 
+    char ** held; 
+    off_t ofs; 
+    size_t recsize; 
+    int file_fd, mode, n, nheld, i; 
+
+    /* the instance of the module in this process only prints */
+    mdl = query_ondemand_init(client_fd, req); 
+
+    src = req->src; 
+    ipc_connect(STORAGE);
+    mode = req->wait ? CS_READER : CS_READER_NOBLOCK; 
+    file_fd = csopen(src->output, mode, 0); 
+    if (file_fd < 0) 
+	panic("opening file %s", src->output);
+
+    end_ts = TIME2TS(req->end, 0);
+    ofs = module_db_seek_by_ts(src, file_fd, TIME2TS(req->start, 0));
+    n = 0; 
+    if (ofs >= 0) 
+	n = qp_partition(src, file_fd, ofs, end_ts, parts, 
+			 MIN(req->workers, QP_MAX_WORKERS)); 
+    csclose(file_fd, 0); 
+    logmsg(V_LOGQUERY, "query split in %d partitions\n", n); 
+
+    for (i = 0; i < n; i++) { 
+	module_t * wmdl; 
+	int fd; 
+
+	if (qp_fork(client_fd, &parts[i], i) != 0) 
+	    continue; 
+
+	/* 
+	 * worker. the memory region inherited from the query process 
+	 * (and the module configuration in it) is shared with the other 
+	 * workers, so create a private instance of the module. 
+	 */
+	map.runmode = RUNMODE_INLINE_RAW; 
+	map.inline_fd = parts[i].out_fd; 
+	wmdl = query_ondemand_module(req); 
+
+	fd = csopen(src->output, mode, 0); 
+	if (fd < 0) 
+	    panic("opening file %s", src->output);
+	query_ondemand_run(wmdl, src, fd, parts[i].start, parts[i].end, 
+			   end_ts); 
+	csclose(fd, 0); 
+	exit(EXIT_SUCCESS); 
+    } 
+
+    /* 
+     * print the records of the workers in order. the records of the 
+     * last flush interval of a partition are held until we know if 
+     * the next partition has records for the same interval. 
+     */
+    recsize = mdl->callbacks.st_recordsize; 
+    held = NULL; 
+    nheld = 0; 
+    held_ivl = 0; 
+
+    for (i = 0; i < n; i++) { 
+	struct stat st; 
+	timestamp_t ts, last_ivl; 
+	char * base, * p; 
+	size_t sz; 
+	int j; 
+
+	qp_wait(&parts[i]); 
+	if (fstat(parts[i].out_fd, &st) < 0) 
+	    panic("reading output of query worker %d", parts[i].pid); 
+	if (st.st_size == 0) { 
+	    close(parts[i].out_fd); 
+	    continue; 
+	} 
+
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, 
+		    parts[i].out_fd, 0); 
+	if (base == MAP_FAILED) 
+	    panic("mapping output of query worker %d", parts[i].pid); 
+
+	/* find the last flush interval of this partition */
+	last_ivl = 0; 
+	for (p = base; p < base + st.st_size; p += sz) { 
+	    sz = mdl->callbacks.load(mdl, p, base + st.st_size - p, &ts); 
+	    if (sz == 0) 
+		panicx("module \"%s\" failed to load\n", mdl->name);
+	    last_ivl = ts - (ts % mdl->flush_ivl); 
+	} 
+
+	for (p = base; p < base + st.st_size; p += sz) { 
+	    timestamp_t ivl; 
+
+	    sz = mdl->callbacks.load(mdl, p, base + st.st_size - p, &ts); 
+	    ivl = ts - (ts % mdl->flush_ivl); 
+
+	    if (nheld > 0 && ivl != held_ivl) { 
+		qp_print_held(mdl, held, nheld, client_fd); 
+		nheld = 0; 
+	    } 
+
+	    if (nheld > 0) { 
+		/* same interval of the held records, try to merge */
+		for (j = 0; j < nheld; j++) { 
+		    if (mdl->callbacks.merge(mdl, held[j], p)) 
+			break; 
+		} 
+		if (j < nheld) 
+		    continue; 
+	    } 
+
+	    if (mdl->callbacks.merge == NULL || ivl != last_ivl) { 
+		qp_print(mdl, p, client_fd); 
+		continue; 
+	    } 
+
+	    /* hold a copy of this record */
+	    held = safe_realloc(held, (nheld + 1) * sizeof(char *)); 
+	    held[nheld] = safe_calloc(1, MAX(recsize, sz)); 
+	    memcpy(held[nheld], p, sz); 
+	    nheld++; 
+	    held_ivl = ivl; 
+	} 
+
+	munmap(base, st.st_size); 
+	close(parts[i].out_fd); 
+    } 
+
+    qp_print_held(mdl, held, nheld, client_fd); 
+    free(held); 
+
+    /* print the footer */
+    qp_print(mdl, NULL, client_fd); 
+}
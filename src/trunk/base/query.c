@@ -378,6 +378,160 @@ qu_ipc_start(procname_t sender, __attribute__((__unused__)) void * buf,
     s_wait_for_modules = 0;
 }
 
+/*
+ * -- query_send_records
+ * 
+ * read the records of req->mdl from file_fd starting at offset ofs 
+ * and send them to out_fd in the format of the query. it stops at 
+ * the end of the data, at the first record with a timestamp after 
+ * end_ts or when reaching offset end_ofs (if not -1). it returns 1 
+ * in the second case, i.e. when all the records of the interval are 
+ * already in the bytestream and will not change. 
+ * 
+ */
+int
+query_send_records(qreq_t * req, int file_fd, off_t ofs, off_t end_ofs, 
+		   timestamp_t end_ts, int out_fd) 
+{
+    timestamp_t ts; 
+    ssize_t len; 
+    int ret; 
+
+    for (;;) { 
+	char * ptr;
+
+	if (end_ofs >= 0 && ofs >= end_ofs) 
+	    break; 
+
+	len = req->mdl->callbacks.st_recordsize;
+	ptr = module_db_record_get(file_fd, &ofs, req->mdl, &len, &ts);
+	if (ptr == NULL) {
+	    /* no data, but why ? */
+	    if (len == 0) {
+		break;
+	    }
+	    panic("reading from file %s ofs %lld len %d",
+		  req->output, ofs, len);
+	}
+	/*
+	 * Now we have either good data or GR_LOSTSYNC.
+	 * If lost sync, move to the next file and try again. 
+	 */
+	if (ptr == GR_LOSTSYNC) {
+	    ofs = csseek(file_fd, CS_SEEK_FILE_NEXT);
+	    if (ofs == -1) { 
+		/* no more data, notify the end of the 
+		 * stream to the module
+		 */ 
+		logmsg(V_LOGQUERY, "reached end of file %s\n",
+		       req->output);
+		break;
+	    }
+	    logmsg(V_LOGQUERY, "lost sync, trying next file %s/%016llx\n", 
+		   req->output, ofs); 
+	    continue;
+	}
+	
+	if (ts >= end_ts) {
+	    return 1;
+	}
+	
+	switch (req->format) {
+	case QFORMAT_COMO: 	
+	    if (module_db_record_replay(req->mdl, ptr, out_fd))
+		handle_replay_fail(req->mdl);
+	    break;
+
+	case QFORMAT_RAW: 
+	    /* send the data to the query client */
+	    ret = como_writen(out_fd, ptr, len);
+	    if (ret < 0) 
+		 err(EXIT_FAILURE, "sending data to the client"); 
+	    break;
+
+	case QFORMAT_CUSTOM: 
+	case QFORMAT_HTML:
+	    if (module_db_record_print(req->mdl, ptr, NULL, out_fd))
+		handle_print_fail(req->mdl);
+	    break;
+	default:
+	    break;
+	}
+    }
+
+    return 0; 
+}
+
+
+/*
+ * -- query_rollup
+ * 
+ * set the bytestream the query will read. if the query asks for 
+ * a granularity (in seconds) and the module has a rollup with a 
+ * resolution that fits, use the rollup and change the granularity 
+ * argument so that print() aggregates the right number of records. 
+ * the rollup is not used if it does not cover the start of the query 
+ * (e.g., it was created after that). 
+ * 
+ */
+static void
+query_rollup(qreq_t * req) 
+{
+    char * output; 
+    off_t ofs; 
+    ssize_t len; 
+    timestamp_t ts; 
+    int granularity, secs, fd, i; 
+
+    req->output = req->mdl->output; 
+    if (req->format != QFORMAT_CUSTOM && req->format != QFORMAT_HTML) 
+	return; 
+
+    granularity = 0; 
+    for (i = 0; req->args && req->args[i]; i++) { 
+	if (strncmp(req->args[i], "granularity=", 12) == 0) 
+	    break; 
+    } 
+    if (req->args == NULL || req->args[i] == NULL) 
+	return; 
+    granularity = atoi(req->args[i] + 12); 
+
+    output = rollup_select(req->mdl, granularity, &secs); 
+    if (output == NULL) 
+	return; 
+
+    /* check that the rollup goes back to the start of the query */
+    fd = csopen(output, CS_READER_NOBLOCK, 0); 
+    if (fd < 0) { 
+	free(output); 
+	return; 
+    } 
+    ts = 0; 
+    ofs = module_db_seek_by_ts(req->mdl, fd, TIME2TS(req->start, 0)); 
+    if (ofs >= 0) { 
+	len = req->mdl->callbacks.st_recordsize; 
+	if (module_db_record_get(fd, &ofs, req->mdl, &len, &ts) == NULL) 
+	    ts = 0; 
+    } 
+    csclose(fd, 0); 
+
+    if (ts == 0 || ts >= TIME2TS(req->start + secs, 0)) { 
+	free(output); 
+	return; 
+    } 
+
+    /* 
+     * print() aggregates granularity/flush_ivl records. 
+     * now each record covers secs seconds. 
+     */
+    logmsg(V_LOGQUERY, "reading rollup %s\n", output); 
+    free(req->args[i]); 
+    asprintf(&req->args[i], "granularity=%d", 
+	     (int) (granularity / secs * TS2SEC(req->mdl->flush_ivl))); 
+    req->output = output; 
+}
+
+
 static char *s_format_names[] = {
     "custom",
     "raw",
@@ -400,6 +554,7 @@ static char *s_format_names[] = {
  *  . time, interval of interest 
  *  . source, data source if not one of the running sniffers 
  *  . format, to define the output format of the query
+ *  . workers, number of processes to split the query interval among
  * 
  * XXX as of now, if "source" is not defined, query_ondemand requires 
  *     that the module has been running during the interval of interest. 
@@ -414,8 +569,7 @@ query(int client_fd, int supervisor_fd, int node_id)
     qreq_t req;
     int file_fd;
     off_t ofs; 
-    ssize_t len;
-    int mode, ret;
+    int mode, ret, out_fd, closed;
     char *httpstr;
     char *null_args[] = {NULL};
     timestamp_t ts, end_ts;
@@ -543,32 +697,62 @@ query(int client_fd, int supervisor_fd, int node_id)
     /* 
      * if we have to retrieve the data using the replay callback of
      * another module instead of reading the output file of the module,
-     * go to query_ondemand that will fork a new CAPTURE and EXPORT to 
-     * execute this query.
+     * go to query_ondemand that will run the module in this process 
+     * over the records of the source module. with more than one 
+     * worker the interval is split among several processes. 
      */
     if (req.source) {
-	query_ondemand(client_fd, &req, node_id); 
-	assert_not_reached();
+	if (req.workers > 1) 
+	    query_parallel_ondemand(client_fd, &req); 
+	else 
+	    query_ondemand(client_fd, &req, node_id); 
+	logmsg(LOGQUERY, "query completed\n"); 
+	close(client_fd);
+	close(supervisor_fd);
+	return;
     }
 
     /* 
      * connect to the storage process, open the module output file 
-     * and then start reading the file and send the data back 
+     * (or one of its rollups) and then start reading the file and 
+     * send the data back 
      */
     ipc_connect(STORAGE);
 
-    logmsg(V_LOGQUERY, "opening file for reading (%s)\n", req.mdl->output); 
+    /* queries with a list of fields are answered by the columnar output */
+    if (column_query(&req, client_fd)) { 
+	logmsg(LOGQUERY, "query completed\n"); 
+	close(client_fd);
+	close(supervisor_fd);
+	return;
+    }
+
+    query_rollup(&req); 
+
+    logmsg(V_LOGQUERY, "opening file for reading (%s)\n", req.output); 
     mode =  req.wait ? CS_READER : CS_READER_NOBLOCK; 
-    file_fd = csopen(req.mdl->output, mode, 0); 
+    file_fd = csopen(req.output, mode, 0); 
     if (file_fd < 0) 
-	panic("opening file %s", req.mdl->output);
+	panic("opening file %s", req.output);
 
     /* seek on the first record */
     ts = TIME2TS(req.start, 0);
     end_ts = TIME2TS(req.end, 0);
     ofs = module_db_seek_by_ts(req.mdl, file_fd, ts);
-    if (ofs >= 0) {
-	/* at this point at least one record exists as we seek on it */
+    if (ofs >= 0 && qcache_send(&req, ofs, client_fd)) {
+	logmsg(V_LOGQUERY, "query served from the cache\n"); 
+    } else if (ofs >= 0) {
+	/* 
+	 * at this point at least one record exists as we seek on it. 
+	 * if the query can be cached (i.e., its interval is closed and 
+	 * it cannot wait for new records), write the output to a new 
+	 * cache entry and send it to the client at the end. otherwise 
+	 * stream it to the client as usual. 
+	 */
+	out_fd = qcache_create(&req, ofs); 
+	if (out_fd < 0) 
+	    out_fd = client_fd; 
+
 	switch (req.format) {
 	case QFORMAT_CUSTOM:
 	case QFORMAT_HTML:
@@ -578,7 +762,7 @@ query(int client_fd, int supervisor_fd, int node_id)
 	    if (req.args == NULL) {
 		req.args = null_args;
 	    }
-	    if (module_db_record_print(req.mdl, NULL, req.args, client_fd) < 0)
+	    if (module_db_record_print(req.mdl, NULL, req.args, out_fd) < 0)
 		handle_print_fail(req.mdl);
 	    break;
 	case QFORMAT_COMO:
@@ -591,70 +775,22 @@ query(int client_fd, int supervisor_fd, int node_id)
 	default:
 	    break;
 	}
-	for (;;) { 
-	    char * ptr;
-	    len = req.mdl->callbacks.st_recordsize;
-	    ptr = module_db_record_get(file_fd, &ofs, req.mdl, &len, &ts);
-	    if (ptr == NULL) {
-		/* no data, but why ? */
-		if (len == 0) {
-		    break;
-		}
-		panic("reading from file %s ofs %lld len %d",
-		      req.mdl->output, ofs, len);
-	    }
-	    /*
-	     * Now we have either good data or GR_LOSTSYNC.
-	     * If lost sync, move to the next file and try again. 
-	     */
-	    if (ptr == GR_LOSTSYNC) {
-		ofs = csseek(file_fd, CS_SEEK_FILE_NEXT);
-		if (ofs == -1) { 
-		    /* no more data, notify the end of the 
-		     * stream to the module
-		     */ 
-		    logmsg(V_LOGQUERY, "reached end of file %s\n",
-			   req.mdl->output);
-		    break;
-		}
-		logmsg(V_LOGQUERY, "lost sync, trying next file %s/%016llx\n", 
-		       req.mdl->output, ofs); 
-		continue;
-	    }
-	    
-	    if (ts >= end_ts) {
-		break;
-	    }
-	    
-	    switch (req.format) {
-	    case QFORMAT_COMO: 	
-		if (module_db_record_replay(req.mdl, ptr, client_fd))
-		    handle_replay_fail(req.mdl);
-		break;
-
-	    case QFORMAT_RAW: 
-		/* send the data to the query client */
-		ret = como_writen(client_fd, ptr, len);
-		if (ret < 0) 
-		     err(EXIT_FAILURE, "sending data to the client"); 
-		break;
+	closed = 0; 
+	if (req.workers > 1) 
+	    query_parallel(client_fd, &req, file_fd, ofs); 
+	else 
+	    closed = query_send_records(&req, file_fd, ofs, -1, end_ts, out_fd);
 
-	    case QFORMAT_CUSTOM: 
-	    case QFORMAT_HTML:
-		if (module_db_record_print(req.mdl, ptr, NULL, client_fd))
-		    handle_print_fail(req.mdl);
-		break;
-	    default:
-		break;
-	    }
-	}
 	/* notify the end of stream to the module */
 	if (req.format == QFORMAT_CUSTOM || req.format == QFORMAT_HTML) {
 	    /* print the footer */
-	    if (module_db_record_print(req.mdl, NULL, NULL, client_fd)) {
+	    if (module_db_record_print(req.mdl, NULL, NULL, out_fd)) {
 		handle_print_fail(req.mdl);
 	    }
 	}
+
+	if (out_fd != client_fd) 
+	    qcache_done(out_fd, closed, client_fd); 
     }
     logmsg(LOGQUERY, "query completed\n"); 
     
@@ -173,7 +173,9 @@ get_mdl_usage(module_t *mdl, resource_t *res)
         case RES_SH_MEM:
             return st->mem_usage_shmem;
         case RES_EX_MEM:
-            return st->mem_usage_export;
+            if (mdl->index >= map.stats->exmem_max)
+                return 0;
+            return map.stats->exmem[mdl->index].bytes;
         default:
             return 0; /* !? */
     }
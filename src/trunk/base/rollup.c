@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2004-2006, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "como.h"
+#include "comopriv.h"
+#include "storage.h"
+
+/*
+ * Rollups. 
+ * 
+ * Modules that store one record per flush interval (e.g., traffic) 
+ * can provide a rollup() callback. EXPORT then also writes the output 
+ * of the module at 1 minute, 1 hour and 1 day resolutions in separate 
+ * bytestreams (<output>.1m, <output>.1h, <output>.1d). Each record of 
+ * a rollup is the average record of one flush interval over the period. 
+ * 
+ * Each resolution is built from the records of the previous one so 
+ * that rollup() aggregates at most a few tens of records at a time. 
+ * Resolutions that are not a multiple of the previous one are skipped. 
+ * 
+ * The query process picks the coarsest resolution that still satisfies 
+ * the granularity of the query (see rollup_select()). 
+ */
+
+/* global state */
+extern struct _como map;
+
+#define ROLLUP_LEVELS		3
+
+static struct { 
+    int		secs; 
+    char *	suffix; 
+} s_levels[ROLLUP_LEVELS] = { 
+    { 60,	"1m" }, 
+    { 3600,	"1h" }, 
+    { 86400,	"1d" }, 
+}; 
+
+
+/* 
+ * -- rollup_levels
+ * 
+ * fill the array r with the resolutions available for mdl. 
+ * returns the number of resolutions. 
+ * 
+ */
+static int
+rollup_levels(module_t * mdl, rollup_t * r) 
+{
+    int prev, i, n; 
+
+    if (mdl->callbacks.rollup == NULL) 
+	return 0; 
+    if (mdl->flush_ivl == 0 || mdl->flush_ivl % TIME2TS(1, 0) != 0) 
+	return 0; 
+
+    prev = TS2SEC(mdl->flush_ivl); 
+    for (i = 0, n = 0; i < ROLLUP_LEVELS; i++) { 
+	if (s_levels[i].secs <= prev || s_levels[i].secs % prev != 0) 
+	    continue; 
+
+	r[n].secs = s_levels[i].secs; 
+	r[n].n = s_levels[i].secs / prev; 
+	asprintf(&r[n].output, "%s.%s", mdl->output, s_levels[i].suffix); 
+	prev = s_levels[i].secs; 
+	n++; 
+    } 
+
+    return n; 
+}
+
+
+/* 
+ * -- rollup_init
+ * 
+ * open the rollup bytestreams of the module. called by EXPORT. 
+ * 
+ */
+void
+rollup_init(module_t * mdl) 
+{
+    rollup_t * r; 
+    int n, i; 
+
+    mdl->rollup = NULL; 
+    r = safe_calloc(ROLLUP_LEVELS + 1, sizeof(rollup_t)); 
+    n = rollup_levels(mdl, r); 
+    if (n == 0) { 
+	free(r); 
+	return; 
+    } 
+
+    for (i = 0; i < n; i++) { 
+	logmsg(V_LOGEXPORT, "module %s: opening file %s\n", 
+	       mdl->name, r[i].output);
+	r[i].file = csopen(r[i].output, CS_WRITER, mdl->streamsize);
+	if (r[i].file < 0)
+	    panic("cannot open file %s for %s", r[i].output, mdl->name);
+	r[i].offset = csgetofs(r[i].file);
+	r[i].rec = safe_malloc(mdl->callbacks.st_recordsize); 
+    } 
+
+    mdl->rollup = r; 
+}
+
+
+static void rollup_add(module_t * mdl, rollup_t * r, char * ptr, size_t len,
+		       timestamp_t ts); 
+
+/* 
+ * -- rollup_close
+ * 
+ * complete the aggregate of the current period, write it to the 
+ * bytestream and pass it on to the next resolution. 
+ * 
+ */
+static void
+rollup_close(module_t * mdl, rollup_t * r) 
+{
+    ssize_t bsize; 
+    char * dst; 
+
+    mdl->callbacks.rollup(mdl, r->rec, NULL, r->n); 
+
+    bsize = r->len; 
+    dst = csmap(r->file, r->offset, &bsize); 
+    if (dst == NULL) 
+	panic("fail csmap for module %s", mdl->name);
+    if (bsize < (ssize_t) r->len) { 
+	logmsg(LOGWARN, "cannot write to disk for module %s (%s)\n",
+	       mdl->name, r->output);
+    } else { 
+	memcpy(dst, r->rec, r->len); 
+	r->offset += r->len; 
+	cscommit(r->file, r->offset);
+    } 
+
+    if (r[1].secs != 0) 
+	rollup_add(mdl, r + 1, r->rec, r->len, r->period); 
+    r->len = 0; 
+}
+
+
+/* 
+ * -- rollup_add
+ * 
+ * add a record to the aggregate of resolution r. 
+ * 
+ */
+static void
+rollup_add(module_t * mdl, rollup_t * r, char * ptr, size_t len, 
+	   timestamp_t ts) 
+{
+    timestamp_t period; 
+
+    period = ts - (ts % TIME2TS(r->secs, 0)); 
+    if (r->len > 0 && period != r->period) 
+	rollup_close(mdl, r); 
+
+    if (r->len == 0) { 
+	if (len > mdl->callbacks.st_recordsize) 
+	    return; 
+	memcpy(r->rec, ptr, len); 
+	r->len = len; 
+	r->period = period; 
+	return; 
+    } 
+
+    if (len != r->len || mdl->callbacks.rollup(mdl, r->rec, ptr, 0) < 0) 
+	logmsg(V_LOGEXPORT, "module %s: record not in rollup %s\n", 
+	       mdl->name, r->output); 
+}
+
+
+/* 
+ * -- rollup_store
+ * 
+ * add the records just written to the output of the module by 
+ * store() to the rollups. called by EXPORT. 
+ * 
+ */
+void
+rollup_store(module_t * mdl, char * ptr, size_t len) 
+{
+    timestamp_t ts; 
+    size_t sz; 
+
+    if (mdl->rollup == NULL) 
+	return; 
+
+    while (len > 0) { 
+	sz = mdl->callbacks.load(mdl, ptr, len, &ts); 
+	if (sz == 0) 
+	    break; 
+	rollup_add(mdl, mdl->rollup, ptr, sz, ts); 
+	ptr += sz; 
+	len -= sz; 
+    } 
+}
+
+
+/* 
+ * -- rollup_destroy
+ * 
+ * close the rollup bytestreams. the records of the periods that 
+ * are not complete yet are lost. 
+ * 
+ */
+void
+rollup_destroy(module_t * mdl) 
+{
+    rollup_t * r; 
+
+    if (mdl->rollup == NULL) 
+	return; 
+
+    for (r = mdl->rollup; r->secs != 0; r++) { 
+	csclose(r->file, r->offset); 
+	free(r->output); 
+	free(r->rec); 
+    } 
+    free(mdl->rollup); 
+    mdl->rollup = NULL; 
+}
+
+
+/* 
+ * -- rollup_select
+ * 
+ * return the name of the bytestream with the coarsest resolution 
+ * that can answer a query with the given granularity (in seconds), 
+ * i.e. the granularity is a multiple of the resolution. the resolution 
+ * is returned in secs. returns NULL if there is no such bytestream. 
+ * 
+ */
+char * 
+rollup_select(module_t * mdl, int granularity, int * secs) 
+{
+    rollup_t r[ROLLUP_LEVELS]; 
+    char * output; 
+    int n, i; 
+
+    n = rollup_levels(mdl, r); 
+    output = NULL; 
+    for (i = 0; i < n; i++) { 
+	if (r[i].secs <= granularity && granularity % r[i].secs == 0) { 
+	    free(output); 
+	    output = r[i].output; 
+	    *secs = r[i].secs; 
+	} else { 
+	    free(r[i].output); 
+	} 
+    } 
+
+    return output; 
+}
+
+
+/* 
+ * -- rollup_stat
+ * 
+ * aggregate (src != NULL) or average (src == NULL) count entries 
+ * made of 64 bit bytes and 32 bit packets in network byte order. 
+ * this is a helper for the rollup() callback of the modules. 
+ */
+void
+rollup_stat(char * dst, char * src, int count, int n)
+{
+    uint64_t b, b2; 
+    uint32_t p, p2; 
+    int i; 
+
+    for (i = 0; i < count * 12; i += 12) { 
+	memcpy(&b, dst + i, 8); 
+	memcpy(&p, dst + i + 8, 4); 
+	if (src != NULL) {
+	    memcpy(&b2, src + i, 8); 
+	    memcpy(&p2, src + i + 8, 4); 
+	    b = HTONLL(NTOHLL(b) + NTOHLL(b2)); 
+	    p = htonl(ntohl(p) + ntohl(p2)); 
+	} else { 
+	    b = HTONLL(NTOHLL(b) / n); 
+	    p = htonl(ntohl(p) / n); 
+	} 
+	memcpy(dst + i, &b, 8); 
+	memcpy(dst + i + 8, &p, 4); 
+    } 
+}
@@ -0,0 +1,461 @@
+/*
+ * Copyright (c) 2004-2006, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glob.h>
+#include <errno.h>
+
+#include "como.h"
+#include "comopriv.h"
+#include "sniffers.h"
+#include "storage.h"
+#include "ipc.h"
+
+/*
+ * Offline shards. 
+ * 
+ * When processing trace files, the list of files of each sniffer 
+ * can be split in map.shards contiguous slices. Each slice is 
+ * processed by a shard, i.e. a full CoMo pipeline (SUPERVISOR, 
+ * CAPTURE, EXPORT and STORAGE with their own shared memory and 
+ * work directory) that writes the module outputs in 
+ * <db-path>/shard.<n>. When all shards are done, the parent 
+ * merges their outputs in the module bytestreams in timestamp 
+ * order and exits. 
+ * 
+ * Records of the same flush interval found in more than one shard 
+ * (i.e., intervals that straddle the boundary between two slices) 
+ * are given to the merge() callback of the module, if any. 
+ * Otherwise they are all written to the output. 
+ */
+
+/* global state */
+extern struct _como map;
+
+/* input of the merge, one per shard */
+typedef struct shard_in {
+    int		fd;		/* shard bytestream */
+    off_t	ofs;		/* offset of the next record */
+    char *	rec;		/* copy of the current record */
+    size_t	len;		/* length of the current record */
+    size_t	size;		/* size of the rec buffer */
+    timestamp_t	ts;		/* timestamp of the current record */
+    timestamp_t	ivl;		/* flush interval of the current record */
+    int		done;		/* no more records */
+} shard_in_t;
+
+/* record held while merging an interval */
+typedef struct shard_rec {
+    char *	rec;
+    size_t	len;
+} shard_rec_t;
+
+
+/* 
+ * -- shard_output
+ * 
+ * name of the output of a module in a shard 
+ */
+static char * 
+shard_output(module_t * mdl, int shard) 
+{
+    char * name, * base; 
+
+    base = strrchr(mdl->output, '/'); 
+    base = (base == NULL) ? mdl->output : base + 1; 
+    asprintf(&name, "%s/shard.%d/%s", map.dbdir, shard, base); 
+    return name; 
+}
+
+
+/* 
+ * -- shard_setup
+ * 
+ * prepare the map of a shard. the shard needs its own work 
+ * directory (for the IPC sockets), writes to its own directory 
+ * and exits when the trace files are done. 
+ */
+static void
+shard_setup(int shard) 
+{
+    char * dir; 
+    int idx; 
+
+    map.shard = shard; 
+    map.exit_when_done = 1; 
+    map.silent = 1; 
+    map.workdir = mkdtemp(strdup("/tmp/comoXXXXXX"));
+    if (map.workdir == NULL) 
+	panic("cannot create work directory for shard %d", shard); 
+
+    asprintf(&dir, "%s/shard.%d", map.dbdir, shard); 
+    if (mkdir(dir, (mode_t) (S_IRWXU | S_IRWXG | S_IRWXO)) < 0 && 
+	    errno != EEXIST) 
+	panic("cannot create %s", dir); 
+    free(dir); 
+
+    for (idx = 0; idx <= map.module_last; idx++) { 
+	module_t * mdl = &map.modules[idx]; 
+
+	if (mdl->status == MDL_UNUSED || mdl->output == NULL) 
+	    continue; 
+	dir = shard_output(mdl, shard); 
+	free(mdl->output); 
+	mdl->output = dir; 
+    } 
+}
+
+
+/* 
+ * -- shard_next
+ * 
+ * read the next record of a shard. lost sync is handled as 
+ * everywhere else by moving to the next file. 
+ */
+static void
+shard_next(module_t * mdl, shard_in_t * in) 
+{
+    ssize_t len; 
+    char * ptr; 
+
+    for (;;) { 
+	len = mdl->callbacks.st_recordsize; 
+	ptr = module_db_record_get(in->fd, &in->ofs, mdl, &len, &in->ts); 
+	if (ptr == NULL) { 
+	    in->done = 1; 
+	    return; 
+	} 
+
+	if (ptr == GR_LOSTSYNC) { 
+	    in->ofs = csseek(in->fd, CS_SEEK_FILE_NEXT); 
+	    if (in->ofs == -1) { 
+		in->done = 1; 
+		return; 
+	    } 
+	    continue; 
+	} 
+
+	if ((size_t) len > in->size) { 
+	    in->size = len; 
+	    in->rec = safe_realloc(in->rec, in->size); 
+	} 
+	memcpy(in->rec, ptr, len); 
+	in->len = len; 
+	in->ivl = in->ts - (in->ts % mdl->flush_ivl); 
+	return; 
+    } 
+}
+
+
+/* 
+ * -- shard_store
+ * 
+ * append a record to the module output (and to its rollups 
+ * and columnar output as EXPORT does). 
+ */
+static void
+shard_store(module_t * mdl, char * rec, size_t len) 
+{
+    ssize_t sz = len; 
+    char * dst; 
+
+    dst = csmap(mdl->file, mdl->offset, &sz); 
+    if (dst == NULL || sz < (ssize_t) len) 
+	panic("fail csmap for module %s", mdl->name);
+
+    memcpy(dst, rec, len); 
+    rollup_store(mdl, dst, len); 
+    column_store(mdl, dst, len); 
+    mdl->offset += len; 
+    cscommit(mdl->file, mdl->offset);
+}
+
+
+/* 
+ * -- shard_merge_module
+ * 
+ * merge the outputs of all shards in the module bytestream. 
+ * this is a merge of n sorted lists. if more than one shard has 
+ * records for the same interval, the records of the later shards 
+ * are merged (if possible) with the records of the earlier ones. 
+ */
+static void
+shard_merge_module(module_t * mdl, int n) 
+{
+    shard_in_t * in; 
+    shard_rec_t * held; 
+    int nheld, maxheld; 
+    uint64_t count; 
+    int i; 
+
+    mdl->file = csopen(mdl->output, CS_WRITER, mdl->streamsize);
+    if (mdl->file < 0)
+	panic("cannot open file %s for %s", mdl->output, mdl->name);
+    mdl->offset = csgetofs(mdl->file);
+    rollup_init(mdl); 
+    column_init(mdl); 
+
+    in = safe_calloc(n, sizeof(shard_in_t)); 
+    for (i = 0; i < n; i++) { 
+	char * name = shard_output(mdl, i + 1); 
+
+	in[i].fd = csopen(name, CS_READER_NOBLOCK, 0); 
+	if (in[i].fd < 0) { 
+	    in[i].done = 1; 
+	} else { 
+	    in[i].ofs = csgetofs(in[i].fd); 
+	    shard_next(mdl, &in[i]); 
+	} 
+	free(name); 
+    } 
+
+    held = NULL; 
+    maxheld = 0; 
+    count = 0; 
+    for (;;) { 
+	timestamp_t ivl = ~0; 
+	int shards = 0; 
+
+	/* 
+	 * find the earliest flush interval and how many shards have it. 
+	 * records are grouped by interval (as in query-parallel.c) and 
+	 * not by timestamp, as shards may stamp the same interval with 
+	 * different timestamps. 
+	 */
+	for (i = 0; i < n; i++) { 
+	    if (in[i].done) 
+		continue; 
+	    if (in[i].ivl < ivl) { 
+		ivl = in[i].ivl; 
+		shards = 1; 
+	    } else if (in[i].ivl == ivl) { 
+		shards++; 
+	    } 
+	} 
+	if (shards == 0) 
+	    break; 
+
+	if (shards == 1 || mdl->callbacks.merge == NULL) { 
+	    /* no merge needed, write the records in shard order */
+	    for (i = 0; i < n; i++) { 
+		while (!in[i].done && in[i].ivl == ivl) { 
+		    shard_store(mdl, in[i].rec, in[i].len); 
+		    shard_next(mdl, &in[i]); 
+		    count++; 
+		} 
+	    } 
+	    continue; 
+	} 
+
+	/* 
+	 * the interval straddles two or more shards. hold its 
+	 * records and merge each one of them with the records of 
+	 * the earlier shards. 
+	 */
+	nheld = 0; 
+	for (i = 0; i < n; i++) { 
+	    int first = nheld; 
+
+	    while (!in[i].done && in[i].ivl == ivl) { 
+		int h; 
+
+		for (h = 0; h < first; h++) { 
+		    if (mdl->callbacks.merge(mdl, held[h].rec, in[i].rec)) 
+			break; 
+		} 
+		if (h == first) { 
+		    if (nheld == maxheld) { 
+			maxheld = maxheld ? maxheld * 2 : 64; 
+			held = safe_realloc(held, maxheld * sizeof(shard_rec_t));
+		    } 
+		    held[nheld].rec = safe_malloc(in[i].len); 
+		    memcpy(held[nheld].rec, in[i].rec, in[i].len); 
+		    held[nheld].len = in[i].len; 
+		    nheld++; 
+		} 
+		shard_next(mdl, &in[i]); 
+	    } 
+	} 
+
+	for (i = 0; i < nheld; i++) { 
+	    shard_store(mdl, held[i].rec, held[i].len); 
+	    free(held[i].rec); 
+	    count++; 
+	} 
+    } 
+
+    logmsg(LOGUI, "... module %s: %llu records merged from %d shards\n", 
+	   mdl->name, (unsigned long long) count, n); 
+
+    for (i = 0; i < n; i++) { 
+	if (in[i].fd >= 0) 
+	    csclose(in[i].fd, 0); 
+	free(in[i].rec); 
+    } 
+    free(in); 
+    free(held); 
+
+    column_destroy(mdl); 
+    rollup_destroy(mdl); 
+    csclose(mdl->file, mdl->offset);
+}
+
+
+/* 
+ * -- shard_merge
+ * 
+ * start a STORAGE process and merge the outputs of all modules. 
+ */
+static void
+shard_merge(int n) 
+{
+    int idx, storage_fd; 
+
+    memory_init(map.mem_size);
+    map.stats = mem_calloc(1, sizeof(stats_t)); 
+    map.mem_type = COMO_SHARED_MEM; 
+
+    ipc_listen(SUPERVISOR); 
+    storage_fd = ipc_listen(STORAGE); 
+    start_child(STORAGE, COMO_PRIVATE_MEM, storage_mainloop, storage_fd, 0);
+    ipc_connect(STORAGE); 
+
+    for (idx = 0; idx <= map.module_last; idx++) { 
+	module_t * mdl = &map.modules[idx]; 
+
+	if (mdl->status != MDL_LOADING || mdl->running == RUNNING_ON_DEMAND)
+	    continue;
+
+	if (activate_module(mdl, map.libdir) || init_module(mdl)) { 
+	    logmsg(LOGWARN, "cannot merge module %s\n", mdl->name); 
+	    continue; 
+	} 
+
+	shard_merge_module(mdl, n); 
+    } 
+
+    ipc_send(STORAGE, IPC_EXIT, NULL, 0); 
+    wait(NULL); 
+}
+
+
+/* 
+ * -- shard_run
+ * 
+ * fork the shards and wait for them. in the shards this function 
+ * returns and they go on as a regular CoMo. in the parent, it 
+ * merges the outputs and exits. 
+ */
+void
+shard_run(void) 
+{
+    source_t * src; 
+    pid_t * pids; 
+    char * cmd; 
+    int i, n, status, failed; 
+
+    if (map.runmode != RUNMODE_NORMAL) { 
+	map.shards = 1; 
+	return; 
+    } 
+
+    /* 
+     * all sniffers must support shards. we cannot have more 
+     * shards than the files of any sniffer. 
+     */
+    n = map.shards; 
+    for (src = map.sources; src != NULL; src = src->next) { 
+	glob_t g; 
+
+	if (!(src->sniff->flags & SNIFF_SHARDS)) { 
+	    logmsg(LOGWARN, "sniffer-%s cannot be split in shards\n", 
+		   src->cb->name); 
+	    map.shards = 1; 
+	    return; 
+	} 
+
+	if (glob(src->device, GLOB_ERR | GLOB_TILDE, NULL, &g) == 0) { 
+	    if ((int) g.gl_pathc < n) 
+		n = g.gl_pathc; 
+	    globfree(&g); 
+	} 
+    } 
+
+    if (n <= 1) { 
+	map.shards = 1; 
+	return; 
+    } 
+    map.shards = n; 
+
+    logmsg(LOGUI, "... processing trace files in %d shards\n", n); 
+
+    pids = safe_calloc(n, sizeof(pid_t)); 
+    for (i = 0; i < n; i++) { 
+	pids[i] = fork(); 
+	if (pids[i] < 0) 
+	    panic("forking shard %d", i + 1); 
+	if (pids[i] == 0) { 
+	    free(pids); 
+	    shard_setup(i + 1); 
+	    return; 
+	} 
+    } 
+
+    failed = 0; 
+    for (i = 0; i < n; i++) { 
+	if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) || 
+		WEXITSTATUS(status) != EXIT_SUCCESS) { 
+	    logmsg(LOGWARN, "shard %d failed\n", i + 1); 
+	    failed = 1; 
+	} 
+    } 
+    free(pids); 
+
+    if (failed) 
+	panicx("not merging, shard outputs left in %s/shard.*", map.dbdir); 
+
+    shard_merge(n); 
+
+    /* remove the shard outputs and our work directory */
+    asprintf(&cmd, "rm -rf %s/shard.* %s\n", map.dbdir, map.workdir);
+    system(cmd);
+    free(cmd); 
+    logmsg(LOGUI, "--- done, thank you for using como\n");
+    exit(EXIT_SUCCESS); 
+}
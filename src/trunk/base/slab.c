@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2004-2006, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "como.h"
+#include "comopriv.h"
+
+/*
+ * Slab allocator for the export records.
+ *
+ * EXPORT used to calloc() and free() each export record. Modules that 
+ * create and discard millions of records per interval spent most of 
+ * their time in malloc and fragmented the heap of EXPORT. 
+ *
+ * Each module now has a slab of objects of the exact size of its 
+ * export records (rounded up to 8 bytes, no malloc header). Objects 
+ * are carved out of chunks of SLAB_CHUNK bytes and freed objects go 
+ * in a free list. The chunks are given back all at once when the 
+ * export table becomes empty (slab_clear) or the module is removed 
+ * (slab_destroy). slab_usage() gives the memory actually held by 
+ * the module. 
+ */
+
+#define SLAB_CHUNK	(256 * 1024)	/* target size of a chunk */
+#define SLAB_MIN_OBJS	16		/* min objects per chunk */
+#define SLAB_HDR	16		/* chunk header (next pointer) */
+
+struct _slab {
+    size_t	size;		/* object size */
+    size_t	chunk_size;	/* bytes per chunk (with header) */
+    char *	chunks;		/* list of chunks, most recent first */
+    uint32_t	nchunks;	/* no. of chunks */
+    char *	cur;		/* next unused object in the first chunk */
+    char *	end;		/* end of the first chunk */
+    void *	free;		/* list of freed objects */
+    size_t	count;		/* objects in use */
+};
+
+
+slab_t *
+slab_new(size_t size)
+{
+    slab_t * s;
+    size_t n;
+
+    s = safe_calloc(1, sizeof(slab_t));
+    s->size = (size + 7) & ~(size_t) 7;
+    if (s->size < sizeof(void *))
+	s->size = sizeof(void *);
+
+    n = (SLAB_CHUNK - SLAB_HDR) / s->size;
+    if (n < SLAB_MIN_OBJS)
+	n = SLAB_MIN_OBJS;
+    s->chunk_size = SLAB_HDR + n * s->size;
+    return s;
+}
+
+
+/*
+ * -- slab_alloc
+ *
+ * return a zeroed object
+ */
+void *
+slab_alloc(slab_t * s)
+{
+    void * p;
+
+    if (s->free != NULL) {
+	p = s->free;
+	s->free = *(void **) p;
+    } else {
+	if (s->cur == NULL || s->cur + s->size > s->end) {
+	    char * c = safe_malloc(s->chunk_size);
+
+	    *(char **) c = s->chunks;
+	    s->chunks = c;
+	    s->nchunks++;
+	    s->cur = c + SLAB_HDR;
+	    s->end = c + s->chunk_size;
+	}
+	p = s->cur;
+	s->cur += s->size;
+    }
+
+    s->count++;
+    memset(p, 0, s->size);
+    return p;
+}
+
+
+void
+slab_free(slab_t * s, void * p)
+{
+    *(void **) p = s->free;
+    s->free = p;
+    s->count--;
+}
+
+
+/*
+ * -- slab_clear
+ *
+ * free all the objects at once. the most recent chunk is kept 
+ * so that a module that empties its table at every interval 
+ * does not go back to malloc for the first records.
+ */
+void
+slab_clear(slab_t * s)
+{
+    char * c, * next;
+
+    if (s->chunks == NULL)
+	return;
+
+    for (c = *(char **) s->chunks; c != NULL; c = next) {
+	next = *(char **) c;
+	free(c);
+    }
+    *(char **) s->chunks = NULL;
+    s->nchunks = 1;
+    s->cur = s->chunks + SLAB_HDR;
+    s->end = s->chunks + s->chunk_size;
+    s->free = NULL;
+    s->count = 0;
+}
+
+
+void
+slab_destroy(slab_t * s)
+{
+    char * c, * next;
+
+    for (c = s->chunks; c != NULL; c = next) {
+	next = *(char **) c;
+	free(c);
+    }
+    free(s);
+}
+
+
+/*
+ * -- slab_usage
+ *
+ * memory held by the slab
+ */
+size_t
+slab_usage(slab_t * s)
+{
+    return sizeof(slab_t) + (size_t) s->nchunks * s->chunk_size;
+}
+
+
+/*
+ * -- slab_count
+ *
+ * objects in use
+ */
+size_t
+slab_count(slab_t * s)
+{
+    return s->count;
+}
@@ -32,7 +32,9 @@
 
 
 #include <sys/types.h>
+#include <stdlib.h>
 #include <string.h>
+#include <glob.h>
 #include <assert.h>
 #include "como.h"
 #include "comofunc.h"
@@ -40,6 +42,9 @@
 
 #include "sniffers-list.h"
 
+/* global state */
+extern struct _como map;
+
 sniffer_cb_t *
 sniffer_cb_lookup(const char *name)
 {
@@ -53,6 +58,36 @@ sniffer_cb_lookup(const char *name)
     return NULL;
 }
 
+
+/*
+ * -- sniffer_shard_files
+ * 
+ * keep only the slice of a list of trace files that is processed 
+ * by this shard (see shard.c). the files are split in contiguous 
+ * slices so that each shard processes a contiguous time interval. 
+ * the names of the files left out are freed so that the list can 
+ * still be released with globfree(). 
+ */
+void
+sniffer_shard_files(glob_t * files)
+{
+    size_t first, last, i; 
+
+    if (map.shard == 0) 
+	return;
+
+    first = (map.shard - 1) * files->gl_pathc / map.shards; 
+    last = map.shard * files->gl_pathc / map.shards; 
+    for (i = 0; i < first; i++) 
+	free(files->gl_pathv[i]); 
+    for (i = last; i < files->gl_pathc; i++) 
+	free(files->gl_pathv[i]); 
+    memmove(files->gl_pathv, files->gl_pathv + first, 
+	    (last - first) * sizeof(char *)); 
+    files->gl_pathv[last - first] = NULL; 
+    files->gl_pathc = last - first; 
+}
+
 /* 
  * this file includes some inline helper functions to be 
  * shared among all sniffers. 
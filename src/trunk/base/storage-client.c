@@ -63,6 +63,14 @@ four methods, and provides an mmap-like interface.
 	Flushes any unmapped block, and returns a new one.
 	Returns a pointer to the mapped region.
 
+	The size of the region mapped is larger than requested and 
+	adapts to the access pattern: it doubles every time the 
+	request continues the current region (sequential scans) up 
+	to a whole file (CS_MAXWRITESIZE for the writer) and goes back 
+	to CS_OPTIMALSIZE otherwise. Readers also keep the last 
+	CS_WINDOWS regions of the current file mapped so that going 
+	back and forth in a file does not require a new mmap. 
+
   off_t csseek(int fd, csmethod_t where)
 
 	fd		is the file descriptor
@@ -95,6 +103,23 @@ four methods, and provides an mmap-like interface.
 #include "storage.h"
 #include "ipc.h"
 
+/* global state */
+extern struct _como map;
+
+#define CS_WINDOWS	4	/* regions kept mapped by a reader */
+
+/*
+ * Mapped region. Readers keep the regions they move away from 
+ * in a small cache (only regions of the current file are reused). 
+ */
+typedef struct { 
+    void * addr; 		/* address of memory mapped block */
+    size_t size; 		/* size of memory mapped block */
+    off_t offset; 		/* bytestream offset of the mapped block */
+    off_t off_file; 		/* start offset of the file */
+    uint32_t used; 		/* last use (for LRU replacement) */
+} cswin_t;
+
 /* 
  * Client-side file descriptor 
  * 
@@ -116,6 +141,9 @@ typedef struct {
     off_t offset; 		/* bytestream offset of the mapped block */
     off_t readofs; 		/* currently read offset (used by csreadp) */
     off_t readsz; 		/* currently read size (used by csreadp) */
+    size_t winsize; 		/* size of the next mapped block */
+    uint32_t clock; 		/* counter for LRU replacement */
+    cswin_t win[CS_WINDOWS];	/* old mapped blocks (readers only) */
 } csfile_t;
 
 
@@ -179,6 +207,7 @@ csopen(const char * name, int mode, off_t size)
      */
     cf = safe_calloc(1, sizeof(csfile_t)); 
     cf->fd = -1; 
+    cf->winsize = CS_OPTIMALSIZE; 
     cf->name = strdup(name);
     cf->mode = mode;
     cf->id = in->id;
@@ -219,6 +248,81 @@ _csinform(csfile_t * cf, off_t ofs)
 }
 
 
+/* 
+ * -- _csretire
+ * 
+ * the current block is not needed anymore. writers unmap it, 
+ * readers move it to the cache of old blocks replacing the least 
+ * recently used one. 
+ *
+ */
+static void
+_csretire(csfile_t * cf) 
+{
+    cswin_t * w; 
+    int i; 
+
+    if (cf->addr == NULL) 
+	return; 
+
+    if (cf->mode == CS_WRITER) { 
+	munmap(cf->addr, cf->size); 
+    } else { 
+	w = &cf->win[0]; 
+	for (i = 1; i < CS_WINDOWS && w->addr != NULL; i++) { 
+	    if (cf->win[i].addr == NULL || cf->win[i].used < w->used) 
+		w = &cf->win[i]; 
+	} 
+	if (w->addr != NULL) 
+	    munmap(w->addr, w->size); 
+	w->addr = cf->addr; 
+	w->size = cf->size; 
+	w->offset = cf->offset; 
+	w->off_file = cf->off_file; 
+	w->used = cf->clock++; 
+    } 
+
+    cf->addr = NULL; 
+    cf->size = 0; 
+}
+
+
+/* 
+ * -- _cslookup
+ * 
+ * look for a block that contains the requested region in the 
+ * cache of old blocks. if found, the block becomes the current 
+ * one and the current one goes to the cache. 
+ *
+ */
+static void * 
+_cslookup(csfile_t * cf, off_t ofs, ssize_t sz) 
+{
+    cswin_t tmp, * w; 
+    int i; 
+
+    for (i = 0, w = cf->win; i < CS_WINDOWS; i++, w++) { 
+	if (w->addr == NULL || w->off_file != cf->off_file) 
+	    continue; 
+	if (ofs >= w->offset && ofs + sz <= w->offset + (off_t) w->size) 
+	    break; 
+    } 
+    if (i == CS_WINDOWS) 
+	return NULL; 
+
+    tmp = *w; 
+    w->addr = cf->addr; 
+    w->size = cf->size; 
+    w->offset = cf->offset; 
+    w->off_file = cf->off_file; 
+    w->used = cf->clock++; 
+    cf->addr = tmp.addr; 
+    cf->size = tmp.size; 
+    cf->offset = tmp.offset; 
+    return (cf->addr + (ofs - cf->offset)); 
+}
+
+
 /* 
  * -- _csmap
  * 
@@ -244,7 +348,7 @@ _csmap(int fd, off_t ofs, ssize_t * sz, int method, int arg)
 {
     csfile_t * cf;
     csmsg_t out, *in;
-    int flags;
+    int flags, mflags;
     int diff;
     size_t m_sz;
     ipctype_t ret;
@@ -278,10 +382,9 @@ _csmap(int fd, off_t ofs, ssize_t * sz, int method, int arg)
     case IPC_ACK: 
 	/* 
 	 * The server acknowledged our request,
-	 * unmap the current block (both for csmap and csseek)
+	 * retire the current block (both for csmap and csseek)
 	 */
-	if (cf->addr)
-	    munmap(cf->addr, cf->size);
+	_csretire(cf); 
 
 	if (method == S_REGION) {
 	    /* 
@@ -290,6 +393,7 @@ _csmap(int fd, off_t ofs, ssize_t * sz, int method, int arg)
 	     */
 	    if (in->size == 0) { 
 		close(cf->fd);
+		cf->fd = -1;
 		*sz = 0;
 		return NULL;
 	    }
@@ -349,11 +453,37 @@ _csmap(int fd, off_t ofs, ssize_t * sz, int method, int arg)
     cf->offset -= diff; 
     cf->size += diff; 
 
-    cf->addr = mmap(0, cf->size, flags, MAP_NOSYNC|MAP_SHARED, 
+    /* 
+     * the writer is going to fill the whole block, prefault it 
+     * instead of taking one page fault at a time. 
+     */
+    mflags = MAP_NOSYNC|MAP_SHARED; 
+#ifdef MAP_POPULATE
+    if (cf->mode == CS_WRITER) 
+	mflags |= MAP_POPULATE; 
+#endif
+
+    cf->addr = mmap(0, cf->size, flags, mflags, 
 	cf->fd, cf->offset - cf->off_file);
     if (cf->addr == MAP_FAILED || cf->addr == NULL)
         panic("mmap got NULL (%s)\n", strerror(errno)); 
 
+    /* 
+     * large blocks are the result of sequential scans. tell the 
+     * kernel to read ahead and to use large pages if it can. 
+     */
+    if (cf->size > CS_OPTIMALSIZE) { 
+#ifdef MADV_SEQUENTIAL
+	madvise(cf->addr, cf->size, MADV_SEQUENTIAL); 
+#endif
+#ifdef MADV_HUGEPAGE
+	madvise(cf->addr, cf->size, MADV_HUGEPAGE); 
+#endif
+    } 
+
+    if (map.stats != NULL) 
+	__sync_fetch_and_add(&map.stats->cs_remaps, 1); 
+
     assert(cf->addr + diff != NULL);
 
     return (cf->addr + diff);
@@ -365,7 +495,8 @@ _csmap(int fd, off_t ofs, ssize_t * sz, int method, int arg)
  * 
  * this function request to mmap a new region in the bytestream. 
  * it first checks if the input parameters are correct. then it 
- * checks if the region requested is already mmapped. if so, it 
+ * checks if the region requested is already mmapped (in the current 
+ * block or, for readers, in one of the old ones). if so, it 
  * informs of the request the storage server only if this is a 
  * writer. 
  * 
@@ -376,15 +507,21 @@ csmap(int fd, off_t ofs, ssize_t * sz)
 {
     csfile_t * cf;
     ssize_t newsz; 
+    size_t maxsz; 
     void * addr; 
 
     assert(fd >= 0 && fd < CS_MAXCLIENTS && files[fd] != NULL); 
     cf = files[fd];
 
+    /* all the processes using STORAGE share the stats */
+    if (map.stats != NULL) 
+	__sync_fetch_and_add(&map.stats->cs_maps, 1); 
+
     /* 
      * check if we already have mmapped the requested region. 
      */
-    if (ofs > cf->offset && ofs + *sz <= cf->offset + cf->size) { 
+    if (cf->addr != NULL && ofs > cf->offset && 
+	    ofs + *sz <= cf->offset + cf->size) { 
         logmsg(V_LOGSTORAGE, 
 	    "ofs %lld sz %d silently approved (%lld:%d)\n", 
             ofs, *sz, cf->offset, cf->size); 
@@ -392,13 +529,33 @@ csmap(int fd, off_t ofs, ssize_t * sz)
         return (cf->addr + (ofs - cf->offset));
     } 
 
+    if (cf->mode != CS_WRITER) { 
+	addr = _cslookup(cf, ofs, *sz); 
+	if (addr != NULL) 
+	    return addr; 
+    } 
+
+    /* 
+     * size the new block. if the request continues the current 
+     * block we are scanning the bytestream and double the block, 
+     * otherwise go back to the default size. 
+     */
+    maxsz = (cf->mode == CS_WRITER)? CS_MAXWRITESIZE : map.maxfilesize; 
+    if (cf->addr != NULL && ofs >= cf->offset && 
+	    ofs <= cf->offset + (off_t) cf->size) { 
+	if (cf->winsize < maxsz) 
+	    cf->winsize *= 2; 
+    } else { 
+	cf->winsize = CS_OPTIMALSIZE; 
+    } 
+
     /* 
      * inflate the block size if too small. this will help answering
      * future requests. however do not tell anything to the caller. 
      * we change *sz only if the storage process cannot handle the 
      * requested size; 
      */
-    newsz = (*sz < CS_OPTIMALSIZE)? CS_OPTIMALSIZE : *sz; 
+    newsz = (*sz < (ssize_t) cf->winsize)? (ssize_t) cf->winsize : *sz; 
     addr = _csmap(fd, ofs, &newsz, S_REGION, 0);
     if (newsz < *sz) 
 	*sz = newsz; 
@@ -504,14 +661,19 @@ csclose(int fd, off_t ofs)
 {
     csfile_t * cf;
     csmsg_t m;
+    int i;
 
     assert(fd >= 0 && fd < CS_MAXCLIENTS && files[fd] != NULL); 
     cf = files[fd];
     files[fd] = NULL;
 
-    /* unmap the current block and close the file, if any */
+    /* unmap the current and old blocks and close the file, if any */
     if (cf->addr != NULL)
 	munmap(cf->addr, cf->size);
+    for (i = 0; i < CS_WINDOWS; i++) { 
+	if (cf->win[i].addr != NULL) 
+	    munmap(cf->win[i].addr, cf->win[i].size); 
+    } 
     if (cf->fd >= 0)
 	close(cf->fd); 
 
@@ -1533,7 +1533,13 @@ static void
 st_ipc_exit(procname_t sender, __attribute__((__unused__)) void * buf,
              __attribute__((__unused__)) size_t len)
 {
+    csbytestream_t * bs; 
+
     assert(sender == map.parent);  
+
+    /* close and truncate the files of the writers that are gone */
+    for (bs = cs_state.bs; bs != NULL; bs = bs->next) 
+	flush_wb(bs); 
     exit(EXIT_SUCCESS); 
 }
 
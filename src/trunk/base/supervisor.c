@@ -131,6 +131,87 @@ su_ipc_record(__attribute__((__unused__)) procname_t sender, void * buf,
 }
 
 
+/*
+ * -- write_stats
+ *
+ * write the statistic counters to map.stats_file, in JSON. this is
+ * used by como-bench to collect the results of a run. cycles are
+ * taken from the callback histograms (see cbhist.c) and divided by
+ * the number of packets CAPTURE has processed.
+ */
+static void
+write_stats(void)
+{
+    struct timeval now;
+    FILE * f;
+    double elapsed, lag;
+    uint64_t pkts;
+    int idx, cb, first;
+
+    f = fopen(map.stats_file, "w");
+    if (f == NULL) {
+	logmsg(LOGWARN, "cannot write %s: %s\n", map.stats_file,
+	       strerror(errno));
+	return;
+    }
+
+    gettimeofday(&now, NULL);
+    elapsed = (now.tv_sec - map.stats->start.tv_sec) +
+	      (now.tv_usec - map.stats->start.tv_usec) / 1e6;
+    lag = 0;
+    if (map.stats->ca_done.tv_sec != 0)
+	lag = (now.tv_sec - map.stats->ca_done.tv_sec) +
+	      (now.tv_usec - map.stats->ca_done.tv_usec) / 1e6;
+    pkts = map.stats->pkts;
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"pkts\": %llu,\n", (unsigned long long) pkts);
+    fprintf(f, "  \"drops\": %d,\n", map.stats->drops);
+    fprintf(f, "  \"elapsed\": %.6f,\n", elapsed);
+    fprintf(f, "  \"pkts_per_sec\": %.1f,\n",
+	    elapsed > 0 ? pkts / elapsed : 0);
+    fprintf(f, "  \"export_lag\": %.6f,\n", lag);
+    fprintf(f, "  \"table_queue_peak\": %d,\n",
+	    map.stats->table_queue_peak);
+    fprintf(f, "  \"mem_peak\": %u,\n", map.stats->mem_usage_peak);
+    fprintf(f, "  \"modules\": [");
+
+    first = 1;
+    for (idx = 0; idx <= map.module_last; idx++) {
+	module_t * mdl = &map.modules[idx];
+	uint64_t stage[2] = { 0, 0 };
+
+	if (mdl->status == MDL_UNUSED || mdl->running == RUNNING_ON_DEMAND)
+	    continue;
+
+	fprintf(f, "%s\n    { \"name\": \"%s\", \"cycles_per_pkt\": {",
+		first ? "" : ",", mdl->name);
+	first = 0;
+
+	for (cb = 0; cb < CB_MAX; cb++) {
+	    cbhist_t * h = cbhist_get(map.stats, mdl, cb);
+	    uint64_t total = (h != NULL)? h->total : 0;
+
+	    /* check..flush run in CAPTURE, export..store in EXPORT */
+	    if (cb <= CB_FLUSH)
+		stage[0] += total;
+	    else if (cb <= CB_STORE)
+		stage[1] += total;
+	    fprintf(f, "%s\"%s\": %.1f", cb ? ", " : "", cbhist_name(cb),
+		    pkts ? (double) total / pkts : 0);
+	}
+
+	fprintf(f, " }, \"capture_cycles_per_pkt\": %.1f, "
+		"\"export_cycles_per_pkt\": %.1f }",
+		pkts ? (double) stage[0] / pkts : 0,
+		pkts ? (double) stage[1] / pkts : 0);
+    }
+
+    fprintf(f, "\n  ]\n}\n");
+    fclose(f);
+}
+
+
 /*  
  * -- su_ipc_done 
  * 
@@ -145,6 +226,9 @@ su_ipc_done(__attribute__((__unused__)) procname_t sender,
 	__attribute__((__unused__)) void * b,
         __attribute__((__unused__)) size_t l)
 {
+    if (map.stats_file != NULL) 
+	write_stats();
+
     ipc_send(CAPTURE, IPC_EXIT, NULL, 0); 
     ipc_send(EXPORT, IPC_EXIT, NULL, 0); 
     ipc_send(STORAGE, IPC_EXIT, NULL, 0); 
@@ -266,6 +350,10 @@ apply_map_changes(struct _como * x)
 	    continue;
 	} 
 
+	/* the slot may have been used by a removed module */
+	cbhist_reset(map.stats, mdl);
+	pmc_reset(map.stats, mdl);
+
 	/* if this module is not running on demand, initialize it. 
 	 * however, before doing so freeze CAPTURE to avoid conflicts 
          * in the shared memory
@@ -374,9 +462,10 @@ supervisor_mainloop(int accept_fd)
     /* 
      * create sockets and accept connections from the outside world. 
      * they are queries that can be destined to any of the virtual nodes. 
+     * shards (see shard.c) do not answer queries. 
      */
     external_fd = safe_calloc(map.node_count, sizeof(int));
-    for (i = 0; i < map.node_count; i++) { 
+    for (i = 0; i < map.node_count && map.shard == 0; i++) { 
 	char *buf;
 
 	asprintf(&buf, "S:http://%s:%d/", map.node[i].query_address,
@@ -38,25 +38,7 @@
 #include <sys/types.h>
 
 #include "como.h"
-
-/* 
- * -- rdtsc()
- * 
- * read the timestamp counter (TSC) and return its value (64 bit)
- * 
- */
-static __inline__ uint64_t
-rdtsc(void)
-{
-    u_int64_t rv;
-#ifdef BUILD_FOR_ARM 
-    rv = 0; 
-#else
-    __asm __volatile(".byte 0x0f, 0x31" : "=A" (rv));
-#endif
-    return (rv);
-}
-
+#include "comopriv.h"	/* rdtsc */
 
 /* 
  * -- new_tsctimer()
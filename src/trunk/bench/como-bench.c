@@ -0,0 +1,627 @@
+/*
+ * Copyright (c) 2004-2006, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * como-bench
+ *
+ * End-to-end benchmark of the CoMo pipeline. It generates a trace
+ * from a traffic profile and a seed (the same profile and seed always
+ * give the same packets), runs the real process tree on it with the
+ * given set of modules and reports the results in JSON:
+ *
+ *   . packets per second and cycles per packet of each module in
+ *     CAPTURE and EXPORT (from the statistics written by como with
+ *     the "stats-file" option, see supervisor.c);
+ *   . peak shared memory usage and peak capture->export table queue;
+ *   . export lag, i.e. how long EXPORT took after CAPTURE was done;
+ *   . bytes written by STORAGE.
+ *
+ * Usage:
+ *   como-bench [-c como] [-L libdir] [-P profile] [-n packets]
+ *              [-f flows] [-s seed] [-r rate] [-S snaplen] [-m memsize]
+ *              [-p query-port] [-t trace] [-o output] [-H] [-k]
+ *              [module[,module ...]]
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <errno.h>
+#include <err.h>
+#include <math.h>
+
+#define DEFAULT_MODULES		"traffic,tuple,topaddr"
+#define DEFAULT_PACKETS		1000000
+#define DEFAULT_SNAPLEN		128
+#define DEFAULT_RATE		100000		/* packets per second */
+#define EXIT_TIMEOUT		30		/* secs to wait for como */
+
+#define PCAP_MAGIC		0xa1b2c3d4
+#define LINKTYPE_EN10MB		1
+
+/*
+ * Traffic profiles. Flows are picked with a Zipf distribution of
+ * parameter zipf. Packet sizes are picked among sizes[] with the
+ * given weights. A fraction scan of the packets is a SYN scan
+ * from one source to random destinations.
+ */
+typedef struct profile {
+    const char *	name;
+    int			tcp;		/* percentage of TCP flows */
+    int			udp;		/* percentage of UDP flows */
+    const uint16_t *	ports;		/* server ports (0 terminated) */
+    int			sizes[4];	/* packet sizes (wire) */
+    int			weights[4];	/* weights of the sizes */
+    double		zipf;		/* Zipf parameter */
+    int			scan;		/* percentage of scan packets */
+} profile_t;
+
+static const uint16_t web_ports[] = { 80, 443, 8080, 0 };
+static const uint16_t dns_ports[] = { 53, 0 };
+static const uint16_t mix_ports[] = { 80, 443, 53, 25, 22, 110, 123, 0 };
+
+static profile_t profiles[] = {
+    { "web",  90,  8, web_ports, { 64, 576, 1500, 0 }, { 4, 2, 4, 0 },
+      1.0,  0 },
+    { "dns",   5, 95, dns_ports, { 80, 120, 300, 0 },  { 5, 3, 2, 0 },
+      0.8,  0 },
+    { "mix",  60, 35, mix_ports, { 64, 576, 1500, 0 }, { 7, 4, 1, 0 },
+      1.0,  0 },
+    { "scan", 60, 35, mix_ports, { 64, 576, 1500, 0 }, { 7, 4, 1, 0 },
+      1.0, 50 },
+    { NULL,    0,  0, NULL,      { 0, 0, 0, 0 },       { 0, 0, 0, 0 },
+      0.0,  0 }
+};
+
+typedef struct flow {
+    uint32_t	src_ip;
+    uint32_t	dst_ip;
+    uint16_t	src_port;
+    uint16_t	dst_port;
+    uint8_t	proto;
+} flow_t;
+
+/* PRNG state (xorshift64*) */
+static uint64_t rnd_state;
+
+static uint64_t
+rnd(void)
+{
+    rnd_state ^= rnd_state >> 12;
+    rnd_state ^= rnd_state << 25;
+    rnd_state ^= rnd_state >> 27;
+    return rnd_state * 0x2545F4914F6CDD1DULL;
+}
+
+static double
+rnd_double(void)
+{
+    return (rnd() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+/*
+ * -- ip_cksum
+ *
+ */
+static uint16_t
+ip_cksum(const uint8_t * p, int len)
+{
+    uint32_t sum = 0;
+    int i;
+
+    for (i = 0; i < len; i += 2)
+	sum += (p[i] << 8) | p[i + 1];
+    while (sum >> 16)
+	sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t) ~sum;
+}
+
+static void
+put16(uint8_t * p, uint16_t x)
+{
+    p[0] = x >> 8;
+    p[1] = x & 0xff;
+}
+
+static void
+put32(uint8_t * p, uint32_t x)
+{
+    p[0] = x >> 24;
+    p[1] = (x >> 16) & 0xff;
+    p[2] = (x >> 8) & 0xff;
+    p[3] = x & 0xff;
+}
+
+
+/*
+ * -- write_packet
+ *
+ * write one Ethernet/IPv4 packet of the given flow to the trace.
+ * only the first snaplen bytes are written, the payload is zero.
+ */
+static void
+write_packet(FILE * f, flow_t * fl, int len, int snaplen, uint8_t flags,
+	     uint64_t usecs)
+{
+    uint8_t pkt[1514];
+    uint32_t hdr[4];
+    int l4len, caplen;
+
+    memset(pkt, 0, sizeof(pkt));
+    if (len > 1514)
+	len = 1514;
+
+    /* ethernet */
+    pkt[0] = 0x02; pkt[5] = 0x01;
+    pkt[6] = 0x02; pkt[11] = 0x02;
+    put16(pkt + 12, 0x0800);
+
+    /* ipv4 */
+    l4len = (fl->proto == 6)? 20 : 8;
+    if (len < 14 + 20 + l4len)
+	len = 14 + 20 + l4len;
+    pkt[14] = 0x45;
+    put16(pkt + 16, len - 14);
+    pkt[22] = 64;
+    pkt[23] = fl->proto;
+    put32(pkt + 26, fl->src_ip);
+    put32(pkt + 30, fl->dst_ip);
+    put16(pkt + 24, ip_cksum(pkt + 14, 20));
+
+    /* tcp or udp */
+    put16(pkt + 34, fl->src_port);
+    put16(pkt + 36, fl->dst_port);
+    if (fl->proto == 6) {
+	pkt[46] = 0x50;
+	pkt[47] = flags;
+	put16(pkt + 48, 65535);
+    } else {
+	put16(pkt + 38, len - 34);
+    }
+
+    caplen = (len < snaplen)? len : snaplen;
+    hdr[0] = (uint32_t) (usecs / 1000000);
+    hdr[1] = (uint32_t) (usecs % 1000000);
+    hdr[2] = caplen;
+    hdr[3] = len;
+    if (fwrite(hdr, sizeof(hdr), 1, f) != 1 ||
+	fwrite(pkt, caplen, 1, f) != 1)
+	err(EXIT_FAILURE, "writing trace");
+}
+
+
+/*
+ * -- generate_trace
+ *
+ * write a trace of n packets following profile p. returns the
+ * size of the file.
+ */
+static off_t
+generate_trace(const char * path, profile_t * p, uint64_t seed, int n,
+	       int nflows, int snaplen, int rate)
+{
+    uint32_t filehdr[6];
+    flow_t * flows;
+    double * cdf;
+    double sum;
+    FILE * f;
+    int i, w, wsum;
+    struct stat st;
+
+    rnd_state = seed ? seed : 1;
+
+    /* the flows and their popularity */
+    flows = calloc(nflows, sizeof(flow_t));
+    cdf = calloc(nflows, sizeof(double));
+    if (flows == NULL || cdf == NULL)
+	err(EXIT_FAILURE, "allocating %d flows", nflows);
+
+    sum = 0;
+    for (i = 0; i < nflows; i++) {
+	flow_t * fl = &flows[i];
+	int x = rnd() % 100;
+	int np;
+
+	fl->proto = (x < p->tcp)? 6 : (x < p->tcp + p->udp)? 17 : 1;
+	fl->src_ip = 0x0a000000 | (rnd() & 0xffffff);		/* 10/8 */
+	fl->dst_ip = 0xc0a80000 | (rnd() & 0xffff);		/* 192.168/16 */
+	for (np = 0; p->ports[np] != 0; np++)
+	    ;
+	fl->src_port = 1024 + rnd() % 64000;
+	fl->dst_port = p->ports[rnd() % np];
+	sum += 1.0 / pow(i + 1, p->zipf);
+	cdf[i] = sum;
+    }
+    for (i = 0; i < nflows; i++)
+	cdf[i] /= sum;
+
+    for (wsum = 0, w = 0; w < 4; w++)
+	wsum += p->weights[w];
+
+    f = fopen(path, "w");
+    if (f == NULL)
+	err(EXIT_FAILURE, "creating %s", path);
+
+    filehdr[0] = PCAP_MAGIC;
+    filehdr[1] = 2 | (4 << 16);		/* version 2.4 */
+    filehdr[2] = 0;
+    filehdr[3] = 0;
+    filehdr[4] = snaplen;
+    filehdr[5] = LINKTYPE_EN10MB;
+    if (fwrite(filehdr, sizeof(filehdr), 1, f) != 1)
+	err(EXIT_FAILURE, "writing %s", path);
+
+    for (i = 0; i < n; i++) {
+	uint64_t usecs = 1200000000ULL * 1000000 + (uint64_t) i * 1000000 / rate;
+	flow_t scan, * fl;
+	int len, lo, hi;
+
+	if (p->scan && (int) (rnd() % 100) < p->scan) {
+	    /* SYN scan from a single source */
+	    scan.proto = 6;
+	    scan.src_ip = 0xac100001;				/* 172.16.0.1 */
+	    scan.dst_ip = 0xc0a80000 | (rnd() & 0xffff);
+	    scan.src_port = 40000;
+	    scan.dst_port = 1 + rnd() % 1024;
+	    write_packet(f, &scan, 60, snaplen, 0x02, usecs);
+	    continue;
+	}
+
+	/* pick a flow with binary search on the cdf */
+	{
+	    double u = rnd_double();
+
+	    lo = 0;
+	    hi = nflows - 1;
+	    while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (cdf[mid] < u)
+		    lo = mid + 1;
+		else
+		    hi = mid;
+	    }
+	    fl = &flows[lo];
+	}
+
+	/* pick a size */
+	w = rnd() % wsum;
+	for (hi = 0; w >= p->weights[hi]; hi++)
+	    w -= p->weights[hi];
+	len = p->sizes[hi];
+
+	write_packet(f, fl, len, snaplen, 0x10, usecs);
+    }
+
+    fclose(f);
+    free(flows);
+    free(cdf);
+
+    if (stat(path, &st) < 0)
+	err(EXIT_FAILURE, "stat %s", path);
+    return st.st_size;
+}
+
+
+/*
+ * nftw() callbacks to measure and remove a directory
+ */
+static off_t du_bytes;
+
+static int
+du_fn(__attribute__((__unused__)) const char * path, const struct stat * st,
+      int type, __attribute__((__unused__)) struct FTW * ftw)
+{
+    if (type == FTW_F)
+	du_bytes += st->st_size;
+    return 0;
+}
+
+static int
+rm_fn(const char * path, __attribute__((__unused__)) const struct stat * st,
+      __attribute__((__unused__)) int type,
+      __attribute__((__unused__)) struct FTW * ftw)
+{
+    return remove(path);
+}
+
+
+/*
+ * -- write_config
+ *
+ */
+static void
+write_config(const char * path, const char * dir, const char * libdir,
+	     const char * trace, char * modules, int memsize, int port,
+	     int perf)
+{
+    FILE * f;
+    char * m;
+
+    f = fopen(path, "w");
+    if (f == NULL)
+	err(EXIT_FAILURE, "creating %s", path);
+
+    fprintf(f, "# generated by como-bench\n");
+    fprintf(f, "db-path\t\t\"%s/db\"\n", dir);
+    if (libdir != NULL)
+	fprintf(f, "librarydir\t\"%s\"\n", libdir);
+    fprintf(f, "memsize\t\t%d\n", memsize);
+    if (port > 0)
+	fprintf(f, "query-port\t%d\n", port);
+    fprintf(f, "stats-file\t\"%s/stats.json\"\n", dir);
+    if (perf)
+	fprintf(f, "perf-counters\ton\n");
+    fprintf(f, "sniffer\t\t\"pcap\" \"%s\"\n", trace);
+
+    for (m = strtok(modules, ","); m != NULL; m = strtok(NULL, ","))
+	fprintf(f, "module \"%s\"\nend\n", m);
+
+    fclose(f);
+}
+
+
+/*
+ * -- run_como
+ *
+ * run como on the configuration file and wait for all its processes
+ * to terminate. returns the exit status of the supervisor.
+ */
+static int
+run_como(const char * como, const char * cfg, const char * log)
+{
+    pid_t pid;
+    int status, i;
+
+    pid = fork();
+    if (pid < 0)
+	err(EXIT_FAILURE, "fork");
+
+    if (pid == 0) {
+	int fd;
+
+	/* a process group of its own, to wait for all of them */
+	setpgid(0, 0);
+	fd = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd >= 0) {
+	    dup2(fd, STDOUT_FILENO);
+	    dup2(fd, STDERR_FILENO);
+	    close(fd);
+	}
+	execl(como, como, "-q", "-e", "-c", cfg, (char *) NULL);
+	err(EXIT_FAILURE, "exec %s", como);
+    }
+
+    setpgid(pid, pid);
+    if (waitpid(pid, &status, 0) < 0)
+	err(EXIT_FAILURE, "waitpid");
+
+    /* the children exit when they get IPC_EXIT, give them some time */
+    for (i = 0; i < EXIT_TIMEOUT * 100 && kill(-pid, 0) == 0; i++)
+	usleep(10000);
+    if (kill(-pid, 0) == 0) {
+	warnx("como processes still running, killing them");
+	kill(-pid, SIGKILL);
+    }
+
+    return WIFEXITED(status)? WEXITSTATUS(status) : -1;
+}
+
+
+/*
+ * -- copy_file
+ *
+ * copy the content of a file to f (used to embed the como stats)
+ */
+static int
+copy_file(const char * path, FILE * f)
+{
+    char buf[4096];
+    FILE * in;
+    size_t n;
+
+    in = fopen(path, "r");
+    if (in == NULL)
+	return -1;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+	fwrite(buf, 1, n, f);
+    fclose(in);
+    return 0;
+}
+
+
+int
+main(int argc, char ** argv)
+{
+    static const char * usage =
+	"usage: %s [-c como] [-L libdir] [-P profile] [-n packets]\n"
+	"          [-f flows] [-s seed] [-r rate] [-S snaplen] [-m memsize]\n"
+	"          [-p query-port] [-t trace] [-o output] [-H] [-k]\n"
+	"          [module[,module ...]]\n";
+    const char * como = DEFAULT_COMO;
+    const char * libdir = BENCH_LIBDIR;
+    const char * trace = NULL;
+    const char * output = NULL;
+    char * modules;
+    char dir[] = "/tmp/como-benchXXXXXX";
+    char path[1024], cfg[1024], log[1024], stats[1024];
+    profile_t * p = &profiles[2];
+    uint64_t seed = 1;
+    int packets = DEFAULT_PACKETS;
+    int flows = 10000;
+    int rate = DEFAULT_RATE;
+    int snaplen = DEFAULT_SNAPLEN;
+    int memsize = 64;
+    int port = 0;
+    int perf = 0, keep = 0;
+    struct timeval t0, t1;
+    off_t trace_bytes;
+    double wall;
+    FILE * out;
+    int c, ret;
+
+    while ((c = getopt(argc, argv, "c:L:P:n:f:s:r:S:m:p:t:o:Hkh")) != -1) {
+	switch (c) {
+	case 'c':
+	    como = optarg;
+	    break;
+	case 'L':
+	    libdir = optarg;
+	    break;
+	case 'P':
+	    for (p = profiles; p->name != NULL; p++)
+		if (strcmp(p->name, optarg) == 0)
+		    break;
+	    if (p->name == NULL)
+		errx(EXIT_FAILURE, "unknown profile %s", optarg);
+	    break;
+	case 'n':
+	    packets = atoi(optarg);
+	    break;
+	case 'f':
+	    flows = atoi(optarg);
+	    break;
+	case 's':
+	    seed = strtoull(optarg, NULL, 0);
+	    break;
+	case 'r':
+	    rate = atoi(optarg);
+	    break;
+	case 'S':
+	    snaplen = atoi(optarg);
+	    break;
+	case 'm':
+	    memsize = atoi(optarg);
+	    break;
+	case 'p':
+	    port = atoi(optarg);
+	    break;
+	case 't':
+	    trace = optarg;
+	    break;
+	case 'o':
+	    output = optarg;
+	    break;
+	case 'H':
+	    perf = 1;
+	    break;
+	case 'k':
+	    keep = 1;
+	    break;
+	default:
+	    fprintf(stderr, usage, argv[0]);
+	    exit(EXIT_FAILURE);
+	}
+    }
+
+    if (packets < 1 || flows < 1 || rate < 1 || snaplen < 64)
+	errx(EXIT_FAILURE, "invalid packets, flows, rate or snaplen");
+
+    modules = strdup(optind < argc ? argv[optind] : DEFAULT_MODULES);
+
+    if (mkdtemp(dir) == NULL)
+	err(EXIT_FAILURE, "creating work directory");
+
+    /* the traffic */
+    if (trace == NULL) {
+	snprintf(path, sizeof(path), "%s/trace.pcap", dir);
+	trace_bytes = generate_trace(path, p, seed, packets, flows,
+				     snaplen, rate);
+	trace = path;
+    } else {
+	struct stat st;
+
+	if (stat(trace, &st) < 0)
+	    err(EXIT_FAILURE, "stat %s", trace);
+	trace_bytes = st.st_size;
+    }
+
+    snprintf(cfg, sizeof(cfg), "%s/como.conf", dir);
+    snprintf(log, sizeof(log), "%s/como.log", dir);
+    snprintf(stats, sizeof(stats), "%s/stats.json", dir);
+    out = (output != NULL)? fopen(output, "w") : stdout;
+    if (out == NULL)
+	err(EXIT_FAILURE, "creating %s", output);
+
+    /* write the header now, strtok() will consume the module list */
+    fprintf(out, "{\n");
+    fprintf(out, "  \"profile\": \"%s\",\n", trace == path ? p->name : "");
+    fprintf(out, "  \"trace\": \"%s\",\n", trace == path ? "" : trace);
+    fprintf(out, "  \"seed\": %llu,\n", (unsigned long long) seed);
+    fprintf(out, "  \"packets\": %d,\n", packets);
+    fprintf(out, "  \"flows\": %d,\n", flows);
+    fprintf(out, "  \"modules\": \"%s\",\n", modules);
+    fprintf(out, "  \"trace_bytes\": %llu,\n",
+	    (unsigned long long) trace_bytes);
+
+    write_config(cfg, dir, libdir, trace, modules, memsize, port, perf);
+
+    gettimeofday(&t0, NULL);
+    ret = run_como(como, cfg, log);
+    gettimeofday(&t1, NULL);
+    wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1e6;
+
+    /* what STORAGE has written */
+    snprintf(path, sizeof(path), "%s/db", dir);
+    du_bytes = 0;
+    nftw(path, du_fn, 16, FTW_PHYS);
+
+    fprintf(out, "  \"exit_status\": %d,\n", ret);
+    fprintf(out, "  \"wall\": %.6f,\n", wall);
+    fprintf(out, "  \"bytes_written\": %llu,\n",
+	    (unsigned long long) du_bytes);
+    fprintf(out, "  \"como\": ");
+    if (copy_file(stats, out) < 0)
+	fprintf(out, "null\n");
+    fprintf(out, "}\n");
+    if (out != stdout)
+	fclose(out);
+
+    if (ret != 0)
+	warnx("como exited with status %d, see %s", ret, log);
+
+    if (keep)
+	fprintf(stderr, "results kept in %s\n", dir);
+    else if (ret == 0)
+	nftw(dir, rm_fn, 16, FTW_DEPTH | FTW_PHYS);
+
+    return (ret == 0)? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,915 @@
+/*
+ * Copyright (c) 2004-2006, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/*
+ * como-microbench
+ *
+ * Micro-benchmarks of the data structures in lib/ and of the shared
+ * memory allocator (base/memory.c) that sit on the hot paths of
+ * CAPTURE and EXPORT:
+ *
+ *   . hash.c       insert/lookup/remove of ulong and 5-tuple keys
+ *   . flowtable.c  insert/lookup/remove at several load factors
+ *   . heap.c       insert/extract
+ *   . bitmap.c     set_bit, test_and_set_bit and estimate_unique_keys
+ *   . uhash.c      H3 hashing of keys of different length
+ *   . pattern_search.c  Boyer-Moore search throughput
+ *   . memory.c     malloc/free mixes with the record sizes of the
+ *                  modules, compared with the libc allocator
+ *
+ * Lookups are done with uniform, Zipf and sequential key
+ * distributions. All the keys are generated from the seed before
+ * the clock starts. Results are printed in JSON, one object per
+ * benchmark, so that runs can be compared when these structures
+ * are replaced.
+ *
+ * Usage:
+ *   como-microbench [-n entries] [-r rounds] [-s seed] [-m memsize]
+ *                   [-o output] [name ...]
+ *
+ * Only the benchmarks whose name starts with one of the given
+ * names are run (e.g., "hash" runs hash_ulong and hash_tuple).
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <err.h>
+
+#include "como.h"
+#include "corlib.h"
+#include "comopriv.h"
+#include "hashfn.h"
+#include "pattern_search.h"
+
+#define DEFAULT_ENTRIES		(1 << 18)
+#define DEFAULT_ROUNDS		3
+#define DEFAULT_MEMSIZE		256		/* MB */
+
+/*
+ * the lib/ and memory.c code uses the logging and process helpers
+ * of como. the benchmark is a single process, provide minimal
+ * versions of them here.
+ */
+struct _como map;
+
+char *
+getprocname(__attribute__((__unused__)) procname_t who)
+{
+    return "BENCH";
+}
+
+void
+_logmsg(__attribute__((__unused__)) const char * file,
+	__attribute__((__unused__)) int line, int flags, const char * fmt, ...)
+{
+    va_list ap;
+
+    if (!(flags & LOGWARN))
+	return;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+void
+_epanic(const char * file, int line, const char * fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "panic at %s:%d: ", file, line);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    abort();
+}
+
+void
+_epanicx(const char * file, int line, const char * fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "panic at %s:%d: ", file, line);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    abort();
+}
+
+
+/* PRNG state (xorshift64*) */
+static uint64_t rnd_state;
+
+static uint64_t
+rnd(void)
+{
+    rnd_state ^= rnd_state >> 12;
+    rnd_state ^= rnd_state << 25;
+    rnd_state ^= rnd_state >> 27;
+    return rnd_state * 0x2545F4914F6CDD1DULL;
+}
+
+static double
+rnd_double(void)
+{
+    return (rnd() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Key distributions for the lookups. Each one gives the index of
+ * the key to look up among the n inserted keys.
+ */
+typedef enum {
+    DIST_UNIFORM = 0,
+    DIST_ZIPF,
+    DIST_SEQUENTIAL,
+    DIST_MAX
+} dist_t;
+
+static const char * dist_names[] = { "uniform", "zipf", "sequential" };
+
+/*
+ * -- make_index
+ *
+ * fill idx[] with m indexes in [0, n) drawn from distribution d.
+ * Zipf uses parameter 1.0 over a random permutation of the keys,
+ * so that the popular keys are not the first inserted.
+ */
+static void
+make_index(uint32_t * idx, int m, int n, dist_t d)
+{
+    double * cdf, sum;
+    uint32_t * perm;
+    int i;
+
+    switch (d) {
+    case DIST_UNIFORM:
+	for (i = 0; i < m; i++)
+	    idx[i] = rnd() % n;
+	break;
+
+    case DIST_SEQUENTIAL:
+	for (i = 0; i < m; i++)
+	    idx[i] = i % n;
+	break;
+
+    default:
+	cdf = safe_malloc(n * sizeof(double));
+	perm = safe_malloc(n * sizeof(uint32_t));
+	sum = 0;
+	for (i = 0; i < n; i++) {
+	    sum += 1.0 / (i + 1);
+	    cdf[i] = sum;
+	    perm[i] = i;
+	}
+	for (i = n - 1; i > 0; i--) {
+	    int j = rnd() % (i + 1);
+	    uint32_t t = perm[i];
+
+	    perm[i] = perm[j];
+	    perm[j] = t;
+	}
+	for (i = 0; i < m; i++) {
+	    double x = rnd_double() * sum;
+	    int lo = 0, hi = n - 1;
+
+	    while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (cdf[mid] < x)
+		    lo = mid + 1;
+		else
+		    hi = mid;
+	    }
+	    idx[i] = perm[lo];
+	}
+	free(cdf);
+	free(perm);
+	break;
+    }
+}
+
+
+/*
+ * Output. Each result is the best (lowest) time per operation over
+ * the rounds, that is the one least disturbed by the rest of the
+ * system.
+ */
+static FILE * out;
+static int nresults;
+static int rounds = DEFAULT_ROUNDS;
+static char ** only;
+static int nonly;
+
+static int
+selected(const char * name)
+{
+    int i;
+
+    if (nonly == 0)
+	return 1;
+    for (i = 0; i < nonly; i++)
+	if (strncmp(name, only[i], strlen(only[i])) == 0)
+	    return 1;
+    return 0;
+}
+
+/*
+ * -- result
+ *
+ * print one result. ns is the total time of ops operations,
+ * bytes (if not zero) the amount of data processed.
+ */
+static void
+result(const char * name, const char * op, const char * dist, int n,
+       double load, uint64_t ops, uint64_t ns, uint64_t bytes)
+{
+    fprintf(out, "%s\n    { \"name\": \"%s\", \"op\": \"%s\", ",
+	    nresults++ ? "," : "", name, op);
+    if (dist != NULL)
+	fprintf(out, "\"dist\": \"%s\", ", dist);
+    fprintf(out, "\"n\": %d, ", n);
+    if (load > 0)
+	fprintf(out, "\"load\": %.2f, ", load);
+    fprintf(out, "\"ops\": %llu, \"ns_per_op\": %.2f, \"mops\": %.3f",
+	    (unsigned long long) ops, (double) ns / ops,
+	    ns ? ops * 1000.0 / ns : 0);
+    if (bytes > 0)
+	fprintf(out, ", \"mb_per_sec\": %.1f",
+		ns ? bytes * 1000.0 / ns : 0);
+    fprintf(out, " }");
+    fflush(out);
+}
+
+/* keep the best time over the rounds */
+#define BEST(best, t0)	do {			\
+    uint64_t _t = now_ns() - (t0);		\
+    if ((best) == 0 || _t < (best))		\
+	(best) = _t;				\
+} while (0)
+
+/* sink for lookup results, so that they are not optimized away */
+static volatile uintptr_t sink;
+
+
+/*
+ * -- bench_hash_ulong
+ *
+ * hash.c with HASHKEYS_ULONG keys (e.g., the IP addresses in
+ * topaddr). The table grows while inserting, as it does in the
+ * modules.
+ */
+static void
+bench_hash_ulong(int n)
+{
+    uint64_t t0, t_ins = 0, t_rem = 0, t_miss = 0, t_look[DIST_MAX];
+    unsigned long * keys;
+    uint32_t * idx;
+    hash_t * h;
+    int r, i, d;
+
+    keys = safe_malloc(n * sizeof(unsigned long));
+    idx = safe_malloc(n * sizeof(uint32_t));
+    for (i = 0; i < n; i++)
+	keys[i] = (unsigned long) (rnd() & 0xffffffff);
+    memset(t_look, 0, sizeof(t_look));
+
+    for (r = 0; r < rounds; r++) {
+	h = hash_new(allocator_safe(), HASHKEYS_ULONG, NULL, NULL);
+
+	t0 = now_ns();
+	for (i = 0; i < n; i++)
+	    hash_insert_ulong(h, keys[i], &keys[i]);
+	BEST(t_ins, t0);
+
+	for (d = 0; d < DIST_MAX; d++) {
+	    make_index(idx, n, n, d);
+	    t0 = now_ns();
+	    for (i = 0; i < n; i++)
+		sink += (uintptr_t) hash_lookup_ulong(h, keys[idx[i]]);
+	    BEST(t_look[d], t0);
+	}
+
+	t0 = now_ns();
+	for (i = 0; i < n; i++)
+	    sink += (uintptr_t) hash_lookup_ulong(h, keys[i] | (1ULL << 32));
+	BEST(t_miss, t0);
+
+	t0 = now_ns();
+	for (i = 0; i < n; i++)
+	    hash_remove_ulong(h, keys[i]);
+	BEST(t_rem, t0);
+
+	hash_destroy(h);
+    }
+
+    result("hash_ulong", "insert", NULL, n, 0, n, t_ins, 0);
+    for (d = 0; d < DIST_MAX; d++)
+	result("hash_ulong", "lookup", dist_names[d], n, 0, n, t_look[d], 0);
+    result("hash_ulong", "lookup_miss", NULL, n, 0, n, t_miss, 0);
+    result("hash_ulong", "remove", NULL, n, 0, n, t_rem, 0);
+
+    free(keys);
+    free(idx);
+}
+
+
+/*
+ * 5-tuple keys, as used by the flow based modules
+ */
+static unsigned int
+tuple_hash(const void * k)
+{
+    return hashfn_tuple4(0, k);
+}
+
+static int
+tuple_cmp(const void * a, const void * b)
+{
+    return memcmp(a, b, sizeof(hkey_tuple4_t));
+}
+
+static hkey_tuple4_t *
+make_tuples(int n)
+{
+    hkey_tuple4_t * keys;
+    int i;
+
+    keys = safe_calloc(n, sizeof(hkey_tuple4_t));
+    for (i = 0; i < n; i++) {
+	keys[i].src_ip = rnd();
+	keys[i].dst_ip = rnd();
+	keys[i].src_port = rnd();
+	keys[i].dst_port = rnd();
+	keys[i].proto = (rnd() & 1)? 6 : 17;
+    }
+    return keys;
+}
+
+
+/*
+ * -- bench_hash_tuple
+ *
+ * hash.c with HASHKEYS_POINTER keys and the 5-tuple hash of hashfn.h
+ */
+static void
+bench_hash_tuple(int n)
+{
+    uint64_t t0, t_ins = 0, t_rem = 0, t_look[DIST_MAX];
+    hkey_tuple4_t * keys;
+    uint32_t * idx;
+    hash_t * h;
+    int r, i, d;
+
+    keys = make_tuples(n);
+    idx = safe_malloc(n * sizeof(uint32_t));
+    memset(t_look, 0, sizeof(t_look));
+
+    for (r = 0; r < rounds; r++) {
+	h = hash_new(allocator_safe(), HASHKEYS_POINTER, tuple_hash,
+		     tuple_cmp);
+
+	t0 = now_ns();
+	for (i = 0; i < n; i++)
+	    hash_insert(h, &keys[i], &keys[i]);
+	BEST(t_ins, t0);
+
+	for (d = 0; d < DIST_MAX; d++) {
+	    make_index(idx, n, n, d);
+	    t0 = now_ns();
+	    for (i = 0; i < n; i++)
+		sink += (uintptr_t) hash_lookup(h, &keys[idx[i]]);
+	    BEST(t_look[d], t0);
+	}
+
+	t0 = now_ns();
+	for (i = 0; i < n; i++)
+	    hash_remove(h, &keys[i]);
+	BEST(t_rem, t0);
+
+	hash_destroy(h);
+    }
+
+    result("hash_tuple", "insert", NULL, n, 0, n, t_ins, 0);
+    for (d = 0; d < DIST_MAX; d++)
+	result("hash_tuple", "lookup", dist_names[d], n, 0, n, t_look[d], 0);
+    result("hash_tuple", "remove", NULL, n, 0, n, t_rem, 0);
+
+    free(keys);
+    free(idx);
+}
+
+
+/*
+ * flowtable entries. The packet passed to flowtable_lookup() is
+ * never dereferenced by flowtable.c, only by our pkt_in_flow
+ * callback, so we pass the key instead.
+ */
+typedef struct bflow {
+    flow_t		flow;
+    hkey_tuple4_t	key;
+} bflow_t;
+
+static int
+bflow_equal(const flow_t * a, const flow_t * b)
+{
+    return memcmp(&((bflow_t *) a)->key, &((bflow_t *) b)->key,
+		  sizeof(hkey_tuple4_t)) == 0;
+}
+
+static int
+bflow_match(const pkt_t * pkt, const flow_t * f)
+{
+    return memcmp(pkt, &((bflow_t *) f)->key, sizeof(hkey_tuple4_t)) == 0;
+}
+
+
+/*
+ * -- bench_flowtable
+ *
+ * flowtable.c at load factors (entries per bucket) from 0.5 to 3.
+ * The number of buckets is fixed (the largest power of 2 <= n) and
+ * the number of flows changes. The table is rebuilt only when it
+ * reaches 3 entries per bucket, so the load stays just below that.
+ */
+static void
+bench_flowtable(int n)
+{
+    static const double loads[] = { 0.5, 1, 2, 2.9 };
+    uint64_t t0, t_ins, t_rem, t_look[DIST_MAX];
+    hkey_tuple4_t * keys;
+    bflow_t * flows;
+    uint32_t * idx;
+    int buckets, l, r, i, d;
+
+    for (buckets = 1; buckets * 2 <= n; buckets <<= 1)
+	;
+
+    keys = make_tuples(3 * buckets);
+    flows = safe_calloc(3 * buckets, sizeof(bflow_t));
+    idx = safe_malloc(3 * buckets * sizeof(uint32_t));
+    for (i = 0; i < 3 * buckets; i++) {
+	flows[i].key = keys[i];
+	flows[i].flow.hash = hashfn_tuple4(0, &keys[i]);
+    }
+
+    for (l = 0; l < (int) (sizeof(loads) / sizeof(loads[0])); l++) {
+	int m = loads[l] * buckets;
+	double load = (double) m / buckets;
+
+	t_ins = t_rem = 0;
+	memset(t_look, 0, sizeof(t_look));
+
+	for (r = 0; r < rounds; r++) {
+	    flowtable_t * ft;
+
+	    ft = flowtable_new_full(allocator_safe(), buckets, bflow_equal,
+				    bflow_match, NULL);
+
+	    t0 = now_ns();
+	    for (i = 0; i < m; i++)
+		flowtable_insert(ft, &flows[i].flow);
+	    BEST(t_ins, t0);
+
+	    for (d = 0; d < DIST_MAX; d++) {
+		make_index(idx, m, m, d);
+		t0 = now_ns();
+		for (i = 0; i < m; i++) {
+		    bflow_t * f = &flows[idx[i]];
+
+		    sink += (uintptr_t) flowtable_lookup(ft, f->flow.hash,
+						(pkt_t *) &f->key);
+		}
+		BEST(t_look[d], t0);
+	    }
+
+	    t0 = now_ns();
+	    for (i = 0; i < m; i++)
+		flowtable_remove(ft, &flows[i].flow);
+	    BEST(t_rem, t0);
+
+	    flowtable_destroy(ft);
+	}
+
+	result("flowtable", "insert", NULL, m, load, m, t_ins, 0);
+	for (d = 0; d < DIST_MAX; d++)
+	    result("flowtable", "lookup", dist_names[d], m, load, m,
+		   t_look[d], 0);
+	result("flowtable", "remove", NULL, m, load, m, t_rem, 0);
+    }
+
+    free(keys);
+    free(flows);
+    free(idx);
+}
+
+
+static int
+u64_cmp(const void * a, const void * b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * -- bench_heap
+ *
+ * heap.c, starting from a small heap that grows as in topk-style
+ * modules.
+ */
+static void
+bench_heap(int n)
+{
+    uint64_t t0, t_ins = 0, t_ext = 0;
+    uint64_t * vals;
+    void * e;
+    int r, i;
+
+    vals = safe_malloc(n * sizeof(uint64_t));
+    for (i = 0; i < n; i++)
+	vals[i] = rnd();
+
+    for (r = 0; r < rounds; r++) {
+	heap_t * h = heap_init(u64_cmp, 64);
+
+	t0 = now_ns();
+	for (i = 0; i < n; i++)
+	    heap_insert(h, &vals[i]);
+	BEST(t_ins, t0);
+
+	t0 = now_ns();
+	while (heap_extract(h, &e) == 0)
+	    sink += (uintptr_t) e;
+	BEST(t_ext, t0);
+
+	heap_close(h);
+    }
+
+    result("heap", "insert", NULL, n, 0, n, t_ins, 0);
+    result("heap", "extract", NULL, n, 0, n, t_ext, 0);
+    free(vals);
+}
+
+
+/*
+ * -- bench_bitmap
+ *
+ * bitmap.c with the sizes used by flowcount-style modules. The
+ * keys are hashes, n of them with about n/4 distinct values.
+ */
+static void
+bench_bitmap(int n)
+{
+    static const int sizes[] = { 1 << 12, 1 << 16, 1 << 20 };
+    uint32_t * keys;
+    int s, r, i;
+
+    keys = safe_malloc(n * sizeof(uint32_t));
+    for (i = 0; i < n; i++)
+	keys[i] = hashfn_u32(0, rnd() % (n / 4 + 1));
+
+    for (s = 0; s < (int) (sizeof(sizes) / sizeof(sizes[0])); s++) {
+	uint64_t t0, t_set = 0, t_tas = 0, t_est = 0;
+	int nest = 16;
+
+	for (r = 0; r < rounds; r++) {
+	    bitmap_t * bm = new_bitmap(sizes[s]);
+
+	    t0 = now_ns();
+	    for (i = 0; i < n; i++)
+		set_bit(bm, keys[i]);
+	    BEST(t_set, t0);
+
+	    reset_bitmap(bm);
+	    t0 = now_ns();
+	    for (i = 0; i < n; i++)
+		sink += test_and_set_bit(bm, keys[i]);
+	    BEST(t_tas, t0);
+
+	    t0 = now_ns();
+	    for (i = 0; i < nest; i++)
+		sink += (uintptr_t) estimate_unique_keys(bm);
+	    BEST(t_est, t0);
+
+	    destroy_bitmap(bm);
+	}
+
+	result("bitmap", "set_bit", NULL, sizes[s], 0, n, t_set, 0);
+	result("bitmap", "test_and_set_bit", NULL, sizes[s], 0, n, t_tas, 0);
+	result("bitmap", "estimate", NULL, sizes[s], 0, nest, t_est, 0);
+    }
+
+    free(keys);
+}
+
+
+/*
+ * -- bench_uhash
+ *
+ * uhash.c (H3) on keys of 4 (address), 8 (address pair) and 13
+ * (5-tuple) bytes.
+ */
+static void
+bench_uhash(int n)
+{
+    static const int lens[] = { 4, 8, 13 };
+    hkey_tuple4_t * keys;
+    uhash_t * h;
+    int l, r, i;
+
+    h = safe_malloc(sizeof(uhash_t));
+    srand(rnd());
+    uhash_initialize(h);
+    keys = make_tuples(n);
+
+    for (l = 0; l < (int) (sizeof(lens) / sizeof(lens[0])); l++) {
+	uint64_t t0, t = 0;
+
+	for (r = 0; r < rounds; r++) {
+	    t0 = now_ns();
+	    for (i = 0; i < n; i++)
+		sink += uhash(h, (uint8_t *) &keys[i], lens[l], UHASH_NEW);
+	    BEST(t, t0);
+	}
+	result("uhash", "hash", NULL, lens[l], 0, n, t,
+	       (uint64_t) n * lens[l]);
+    }
+
+    free(keys);
+    free(h);
+}
+
+
+/*
+ * -- bench_pattern_search
+ *
+ * pattern_search.c on packet payloads (random bytes, so the pattern
+ * is almost never found and the whole payload is scanned).
+ */
+static void
+bench_pattern_search(int n)
+{
+    static const int lens[] = { 4, 16, 64 };
+    pattern_search_t * ps;
+    char pat[65], * buf;
+    size_t payload = 1460, sz;
+    int npkts, l, r, i;
+
+    npkts = n / 16 + 1;
+    sz = payload * npkts;
+    buf = safe_malloc(sz);
+    for (i = 0; i < (int) sz; i++)
+	buf[i] = 'a' + rnd() % 26;
+    ps = safe_malloc(sizeof(pattern_search_t));
+
+    for (l = 0; l < (int) (sizeof(lens) / sizeof(lens[0])); l++) {
+	uint64_t t0, t = 0;
+
+	for (i = 0; i < lens[l]; i++)
+	    pat[i] = 'a' + rnd() % 26;
+	pat[i] = '\0';
+	pattern_search_initialize(ps, pat);
+
+	for (r = 0; r < rounds; r++) {
+	    t0 = now_ns();
+	    for (i = 0; i < npkts; i++)
+		sink += pattern_search(ps, buf + i * payload, payload, NULL);
+	    BEST(t, t0);
+	}
+	result("pattern_search", "search", NULL, lens[l], 0, npkts, t, sz);
+    }
+
+    free(buf);
+    free(ps);
+}
+
+
+/*
+ * Record sizes of the modules, with weights that reflect how many
+ * of them are allocated per interval (flow records are many, the
+ * per-interval tables few). 
+ */
+static const struct {
+    size_t	size;
+    int		weight;
+} records[] = {
+    { 24,	4 },	/* traffic, counters */
+    { 48,	16 },	/* tuple, 5-tuple flow record */
+    { 64,	8 },	/* topaddr, topports entries */
+    { 128,	4 },	/* hash and flowtable entries, small tables */
+    { 512,	2 },	/* capture tables */
+    { 4096,	1 },	/* bitmaps, per-interval arrays */
+    { 65536,	1 },	/* large bitmaps, port arrays */
+};
+
+#define NRECORDS	((int) (sizeof(records) / sizeof(records[0])))
+
+/*
+ * -- bench_alloc
+ *
+ * malloc/free mixes with the sizes above. "fifo" frees the blocks
+ * in allocation order (flow records flushed at the end of an
+ * interval), "lifo" in reverse order and "random" in random order
+ * (flows expiring at different times). The shared memory allocator
+ * (mem_malloc) is compared with the libc one (allocator_safe).
+ */
+static void
+bench_alloc(int n)
+{
+    static const char * orders[] = { "fifo", "lifo", "random" };
+    allocator_t * alcs[2];
+    const char * names[2] = { "alloc_shared", "alloc_safe" };
+    size_t * sizes;
+    uint32_t * perm;
+    void ** ptrs;
+    int total, a, o, r, i, m;
+
+    alcs[0] = allocator_shared();
+    alcs[1] = allocator_safe();
+
+    total = 0;
+    for (i = 0; i < NRECORDS; i++)
+	total += records[i].weight;
+
+    /* keep the working set well within the shared memory */
+    m = n / 4;
+    sizes = safe_malloc(m * sizeof(size_t));
+    perm = safe_malloc(m * sizeof(uint32_t));
+    ptrs = safe_calloc(m, sizeof(void *));
+    for (i = 0; i < m; i++) {
+	int w = rnd() % total, j;
+
+	for (j = 0; w >= records[j].weight; j++)
+	    w -= records[j].weight;
+	sizes[i] = records[j].size;
+	perm[i] = i;
+    }
+    for (i = m - 1; i > 0; i--) {
+	int j = rnd() % (i + 1);
+	uint32_t t = perm[i];
+
+	perm[i] = perm[j];
+	perm[j] = t;
+    }
+
+    for (a = 0; a < 2; a++) {
+	for (o = 0; o < 3; o++) {
+	    uint64_t t0, t_mal = 0, t_free = 0;
+
+	    for (r = 0; r < rounds; r++) {
+		t0 = now_ns();
+		for (i = 0; i < m; i++) {
+		    ptrs[i] = alc_malloc(alcs[a], sizes[i]);
+		    if (ptrs[i] == NULL)
+			errx(1, "out of memory, increase -m");
+		}
+		BEST(t_mal, t0);
+
+		t0 = now_ns();
+		for (i = 0; i < m; i++) {
+		    int j = (o == 0)? i : (o == 1)? m - 1 - i : (int) perm[i];
+
+		    alc_free(alcs[a], ptrs[j]);
+		}
+		BEST(t_free, t0);
+	    }
+
+	    result(names[a], "malloc", orders[o], m, 0, m, t_mal, 0);
+	    result(names[a], "free", orders[o], m, 0, m, t_free, 0);
+	}
+    }
+
+    free(sizes);
+    free(perm);
+    free(ptrs);
+}
+
+
+static const struct {
+    const char *	name;
+    void		(*fn)(int n);
+} benchmarks[] = {
+    { "hash_ulong",	bench_hash_ulong },
+    { "hash_tuple",	bench_hash_tuple },
+    { "flowtable",	bench_flowtable },
+    { "heap",		bench_heap },
+    { "bitmap",		bench_bitmap },
+    { "uhash",		bench_uhash },
+    { "pattern_search",	bench_pattern_search },
+    { "alloc",		bench_alloc },
+    { NULL,		NULL }
+};
+
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+	"usage: como-microbench [-n entries] [-r rounds] [-s seed] "
+	"[-m memsize] [-o output] [name ...]\n");
+    exit(1);
+}
+
+int
+main(int argc, char ** argv)
+{
+    const char * output = NULL;
+    uint64_t seed = 1;
+    int n = DEFAULT_ENTRIES;
+    int memsize = DEFAULT_MEMSIZE;
+    int c, i;
+
+    while ((c = getopt(argc, argv, "n:r:s:m:o:")) != -1) {
+	switch (c) {
+	case 'n':
+	    n = atoi(optarg);
+	    break;
+	case 'r':
+	    rounds = atoi(optarg);
+	    break;
+	case 's':
+	    seed = strtoull(optarg, NULL, 0);
+	    break;
+	case 'm':
+	    memsize = atoi(optarg);
+	    break;
+	case 'o':
+	    output = optarg;
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (n < 16 || rounds < 1 || memsize < 1)
+	usage();
+    only = argv + optind;
+    nonly = argc - optind;
+
+    out = stdout;
+    if (output != NULL && (out = fopen(output, "w")) == NULL)
+	err(1, "cannot open %s", output);
+
+    memory_init(memsize);
+
+    fprintf(out, "{\n  \"seed\": %llu,\n  \"entries\": %d,\n"
+	    "  \"rounds\": %d,\n  \"results\": [",
+	    (unsigned long long) seed, n, rounds);
+
+    for (i = 0; benchmarks[i].name != NULL; i++) {
+	if (!selected(benchmarks[i].name))
+	    continue;
+	/* each benchmark starts from the same PRNG state */
+	rnd_state = seed ? seed : 1;
+	benchmarks[i].fn(n);
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout)
+	fclose(out);
+    return 0;
+}
@@ -79,7 +79,9 @@
 #sniffer	"bpf" "xl0"
 
 # pcap		- Reads packets from a trace file in tcpdump format.
-#sniffer	"pcap" "/path/to/trace"
+#		  "read" copies the file in mapsize windows instead of
+#		  mmapping them.
+#sniffer	"pcap" "/path/to/trace" "mapsize=33554432 read"
 
 # libpcap	- Captures live from a device using libpcap.
 #sniffer	"libpcap" "eth0" "snaplen=112 promisc=1 timeout=1"
@@ -105,6 +107,12 @@
 # como		- Receives packet from another CoMo node.
 #sniffer	"como" "http://como:44444/?module=trace&format=como&time=-5m:0"
 
+# synth		- Generates synthetic IPv4 traffic (Zipf flows, TCP/UDP mix,
+#		  optional "synscan" or "flood" attack) at the given rate
+#		  without any I/O. The same seed gives the same packets
+#		  and timestamps (first packet at "start", in seconds).
+#sniffer	"synth" "mix" "seed=1 flows=10000 zipf=1.0 rate=1000000 packets=10000000"
+
 # NOTE: some of them may not be present in your system.
 
 sniffer		"pcap" "@EXAMPLE_TRACE@"
@@ -146,6 +154,49 @@ sniffer		"pcap" "@EXAMPLE_TRACE@"
 
 #filesize	128MB
 
+# Set the maximum size of the cache of query results. Queries 
+# on intervals whose data will not change anymore are kept in 
+# the cache and served from there when the same query comes 
+# again. A size of 0 disables the cache. 
+# Default: 64MB
+
+#query-cache	64MB
+
+# Number of pipelines used to process trace files. With more than 
+# one shard the list of files of each sniffer is split in as many 
+# contiguous slices, each processed by its own CAPTURE and EXPORT. 
+# At the end the outputs are merged in the module bytestreams and 
+# CoMo exits. Only the pcap and erf sniffers support this. 
+# Default: 1
+
+#shards		4
+
+# Read the hardware performance counters (cycles, instructions, 
+# last level cache misses and branch misses) around the processing 
+# of each module in CAPTURE and EXPORT. The status service then 
+# reports the IPC and the misses per packet of each module. Only 
+# available on Linux (perf events). 
+# Default: off
+
+#perf-counters	on
+
+# Let the sniffers that can do it (e.g., libpcap) filter out the 
+# packets that no module wants, instead of matching them in CAPTURE. 
+# This saves copying those packets but, as they are never seen, they 
+# no longer move the time forward: the tables of a module are then 
+# flushed only when one of its packets arrives, so a module with a 
+# narrow filter may deliver its intervals late. 
+# Default: off
+
+#filter-pushdown	on
+
+# Write the statistics of the run (packets, peak memory, export lag, 
+# cycles per packet of each module) to this file in JSON when CoMo 
+# exits after processing all its input (-e flag). Used by como-bench. 
+# Default: none
+
+#stats-file	"/tmp/como-stats.json"
+
 # Modules. 
 # This is an example with all keywords currently implemented. 
 #
@@ -274,6 +325,8 @@ end
 #    streamsize 1GB
 #    #args "wait_fin=10"	# timeout after receiving the FIN
 #    #args "flow_timeout=60"	# idle flow expiration timeout
+#    #args "max_buffer=100000"	# max bytes out of order per flow
+#    #args "max_memory=67108864"	# max bytes out of order for all flows
 #end
 
 #module "flowcount"
@@ -317,6 +370,8 @@ end
 #module "pattern-search"
 #    description "Packet-level trace of packets containing a given pattern"
 #    args "pattern=GET"		# pattern to match against
+#    #args "patterns=/path/to/file"	# patterns to match, one per line
+#    #args "nocase"		# case insensitive match
 #    #args "snaplen=1514"	# max bytes to be stored per packet
 #end
 
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2008, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/* CoMo portability library */
+
+/*
+ * Multi-pattern search (Aho-Corasick).
+ *
+ * Patterns are added with ac_search_add() and then compiled into a
+ * deterministic automaton with ac_search_compile(). A single pass over
+ * the input reports all occurrences of all patterns.
+ *
+ * The input alphabet is reduced to the bytes that appear in the patterns
+ * (all other bytes share one class) to keep the transition table small.
+ * While the automaton is in the initial state the input is scanned for
+ * the first bytes of the patterns only (with SSSE3 when available).
+ */
+
+#ifndef AC_SEARCH_H_
+#define AC_SEARCH_H_
+
+#include <sys/types.h>
+#include <inttypes.h>
+#include "allocator.h"
+
+typedef struct ac_search ac_search_t;
+
+/*
+ * called for each match with the id of the pattern and the offset
+ * of the match in the input. a non-zero return value stops the search.
+ */
+typedef int (*ac_match_fn) (int id, size_t offset, void *data);
+
+ac_search_t * ac_search_new     (allocator_t *alc, int nocase);
+void          ac_search_destroy (ac_search_t *ac);
+int           ac_search_add     (ac_search_t *ac, const char *pattern,
+				 size_t len, int id);
+int           ac_search_compile (ac_search_t *ac);
+int           ac_search         (const ac_search_t *ac, const char *buf,
+				 size_t len, ac_match_fn cb, void *data);
+int           ac_search_count   (const ac_search_t *ac);
+size_t        ac_search_memusage(const ac_search_t *ac);
+
+#endif /* AC_SEARCH_H_ */
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2008, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/* CoMo portability library */
+
+/*
+ * Content-defined chunking with a gear hash (see "FastCDC: a Fast and
+ * Efficient Content-Defined Chunking Approach for Data Deduplication"
+ * by W. Xia et al.).
+ *
+ * The hash is updated with one shift and one add per byte:
+ *
+ *	h = (h << 1) + gear[byte]
+ *
+ * so that the high bits of h only depend on the last 64 bytes. A chunk
+ * ends after a byte where the high bits selected by the mask are all
+ * zero, which happens on average every 'avg' bytes after the minimum
+ * chunk size. As only the last 64 bytes matter, the first min - 64
+ * bytes of each chunk are skipped without hashing them.
+ */
+
+#ifndef CDC_H_
+#define CDC_H_
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+typedef struct cdc {
+    uint64_t	mask;		/* boundary mask (high bits) */
+    uint32_t	min;		/* minimum chunk size */
+    uint32_t	max;		/* maximum chunk size */
+    uint64_t	gear[256];	/* random value for each byte */
+} cdc_t;
+
+void   cdc_init (cdc_t *c, uint32_t min, uint32_t avg, uint32_t max);
+size_t cdc_chunk(const cdc_t *c, const void *buf, size_t len);
+
+#endif /* CDC_H_ */
@@ -111,6 +111,7 @@ struct _como {
     alias_t *	aliases; 	/* module aliases */ 
 
     size_t	maxfilesize; 	/* max file size in one bytestream */
+    size_t	qcache_size;	/* max size of the query cache (0: off) */
 
     int		debug;		/* debug mode */
     int		debug_sleep;	/* how many secs to sleep */
@@ -124,6 +125,11 @@ struct _como {
     int		exit_when_done; /* when set causes capture to send IPC_DONE
 				   message to its parent process when all
 				   the sniffers have terminated */
+    int		shards;		/* no. of pipelines for trace files */
+    int		shard;		/* pipeline of this process (0: none) */
+    int		perf_counters;	/* read hw counters around modules */
+    int		filter_pushdown; /* let the sniffers filter the pkts */
+    char *	stats_file;	/* statistics written here when done */
     struct {
 	int	done_flag:1;
 	int	dbdir_set:1;
@@ -184,6 +190,7 @@ struct _como {
  */
 #define DEFAULT_STREAMSIZE 	(1024*1024*1024)/* bytestream size */
 #define DEFAULT_FILESIZE 	(128*1024*1024)	/* single file size in stream */
+#define DEFAULT_QCACHE_SIZE	(64*1024*1024)	/* query result cache */
 #define DEFAULT_BLOCKSIZE 	4096		/* block size */
 #define DEFAULT_MODULE_MAX	128		/* max no. modules */
 #define DEFAULT_LOGFLAGS	(LOGUI|LOGWARN) /* log messages */
@@ -101,6 +101,27 @@ pkt_t * cca_next_pkt (cca_t * cca);
  */
 void export_mainloop();
 
+/*
+ * rollup.c
+ */
+void rollup_stat(char * dst, char * src, int count, int n);
+
+/*
+ * expiry.c
+ */
+void expiry_set(void * self, void * efh, timestamp_t when);
+
+/*
+ * pktkey.c
+ */
+extern struct pktkey * pktkey_cur;
+struct pktkey * pktkey_get(pkt_t * pkt);
+
+/* flow key of a packet (see hashfn.h). CAPTURE computes it in advance */
+#define PKTKEY(pkt)							\
+	((pktkey_cur != NULL && pktkey_cur->pkt == (pkt))?		\
+	 pktkey_cur : pktkey_get(pkt))
+
 /*
  * supervisor.c
  */
@@ -137,6 +158,7 @@ void _epanicx (const char * file, int line, const char *fmt, ...);
  */
 int          parse_filter (char *, treenode_t **, char **);
 int          evaluate     (treenode_t *t, pkt_t *pkt);
+char *       tree_to_pcap (treenode_t *t);
 
 
 /*
@@ -144,6 +166,7 @@ int          evaluate     (treenode_t *t, pkt_t *pkt);
  */
 void asn_readfile(const char * filename);
 int asn_test(const uint32_t addr, const uint16_t asn);
+asn_t asn_lookup(const uint32_t addr);
 
 /*
  * util-socket.c
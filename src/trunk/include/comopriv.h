@@ -73,6 +73,196 @@ typedef void (*mainloop_fn) (int out_fd, int in_fd, int id);
 pid_t start_child (procname_t who, int mtype, mainloop_fn mainloop, int, int);
 int handle_children ();
 
+/*
+ * export.c
+ */
+void export_init_module  (module_t * mdl);
+void export_process_table(module_t * mdl, ctable_t * ct);
+void export_flush_module (module_t * mdl);
+
+/*
+ * rollup.c
+ */
+struct _rollup {
+    int		secs;		/* resolution (0 terminates the array) */
+    int		n;		/* intervals of the previous resolution */
+    char *	output;		/* bytestream name */
+    int		file;		/* output file */
+    off_t	offset;		/* current offset in the output file */
+    timestamp_t	period;		/* start of the current period */
+    char *	rec;		/* aggregate record of the current period */
+    size_t	len;		/* size of the aggregate, 0 if empty */
+};
+
+void   rollup_init    (module_t * mdl);
+void   rollup_store   (module_t * mdl, char * ptr, size_t len);
+void   rollup_destroy (module_t * mdl);
+char * rollup_select  (module_t * mdl, int granularity, int * secs);
+
+/*
+ * column.c
+ */
+void column_init    (module_t * mdl);
+void column_store   (module_t * mdl, char * ptr, size_t len);
+void column_destroy (module_t * mdl);
+
+/*
+ * cbhist.c
+ */
+void         cbhist_init       (stats_t * st, int modules);
+void         cbhist_reset      (stats_t * st, module_t * mdl);
+cbhist_t *   cbhist_get        (stats_t * st, module_t * mdl, cbtype_t cb);
+uint64_t     cbhist_lower      (int b);
+uint64_t     cbhist_percentile (cbhist_t * h, double p);
+const char * cbhist_name       (cbtype_t cb);
+
+/* 
+ * -- rdtsc
+ * 
+ * read the timestamp counter (TSC) and return its value (64 bit). 
+ * used by the tsc timers (util-timers.c) and the callback histograms. 
+ */
+static __inline__ uint64_t
+rdtsc(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    uint32_t lo, hi;
+
+    /* 
+     * "=A" is edx:eax only on i386. on x86_64 it is a single 64 bit 
+     * register and the high half would be lost. 
+     */
+    __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+#else
+    return 0; 
+#endif
+}
+
+/*
+ * -- cbhist_cycles
+ *
+ * start of a callback. this is inlined at each call site.
+ */
+static __inline__ uint64_t
+cbhist_cycles(void)
+{
+    return rdtsc();
+}
+
+/*
+ * -- cbhist_bucket
+ *
+ * log-linear bucket of a sample (see struct _cbhist)
+ */
+static __inline__ int
+cbhist_bucket(uint64_t v)
+{
+    int msb, b;
+
+    if (v < CBH_SUB)
+	return (int) v;
+
+    msb = 63 - __builtin_clzll(v);
+    b = ((msb - CBH_SUBBITS + 1) << CBH_SUBBITS) +
+	(int) ((v >> (msb - CBH_SUBBITS)) & (CBH_SUB - 1));
+    return (b < CBH_BUCKETS)? b : CBH_BUCKETS - 1;
+}
+
+/*
+ * -- cbhist_record
+ *
+ * add the cycles elapsed since start to the histogram of callback
+ * cb of module mdl. the capture and export callbacks are timed by a
+ * single process (CAPTURE or EXPORT) and need no locking. load() and
+ * print() run in all the QUERY processes at the same time, so their
+ * histograms are updated with atomic operations.
+ */
+static __inline__ void
+cbhist_record(stats_t * st, module_t * mdl, cbtype_t cb, uint64_t start)
+{
+    uint64_t v = cbhist_cycles() - start;
+    cbhist_t * h;
+
+    if (mdl->index >= st->cbhist_max)
+	return;
+
+    h = &st->cbhist[mdl->index * CB_MAX + cb];
+    if (cb == CB_LOAD || cb == CB_PRINT) {
+	uint64_t m;
+
+	__sync_fetch_and_add(&h->n, 1);
+	__sync_fetch_and_add(&h->total, v);
+	while ((m = h->max) < v && 
+	       !__sync_bool_compare_and_swap(&h->max, m, v))
+	    ;
+	__sync_fetch_and_add(&h->bucket[cbhist_bucket(v)], 1);
+	return;
+    }
+
+    h->n++;
+    h->total += v;
+    if (v > h->max)
+	h->max = v;
+    h->bucket[cbhist_bucket(v)]++;
+}
+
+/*
+ * pmc.c
+ */
+typedef struct pmcsample {
+    uint64_t	v[PMC_MAX];
+} pmcsample_t;
+
+void pmc_init  (stats_t * st, int modules);
+void pmc_reset (stats_t * st, module_t * mdl);
+void pmc_open  (void);
+void pmc_start (pmcsample_t * s);
+void pmc_stop  (pmcsample_t * s, module_t * mdl, int proc, uint64_t pkts);
+
+/*
+ * expiry.c
+ */
+typedef struct _exnode exnode_t;
+
+struct _exnode {
+    exnode_t *	next;		/* next timer in the slot */
+    exnode_t **	pprev;		/* previous next pointer */
+    timestamp_t	when;		/* expiry time */
+    uint32_t	index;		/* position of the record in the ex_array */
+    int		level;		/* wheel level, EXPIRY_IDLE or EXPIRY_FIRED */
+};
+
+#define EXPIRY_IDLE	-1
+#define EXPIRY_FIRED	-2
+
+/* timer of an export record and vice versa */
+#define EXREC_NODE(rp)	((exnode_t *) (rp) - 1)
+#define EXNODE_REC(n)	((rec_t *) ((exnode_t *) (n) + 1))
+
+expiry_t * expiry_new     (void);
+void       expiry_destroy (expiry_t * ex);
+void       expiry_arm     (expiry_t * ex, exnode_t * n, timestamp_t when);
+void       expiry_remove  (expiry_t * ex, exnode_t * n);
+int        expiry_advance (expiry_t * ex, timestamp_t ts);
+exnode_t * expiry_fired   (expiry_t * ex);
+
+/*
+ * slab.c
+ */
+slab_t * slab_new     (size_t size);
+void *   slab_alloc   (slab_t * s);
+void     slab_free    (slab_t * s, void * p);
+void     slab_clear   (slab_t * s);
+void     slab_destroy (slab_t * s);
+size_t   slab_usage   (slab_t * s);
+size_t   slab_count   (slab_t * s);
+
+/*
+ * shard.c
+ */
+void shard_run(void);
+
 /*
  * inline.c
  */
@@ -163,4 +353,9 @@ typedef union ccamsg_t {
     } close;
 } ccamsg_t;
 
+/*
+ * pktkey.c
+ */
+struct pktkey * pktkey_batch(batch_t * batch);
+
 #endif /*COMOPRIV_H_*/
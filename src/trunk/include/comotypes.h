@@ -62,6 +62,8 @@ typedef struct _export_table    etable_t;       /* export hash table */
 typedef struct _export_array    earray_t;       /* export record array */
 
 typedef struct _tsc		tsc_t; 		/* timers (using TSC) */
+typedef struct _cbhist		cbhist_t;	/* callback latency histogram */
+typedef struct _pmcstat		pmcstat_t;	/* hardware counters */
 typedef struct _statistics	stats_t; 	/* statistic counters */
 
 typedef struct _como_metadesc	metadesc_t;
@@ -71,13 +73,20 @@ typedef struct _como_headerinfo headerinfo_t;
 
 typedef struct cca		cca_t;
 
+typedef struct _rollup		rollup_t;	/* lower resolution outputs */
+typedef struct _colstore	colstore_t;	/* columnar output */
+typedef struct _expiry		expiry_t;	/* export record timers */
+typedef struct _slab		slab_t;		/* export record allocator */
+typedef struct _exmem		exmem_t;	/* export memory usage */
+
 typedef uint64_t 		timestamp_t;	/* NTP-like timestamps */
 
 typedef uint16_t		asn_t;		/* ASN values */
 
 typedef enum runmode { 
     RUNMODE_NORMAL = 0, 
-    RUNMODE_INLINE = 1
+    RUNMODE_INLINE = 1,
+    RUNMODE_INLINE_RAW = 2		/* inline, send stored records */
 } runmode_t;
 
 typedef enum status_t {
@@ -195,6 +204,8 @@ typedef int (compare_fn)(const void *, const void *);
  * that the action must be taken on the entire table. In this case
  * an ACT_STOP means that no record is processed at all. ACT_GO instead
  * makes export process the entire table (and sort it if needed).
+ * Modules with the has_expiry capability get this call only for the
+ * records whose timer (see expiry_set()) has expired. 
  * Not mandatory; if defined, an export_fn() should be defined too.
  * 
  */
@@ -259,9 +270,66 @@ typedef char * (print_fn)(void * self, char * buf, size_t * len,
 typedef int (replay_fn)(void * self, char *ptr, char *out, 
 			size_t * out_len, int left);
 
+/**
+ * merge_fn() - used by parallel queries. it is called with two records 
+ * as written by store() that belong to the same flush interval but have 
+ * been computed over different time partitions of the query. The module
+ * has to fold the src record into the dst one (dst is st_recordsize 
+ * bytes long and can be modified in place). 
+ * 
+ * Returns 1 if src has been merged into dst, 0 if the two records are
+ * unrelated and have to be printed separately. 
+ * 
+ * Not mandatory.
+ */
+typedef int (merge_fn)(void * self, char * dst, char * src);
+
+/**
+ * rollup_fn() - used by EXPORT to write copies of the output of the 
+ * module at lower time resolutions (1 minute, 1 hour, 1 day). The 
+ * record that aggregates a period starts as a copy of the first record 
+ * (as written by store()) of the period. For each of the following 
+ * records, the function is called with the aggregate (dst) and the 
+ * record (src). At the end of the period it is called with src == NULL 
+ * and n set to the number of intervals of the previous resolution in 
+ * the period: dst has to become the average record of one interval. 
+ * 
+ * This way, a query with granularity=N reads N/60 records of the 
+ * 1 minute resolution instead of N records of 1 second. 
+ * 
+ * Returns 0 on success, -1 if src cannot be aggregated. 
+ *
+ * Not mandatory.
+ */
+typedef int (rollup_fn)(void * self, char * dst, char * src, int n);
+
+/*
+ * Record schema. A module that stores fixed-size records can describe 
+ * the fields of the records as written by store() (in network byte 
+ * order). EXPORT then also writes the records in columnar format and 
+ * queries can read only some of the fields (see column.c). 
+ * The first field must be the timestamp of the record, as returned 
+ * by load(). The array is terminated by an entry with name == NULL. 
+ */
+typedef enum fieldtype_t {
+    FIELD_UINT8,
+    FIELD_UINT16,
+    FIELD_UINT32,
+    FIELD_UINT64,
+    FIELD_TIME,				/* timestamp_t */
+    FIELD_IPV4				/* IPv4 address */
+} fieldtype_t;
+
+typedef struct field_t {
+    const char *	name;
+    fieldtype_t		type;
+    size_t		offset;		/* offset in the stored record */
+} field_t;
+
 typedef struct capabilities_t {
     uint32_t has_flexible_flush:1;
-    uint32_t _res:31;
+    uint32_t has_expiry:1;	/* uses expiry_set(), see expiry.c */
+    uint32_t _res:30;
 } capabilities_t;
 
 /*
@@ -298,7 +366,10 @@ struct _callbacks {
     load_fn     * load;
     print_fn    * print;
     replay_fn   * replay;
+    merge_fn    * merge;
+    rollup_fn   * rollup;
 
+    field_t * schema; 
     char * formats; 
 };
 
@@ -354,6 +425,9 @@ struct _module {
     char * source;              /* filename of the shared lib. */
 
     callbacks_t callbacks;      /* callbacks (static, from the shared obj) */
+    size_t ca_recordsize;	/* record sizes set by init(), if not 0 */
+    size_t ex_recordsize;	/* they replace the ones in callbacks */
+    size_t st_recordsize;
     void * cb_handle;           /* handle of module's dynamic libraries */
 
     status_t status; 		/* current module status */
@@ -362,15 +436,21 @@ struct _module {
 
     ctable_t *ca_hashtable;  	/* capture hash table */
     uint ca_hashsize;    	/* capture hash table size (by config) */
+    ctable_t *ca_tblpool;	/* processed tables ready for reuse */
+    int ca_tblpool_len;		/* no. tables in the pool */
     timestamp_t flush_ivl;	/* capture flush interval */
 
     etable_t *ex_hashtable;  	/* export hash table */
     uint ex_hashsize; 	   	/* export hash table size (by config) */
     earray_t *ex_array; 	/* array of export records */
+    expiry_t *ex_expiry;	/* export record timers (has_expiry) */
+    slab_t *ex_slab;		/* export record allocator */
 
     int	file;			/* output file for export records */
     off_t streamsize;       	/* max bytestream size */
     off_t offset;		/* current offset in the export file */
+    rollup_t * rollup;		/* lower resolution outputs (EXPORT) */
+    colstore_t * columns;	/* columnar output (EXPORT) */
 
     int priority;               /* resource management priority, the lower
                                  * the more important the module is */
@@ -449,6 +529,7 @@ struct _capture_table {
     uint32_t bytes;             /* size of table and contents in memory */
     int flexible;		/* set to one if the table is created after a
 				   flexible flush occurred in the interal */
+    ctable_t *next;		/* next table in the recycle pool */
     rec_t *bucket[0];           /* pointers to records -- actual hash table */
 };
 
@@ -494,6 +575,76 @@ struct _tsc {
 };
 
 
+/* 
+ * callback latency histograms. there is one histogram for each 
+ * callback of each module, all of them in shared memory so that 
+ * the QUERY processes can read what CAPTURE and EXPORT write. 
+ * 
+ * values are in TSC cycles. buckets are log-linear: the first 
+ * CBH_SUB buckets count the values 0 .. CBH_SUB-1, then each power 
+ * of two is split in CBH_SUB buckets of the same width. the error 
+ * is thus at most 1/CBH_SUB of the value. the last bucket also 
+ * counts everything above 2^48 cycles. 
+ */
+typedef enum cbtype { 
+    CB_CHECK = 0, 
+    CB_HASH, 
+    CB_MATCH, 
+    CB_UPDATE, 
+    CB_FLUSH, 
+    CB_EXPORT, 
+    CB_ACTION, 
+    CB_STORE, 
+    CB_LOAD, 
+    CB_PRINT, 
+    CB_MAX 
+} cbtype_t; 
+
+#define CBH_SUBBITS	2			/* log2 of sub-buckets */
+#define CBH_SUB		(1 << CBH_SUBBITS)	/* sub-buckets per power */
+#define CBH_BUCKETS	(48 * CBH_SUB)		/* up to 2^48 cycles */
+
+struct _cbhist { 
+    uint64_t n;			/* number of samples */
+    uint64_t total;		/* sum of all samples */
+    uint64_t max;		/* largest sample */
+    uint32_t bucket[CBH_BUCKETS]; 	/* sample counts */
+};
+
+
+/* 
+ * hardware performance counters (see pmc.c). they are read around 
+ * the processing of each batch in CAPTURE and of each table in 
+ * EXPORT and accumulated per module and per process. 
+ */
+typedef enum pmctype { 
+    PMC_CYCLES = 0, 
+    PMC_INSTRUCTIONS, 
+    PMC_LLC_MISSES, 
+    PMC_BRANCH_MISSES, 
+    PMC_MAX 
+} pmctype_t; 
+
+#define PMC_CAPTURE	0		/* counters in CAPTURE */
+#define PMC_EXPORT	1		/* counters in EXPORT */
+#define PMC_PROCS	2
+
+struct _pmcstat { 
+    uint64_t pkts;		/* packets processed (CAPTURE only) */
+    uint64_t count[PMC_MAX];	/* counter totals */
+};
+
+
+/*
+ * memory used by a module in EXPORT (records, hash table and 
+ * record array). updated by EXPORT after each table. 
+ */
+struct _exmem {
+    uint64_t bytes;		/* memory held */
+    uint64_t peak;		/* max of bytes */
+    uint64_t records;		/* live export records */
+};
+
 struct _statistics { 
     struct timeval start; 	/* CoMo start time (with gettimeofday)*/
 
@@ -503,6 +654,7 @@ struct _statistics {
     timestamp_t first_ts; 	/* timestamp first processed batch */
     int modules_active;		/* no. of modules processing packets */
     int table_queue; 		/* expired tables in capture->export queue */
+    int table_queue_peak;	/* max expired tables in the queue */
     int batch_queue;		/* pending batches */
     int ca_clients;		/* capture clients */
     uint mem_usage_cur; 	/* current shared memory usage */
@@ -510,6 +662,18 @@ struct _statistics {
     uint mem_usage_peak; 	/* peak shared memory usage */
     uint64_t pkts; 		/* sniffed packets so far */
     int drops; 			/* global packet drop counter */
+    uint64_t qc_lookups;	/* query cache lookups */
+    uint64_t qc_hits;		/* query cache hits */
+    uint64_t cs_maps;		/* csmap() calls */
+    uint64_t cs_remaps;		/* csmap() calls that needed a new mmap */
+    cbhist_t * cbhist;		/* callback histograms, CB_MAX per module */
+    int cbhist_max;		/* no. of modules with histograms */
+    pmcstat_t * pmc;		/* hw counters, PMC_PROCS per module */
+    int pmc_max;		/* no. of modules with hw counters */
+    exmem_t * exmem;		/* export memory, one per module */
+    int exmem_max;		/* no. of modules with exmem */
+    
+    struct timeval ca_done;	/* CAPTURE done with all sniffers */
     
     uint64_t load_15m[15];	/* bytes load in last 15m */
     uint64_t load_1h[60];	/* bytes load in last 1h */
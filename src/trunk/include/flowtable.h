@@ -68,7 +68,7 @@ typedef int        (*pkt_in_flow_fn) (const pkt_t * pkt,
 				      const flow_t * flow);
 
 
-flowtable_t * flowtable_new    (allocator_t * alc,
+flowtable_t * flowtable_new_full (allocator_t * alc, int size,
 				flow_equal_fn flowEqualFn,
 				pkt_in_flow_fn pktInFlowFn,
 				destroy_notify_fn flowDestroyFn);
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2008, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/* CoMo portability library */
+
+/*
+ * Hash functions for the fixed-size keys used by the modules
+ * (IPv4/IPv6 5-tuples, address pairs, MAC addresses).
+ *
+ * Three families are provided:
+ *
+ *   . hashfn_crc32c()  CRC32C (Castagnoli). Uses the SSE4.2 crc32
+ *                      instruction when the CPU has it, a table
+ *                      otherwise. Fast, good enough for hash tables.
+ *   . hashfn_xx()      xxHash64-style multiply/rotate mixing reduced to
+ *                      32 bits. Fixed-size variants are inlined below.
+ *                      hashfn_xx64() returns all 64 bits (e.g., to
+ *                      fingerprint variable-size content).
+ *   . hashfn_tab()     keyed simple tabulation hashing. It is 3-wise
+ *                      independent and is the replacement for the H3
+ *                      functions in uhash.h where the hash quality
+ *                      matters (e.g., probabilistic counting).
+ *
+ * Each family has a _batch() variant that hashes an array of keys of
+ * the same size in one call, interleaving the work on several keys.
+ */
+
+#ifndef HASHFN_H_
+#define HASHFN_H_
+
+#include <inttypes.h>
+#include <string.h>		/* memcpy, bzero */
+
+#include "stdpkt.h"
+
+/*
+ * Canonical keys. All the fields are in network byte order and
+ * the padding is always zero so that keys can be hashed (and
+ * compared) as opaque blocks of memory.
+ */
+typedef struct hkey_tuple4 {
+    uint32_t	src_ip;
+    uint32_t	dst_ip;
+    uint16_t	src_port;
+    uint16_t	dst_port;
+    uint8_t	proto;
+    uint8_t	_pad[3];
+} hkey_tuple4_t;			/* 16 bytes */
+
+typedef struct hkey_tuple6 {
+    uint8_t	src_ip[16];
+    uint8_t	dst_ip[16];
+    uint16_t	src_port;
+    uint16_t	dst_port;
+    uint8_t	proto;
+    uint8_t	_pad[3];
+} hkey_tuple6_t;			/* 40 bytes */
+
+typedef struct hkey_addrpair {
+    uint32_t	src_ip;
+    uint32_t	dst_ip;
+} hkey_addrpair_t;			/* 8 bytes */
+
+typedef struct hkey_mac {
+    uint8_t	addr[6];
+    uint8_t	_pad[2];
+} hkey_mac_t;				/* 8 bytes */
+
+/*
+ * Tabulation hash state. One table of 256 random words for each
+ * byte of the key. Keys longer than HASHFN_TAB_KEYLEN cannot be
+ * hashed with this function (use hashfn_xx or hashfn_crc32c).
+ */
+#define HASHFN_TAB_KEYLEN	16
+
+typedef struct tabhash {
+    uint32_t	t[HASHFN_TAB_KEYLEN][256];
+} tabhash_t;
+
+void     hashfn_tab_init    (tabhash_t *th, uint64_t seed);
+
+uint32_t hashfn_crc32c      (uint32_t seed, const void *key, size_t len);
+uint32_t hashfn_xx          (uint32_t seed, const void *key, size_t len);
+uint64_t hashfn_xx64        (uint64_t seed, const void *key, size_t len);
+
+void     hashfn_crc32c_batch(uint32_t seed, const void *keys, size_t keylen,
+			     int n, uint32_t *out);
+void     hashfn_xx_batch    (uint32_t seed, const void *keys, size_t keylen,
+			     int n, uint32_t *out);
+void     hashfn_tab_batch   (const tabhash_t *th, const void *keys,
+			     size_t keylen, int n, uint32_t *out);
+
+int      hashfn_has_hw_crc32c(void);
+
+
+/*
+ * -- hashfn_tab
+ *
+ * Tabulation hash of a key of at most HASHFN_TAB_KEYLEN bytes.
+ */
+static __inline__ uint32_t
+hashfn_tab(const tabhash_t *th, const void *key, size_t len)
+{
+    const uint8_t *k = (const uint8_t *) key;
+    uint32_t h = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+	h ^= th->t[i][k[i]];
+    return h;
+}
+
+/*
+ * xxHash64 primes and round function. The fixed-size helpers
+ * below work on 8-byte lanes and are meant to be inlined in the
+ * hash() callbacks of the modules.
+ */
+#define HASHFN_P1	0x9E3779B185EBCA87ULL
+#define HASHFN_P2	0xC2B2AE3D27D4EB4FULL
+#define HASHFN_P3	0x165667B19E3779F9ULL
+#define HASHFN_P4	0x85EBCA77C2B2AE63ULL
+#define HASHFN_P5	0x27D4EB2F165667C5ULL
+
+#define HASHFN_ROTL64(x, r)	(((x) << (r)) | ((x) >> (64 - (r))))
+
+static __inline__ uint64_t
+hashfn_xx_lane(uint64_t h, uint64_t w)
+{
+    w *= HASHFN_P2;
+    w = HASHFN_ROTL64(w, 31);
+    w *= HASHFN_P1;
+    h ^= w;
+    return HASHFN_ROTL64(h, 27) * HASHFN_P1 + HASHFN_P4;
+}
+
+static __inline__ uint64_t
+hashfn_xx_final64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= HASHFN_P2;
+    h ^= h >> 29;
+    h *= HASHFN_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+#define hashfn_xx_final(h)	((uint32_t) hashfn_xx_final64(h))
+
+static __inline__ uint64_t
+hashfn_load64(const void *p)
+{
+    uint64_t w;
+
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+/* hash a key made of nlanes 8-byte words */
+static __inline__ uint32_t
+hashfn_xx_lanes(uint32_t seed, const void *key, int nlanes)
+{
+    const uint8_t *k = (const uint8_t *) key;
+    uint64_t h;
+    int i;
+
+    h = (uint64_t) seed + HASHFN_P5 + (uint64_t) (nlanes * 8);
+    for (i = 0; i < nlanes; i++)
+	h = hashfn_xx_lane(h, hashfn_load64(k + i * 8));
+    return hashfn_xx_final(h);
+}
+
+/*
+ * same as above but returns the full 64 bit hash. this is what the
+ * cardinality sketches (see hll.h) want as input.
+ */
+static __inline__ uint64_t
+hashfn_xx64_lanes(uint64_t seed, const void *key, int nlanes)
+{
+    const uint8_t *k = (const uint8_t *) key;
+    uint64_t h;
+    int i;
+
+    h = seed + HASHFN_P5 + (uint64_t) (nlanes * 8);
+    for (i = 0; i < nlanes; i++)
+	h = hashfn_xx_lane(h, hashfn_load64(k + i * 8));
+    return hashfn_xx_final64(h);
+}
+
+#define hashfn_tuple4(seed, k)		hashfn_xx_lanes(seed, k, 2)
+#define hashfn_tuple6(seed, k)		hashfn_xx_lanes(seed, k, 5)
+#define hashfn_addrpair(seed, k)	hashfn_xx_lanes(seed, k, 1)
+#define hashfn_mac(seed, k)		hashfn_xx_lanes(seed, k, 1)
+
+/* hash a single 32 bit value (e.g., an IPv4 address) */
+static __inline__ uint32_t
+hashfn_u32(uint32_t seed, uint32_t x)
+{
+    uint64_t h;
+
+    h = (uint64_t) seed + HASHFN_P5 + 4;
+    h ^= (uint64_t) x * HASHFN_P1;
+    h = HASHFN_ROTL64(h, 23) * HASHFN_P2 + HASHFN_P3;
+    return hashfn_xx_final(h);
+}
+
+/*
+ * -- hkey_tuple4_fill
+ *
+ * Fill a 5-tuple key from an IPv4 packet. Ports are zero if the
+ * packet is neither TCP nor UDP.
+ */
+static __inline__ void
+hkey_tuple4_fill(hkey_tuple4_t *k, pkt_t *pkt)
+{
+    k->src_ip = N32(IP(src_ip));
+    k->dst_ip = N32(IP(dst_ip));
+    k->proto = IP(proto);
+    k->_pad[0] = k->_pad[1] = k->_pad[2] = 0;
+    if (isTCP) {
+	k->src_port = N16(TCP(src_port));
+	k->dst_port = N16(TCP(dst_port));
+    } else if (isUDP) {
+	k->src_port = N16(UDP(src_port));
+	k->dst_port = N16(UDP(dst_port));
+    } else {
+	k->src_port = k->dst_port = 0;
+    }
+}
+
+/*
+ * Flow key of a packet and the hashes most modules need. CAPTURE
+ * fills one per packet before running the modules so that the
+ * headers are parsed and hashed once (see PKTKEY() in comofunc.h).
+ * All the hashes use seed 0 and are computed on the key fields in
+ * network byte order. The key is all zero if the packet is not IPv4.
+ */
+typedef struct pktkey {
+    const pkt_t *	pkt;		/* packet the key belongs to */
+    hkey_tuple4_t	tuple;		/* 5-tuple */
+    uint32_t		h_tuple;	/* hashfn_tuple4() of the 5-tuple */
+    uint32_t		h_src;		/* hashfn_u32() of the source */
+    uint32_t		h_dst;		/* hashfn_u32() of the destination */
+} pktkey_t;
+
+/*
+ * -- pktkey_fill
+ *
+ * Parse the headers of a packet and hash its flow key.
+ */
+static __inline__ void
+pktkey_fill(pktkey_t *k, pkt_t *pkt)
+{
+    k->pkt = pkt;
+    if (isIP) {
+	hkey_tuple4_fill(&k->tuple, pkt);
+    } else {
+	bzero(&k->tuple, sizeof(k->tuple));
+    }
+    k->h_tuple = hashfn_tuple4(0, &k->tuple);
+    k->h_src = hashfn_u32(0, k->tuple.src_ip);
+    k->h_dst = hashfn_u32(0, k->tuple.dst_ip);
+}
+
+#endif /* HASHFN_H_ */
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2008, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/* CoMo portability library */
+
+/*
+ * HyperLogLog cardinality sketches.
+ *
+ * See "HyperLogLog: the analysis of a near-optimal cardinality
+ * estimation algorithm" by P. Flajolet et al. and "HyperLogLog in
+ * Practice" by S. Heule et al. (HyperLogLog++).
+ *
+ * A sketch with precision p uses m = 2^p registers and estimates the
+ * number of distinct keys with a standard error of about 1.04/sqrt(m)
+ * (e.g., 0.8% for p = 14, 3.2% for p = 10) no matter how many keys are
+ * added. Keys are not added directly, the caller hashes them with a
+ * 64 bit hash function (e.g., hashfn_xx64_lanes) and adds the hash.
+ *
+ * Sketches start in a sparse representation (a sorted list of the
+ * non-zero registers) and switch to the dense one (one byte per
+ * register) when the sparse list would take more memory. This way
+ * sketches of hosts with few peers take a few bytes only.
+ *
+ * Sketches created with hll_new_arena() never free memory, the blocks
+ * left behind when the sparse list grows stay allocated until the
+ * caller releases the whole arena (e.g., the module shared map in
+ * CAPTURE, where single blocks cannot be freed).
+ *
+ * Two sketches with the same precision can be merged: the result is
+ * the sketch of the union of the two sets. Sketches can be serialized
+ * to be stored on disk by store() and recovered by load()/print().
+ */
+
+#ifndef HLL_H_
+#define HLL_H_
+
+#include <inttypes.h>
+#include "allocator.h"
+
+#define HLL_MIN_PRECISION	4
+#define HLL_MAX_PRECISION	16
+
+typedef struct hll hll_t;
+
+struct hll {
+    allocator_t *	alc;		/* allocator for the registers */
+    uint8_t		p;		/* precision */
+    uint8_t		dense;		/* set if using dense registers */
+    uint8_t		arena;		/* set if memory is never freed */
+    uint8_t		_pad;
+    uint32_t		m;		/* number of registers (2^p) */
+    uint32_t		sparse_len;	/* entries in the sparse list */
+    uint32_t		sparse_max;	/* entries allocated */
+    uint32_t *		sparse;		/* sorted (index << 8 | rank) list */
+    uint8_t *		regs;		/* dense registers */
+};
+
+/*
+ * Serialized sketch: 1 byte format, 1 byte precision, 4 bytes
+ * length of the payload (network byte order) and then the payload
+ * (sparse entries in network byte order or dense registers).
+ */
+#define HLL_HDR_SIZE		6
+#define HLL_SERIALIZED_MAX(p)	(HLL_HDR_SIZE + (1 << (p)))
+
+hll_t *  hll_new           (allocator_t *alc, int p);
+hll_t *  hll_new_arena     (allocator_t *alc, int p);
+void     hll_destroy       (hll_t *h);
+void     hll_reset         (hll_t *h);
+void     hll_add           (hll_t *h, uint64_t hash);
+double   hll_estimate      (hll_t *h);
+int      hll_merge         (hll_t *dst, const hll_t *src);
+size_t   hll_memusage      (const hll_t *h);
+
+size_t   hll_serialized_size(const hll_t *h);
+size_t   hll_serialize     (const hll_t *h, char *buf, size_t len);
+hll_t *  hll_deserialize   (allocator_t *alc, const char *buf, size_t len,
+			    size_t *used);
+int      hll_merge_serialized(hll_t *dst, const char *buf, size_t len);
+
+#endif /* HLL_H_ */
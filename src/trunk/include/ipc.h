@@ -94,6 +94,7 @@ enum _ipc_types {
  */
 int  ipc_listen();
 int  ipc_connect(procname_t name);
+void ipc_disconnect(procname_t name);
 void ipc_finish();
 int  ipc_send(procname_t name, ipctype_t type, const void *data, size_t sz);
 void * ipc_receive(procname_t, ipctype_t *, size_t * sz, struct timeval *tout);
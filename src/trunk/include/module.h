@@ -88,6 +88,15 @@
  */
 #define FSTATE(x)	(((module_t *) (x))->fstate)
 
+/* 
+ * record sizes that depend on the module arguments can be set by 
+ * init() with CA_RECORDSIZE(), EX_RECORDSIZE() and ST_RECORDSIZE(). 
+ * if not zero, they replace the sizes in the callbacks. 
+ */
+#define CA_RECORDSIZE(x)	(((module_t *) (x))->ca_recordsize)
+#define EX_RECORDSIZE(x)	(((module_t *) (x))->ex_recordsize)
+#define ST_RECORDSIZE(x)	(((module_t *) (x))->st_recordsize)
+
 /*
  * Macros to copy integers from host to network byte order. 
  * They advance the buffer pointer of the proper amount as well. 
@@ -91,6 +91,23 @@ typedef	int bpf_int32;
 typedef	u_int bpf_u_int32;
 #endif
 
+/*
+ * compiled filter program (from net/bpf.h, if not already there)
+ */
+#ifndef BPF_MAJOR_VERSION
+struct bpf_insn {
+	u_short		code;
+	u_char		jt;
+	u_char		jf;
+	bpf_u_int32	k;
+};
+
+struct bpf_program {
+	u_int		bf_len;
+	struct bpf_insn	*bf_insns;
+};
+#endif
+
 typedef struct pcap pcap_t;
 typedef struct pcap_dumper pcap_dumper_t;
 typedef struct pcap_if pcap_if_t;
@@ -205,6 +222,10 @@ int	pcap_setnonblock(pcap_t *, int, char *);
 void	pcap_perror(pcap_t *, char *);
 char	*pcap_strerror(int);
 char	*pcap_geterr(pcap_t *);
+int	pcap_compile(pcap_t *, struct bpf_program *, const char *, int,
+		     bpf_u_int32);
+int	pcap_setfilter(pcap_t *, struct bpf_program *);
+void	pcap_freecode(struct bpf_program *);
 int	pcap_datalink(pcap_t *);
 int	pcap_list_datalinks(pcap_t *, int **);
 int	pcap_set_datalink(pcap_t *, int);
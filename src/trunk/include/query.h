@@ -70,12 +70,14 @@ typedef struct qreq_t {
     uint32_t	end;		/* query ends at */
     int		wait;		/* set if query should wait for data */
     qformat_t	format;		/* query response format */
+    int		workers;	/* number of processes to run the query */
 
     char *	source;		/* source module to read data from */
     char **	args;		/* arguments to be passed to module */
 
     module_t *	mdl;		/* module producing data -- using print() */
     module_t *	src;		/* module retrieving data -- using load() */
+    char *	output;		/* bytestream to read (output or rollup) */
 } qreq_t;
 
 /* 
@@ -83,7 +85,30 @@ typedef struct qreq_t {
  */
 void query          (int client_fd, int supervisor_fd, int node_id);
 int  query_recv     (qreq_t * q, int sd, timestamp_t now);
-void query_ondemand (int client, qreq_t * req, int node_id);
+int  query_send_records (qreq_t * req, int file_fd, off_t ofs, 
+			 off_t end_ofs, timestamp_t end_ts, int out_fd);
+
+/* query-ondemand.c */
+void       query_ondemand         (int client, qreq_t * req, int node_id);
+uint       query_ondemand_memsize (module_t * mdl);
+module_t * query_ondemand_module  (qreq_t * req);
+module_t * query_ondemand_init    (int client, qreq_t * req);
+void       query_ondemand_run     (module_t * mdl, module_t * src, 
+				   int file_fd, off_t ofs, off_t end_ofs, 
+				   timestamp_t end_ts);
+
+/* query-cache.c */
+int  qcache_send   (qreq_t * req, off_t ofs, int client);
+int  qcache_create (qreq_t * req, off_t ofs);
+void qcache_done   (int fd, int keep, int client);
+
+/* column.c */
+int  column_query  (qreq_t * req, int client_fd);
+
+/* query-parallel.c */
+void query_parallel          (int client, qreq_t * req, int file_fd, 
+			      off_t ofs);
+void query_parallel_ondemand (int client, qreq_t * req);
 
 /*
  * services
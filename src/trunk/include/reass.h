@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2008, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/* CoMo portability library */
+
+/*
+ * TCP stream reassembly.
+ *
+ * Each stream keeps the data received in order as a list of segments
+ * and the segments received out of order in a second list sorted by
+ * sequence number. Out of order segments never overlap: when a segment
+ * overlaps data already received, the data received first is kept and
+ * the new segment is trimmed (or split). As segments mostly arrive at
+ * the end of the stream, the sorted list is scanned from its tail.
+ *
+ * Segments are allocated with the exact size of their payload. The
+ * amount of out of order data can be capped: segments that would exceed
+ * the cap are dropped (and accounted for).
+ *
+ * Sequence numbers are absolute and compared modulo 2^32.
+ */
+
+#ifndef REASS_H_
+#define REASS_H_
+
+#include <sys/types.h>
+#include <inttypes.h>
+#include "allocator.h"
+
+typedef struct reass reass_t;
+
+reass_t * reass_new        (allocator_t *alc, uint32_t ooo_max);
+void      reass_destroy    (reass_t *r);
+void      reass_start      (reass_t *r, uint32_t seq);
+void      reass_start_lowest(reass_t *r);
+int       reass_started    (const reass_t *r);
+int       reass_add        (reass_t *r, uint32_t seq, const void *data,
+			    uint32_t len);
+void      reass_drop_pending(reass_t *r);
+size_t    reass_copy       (const reass_t *r, void *buf, size_t len);
+uint32_t  reass_len        (const reass_t *r);
+uint32_t  reass_buffered   (const reass_t *r);
+uint32_t  reass_dropped    (const reass_t *r);
+
+#endif /* REASS_H_ */
@@ -34,6 +34,8 @@
 #ifndef _COMO_SNIFFERS_H
 #define _COMO_SNIFFERS_H
 
+#include <glob.h>	/* glob_t */
+
 #include "comotypes.h"
 
 /* sniffer-related typedefs */
@@ -76,6 +78,12 @@ int ppbuf_get_count (ppbuf_t * ppbuf);
  * stop()	Terminate the activity of the sniffer.
  *		This usually involves closing the descriptor, but
  *		maybe also freeing memory etc.
+ *
+ * setfilter()	(optional) Install a libpcap filter expression, so that
+ *		the packets no module is interested in are dropped before
+ *		they reach CoMo. A NULL expression removes the filter.
+ *		Return 0 if the filter is installed, -1 otherwise (CAPTURE
+ *		then drops those packets itself in ppbuf_capture()).
  */
 
 /* sniffer callbacks */
@@ -91,6 +99,7 @@ typedef int  (*sniffer_next_fn)           (sniffer_t * s,
 typedef void (*sniffer_stop_fn)           (sniffer_t * s);
 typedef float (*sniffer_usage_fn)         (sniffer_t * s, pkt_t * first,
 					   pkt_t * last);
+typedef int  (*sniffer_setfilter_fn)      (sniffer_t * s, const char * expr);
 
 struct sniffer_cb {
     char const *		name;
@@ -101,6 +110,7 @@ struct sniffer_cb {
     sniffer_next_fn		next;     /* get next packet */
     sniffer_stop_fn		stop;     /* stop the sniffer */
     sniffer_usage_fn		usage;
+    sniffer_setfilter_fn	setfilter; /* push a filter down (optional) */
 };
 
 struct sniffer {
@@ -140,11 +150,13 @@ struct source {
 #define SNIFF_INACTIVE	0x0008	/* inactive, i.e. do not select() */
 #define SNIFF_FROZEN	0x0010	/* frozen to slow down (only for SNIFF_FILE) */
 #define SNIFF_COMPLETE  0x0020  /* complete, i.e. finish the buffer */
+#define SNIFF_SHARDS	0x0080	/* list of files can be split in shards */
 
 sniffer_cb_t * sniffer_cb_lookup(const char *name);
 
 /* generic function used by sniffer-*.c */
 void updateofs(pkt_t * pkt, layer_t l, int type);
+void sniffer_shard_files(glob_t * files);
 
 /* function used by sniffer-*.c to parse the 802.11 frames */
 int ieee80211_process_mgmt_frame(const char *buf, int buf_len, char *dest);
@@ -46,6 +46,7 @@
 
 #define CS_MAXCLIENTS   	500            	/* max no. of clients/files */
 #define CS_OPTIMALSIZE		(1024*1024)	/* size for mmap() */
+#define CS_MAXWRITESIZE		(8*1024*1024)	/* max mmap() size for writers */
 #define CS_DEFAULT_TIMEOUT	TIME2TS(3600,0)	/* readers' timeout */
 
 /*
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2008, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+/* CoMo portability library */
+
+/*
+ * Heavy hitters summary (Space-Saving).
+ *
+ * See "Efficient Computation of Frequent and Top-k Elements in Data
+ * Streams" by A. Metwally, D. Agrawal and A. El Abbadi.
+ *
+ * The summary monitors at most k keys. When a key that is not monitored
+ * arrives and all counters are in use, the key with the smallest count
+ * is replaced and the new key inherits its count (which becomes the
+ * error of the new counter). Memory is fixed and does not depend on the
+ * number of distinct keys. For each monitored key:
+ *
+ *	count - error <= real weight <= count
+ *
+ * and error <= total weight / k. Any key with a weight larger than
+ * total / k is guaranteed to be in the summary.
+ *
+ * Each counter also has an auxiliary value (e.g., packets when the
+ * count is in bytes) that is reset when a counter is replaced and
+ * therefore has no error guarantee.
+ *
+ * Updates and lookups take O(log k) time (a min-heap orders the
+ * counters, an open addressing index finds the keys).
+ */
+
+#ifndef TOPK_H_
+#define TOPK_H_
+
+#include <inttypes.h>
+#include "allocator.h"
+
+#define TOPK_MAX_KEYLEN		16
+
+typedef struct topk topk_t;
+
+typedef struct topk_entry {
+    uint64_t	count;			/* estimated weight (upper bound) */
+    uint64_t	error;			/* max overestimation of count */
+    uint64_t	aux;			/* auxiliary counter */
+    uint32_t	hash;			/* hash of the key */
+    uint32_t	heappos;		/* position in the heap */
+    uint8_t	key[TOPK_MAX_KEYLEN];	/* key */
+} topk_entry_t;
+
+topk_t * topk_new     (allocator_t *alc, uint32_t k, size_t keylen);
+void     topk_destroy (topk_t *t);
+void     topk_reset   (topk_t *t);
+void     topk_update  (topk_t *t, const void *key, uint32_t hash,
+		       uint64_t weight, uint64_t aux);
+int      topk_merge   (topk_t *dst, const topk_t *src);
+uint32_t topk_sorted  (topk_t *t, topk_entry_t **out, uint32_t n);
+uint64_t topk_total   (const topk_t *t);
+uint64_t topk_min     (const topk_t *t);
+size_t   topk_memusage(const topk_t *t);
+
+#endif /* TOPK_H_ */
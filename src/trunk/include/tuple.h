@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2004-2006, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * $Id$
+ */
+
+/*
+ * 5-tuple flow record stored by the tuple and sessions modules and
+ * its layout for the columnar output (see base/column.c).
+ */
+
+#ifndef _TUPLE_H
+#define _TUPLE_H
+#include <stddef.h>		/* offsetof */
+#include "module.h"
+
+#define FLOWDESC    struct _tuple_stat
+FLOWDESC {
+    timestamp_t start_ts; 
+    timestamp_t last_ts; 
+    n32_t src_ip;
+    n32_t dst_ip;
+    n16_t src_port;
+    n16_t dst_port;
+    uint8_t proto;
+    char padding;
+    uint16_t sampling;
+    uint64_t bytes;
+    uint64_t pkts;
+};
+
+static field_t tuple_schema[] = { 
+    { "start_ts", FIELD_TIME, offsetof(FLOWDESC, start_ts) }, 
+    { "last_ts", FIELD_TIME, offsetof(FLOWDESC, last_ts) }, 
+    { "src_ip", FIELD_IPV4, offsetof(FLOWDESC, src_ip) }, 
+    { "dst_ip", FIELD_IPV4, offsetof(FLOWDESC, dst_ip) }, 
+    { "src_port", FIELD_UINT16, offsetof(FLOWDESC, src_port) }, 
+    { "dst_port", FIELD_UINT16, offsetof(FLOWDESC, dst_port) }, 
+    { "proto", FIELD_UINT8, offsetof(FLOWDESC, proto) }, 
+    { "sampling", FIELD_UINT16, offsetof(FLOWDESC, sampling) }, 
+    { "bytes", FIELD_UINT64, offsetof(FLOWDESC, bytes) }, 
+    { "pkts", FIELD_UINT64, offsetof(FLOWDESC, pkts) }, 
+    { NULL, 0, 0 } 
+};
+
+#endif
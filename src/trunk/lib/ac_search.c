@@ -0,0 +1,415 @@
+/*
+ * Copyright (c) 2008, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+#include <string.h>	/* memset, memcpy */
+#include <ctype.h>	/* tolower, toupper */
+
+#include "ac_search.h"
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(BUILD_FOR_ARM)
+#define HAVE_SSSE3_PREFILTER
+#include <tmmintrin.h>
+#endif
+
+#define AC_ROOT		0
+#define AC_NONE		(-1)
+
+typedef struct ac_node {
+    int32_t	child;		/* first child in the trie */
+    int32_t	sibling;	/* next child of the same parent */
+    int32_t	pattern;	/* first pattern ending here */
+    uint8_t	c;		/* input byte */
+} ac_node_t;
+
+typedef struct ac_pattern {
+    int		id;		/* user id */
+    uint32_t	len;		/* pattern length */
+    int32_t	next;		/* next pattern ending in the same state */
+} ac_pattern_t;
+
+struct ac_search {
+    allocator_t *	alc;
+    int			nocase;		/* case insensitive search */
+    int			compiled;
+
+    ac_pattern_t *	patterns;
+    int			npatterns;
+    int			maxpatterns;
+
+    ac_node_t *		nodes;		/* the trie */
+    int			nstates;
+    int			maxstates;
+
+    /* automaton (valid after ac_search_compile) */
+    uint16_t		classmap[256];	/* byte -> input class (up to 257) */
+    int			nclasses;
+    int32_t *		delta;		/* transitions [state][class] */
+    int32_t *		output;		/* first state with matches */
+    int32_t *		dict;		/* next state with matches */
+
+    /* first byte prefilter */
+    uint8_t		first[32];	/* bitmap of first bytes */
+    int			prefilter;
+    uint8_t		lo[16];		/* low nibble buckets */
+    uint8_t		hi[16];		/* high nibble buckets */
+};
+
+#define FIRST_ISSET(ac, b)	((ac)->first[(b) >> 3] & (1 << ((b) & 7)))
+#define FIRST_SET(ac, b)	((ac)->first[(b) >> 3] |= (1 << ((b) & 7)))
+
+/*
+ * -- grow
+ *
+ * Double the size of an array allocated with alc.
+ */
+static void *
+grow(allocator_t *alc, void *ptr, int *max, size_t size)
+{
+    void *p;
+    int n = (*max == 0) ? 16 : *max * 2;
+
+    p = alc_malloc(alc, n * size);
+    if (ptr != NULL) {
+	memcpy(p, ptr, *max * size);
+	alc_free(alc, ptr);
+    }
+    *max = n;
+    return p;
+}
+
+static int
+new_state(ac_search_t *ac, uint8_t c)
+{
+    ac_node_t *n;
+
+    if (ac->nstates == ac->maxstates)
+	ac->nodes = grow(ac->alc, ac->nodes, &ac->maxstates,
+			 sizeof(ac_node_t));
+    n = &ac->nodes[ac->nstates];
+    n->child = n->sibling = n->pattern = AC_NONE;
+    n->c = c;
+    return ac->nstates++;
+}
+
+ac_search_t *
+ac_search_new(allocator_t *alc, int nocase)
+{
+    ac_search_t *ac;
+
+    ac = alc_calloc(alc, 1, sizeof(ac_search_t));
+    ac->alc = alc;
+    ac->nocase = nocase;
+    new_state(ac, 0);		/* root */
+    return ac;
+}
+
+void
+ac_search_destroy(ac_search_t *ac)
+{
+    if (ac->compiled) {
+	alc_free(ac->alc, ac->delta);
+	alc_free(ac->alc, ac->output);
+	alc_free(ac->alc, ac->dict);
+    }
+    if (ac->patterns != NULL)
+	alc_free(ac->alc, ac->patterns);
+    alc_free(ac->alc, ac->nodes);
+    alc_free(ac->alc, ac);
+}
+
+/*
+ * -- ac_search_add
+ *
+ * Add a pattern to the search. Patterns can be added only before
+ * compiling the automaton and can contain any byte. Returns -1 on
+ * error (empty pattern or automaton already compiled).
+ */
+int
+ac_search_add(ac_search_t *ac, const char *pattern, size_t len, int id)
+{
+    ac_pattern_t *p;
+    int32_t s, x;
+    size_t i;
+
+    if (ac->compiled || len == 0)
+	return -1;
+
+    s = AC_ROOT;
+    for (i = 0; i < len; i++) {
+	uint8_t c = (uint8_t) pattern[i];
+
+	if (ac->nocase)
+	    c = tolower(c);
+	for (x = ac->nodes[s].child; x != AC_NONE; x = ac->nodes[x].sibling)
+	    if (ac->nodes[x].c == c)
+		break;
+	if (x == AC_NONE) {
+	    x = new_state(ac, c);
+	    ac->nodes[x].sibling = ac->nodes[s].child;
+	    ac->nodes[s].child = x;
+	}
+	s = x;
+    }
+
+    if (ac->npatterns == ac->maxpatterns)
+	ac->patterns = grow(ac->alc, ac->patterns, &ac->maxpatterns,
+			    sizeof(ac_pattern_t));
+    p = &ac->patterns[ac->npatterns];
+    p->id = id;
+    p->len = len;
+    p->next = ac->nodes[s].pattern;
+    ac->nodes[s].pattern = ac->npatterns++;
+    return 0;
+}
+
+/*
+ * -- prefilter_init
+ *
+ * Build the bitmap of the first bytes of the patterns and the nibble
+ * tables used by the SSSE3 scan. Bytes are placed in one of 8 buckets
+ * by their high nibble: a byte is a candidate if both its nibbles map
+ * to the same bucket. Candidates are always checked against the bitmap.
+ */
+static void
+prefilter_init(ac_search_t *ac)
+{
+    int32_t x;
+    int b, count;
+
+    for (x = ac->nodes[AC_ROOT].child; x != AC_NONE; x = ac->nodes[x].sibling) {
+	FIRST_SET(ac, ac->nodes[x].c);
+	if (ac->nocase)
+	    FIRST_SET(ac, toupper(ac->nodes[x].c));
+    }
+
+    for (b = 0, count = 0; b < 256; b++) {
+	if (!FIRST_ISSET(ac, b))
+	    continue;
+	count++;
+	ac->lo[b & 0x0f] |= 1 << ((b >> 4) & 7);
+	ac->hi[b >> 4] |= 1 << ((b >> 4) & 7);
+    }
+
+    /* not worth it if most bytes can start a match */
+    ac->prefilter = (count <= 64);
+}
+
+/*
+ * -- ac_search_compile
+ *
+ * Build the automaton: compute the input classes, the failure
+ * function (in breadth first order) and the full transition table.
+ */
+int
+ac_search_compile(ac_search_t *ac)
+{
+    int32_t *fail, *queue;
+    int32_t r, u, f;
+    int head, tail, b, c;
+
+    if (ac->compiled)
+	return -1;
+
+    /* input classes. class 0 is for all bytes not in any pattern */
+    memset(ac->classmap, 0, sizeof(ac->classmap));
+    ac->nclasses = 1;
+    for (r = 1; r < ac->nstates; r++) {
+	b = ac->nodes[r].c;
+	if (ac->classmap[b] == 0)
+	    ac->classmap[b] = ac->nclasses++;
+    }
+    if (ac->nocase) {
+	for (b = 0; b < 256; b++)
+	    ac->classmap[b] = ac->classmap[tolower(b)];
+    }
+
+    ac->delta = alc_calloc(ac->alc, ac->nstates * ac->nclasses,
+			   sizeof(int32_t));
+    ac->output = alc_malloc(ac->alc, ac->nstates * sizeof(int32_t));
+    ac->dict = alc_malloc(ac->alc, ac->nstates * sizeof(int32_t));
+    fail = alc_malloc(ac->alc, ac->nstates * sizeof(int32_t));
+    queue = alc_malloc(ac->alc, ac->nstates * sizeof(int32_t));
+
+    fail[AC_ROOT] = AC_ROOT;
+    ac->dict[AC_ROOT] = AC_NONE;
+    ac->output[AC_ROOT] = AC_NONE;
+
+    head = tail = 0;
+    queue[tail++] = AC_ROOT;
+    while (head < tail) {
+	int32_t *row;
+
+	r = queue[head++];
+	row = &ac->delta[r * ac->nclasses];
+
+	/* transitions not in the trie are the ones of the failure state */
+	if (r != AC_ROOT)
+	    memcpy(row, &ac->delta[fail[r] * ac->nclasses],
+		   ac->nclasses * sizeof(int32_t));
+
+	for (u = ac->nodes[r].child; u != AC_NONE; u = ac->nodes[u].sibling) {
+	    c = ac->classmap[ac->nodes[u].c];
+	    f = (r == AC_ROOT) ? AC_ROOT :
+		ac->delta[fail[r] * ac->nclasses + c];
+	    fail[u] = f;
+	    ac->dict[u] = (ac->nodes[f].pattern != AC_NONE) ? f : ac->dict[f];
+	    ac->output[u] = (ac->nodes[u].pattern != AC_NONE) ? u : ac->dict[u];
+	    row[c] = u;
+	    queue[tail++] = u;
+	}
+    }
+
+    alc_free(ac->alc, queue);
+    alc_free(ac->alc, fail);
+
+    prefilter_init(ac);
+    ac->compiled = 1;
+    return 0;
+}
+
+/*
+ * -- skip_scalar
+ *
+ * Return the offset of the next byte that may start a match.
+ */
+static size_t
+skip_scalar(const ac_search_t *ac, const uint8_t *p, size_t i, size_t len)
+{
+    while (i < len && !FIRST_ISSET(ac, p[i]))
+	i++;
+    return i;
+}
+
+#ifdef HAVE_SSSE3_PREFILTER
+static __attribute__((target("ssse3"))) size_t
+skip_ssse3(const ac_search_t *ac, const uint8_t *p, size_t i, size_t len)
+{
+    __m128i lo = _mm_loadu_si128((const __m128i *) ac->lo);
+    __m128i hi = _mm_loadu_si128((const __m128i *) ac->hi);
+    __m128i nibble = _mm_set1_epi8(0x0f);
+    __m128i zero = _mm_setzero_si128();
+
+    for (; i + 16 <= len; i += 16) {
+	__m128i v, l, h;
+	int m;
+
+	v = _mm_loadu_si128((const __m128i *) (p + i));
+	l = _mm_shuffle_epi8(lo, _mm_and_si128(v, nibble));
+	h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+	m = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(l, h), zero));
+	m &= 0xffff;
+	while (m != 0) {
+	    int j = __builtin_ctz(m);
+
+	    if (FIRST_ISSET(ac, p[i + j]))
+		return i + j;
+	    m &= m - 1;
+	}
+    }
+    return skip_scalar(ac, p, i, len);
+}
+
+static int has_ssse3 = -1;
+#endif
+
+/*
+ * -- ac_search
+ *
+ * Search all patterns in buf. For each match cb is called with the id
+ * of the pattern and the offset where the match starts. If cb is NULL
+ * the search stops at the first match. Returns the number of matches
+ * reported (or -1 if the automaton is not compiled).
+ */
+int
+ac_search(const ac_search_t *ac, const char *buf, size_t len,
+	  ac_match_fn cb, void *data)
+{
+    const uint8_t *p = (const uint8_t *) buf;
+    size_t (*skip)(const ac_search_t *, const uint8_t *, size_t, size_t);
+    int32_t s, x, k;
+    size_t i;
+    int n;
+
+    if (!ac->compiled)
+	return -1;
+
+    skip = ac->prefilter ? skip_scalar : NULL;
+#ifdef HAVE_SSSE3_PREFILTER
+    if (has_ssse3 < 0)
+	has_ssse3 = __builtin_cpu_supports("ssse3") ? 1 : 0;
+    if (ac->prefilter && has_ssse3)
+	skip = skip_ssse3;
+#endif
+
+    s = AC_ROOT;
+    n = 0;
+    for (i = 0; i < len; i++) {
+	if (s == AC_ROOT && skip != NULL) {
+	    i = skip(ac, p, i, len);
+	    if (i == len)
+		break;
+	}
+
+	s = ac->delta[s * ac->nclasses + ac->classmap[p[i]]];
+
+	for (x = ac->output[s]; x != AC_NONE; x = ac->dict[x]) {
+	    for (k = ac->nodes[x].pattern; k != AC_NONE;
+		 k = ac->patterns[k].next) {
+		n++;
+		if (cb == NULL)
+		    return n;
+		if (cb(ac->patterns[k].id, i + 1 - ac->patterns[k].len, data))
+		    return n;
+	    }
+	}
+    }
+
+    return n;
+}
+
+int
+ac_search_count(const ac_search_t *ac)
+{
+    return ac->npatterns;
+}
+
+size_t
+ac_search_memusage(const ac_search_t *ac)
+{
+    size_t sz;
+
+    sz = sizeof(ac_search_t) + ac->maxstates * sizeof(ac_node_t) +
+	 ac->maxpatterns * sizeof(ac_pattern_t);
+    if (ac->compiled)
+	sz += ac->nstates * (ac->nclasses + 2) * sizeof(int32_t);
+    return sz;
+}
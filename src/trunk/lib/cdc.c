@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2008, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+#include "cdc.h"
+
+#define GEAR_WINDOW	64	/* bytes that affect the high bits */
+
+/*
+ * -- cdc_init
+ *
+ * Set the chunk sizes and fill the gear table. The number of bits in
+ * the mask is log2(avg) (rounded down) so that, after the minimum size,
+ * a boundary is found with probability 1/avg at each byte.
+ */
+void
+cdc_init(cdc_t *c, uint32_t min, uint32_t avg, uint32_t max)
+{
+    uint64_t x = 0x9e3779b97f4a7c15ULL;	/* fixed seed */
+    int bits, i;
+
+    for (bits = 0; bits < 63 && (2u << bits) <= avg; bits++)
+	;
+
+    c->min = (min > 0) ? min : 1;
+    c->max = (max > c->min) ? max : c->min;
+    c->mask = (bits == 0) ? 0 : ~0ULL << (64 - bits);
+
+    /* splitmix64 */
+    for (i = 0; i < 256; i++) {
+	uint64_t z;
+
+	x += 0x9e3779b97f4a7c15ULL;
+	z = x;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	c->gear[i] = z ^ (z >> 31);
+    }
+}
+
+/*
+ * -- cdc_chunk
+ *
+ * Return the length of the first chunk in buf. The whole buffer is
+ * returned if it is shorter than the minimum chunk size or if no
+ * boundary is found before the end.
+ */
+size_t
+cdc_chunk(const cdc_t *c, const void *buf, size_t len)
+{
+    const uint8_t *p = (const uint8_t *) buf;
+    uint64_t h = 0;
+    size_t i, end;
+
+    if (len <= c->min)
+	return len;
+
+    end = (len < c->max) ? len : c->max;
+
+    /* only the last GEAR_WINDOW bytes before the minimum size matter */
+    i = (c->min > GEAR_WINDOW) ? c->min - GEAR_WINDOW : 0;
+    for (; i < c->min; i++)
+	h = (h << 1) + c->gear[p[i]];
+
+    for (; i < end; i++) {
+	h = (h << 1) + c->gear[p[i]];
+	if ((h & c->mask) == 0)
+	    return i + 1;
+    }
+
+    return end;
+}
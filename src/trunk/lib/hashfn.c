@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2008, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+#include <inttypes.h>
+#include <string.h>	/* memcpy */
+
+#include "hashfn.h"
+
+/*
+ * CRC32C (Castagnoli) polynomial, reflected.
+ */
+#define CRC32C_POLY	0x82F63B78
+
+static uint32_t crc32c_table[256];
+static int crc32c_table_ready = 0;
+
+/*
+ * -1 unknown, 0 no, 1 yes. set the first time a CRC32C is computed.
+ */
+static int crc32c_hw = -1;
+
+static void
+crc32c_init_table(void)
+{
+    uint32_t i, j, c;
+
+    for (i = 0; i < 256; i++) {
+	c = i;
+	for (j = 0; j < 8; j++)
+	    c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : (c >> 1);
+	crc32c_table[i] = c;
+    }
+    crc32c_table_ready = 1;
+}
+
+static uint32_t
+crc32c_sw(uint32_t crc, const uint8_t *p, size_t len)
+{
+    if (!crc32c_table_ready)
+	crc32c_init_table();
+
+    while (len--)
+	crc = crc32c_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(BUILD_FOR_ARM)
+#define HAVE_CRC32C_HW
+
+static __attribute__((target("sse4.2"))) uint32_t
+crc32c_hw_update(uint32_t crc, const uint8_t *p, size_t len)
+{
+    uint64_t c = crc;
+
+    for (; len >= 8; len -= 8, p += 8)
+	c = __builtin_ia32_crc32di(c, hashfn_load64(p));
+    crc = (uint32_t) c;
+    for (; len > 0; len--, p++)
+	crc = __builtin_ia32_crc32qi(crc, *p);
+    return crc;
+}
+
+/*
+ * The crc32 instruction has a latency of 3 cycles but a throughput
+ * of one per cycle. Hash four keys at a time so that the chains can
+ * proceed in parallel. Only used for keys that are a multiple of
+ * 8 bytes (all the hkey_* types are).
+ */
+static __attribute__((target("sse4.2"))) void
+crc32c_hw_batch4(uint32_t seed, const uint8_t *k, size_t keylen,
+		 uint32_t *out)
+{
+    uint64_t c0, c1, c2, c3;
+    size_t i;
+
+    c0 = c1 = c2 = c3 = ~seed;
+    for (i = 0; i < keylen; i += 8) {
+	c0 = __builtin_ia32_crc32di(c0, hashfn_load64(k + i));
+	c1 = __builtin_ia32_crc32di(c1, hashfn_load64(k + keylen + i));
+	c2 = __builtin_ia32_crc32di(c2, hashfn_load64(k + 2 * keylen + i));
+	c3 = __builtin_ia32_crc32di(c3, hashfn_load64(k + 3 * keylen + i));
+    }
+    out[0] = ~(uint32_t) c0;
+    out[1] = ~(uint32_t) c1;
+    out[2] = ~(uint32_t) c2;
+    out[3] = ~(uint32_t) c3;
+}
+#endif
+
+/*
+ * -- hashfn_has_hw_crc32c
+ *
+ * Returns 1 if CRC32C is computed with the SSE4.2 instruction.
+ */
+int
+hashfn_has_hw_crc32c(void)
+{
+    if (crc32c_hw == -1) {
+#ifdef HAVE_CRC32C_HW
+	__builtin_cpu_init();
+	crc32c_hw = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+#else
+	crc32c_hw = 0;
+#endif
+    }
+    return crc32c_hw;
+}
+
+/*
+ * -- hashfn_crc32c
+ *
+ * CRC32C of len bytes. The seed is used as initial value so
+ * that different tables can use independent functions.
+ */
+uint32_t
+hashfn_crc32c(uint32_t seed, const void *key, size_t len)
+{
+    const uint8_t *p = (const uint8_t *) key;
+
+#ifdef HAVE_CRC32C_HW
+    if (hashfn_has_hw_crc32c())
+	return ~crc32c_hw_update(~seed, p, len);
+#endif
+    return ~crc32c_sw(~seed, p, len);
+}
+
+/*
+ * -- hashfn_xx64
+ *
+ * xxHash64-style hash of an arbitrary buffer. Whole 8-byte words go
+ * through the lane function, the trailing bytes are folded in as in
+ * xxHash64.
+ */
+uint64_t
+hashfn_xx64(uint64_t seed, const void *key, size_t len)
+{
+    const uint8_t *p = (const uint8_t *) key;
+    uint64_t h;
+
+    h = seed + HASHFN_P5 + (uint64_t) len;
+    for (; len >= 8; len -= 8, p += 8)
+	h = hashfn_xx_lane(h, hashfn_load64(p));
+
+    if (len >= 4) {
+	uint32_t w;
+
+	memcpy(&w, p, sizeof(w));
+	h ^= (uint64_t) w * HASHFN_P1;
+	h = HASHFN_ROTL64(h, 23) * HASHFN_P2 + HASHFN_P3;
+	p += 4;
+	len -= 4;
+    }
+
+    for (; len > 0; len--, p++) {
+	h ^= (uint64_t) (*p) * HASHFN_P5;
+	h = HASHFN_ROTL64(h, 11) * HASHFN_P1;
+    }
+
+    return hashfn_xx_final64(h);
+}
+
+/*
+ * -- hashfn_xx
+ *
+ * hashfn_xx64() reduced to 32 bits.
+ */
+uint32_t
+hashfn_xx(uint32_t seed, const void *key, size_t len)
+{
+    return (uint32_t) hashfn_xx64(seed, key, len);
+}
+
+/*
+ * -- hashfn_tab_init
+ *
+ * Fill the tabulation tables with pseudo-random words generated
+ * from the seed (splitmix64). The same seed always gives the
+ * same function, which makes results reproducible across runs.
+ */
+void
+hashfn_tab_init(tabhash_t *th, uint64_t seed)
+{
+    uint64_t z;
+    int i, j;
+
+    for (i = 0; i < HASHFN_TAB_KEYLEN; i++) {
+	for (j = 0; j < 256; j++) {
+	    seed += 0x9E3779B97F4A7C15ULL;
+	    z = seed;
+	    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	    z ^= z >> 31;
+	    th->t[i][j] = (uint32_t) (z >> 32);
+	}
+    }
+}
+
+/*
+ * -- hashfn_crc32c_batch, hashfn_xx_batch, hashfn_tab_batch
+ *
+ * Hash n keys of keylen bytes each, stored contiguously in keys.
+ * The results are written in out[0..n-1].
+ */
+void
+hashfn_crc32c_batch(uint32_t seed, const void *keys, size_t keylen, int n,
+		    uint32_t *out)
+{
+    const uint8_t *k = (const uint8_t *) keys;
+    int i = 0;
+
+#ifdef HAVE_CRC32C_HW
+    if (hashfn_has_hw_crc32c() && (keylen & 7) == 0) {
+	for (; i + 4 <= n; i += 4)
+	    crc32c_hw_batch4(seed, k + i * keylen, keylen, out + i);
+    }
+#endif
+    for (; i < n; i++)
+	out[i] = hashfn_crc32c(seed, k + i * keylen, keylen);
+}
+
+void
+hashfn_xx_batch(uint32_t seed, const void *keys, size_t keylen, int n,
+		uint32_t *out)
+{
+    const uint8_t *k = (const uint8_t *) keys;
+    int i = 0;
+
+    /*
+     * for whole-lane keys process two keys per iteration. the two
+     * multiply chains are independent and can be overlapped by the cpu.
+     */
+    if ((keylen & 7) == 0) {
+	uint64_t h0, h1;
+	size_t j;
+
+	for (; i + 2 <= n; i += 2) {
+	    h0 = h1 = (uint64_t) seed + HASHFN_P5 + (uint64_t) keylen;
+	    for (j = 0; j < keylen; j += 8) {
+		h0 = hashfn_xx_lane(h0, hashfn_load64(k + i * keylen + j));
+		h1 = hashfn_xx_lane(h1, hashfn_load64(k + (i+1) * keylen + j));
+	    }
+	    out[i] = hashfn_xx_final(h0);
+	    out[i + 1] = hashfn_xx_final(h1);
+	}
+    }
+    for (; i < n; i++)
+	out[i] = hashfn_xx(seed, k + i * keylen, keylen);
+}
+
+void
+hashfn_tab_batch(const tabhash_t *th, const void *keys, size_t keylen, int n,
+		 uint32_t *out)
+{
+    const uint8_t *k = (const uint8_t *) keys;
+    int i;
+
+    for (i = 0; i < n; i++)
+	out[i] = hashfn_tab(th, k + i * keylen, keylen);
+}
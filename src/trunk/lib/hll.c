@@ -0,0 +1,446 @@
+/*
+ * Copyright (c) 2008, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+#include <math.h>	/* log */
+#include <string.h>	/* memcpy, memmove */
+#include <arpa/inet.h>	/* htonl, ntohl */
+
+#include "hll.h"
+#include "corlib.h"
+
+#define HLL_SPARSE		1
+#define HLL_DENSE		2
+
+#define HLL_SPARSE_INITIAL	8
+
+#define SP_INDEX(e)		((e) >> 8)
+#define SP_RANK(e)		((e) & 0xff)
+#define SP_ENTRY(i, r)		(((uint32_t) (i) << 8) | (r))
+
+/*
+ * -- hll_new
+ *
+ * Allocate an empty sketch with 2^p registers. Returns NULL if the
+ * precision is out of range.
+ */
+hll_t *
+hll_new(allocator_t *alc, int p)
+{
+    hll_t *h;
+
+    if (p < HLL_MIN_PRECISION || p > HLL_MAX_PRECISION)
+	return NULL;
+
+    h = alc_calloc(alc, 1, sizeof(hll_t));
+    h->alc = alc;
+    h->p = p;
+    h->m = 1 << p;
+    return h;
+}
+
+/*
+ * -- hll_new_arena
+ *
+ * Same as hll_new() but the sketch never frees the memory it gets
+ * from alc, not even in hll_reset() or hll_destroy().
+ */
+hll_t *
+hll_new_arena(allocator_t *alc, int p)
+{
+    hll_t *h;
+
+    h = hll_new(alc, p);
+    if (h != NULL)
+	h->arena = 1;
+    return h;
+}
+
+/*
+ * -- release
+ *
+ * Free a block of the sketch unless it lives in an arena.
+ */
+static void
+release(hll_t *h, void *ptr)
+{
+    if (ptr != NULL && !h->arena)
+	alc_free(h->alc, ptr);
+}
+
+/*
+ * -- hll_reset
+ *
+ * Empty the sketch. Memory is released and the sketch goes back
+ * to the sparse representation.
+ */
+void
+hll_reset(hll_t *h)
+{
+    release(h, h->sparse);
+    release(h, h->regs);
+    h->sparse = NULL;
+    h->regs = NULL;
+    h->sparse_len = h->sparse_max = 0;
+    h->dense = 0;
+}
+
+void
+hll_destroy(hll_t *h)
+{
+    hll_reset(h);
+    release(h, h);
+}
+
+/*
+ * -- to_dense
+ *
+ * Move all the sparse entries to a newly allocated register array.
+ */
+static void
+to_dense(hll_t *h)
+{
+    uint32_t i;
+
+    h->regs = alc_calloc(h->alc, h->m, sizeof(uint8_t));
+    for (i = 0; i < h->sparse_len; i++)
+	h->regs[SP_INDEX(h->sparse[i])] = SP_RANK(h->sparse[i]);
+    release(h, h->sparse);
+    h->sparse = NULL;
+    h->sparse_len = h->sparse_max = 0;
+    h->dense = 1;
+}
+
+/*
+ * -- set_register
+ *
+ * Set register idx to rank if that is larger than the current value.
+ * In the sparse representation the list is kept sorted by index so
+ * that lookups are a binary search. The list is converted to dense
+ * registers once it would use as much memory as the registers.
+ */
+static void
+set_register(hll_t *h, uint32_t idx, uint8_t rank)
+{
+    uint32_t lo, hi, mid;
+
+    if (h->dense) {
+	if (h->regs[idx] < rank)
+	    h->regs[idx] = rank;
+	return;
+    }
+
+    lo = 0;
+    hi = h->sparse_len;
+    while (lo < hi) {
+	mid = (lo + hi) / 2;
+	if (SP_INDEX(h->sparse[mid]) < idx)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    if (lo < h->sparse_len && SP_INDEX(h->sparse[lo]) == idx) {
+	if (SP_RANK(h->sparse[lo]) < rank)
+	    h->sparse[lo] = SP_ENTRY(idx, rank);
+	return;
+    }
+
+    if (h->sparse_len == h->sparse_max) {
+	uint32_t *x;
+	uint32_t sz;
+
+	sz = h->sparse_max ? h->sparse_max * 2 : HLL_SPARSE_INITIAL;
+	if (sz * sizeof(uint32_t) > h->m) {
+	    to_dense(h);
+	    h->regs[idx] = rank;
+	    return;
+	}
+
+	x = alc_malloc(h->alc, sz * sizeof(uint32_t));
+	if (h->sparse) {
+	    memcpy(x, h->sparse, h->sparse_len * sizeof(uint32_t));
+	    release(h, h->sparse);
+	}
+	h->sparse = x;
+	h->sparse_max = sz;
+    }
+
+    memmove(&h->sparse[lo + 1], &h->sparse[lo],
+	    (h->sparse_len - lo) * sizeof(uint32_t));
+    h->sparse[lo] = SP_ENTRY(idx, rank);
+    h->sparse_len++;
+}
+
+/*
+ * -- hll_add
+ *
+ * Add a 64 bit hash to the sketch. The first p bits select the
+ * register, the position of the first 1 in the remaining bits
+ * is the rank.
+ */
+void
+hll_add(hll_t *h, uint64_t hash)
+{
+    uint32_t idx;
+    uint64_t w;
+    uint8_t rank;
+
+    idx = (uint32_t) (hash >> (64 - h->p));
+    w = (hash << h->p) | ((uint64_t) 1 << (h->p - 1));
+    rank = (uint8_t) (__builtin_clzll(w) + 1);
+    set_register(h, idx, rank);
+}
+
+static double
+hll_alpha(uint32_t m)
+{
+    switch (m) {
+    case 16:
+	return 0.673;
+    case 32:
+	return 0.697;
+    case 64:
+	return 0.709;
+    default:
+	return 0.7213 / (1.0 + 1.079 / (double) m);
+    }
+}
+
+/*
+ * -- hll_estimate
+ *
+ * Return the estimated number of distinct hashes added to the sketch.
+ * Linear counting is used for small cardinalities (always exact enough
+ * in the sparse representation), the harmonic mean of the registers
+ * otherwise. With 64 bit hashes no large range correction is needed.
+ */
+double
+hll_estimate(hll_t *h)
+{
+    double sum, e;
+    uint32_t zeros, i;
+
+    if (!h->dense) {
+	zeros = h->m - h->sparse_len;
+	return (double) h->m * log((double) h->m / (double) zeros);
+    }
+
+    sum = 0;
+    zeros = 0;
+    for (i = 0; i < h->m; i++) {
+	sum += ldexp(1.0, -h->regs[i]);
+	if (h->regs[i] == 0)
+	    zeros++;
+    }
+
+    e = hll_alpha(h->m) * (double) h->m * (double) h->m / sum;
+    if (e <= 2.5 * (double) h->m && zeros > 0)
+	e = (double) h->m * log((double) h->m / (double) zeros);
+    return e;
+}
+
+/*
+ * -- hll_merge
+ *
+ * Merge src into dst. Both sketches must have the same precision.
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+hll_merge(hll_t *dst, const hll_t *src)
+{
+    uint32_t i;
+
+    if (dst->p != src->p)
+	return -1;
+
+    if (!src->dense) {
+	for (i = 0; i < src->sparse_len; i++)
+	    set_register(dst, SP_INDEX(src->sparse[i]),
+			 SP_RANK(src->sparse[i]));
+	return 0;
+    }
+
+    if (!dst->dense)
+	to_dense(dst);
+    for (i = 0; i < dst->m; i++)
+	if (dst->regs[i] < src->regs[i])
+	    dst->regs[i] = src->regs[i];
+    return 0;
+}
+
+/*
+ * -- hll_memusage
+ *
+ * Bytes of memory used by the sketch.
+ */
+size_t
+hll_memusage(const hll_t *h)
+{
+    if (h->dense)
+	return sizeof(hll_t) + h->m;
+    return sizeof(hll_t) + h->sparse_max * sizeof(uint32_t);
+}
+
+/*
+ * -- hll_serialized_size
+ *
+ * Bytes needed by hll_serialize().
+ */
+size_t
+hll_serialized_size(const hll_t *h)
+{
+    if (h->dense)
+	return HLL_HDR_SIZE + h->m;
+    return HLL_HDR_SIZE + h->sparse_len * sizeof(uint32_t);
+}
+
+/*
+ * -- hll_serialize
+ *
+ * Write the sketch to buf. Returns the number of bytes written
+ * or 0 if buf is too small.
+ */
+size_t
+hll_serialize(const hll_t *h, char *buf, size_t len)
+{
+    size_t sz = hll_serialized_size(h);
+    uint32_t plen, i;
+
+    if (len < sz)
+	return 0;
+
+    buf[0] = h->dense ? HLL_DENSE : HLL_SPARSE;
+    buf[1] = h->p;
+    plen = htonl((uint32_t) (sz - HLL_HDR_SIZE));
+    memcpy(buf + 2, &plen, sizeof(plen));
+    buf += HLL_HDR_SIZE;
+
+    if (h->dense) {
+	memcpy(buf, h->regs, h->m);
+    } else {
+	for (i = 0; i < h->sparse_len; i++) {
+	    uint32_t e = htonl(h->sparse[i]);
+	    memcpy(buf + i * sizeof(e), &e, sizeof(e));
+	}
+    }
+    return sz;
+}
+
+/*
+ * -- parse_header
+ *
+ * Check a serialized sketch and return its format, precision and
+ * payload length. Returns -1 if the buffer is not a valid sketch.
+ */
+static int
+parse_header(const char *buf, size_t len, int *fmt, int *p, uint32_t *plen)
+{
+    if (len < HLL_HDR_SIZE)
+	return -1;
+
+    *fmt = buf[0];
+    *p = buf[1];
+    memcpy(plen, buf + 2, sizeof(*plen));
+    *plen = ntohl(*plen);
+
+    if (*p < HLL_MIN_PRECISION || *p > HLL_MAX_PRECISION)
+	return -1;
+    if (*fmt == HLL_DENSE && *plen != (1U << *p))
+	return -1;
+    if (*fmt == HLL_SPARSE && (*plen % sizeof(uint32_t)) != 0)
+	return -1;
+    if (*fmt != HLL_DENSE && *fmt != HLL_SPARSE)
+	return -1;
+    if (len < HLL_HDR_SIZE + *plen)
+	return -1;
+    return 0;
+}
+
+/*
+ * -- hll_merge_serialized
+ *
+ * Merge a serialized sketch into dst without building an
+ * intermediate sketch. Returns the number of bytes consumed from
+ * buf, 0 on error (bad buffer or different precision).
+ */
+int
+hll_merge_serialized(hll_t *dst, const char *buf, size_t len)
+{
+    const uint8_t *x;
+    uint32_t plen, i;
+    int fmt, p;
+
+    if (parse_header(buf, len, &fmt, &p, &plen) < 0 || p != dst->p)
+	return 0;
+
+    x = (const uint8_t *) buf + HLL_HDR_SIZE;
+    if (fmt == HLL_DENSE) {
+	if (!dst->dense)
+	    to_dense(dst);
+	for (i = 0; i < dst->m; i++)
+	    if (dst->regs[i] < x[i])
+		dst->regs[i] = x[i];
+    } else {
+	for (i = 0; i < plen; i += sizeof(uint32_t)) {
+	    uint32_t e;
+
+	    memcpy(&e, x + i, sizeof(e));
+	    e = ntohl(e);
+	    if (SP_INDEX(e) < dst->m)
+		set_register(dst, SP_INDEX(e), SP_RANK(e));
+	}
+    }
+    return HLL_HDR_SIZE + plen;
+}
+
+/*
+ * -- hll_deserialize
+ *
+ * Build a new sketch from a serialized one. The number of bytes
+ * consumed is returned in *used (if not NULL). Returns NULL on error.
+ */
+hll_t *
+hll_deserialize(allocator_t *alc, const char *buf, size_t len, size_t *used)
+{
+    hll_t *h;
+    uint32_t plen;
+    int fmt, p, n;
+
+    if (parse_header(buf, len, &fmt, &p, &plen) < 0)
+	return NULL;
+
+    h = hll_new(alc, p);
+    n = hll_merge_serialized(h, buf, len);
+    if (used)
+	*used = n;
+    return h;
+}
@@ -0,0 +1,354 @@
+/*
+ * Copyright (c) 2008, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+#include <string.h>	/* memcpy */
+
+#include "reass.h"
+
+#define SEQ_LT(a, b)	((int32_t) ((a) - (b)) < 0)
+#define SEQ_LEQ(a, b)	((int32_t) ((a) - (b)) <= 0)
+#define SEQ_GT(a, b)	((int32_t) ((a) - (b)) > 0)
+#define SEQ_GEQ(a, b)	((int32_t) ((a) - (b)) >= 0)
+
+typedef struct reass_seg reass_seg_t;
+
+struct reass_seg {
+    reass_seg_t *	prev;
+    reass_seg_t *	next;
+    uint32_t		seq;		/* sequence number of ptr[0] */
+    uint32_t		len;		/* bytes left in the segment */
+    uint8_t *		ptr;		/* first byte (trimmed segments) */
+    uint8_t		data[0];	/* payload */
+};
+
+typedef struct reass_list {
+    reass_seg_t *	head;
+    reass_seg_t *	tail;
+} reass_list_t;
+
+struct reass {
+    allocator_t *	alc;
+    int			started;	/* next_seq is known */
+    uint32_t		next_seq;	/* next byte expected in order */
+    reass_list_t	data;		/* data in order */
+    uint32_t		len;		/* bytes in order */
+    reass_list_t	ooo;		/* out of order segments */
+    uint32_t		ooo_len;	/* bytes out of order */
+    uint32_t		ooo_max;	/* max bytes out of order (0 = none) */
+    uint32_t		dropped;	/* bytes dropped because of ooo_max */
+};
+
+static reass_seg_t *
+seg_new(reass_t *r, uint32_t seq, const void *data, uint32_t len)
+{
+    reass_seg_t *s;
+
+    s = alc_malloc(r->alc, sizeof(reass_seg_t) + len);
+    s->prev = s->next = NULL;
+    s->seq = seq;
+    s->len = len;
+    s->ptr = s->data;
+    memcpy(s->data, data, len);
+    return s;
+}
+
+/* insert s after p in the list (at the head if p is NULL) */
+static void
+list_insert(reass_list_t *l, reass_seg_t *p, reass_seg_t *s)
+{
+    s->prev = p;
+    s->next = (p != NULL) ? p->next : l->head;
+    if (s->next != NULL)
+	s->next->prev = s;
+    else
+	l->tail = s;
+    if (p != NULL)
+	p->next = s;
+    else
+	l->head = s;
+}
+
+static void
+list_remove(reass_list_t *l, reass_seg_t *s)
+{
+    if (s->prev != NULL)
+	s->prev->next = s->next;
+    else
+	l->head = s->next;
+    if (s->next != NULL)
+	s->next->prev = s->prev;
+    else
+	l->tail = s->prev;
+}
+
+static void
+list_free(reass_t *r, reass_list_t *l)
+{
+    reass_seg_t *s, *next;
+
+    for (s = l->head; s != NULL; s = next) {
+	next = s->next;
+	alc_free(r->alc, s);
+    }
+    l->head = l->tail = NULL;
+}
+
+reass_t *
+reass_new(allocator_t *alc, uint32_t ooo_max)
+{
+    reass_t *r;
+
+    r = alc_calloc(alc, 1, sizeof(reass_t));
+    r->alc = alc;
+    r->ooo_max = ooo_max;
+    return r;
+}
+
+void
+reass_destroy(reass_t *r)
+{
+    list_free(r, &r->data);
+    list_free(r, &r->ooo);
+    alc_free(r->alc, r);
+}
+
+/*
+ * -- drain
+ *
+ * Move the out of order segments that are now in order to the
+ * data list, trimming the bytes that are already there.
+ */
+static void
+drain(reass_t *r)
+{
+    reass_seg_t *s;
+
+    while ((s = r->ooo.head) != NULL && SEQ_LEQ(s->seq, r->next_seq)) {
+	list_remove(&r->ooo, s);
+	r->ooo_len -= s->len;
+
+	if (SEQ_LEQ(s->seq + s->len, r->next_seq)) {
+	    alc_free(r->alc, s);
+	    continue;
+	}
+
+	if (s->seq != r->next_seq) {
+	    uint32_t cut = r->next_seq - s->seq;
+
+	    s->ptr += cut;
+	    s->seq += cut;
+	    s->len -= cut;
+	}
+
+	list_insert(&r->data, r->data.tail, s);
+	r->next_seq += s->len;
+	r->len += s->len;
+    }
+}
+
+/*
+ * -- reass_start
+ *
+ * Set the sequence number of the first byte of the stream (i.e., the
+ * initial sequence number + 1) and move in order the data buffered so
+ * far, if any.
+ */
+void
+reass_start(reass_t *r, uint32_t seq)
+{
+    if (r->started)
+	return;
+    r->started = 1;
+    r->next_seq = seq;
+    drain(r);
+}
+
+/*
+ * -- reass_start_lowest
+ *
+ * Start the stream from the lowest sequence number buffered so far.
+ * This is used when the beginning of the stream has not been seen.
+ */
+void
+reass_start_lowest(reass_t *r)
+{
+    if (r->ooo.head != NULL)
+	reass_start(r, r->ooo.head->seq);
+}
+
+int
+reass_started(const reass_t *r)
+{
+    return r->started;
+}
+
+/*
+ * -- ooo_insert
+ *
+ * Insert a segment in the sorted list of out of order segments,
+ * after p. Fails if the cap on the buffered data is reached.
+ */
+static int
+ooo_insert(reass_t *r, reass_seg_t *p, uint32_t seq, const uint8_t *data,
+	   uint32_t len)
+{
+    if (r->ooo_max > 0 && r->ooo_len + len > r->ooo_max) {
+	r->dropped += len;
+	return -1;
+    }
+
+    list_insert(&r->ooo, p, seg_new(r, seq, data, len));
+    r->ooo_len += len;
+    return 0;
+}
+
+/*
+ * -- reass_add
+ *
+ * Add a segment to the stream. Returns 1 if the segment was added to
+ * the data in order (possibly completing some of the buffered data),
+ * 0 if it was buffered or contains no new data, -1 if it was dropped
+ * (entirely or in part) because of the cap on buffered data.
+ */
+int
+reass_add(reass_t *r, uint32_t seq, const void *data, uint32_t len)
+{
+    const uint8_t *d = data;
+    reass_seg_t *p, *n;
+    uint32_t cut;
+
+    if (len == 0)
+	return 0;
+
+    if (r->started) {
+	if (SEQ_LEQ(seq + len, r->next_seq))
+	    return 0;		/* old data */
+
+	if (SEQ_LT(seq, r->next_seq)) {
+	    cut = r->next_seq - seq;
+	    seq += cut;
+	    d += cut;
+	    len -= cut;
+	}
+
+	if (seq == r->next_seq) {
+	    list_insert(&r->data, r->data.tail, seg_new(r, seq, d, len));
+	    r->next_seq += len;
+	    r->len += len;
+	    drain(r);
+	    return 1;
+	}
+    }
+
+    /* find the last segment starting before this one */
+    for (p = r->ooo.tail; p != NULL && SEQ_GT(p->seq, seq); p = p->prev)
+	;
+
+    /* trim the beginning if it overlaps with p */
+    if (p != NULL && SEQ_GT(p->seq + p->len, seq)) {
+	cut = p->seq + p->len - seq;
+	if (cut >= len)
+	    return 0;
+	seq += cut;
+	d += cut;
+	len -= cut;
+    }
+
+    /* fill the holes between the following segments */
+    for (n = (p != NULL) ? p->next : r->ooo.head;
+	 n != NULL && SEQ_LT(n->seq, seq + len); p = n, n = n->next) {
+	if (SEQ_LT(seq, n->seq)) {
+	    if (ooo_insert(r, p, seq, d, n->seq - seq) < 0)
+		return -1;
+	    p = p != NULL ? p->next : r->ooo.head;
+	}
+	if (SEQ_GEQ(n->seq + n->len, seq + len))
+	    return 0;
+	cut = n->seq + n->len - seq;
+	seq += cut;
+	d += cut;
+	len -= cut;
+    }
+
+    return ooo_insert(r, p, seq, d, len);
+}
+
+/*
+ * -- reass_drop_pending
+ *
+ * Free the out of order segments (that cannot be put in order because
+ * some data is missing).
+ */
+void
+reass_drop_pending(reass_t *r)
+{
+    list_free(r, &r->ooo);
+    r->ooo_len = 0;
+}
+
+/*
+ * -- reass_copy
+ *
+ * Copy at most len bytes of the data in order to buf. Returns the
+ * number of bytes copied.
+ */
+size_t
+reass_copy(const reass_t *r, void *buf, size_t len)
+{
+    reass_seg_t *s;
+    size_t done, n;
+
+    for (done = 0, s = r->data.head; s != NULL && done < len; s = s->next) {
+	n = (s->len < len - done) ? s->len : len - done;
+	memcpy((uint8_t *) buf + done, s->ptr, n);
+	done += n;
+    }
+    return done;
+}
+
+uint32_t
+reass_len(const reass_t *r)
+{
+    return r->len;
+}
+
+uint32_t
+reass_buffered(const reass_t *r)
+{
+    return r->ooo_len;
+}
+
+uint32_t
+reass_dropped(const reass_t *r)
+{
+    return r->dropped;
+}
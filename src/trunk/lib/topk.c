@@ -0,0 +1,349 @@
+/*
+ * Copyright (c) 2008, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+#include <stdlib.h>	/* qsort */
+#include <string.h>	/* memcpy, memcmp */
+
+#include "topk.h"
+#include "corlib.h"
+
+struct topk {
+    allocator_t *	alc;
+    uint32_t		k;		/* number of counters */
+    uint32_t		used;		/* counters in use */
+    uint32_t		keylen;		/* length of the keys */
+    uint32_t		idxmask;	/* size of the index - 1 */
+    uint64_t		total;		/* total weight seen */
+    topk_entry_t *	entries;	/* the counters */
+    uint32_t *		heap;		/* min-heap of counters (by count) */
+    int32_t *		index;		/* key index, -1 if empty slot */
+};
+
+#define HEAP_COUNT(t, i)	((t)->entries[(t)->heap[i]].count)
+
+/*
+ * -- topk_new
+ *
+ * Create a summary with k counters for keys of keylen bytes.
+ */
+topk_t *
+topk_new(allocator_t *alc, uint32_t k, size_t keylen)
+{
+    topk_t *t;
+    uint32_t sz;
+
+    if (k == 0 || keylen == 0 || keylen > TOPK_MAX_KEYLEN)
+	return NULL;
+
+    /* index size is a power of two with load factor below 0.5 */
+    for (sz = 4; sz < 2 * k; sz <<= 1)
+	;
+
+    t = alc_calloc(alc, 1, sizeof(topk_t));
+    t->alc = alc;
+    t->k = k;
+    t->keylen = keylen;
+    t->idxmask = sz - 1;
+    t->entries = alc_calloc(alc, k, sizeof(topk_entry_t));
+    t->heap = alc_calloc(alc, k, sizeof(uint32_t));
+    t->index = alc_malloc(alc, sz * sizeof(int32_t));
+    memset(t->index, 0xff, sz * sizeof(int32_t));
+    return t;
+}
+
+void
+topk_destroy(topk_t *t)
+{
+    alc_free(t->alc, t->index);
+    alc_free(t->alc, t->heap);
+    alc_free(t->alc, t->entries);
+    alc_free(t->alc, t);
+}
+
+void
+topk_reset(topk_t *t)
+{
+    t->used = 0;
+    t->total = 0;
+    memset(t->index, 0xff, (t->idxmask + 1) * sizeof(int32_t));
+}
+
+/*
+ * index management: linear probing with backward shift deletion
+ * so that no tombstones are needed.
+ */
+static int32_t
+index_lookup(topk_t *t, const void *key, uint32_t hash, uint32_t *slot)
+{
+    uint32_t i = hash & t->idxmask;
+    int32_t e;
+
+    for (;; i = (i + 1) & t->idxmask) {
+	e = t->index[i];
+	if (e < 0)
+	    break;
+	if (t->entries[e].hash == hash &&
+	    memcmp(t->entries[e].key, key, t->keylen) == 0)
+	    break;
+    }
+    *slot = i;
+    return e;
+}
+
+static void
+index_remove(topk_t *t, uint32_t slot)
+{
+    uint32_t i = slot, j = slot, home;
+
+    for (;;) {
+	j = (j + 1) & t->idxmask;
+	if (t->index[j] < 0)
+	    break;
+	home = t->entries[t->index[j]].hash & t->idxmask;
+	/* move j back to i if its home slot is not in (i, j] */
+	if ((j > i && (home <= i || home > j)) ||
+	    (j < i && (home <= i && home > j))) {
+	    t->index[i] = t->index[j];
+	    i = j;
+	}
+    }
+    t->index[i] = -1;
+}
+
+/*
+ * heap management. heappos in each entry is kept up to date so that
+ * a counter can be moved after its count changes.
+ */
+static void
+heap_swap(topk_t *t, uint32_t a, uint32_t b)
+{
+    uint32_t x = t->heap[a];
+
+    t->heap[a] = t->heap[b];
+    t->heap[b] = x;
+    t->entries[t->heap[a]].heappos = a;
+    t->entries[t->heap[b]].heappos = b;
+}
+
+static void
+heap_up(topk_t *t, uint32_t i)
+{
+    while (i > 0 && HEAP_COUNT(t, (i - 1) / 2) > HEAP_COUNT(t, i)) {
+	heap_swap(t, i, (i - 1) / 2);
+	i = (i - 1) / 2;
+    }
+}
+
+static void
+heap_down(topk_t *t, uint32_t i)
+{
+    uint32_t l, r, min;
+
+    for (;;) {
+	l = 2 * i + 1;
+	r = l + 1;
+	min = i;
+	if (l < t->used && HEAP_COUNT(t, l) < HEAP_COUNT(t, min))
+	    min = l;
+	if (r < t->used && HEAP_COUNT(t, r) < HEAP_COUNT(t, min))
+	    min = r;
+	if (min == i)
+	    return;
+	heap_swap(t, i, min);
+	i = min;
+    }
+}
+
+/*
+ * -- topk_add
+ *
+ * Add weight (with a given error) to a key, replacing the smallest
+ * counter if the key is not monitored and the summary is full.
+ */
+static void
+topk_add(topk_t *t, const void *key, uint32_t hash, uint64_t weight,
+	 uint64_t aux, uint64_t error)
+{
+    topk_entry_t *e;
+    uint32_t slot;
+    int32_t x;
+    int isfree;
+
+    t->total += weight;
+
+    x = index_lookup(t, key, hash, &slot);
+    if (x >= 0) {
+	e = &t->entries[x];
+	e->count += weight;
+	e->error += error;
+	e->aux += aux;
+	heap_down(t, e->heappos);
+	return;
+    }
+
+    isfree = (t->used < t->k);
+    if (isfree) {
+	/* free counter available */
+	x = t->used++;
+	e = &t->entries[x];
+	e->count = weight;
+	e->error = error;
+	e->heappos = x;
+	t->heap[x] = x;
+    } else {
+	/* replace the counter with the smallest count */
+	uint32_t old;
+
+	x = t->heap[0];
+	e = &t->entries[x];
+	index_lookup(t, e->key, e->hash, &old);
+	index_remove(t, old);
+	e->error = e->count + error;
+	e->count += weight;
+	/* the removal may have moved our slot */
+	index_lookup(t, key, hash, &slot);
+    }
+
+    e->aux = aux;
+    e->hash = hash;
+    memcpy(e->key, key, t->keylen);
+    t->index[slot] = x;
+
+    if (isfree)
+	heap_up(t, e->heappos);
+    else
+	heap_down(t, e->heappos);
+}
+
+/*
+ * -- topk_update
+ *
+ * Add weight to the counter of key. hash is the hash of the key
+ * (computed by the caller, e.g., with hashfn).
+ */
+void
+topk_update(topk_t *t, const void *key, uint32_t hash, uint64_t weight,
+	    uint64_t aux)
+{
+    topk_add(t, key, hash, weight, aux, 0);
+}
+
+/*
+ * -- topk_merge
+ *
+ * Merge the counters of src into dst. The error bounds of the
+ * two summaries add up. Returns -1 if the key lengths differ.
+ */
+int
+topk_merge(topk_t *dst, const topk_t *src)
+{
+    uint32_t i;
+    uint64_t total;
+
+    if (dst->keylen != src->keylen)
+	return -1;
+
+    total = dst->total + src->total;
+    for (i = 0; i < src->used; i++) {
+	const topk_entry_t *e = &src->entries[i];
+	topk_add(dst, e->key, e->hash, e->count, e->aux, e->error);
+    }
+    dst->total = total;
+    return 0;
+}
+
+static int
+cmp_entries(const void *a, const void *b)
+{
+    const topk_entry_t *x = *(topk_entry_t * const *) a;
+    const topk_entry_t *y = *(topk_entry_t * const *) b;
+
+    if (x->count == y->count)
+	return 0;
+    return (x->count > y->count) ? -1 : 1;
+}
+
+/*
+ * -- topk_sorted
+ *
+ * Fill out with (at most n) pointers to the counters with the largest
+ * counts, in decreasing order. Returns the number of pointers written.
+ * The pointers are valid until the next update.
+ */
+uint32_t
+topk_sorted(topk_t *t, topk_entry_t **out, uint32_t n)
+{
+    topk_entry_t **all;
+    uint32_t i;
+
+    if (t->used == 0)
+	return 0;
+
+    all = alc_malloc(t->alc, t->used * sizeof(topk_entry_t *));
+    for (i = 0; i < t->used; i++)
+	all[i] = &t->entries[i];
+    qsort(all, t->used, sizeof(topk_entry_t *), cmp_entries);
+
+    if (n > t->used)
+	n = t->used;
+    memcpy(out, all, n * sizeof(topk_entry_t *));
+    alc_free(t->alc, all);
+    return n;
+}
+
+uint64_t
+topk_total(const topk_t *t)
+{
+    return t->total;
+}
+
+/*
+ * -- topk_min
+ *
+ * Smallest monitored count. This is an upper bound on the weight of
+ * any key that is not in the summary.
+ */
+uint64_t
+topk_min(const topk_t *t)
+{
+    if (t->used < t->k)
+	return 0;
+    return HEAP_COUNT(t, 0);
+}
+
+size_t
+topk_memusage(const topk_t *t)
+{
+    return sizeof(topk_t) +
+	   t->k * (sizeof(topk_entry_t) + sizeof(uint32_t)) +
+	   (t->idxmask + 1) * sizeof(int32_t);
+}
@@ -281,6 +281,17 @@ load(void * self, char * buf, size_t len, timestamp_t * ts)
 }
 
 
+static int
+rollup(void * self, char * dst, char * src, int n)
+{
+    config_t * cf = CONFIG(self);
+
+    /* skip the timestamp */
+    rollup_stat(dst + 4, src ? src + 4 : NULL, cf->classes, n); 
+    return 0;
+}
+
+
 #define GNUPLOTHDR 							\
     "set terminal postscript eps color solid lw 1 \"Helvetica\" 14;"	\
     "set grid;"								\
@@ -482,5 +493,6 @@ MODULE(apps) = {
     load: load,
     print: print,
     replay: NULL,
+    rollup: rollup,
     formats: "plain pretty gnuplot",
 };
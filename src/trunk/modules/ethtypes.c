@@ -246,6 +246,23 @@ load(void * self, char * buf, size_t len, timestamp_t * ts)
 }
 
 
+static int
+rollup(__attribute__((__unused__)) void * self, char * dst, char * src, 
+       int n)
+{
+    uint32_t count; 
+
+    /* the two records must have the same types */
+    memcpy(&count, dst + 8, 4); 
+    if (src != NULL && memcmp(dst + 8, src + 8, 4) != 0) 
+	return -1; 
+
+    /* skip timestamp and count */
+    rollup_stat(dst + 12, src ? src + 12 : NULL, ntohl(count), n); 
+    return 0;
+}
+
+
 
 #define PRINT_PLAIN		0
 #define PRINT_PRETTY		1
@@ -521,6 +538,7 @@ MODULE(ethtypes) = {
     load: load,
     print: print,
     replay: NULL,
+    rollup: rollup,
     formats: "plain pretty gnuplot"
 };
 
@@ -25,7 +25,6 @@
  *
  * $Id: tuple.c 976 2006-10-30 19:01:52Z xxxx $
  */
-
 /*
  * TCP Flow Reassembly Module.
  *
@@ -35,12 +34,19 @@
  * It checks for the initial SYN to get the initial sequence number, then 
  * reassembles all ordered packets or buffers the unordered. Finally, when 
  * the TCP flow finishes, it outputs the reassembled TCP flow.
+ *
+ * The reassembly itself is done by the reass library (see reass.h). 
+ * Capture records only hold the packet header and a copy of the packet 
+ * sized to its capture length. The data buffered out of order is capped 
+ * per flow ("max_buffer") and for the whole module ("max_memory"). When 
+ * the latter is exceeded, flows with buffered data are stored as they are. 
  */
 
 #include <stdio.h>
 #include <time.h>
 #include "module.h"
-#include "hash.h"
+#include "reass.h"
+#include "hashfn.h"
 #include "printpkt.h"       
         
 #define FLOWDESC    struct _reass_cap
@@ -50,10 +56,10 @@
 /* posisble status for flows */
 enum flow_status {
     IN_PROCESS,     /* currently being captured, action does nothing */
-    COMPLETE,       /* all blocks in correct order, and FIN/RST has arrived, 
-                       action stores */
-    COMPLETE_BUFFER /* FIN/RST has arrived, but blocks are all in the buffer 
-                       (so SYN missing). action sorts blocks and then stores */
+    COMPLETE,       /* FIN/RST has arrived (after the SYN), action stores 
+                       after wait_fin */
+    COMPLETE_BUFFER /* FIN/RST has arrived, but SYN missing. action starts 
+                       from the lowest sequence number and then stores */
 };
 
 /* 
@@ -69,36 +75,25 @@ enum flow_status {
 #define PRETTYFMT   0
 #define PCAPFMT     1
 
-/* struct to save each block of data that is already saved in order */
-struct _reass_block
-{
-    /* pointer to previous and next block in the ordered list of blocks */
-    struct _reass_block * next; 
-    struct _reass_block * prev;
-    
-    /* actual payload */
-    unsigned char * data;
-    
-    /* length of the payload */
-    uint32_t len;
-    
+FLOWDESC {
     /* 
-     * sequence number of this block, also the key for the hash table when the
-     * block is out of order
+     * packet header. the payload points to a copy of the packet 
+     * allocated in the capture memory (and released with the table). 
      */
-    uint32_t seq;
-    
-    /* FIN and RST flags, to know if the flow has ended */
-    uint16_t fin;
-    uint16_t rst;
+    pkt_t pkt; 
 };
-        
-typedef struct _reass_block block_t;
 
-FLOWDESC {
-    /* full packet */
-    int len; 
-    char buf[2048]; 
+/* 
+ * flush state. mem_mdl_malloc() rounds sizes to a power of two so 
+ * the copies of the packets are carved out of larger chunks of 
+ * capture memory instead, one caplen at a time. 
+ */
+#define STATE		struct _reass_state
+#define PAYLOAD_CHUNK	(64 * 1024)
+
+STATE {
+    char * base;		/* free space in the current chunk */
+    size_t left;		/* bytes left in the current chunk */
 };
 
 EFLOWDESC {
@@ -114,24 +109,11 @@ EFLOWDESC {
     uint16_t dst_port;
     uint16_t src_port;
     
-    /* expected and initial sequence numbers */
-    uint32_t next_seq;
-    uint32_t base_seq;
-    
-    /* 
-     * hash table with packets out of order, waiting for the missing sequence
-     * numbers
-     */
-    hash_t *htable;
-    
-    /* length of buffered data */
-    uint32_t buffer_len;
-    
-    /*
-     * current reassembled flow (length should always be next_seq - base_seq ?)
-     */
-    block_t * data;
-    uint32_t len;
+    /* reassembled data and segments waiting for missing data */
+    reass_t *rs;
+
+    /* buffered bytes accounted in the module total */
+    uint32_t buffered;
     
     /*
      * CoMo header + l2, l3, l4 headers of the first packet of the flow. Will
@@ -147,228 +129,43 @@ CONFIGDESC {
     timestamp_t flow_timeout;   /* timeout to expire an idle flow */
     uint32_t wait_fin;          /* time to wait for TCP flow finalization after
                                    detecting FIN / RST */
+    uint32_t max_buffer;        /* max bytes out of order per flow */
+    uint64_t max_memory;        /* max bytes out of order for all flows */
     int format;
 };
 
+/* 
+ * bytes buffered out of order by all flows. this is only used by 
+ * EXPORT so it does not need to be in the module memory. 
+ */
+static uint64_t buffered_total = 0;
 
-/* block_t constructor */
-static void
-init_block(block_t *block)
-{
-    block->next = NULL;
-    block->prev = NULL;
-    
-    block->data = NULL;
-    block->len = 0;
-
-    block->seq = 0;
-}
-
-static void 
-buffer_block(EFLOWDESC *ex, block_t *block)
-{
-    /* just insert in the hash */
-    hash_insert_ulong(ex->htable, block->seq, block);
-    ex->buffer_len += block->len;
-}
-
-static int
-unbuffer_block(EFLOWDESC *ex, uint32_t seq, uint32_t len)
-{
-    /* just remove from the hash */
-    int ret;
-    
-    ret = hash_remove_ulong(ex->htable, seq);
-    ex->buffer_len -= len;
-    
-    return ret;
-}
-
+/* 
+ * -- account
+ * 
+ * update the total of buffered bytes after the flow changed
+ */
 static void
-add_block(EFLOWDESC *ex, block_t *block, void *mdl)
+account(EFLOWDESC *ex)
 {
-    /* aux variables necesary in case there is overlapping */
-    unsigned char * aux_data;   /* previous data (with overlapping) */
-    uint32_t aux_old_len;       /* size of old data */
+    uint32_t now = reass_buffered(ex->rs);
 
-    CONFIGDESC *config = CONFIG(mdl);
-    
-    /*
-     * at this point, block->next and block->prev are both NULL (should be)
-     * ex->data is a circular doubled-linked list. always add next block at 
-     * the end. to get the reassembled flow, just follow the list in order
-     */
-    if (ex->data == NULL) {
-        /* special case: first element, just add element and point both 
-         * pointers to itself
-         */
-        ex->data = block;
-        block->next = block;
-        block->prev = block;
-    } else {
-        /* 
-         * first check if the blocks sequence number is the expected, or less 
-         * than the expected (overlapped packet)
-         */
-        if (block->seq < ex->next_seq) {
-            /* if so, trim the data to only the necessary */
-            if (block->seq + block->len <= ex->next_seq)
-                return; /* its old data, do nothing with it */
-            else {
-                /* modify block so its the next expected block */
-                aux_data = block->data;
-                aux_old_len = ex->next_seq - block->seq; /* size of OLD data */
-                
-                block->len -=  aux_old_len;
-                block->seq = ex->next_seq;
-                
-                block->data = (unsigned char *)mem_mdl_malloc(mdl, block->len);
-                memcpy(block->data, aux_data+aux_old_len, block->len);
-                
-                mem_mdl_free(mdl, aux_data);
-            }
-        }
-        
-        /* check if it was the last block */
-        if (block->fin || block->rst) {
-            ex->status = COMPLETE;
-            ex->next_seq++;
-        }
-        
-        /* add block to the data, only if len > 0 */
-        if (block->len > 0) {
-            /* normal case: add block at the end (the end = ex->data->prev) */
-            block->next = ex->data;
-            block->prev = ex->data->prev;
-            
-            ex->data->prev->next = block;
-            ex->data->prev = block;
-        } else 
-            /* free block info (no data to free, should be null) */
-            mem_mdl_free(mdl, block);
-    }
-    
-    /* 
-     * update the information in export entry - next sequence number expected, 
-     * and total data length
-     */
-    if (block != NULL) {
-        ex->next_seq += block->len;
-        ex->len += block->len;
-    }
+    buffered_total += now;
+    buffered_total -= ex->buffered;
+    ex->buffered = now;
 }
 
 static void
-check_buffer(EFLOWDESC *ex, void *mdl)
-{
-    /* 
-     * lookup for a item in the hash table with sequence number = ex->next_seq.
-     * if found, repeat until not found
-     */
-    block_t * block;
-    hash_iter_t iterator;
-    
-    block = (block_t *)hash_lookup_ulong(ex->htable, ex->next_seq);
-    
-    while (block != NULL) {
-        if (block->seq == ex->next_seq) {   /* must ALWAYS be true :) */
-            add_block(ex, block, mdl);
-            unbuffer_block(ex, block->seq, block->len);
-        }
-        block = (block_t *)hash_lookup_ulong(ex->htable, ex->next_seq);
-    }
-    
-    /* 
-     * in case there are overlapped packets, iterate on the hash table to look 
-     * for sequence numbers < ex->next_seq
-     */
-    hash_iter_init(ex->htable, &iterator);
-    
-    while (hash_iter_next (&iterator)) {
-        block = (block_t *)hash_iter_get_value(&iterator);
-        
-        if (block->seq <= ex->next_seq) {
-            add_block(ex, block, mdl);
-            
-            /*
-             * remove from hash with current key value, because the sequence 
-             * number could have changed (in case of overlap with valid data), 
-             * so no longer would coincide with the hash key
-             */
-            unbuffer_block(ex, hash_iter_get_ulong_key(&iterator), block->len);
-            
-            /* start again */
-            hash_iter_init(ex->htable, &iterator);
-        }
-    }
-}
-
-static void 
-sort_buffer(EFLOWDESC *ex, void *mdl)
+finalize_flow(EFLOWDESC *ex)
 {
     /* 
-     * this only happens when FIN / RST arrives for a flow that was already 
-     * established when sniffing started. so SYN was not captured (initial
-     * sequence number). in this case, just sort what we have captured.
-     */
-    hash_iter_t iterator;
-    block_t * block, * min_block;
-    
-    min_block = NULL;
-    hash_iter_init(ex->htable, &iterator);
-    
-    while (hash_iter_next(&iterator)) {
-        block = (block_t *)hash_iter_get_value (&iterator);
-        
-        if (min_block == NULL || block->seq < min_block->seq)
-            min_block = block;
-    }
-    
-    /* 
-     * min_block is now the 'first' block of all. so set it as the first block,
-     * then call check_buffer to put everything in place.
+     * if the SYN was not received, start from the first segment we 
+     * have. the data that is still waiting for missing segments 
+     * cannot be reassembled. 
      */
-    if (min_block != NULL) {
-        ex->base_seq = min_block->seq;
-        ex->next_seq = min_block->seq;
-        
-        add_block(ex, min_block, mdl);
-        unbuffer_block(ex, min_block->seq, min_block->len);
-        
-        check_buffer(ex, mdl);
-    }
-    
-    /* now all possible blocks to be ordered (if any) should be in order */
-}
-
-/* hash function for the hash table containing out of order packets */
-static uint
-hash_function(const void *key)
-{
-    return (uint)((uint32_t)key);
-}
-
-static int
-key_cmp_function(const void *key1, const void *key2)
-{
-    if ((uint32_t)key1 == (uint32_t)key2)
-        return 0;
-    
-    return 1;
-}
-
-static void
-finalize_flow(EFLOWDESC *ex, void *mdl)
-{
-    if ((ex->next_seq == 0) &&  (ex->base_seq == 0))
-        sort_buffer(ex, mdl); /* didnt receive SYN, so sort the buffer */
-    else {
-        /* 
-         * did receive SYN, so just reassemble as many packets as possible in 
-         * the buffer
-         */
-        check_buffer(ex, mdl);
-    }
+    reass_start_lowest(ex->rs);
+    reass_drop_pending(ex->rs);
+    account(ex);
 }
 
 static timestamp_t
@@ -398,6 +195,8 @@ init(void *self, char *args[])
     /* default values for config parameters */
     config->flow_timeout = TIME2TS(60, 0);
     config->wait_fin = 60;
+    config->max_buffer = MAX_FLOW_SIZE;
+    config->max_memory = 64 * 1024 * 1024;
     
     for (i = 0; args && args[i]; i++) {
         if (strstr(args[i], "flow_timeout=")) {
@@ -408,6 +207,14 @@ init(void *self, char *args[])
             char * w_f = index(args[i], '=') + 1; 
             config->wait_fin = atoi(w_f);
         }
+        if (strstr(args[i], "max_buffer=")) {
+            char * m_b = index(args[i], '=') + 1; 
+            config->max_buffer = atoi(m_b);
+        }
+        if (strstr(args[i], "max_memory=")) {
+            char * m_m = index(args[i], '=') + 1; 
+            config->max_memory = strtoull(m_m, NULL, 0);
+        }
     }
 
     CONFIG(self) = config;
@@ -434,25 +241,48 @@ check(void *self, pkt_t *pkt)
 static uint32_t
 hash(void *self, pkt_t *pkt)
 {
+    hkey_tuple4_t key; 
+
     if (pkt->l3type != ETHERTYPE_IP) 
         return 0; 
 
     /* must be the same source ip, dest ip, source port, dest port */
-    return (H32(IP(src_ip)) ^ H32(IP(dst_ip)) ^ (H16(TCP(dst_port)) << 3) ^ 
-           (H16(TCP(dst_port)) << 3));
+    hkey_tuple4_fill(&key, pkt); 
+    return hashfn_tuple4(0, &key);
+}
+
+static void *
+flush(void *self)
+{
+    STATE *st;
+
+    st = mem_mdl_malloc(self, sizeof(STATE));
+    st->base = NULL;
+    st->left = 0;
+    return st;
 }
 
 static int
 update(void *self, pkt_t *pkt, void *fh, int isnew)
 {
-    CONFIGDESC *config = CONFIG(self);
-        
     FLOWDESC *x = F(fh);
-    x->len = sizeof(pkt_t) + pkt->caplen;
+    STATE *st = FSTATE(self);
+    size_t len;
 
-    memcpy(x->buf, pkt, sizeof(pkt_t));
-    memcpy(x->buf + sizeof(pkt_t), pkt->payload, pkt->caplen);
-    ((pkt_t *) x->buf)->payload = x->buf + sizeof(pkt_t);
+    /* 
+     * the copy is as large as the captured packet (rounded to keep 
+     * the headers aligned), not more. 
+     */
+    len = (pkt->caplen + 7) & ~7;
+    if (st->left < len) {
+        st->left = MAX(PAYLOAD_CHUNK, len);
+        st->base = mem_mdl_malloc(self, st->left);
+    }
+    memcpy(&x->pkt, pkt, sizeof(pkt_t));
+    x->pkt.payload = st->base;
+    memcpy(x->pkt.payload, pkt->payload, pkt->caplen);
+    st->base += len;
+    st->left -= len;
     
     return 1;   /* records are always full */
 }
@@ -465,7 +295,7 @@ ematch(void *self, void *efh, void *fh)
     FLOWDESC *x = F(fh);
     EFLOWDESC *ex = EF(efh);
 
-    pkt = (pkt_t *)x->buf;
+    pkt = &x->pkt;
     
     if (ex->full_flow == 0) { /* if its full, go to next export record */
         ret = ((ex->dst_port == H16(TCP(dst_port))) && 
@@ -483,21 +313,16 @@ export(void *self, void *efh, void *fh, int isnew)
     FLOWDESC *x = F(fh);
     EFLOWDESC *ex = EF(efh);
     pkt_t* pkt;
-    pkt_t* pktaux;
+    uint32_t len;
     
     CONFIGDESC *config = CONFIG(self);
     
-    block_t * block;
-    
     module_t * mdl = self;
-    pkt = (pkt_t *)x->buf;
+    pkt = &x->pkt;
     
     if (isnew) {
         ex->full_flow = 0;
         
-        ex->next_seq = 0;
-        ex->base_seq = 0;
-        
         ex->src_ip = H32(IP(src_ip));
         ex->dst_ip = H32(IP(dst_ip));
         ex->src_port = H16(TCP(src_port));
@@ -515,93 +340,44 @@ export(void *self, void *efh, void *fh, int isnew)
         ((pkt_t *) ex->comohdr)->caplen = pkt->l7ofs;
         ((pkt_t *) ex->comohdr)->len = pkt->l7ofs;
         
-        ex->data = NULL;
-        ex->len = 0;
-        
-        ex->htable = hash_new(&(mdl->alc), HASHKEYS_ULONG, hash_function, 
-                              key_cmp_function);
-        ex->buffer_len = 0;
+        ex->rs = reass_new(&(mdl->alc), config->max_buffer);
+        ex->buffered = 0;
 
         ex->status = IN_PROCESS;
     }
     
     ex->ts = COMO(ts);
     
-    if ((ex->next_seq == 0) &&  (ex->base_seq == 0) && (TCP(syn) == 1)) { 
-        /* SYN has arrived, can start assembling */
-        
+    if (TCP(syn) == 1) { 
         /* 
-         * syn is always in order as it's the first packet.
-         * the next seq number after SYN is always ISN + 1 -> i'm using 
-         * relative numbers
+         * SYN has arrived, can start assembling. the first byte of 
+         * data is ISN + 1. this also puts in order the segments that 
+         * arrived before the SYN. 
          */
-        ex->base_seq = H32(TCP(seq));
-        ex->next_seq = 1;  
-       
+        reass_start(ex->rs, H32(TCP(seq)) + 1);
+    } else if (ex->full_flow == 0) { 
         /* 
-         * check the list of out-of-order in case something arrived before 
-         * the SYN
+         * length of real data is IP:total_length - IP:header_size - 
+         * TCP:header_size (limited to what we have captured) 
          */
-        check_buffer(ex, self);
-    } 
-    else {
-        if (ex->full_flow == 0) { 
-            /*
-             * other cases: create the block, then decide what to do with it 
-             * (assemble it or buffer it)
-             */
-            block = (block_t *)mem_mdl_malloc(self, sizeof(block_t));
-            init_block(block);
-            
-            /* 
-             * length of real data is IP:total_length - IP:header_size - 
-             * TCP:header_size
-             */
-            block->len = H16(IP(len)) - 4*(IP(ihl)) - 4*(TCP(hlen));
-            
-            if (block->len > 0) {
-                /* reserve space and memcpy the data */
-                block->data = (unsigned char *)mem_mdl_malloc(self, block->len);
-                memcpy(block->data, (pkt->payload + pkt->l7ofs), block->len); 
-            }
-                
-            /* set the TCP sequence number and flags */
-            block->seq = H32(TCP(seq)) - ex->base_seq;
-            block->fin = TCP(fin);
-            block->rst = TCP(rst);
-                
-            if ((ex->next_seq == 0) && (ex->base_seq == 0)) {
-                /* pkt has arrived before syn */
-                if (block->fin || block->rst) 
-                    ex->status = COMPLETE_BUFFER;
-                
-                /* add to the buffer */
-                if(block->len > 0)
-                    buffer_block(ex, block);
-                else
-                    mem_mdl_free(self, block);
-            }
-            else { 
-                /* 
-                 * not waiting for SYN - check if packet is the next one in the
-                 * flow, if not just add to buffer
-                 */
-                if(block->seq <= ex->next_seq) {
-                    add_block(ex, block, mdl);
-                   /* 
-                    * check the list of out-of-order in case something arrived 
-                    * before the SYN
-                    */
-                    check_buffer(ex, self);
-                } else
-                    buffer_block(ex, block);
-            }
-        }
-        
-        if ((ex->len + ex->buffer_len + MAX_HDR + 2000) >= MAX_FLOW_SIZE) {
-            ex->full_flow = 1;
-            return 1;
-        }
+        len = H16(IP(len)) - 4*(IP(ihl)) - 4*(TCP(hlen));
+        if (pkt->caplen <= pkt->l7ofs) 
+            len = 0; 
+        else if (len > pkt->caplen - pkt->l7ofs) 
+            len = pkt->caplen - pkt->l7ofs; 
+
+        reass_add(ex->rs, H32(TCP(seq)), pkt->payload + pkt->l7ofs, len);
+
+        if (TCP(fin) || TCP(rst)) 
+            ex->status = reass_started(ex->rs) ? COMPLETE : COMPLETE_BUFFER;
+    }
+
+    account(ex);
+    
+    len = reass_len(ex->rs) + reass_buffered(ex->rs);
+    if (len + MAX_HDR + 2000 >= MAX_FLOW_SIZE) {
+        ex->full_flow = 1;
+        return 1;
     }
 
     return 0;
@@ -616,37 +392,36 @@ action(void *self, void *efh, timestamp_t ivl, timestamp_t current_time,
 
     if (efh == NULL) 
         return ACT_GO;
-    else {
-        switch(ex->status) {
-            case IN_PROCESS:
-                if ((TS2SEC(current_time) - TS2SEC(ex->ts) >
-                     TS2SEC(config->flow_timeout)) || ex->full_flow) {
-                    /*
-                     * flow has expired (no new packets for more than 
-                     * flow_timeout) or 
-                     * flow is too big to be stored - this part will be stored 
-                     * now and next part will be put in a separate export
-                     * record
-                     */
-                    finalize_flow(ex, self);
-                    check_buffer(ex, self);
-                    return ACT_STORE | ACT_DISCARD;
-                }
-                return 0;
-                
-            case COMPLETE:
-                if (current_time - ex->ts < config->wait_fin)
-                    return 0;
-                else
-                    return ACT_STORE | ACT_DISCARD;
-                
-           case COMPLETE_BUFFER:
-                sort_buffer(ex, self);
-                return ACT_STORE | ACT_DISCARD;
-                
-            default:
-                return 0;
+
+    switch(ex->status) {
+    case IN_PROCESS:
+        if ((TS2SEC(current_time) - TS2SEC(ex->ts) >
+             TS2SEC(config->flow_timeout)) || ex->full_flow ||
+            (buffered_total > config->max_memory && ex->buffered > 0)) {
+            /*
+             * flow has expired (no new packets for more than 
+             * flow_timeout) or flow is too big to be stored - this 
+             * part will be stored now and next part will be put in 
+             * a separate export record - or we are using too much 
+             * memory for data out of order. 
+             */
+            finalize_flow(ex);
+            return ACT_STORE | ACT_DISCARD;
         }
+        return 0;
+        
+    case COMPLETE:
+        if (TS2SEC(current_time) - TS2SEC(ex->ts) < config->wait_fin)
+            return 0;
+        finalize_flow(ex);
+        return ACT_STORE | ACT_DISCARD;
+        
+    case COMPLETE_BUFFER:
+        finalize_flow(ex);
+        return ACT_STORE | ACT_DISCARD;
+        
+    default:
+        return 0;
     }
 }
 
@@ -655,56 +430,21 @@ store(void * self, void *efh, char *buf)
 {
     EFLOWDESC *ex = EF(efh);
     pkt_t * pkt;
-    uint32_t size;
+    uint32_t size, hdrlen, len;
         
-    CONFIGDESC *config = CONFIG(self);
-    
-    uint32_t maxsize = MAX_FLOW_SIZE - sizeof(pkt_t) - MAX_HDR;
-    
     /* 
      * save space for the CoMo header and the reassembled data.
      * size > MAX_FLOW_SIZE is controlled in ematch/export
      */
-    size = sizeof(pkt_t) + ((pkt_t *) ex->comohdr)->caplen + ex->len; 
-    
-    pkt = (pkt_t *)ex->comohdr;
-    
-    memcpy(buf, ex->comohdr, sizeof(pkt_t) + ((pkt_t *) ex->comohdr)->caplen);
-    
-    /* loop to copy all the blocks of this flow */
-    block_t * block, * remove_block;
-    uint32_t current_total_len = 0;
+    hdrlen = sizeof(pkt_t) + ((pkt_t *) ex->comohdr)->caplen;
+    memcpy(buf, ex->comohdr, hdrlen);
     
-    if (ex->data != NULL) {
-        block = ex->data;
-        
-        do {
-            memcpy(buf + sizeof(pkt_t) + ((pkt_t *) ex->comohdr)->caplen + 
-                   current_total_len, block->data, block->len);
-            current_total_len += block->len;
-            /* 
-             * Once it's already stored, free the memory reserved for the 
-             * reassembled data. Check if data is empty first!
-             */
-            remove_block = block;
-            block = block->next;
-            
-            if (remove_block != ex->data) {
-                /* 
-                 * free all blocks except the first one (to check when we have
-                 * finished the loop)
-                 */
-                mem_mdl_free(self, remove_block->data);
-                mem_mdl_free(self, remove_block);
-            }
-        } while (block != ex->data);
-        
-        /* now we can free the first block */
-        if (ex->data->data != NULL) 
-            mem_mdl_free(self, ex->data->data);
+    /* copy all the data of this flow, then free it */ 
+    len = reass_copy(ex->rs, buf + hdrlen, MAX_FLOW_SIZE - hdrlen);
+    size = hdrlen + len; 
 
-        mem_mdl_free(self, ex->data);
-    }
+    reass_destroy(ex->rs);
+    ex->rs = NULL;
     
     /* payload pointer */
     ((pkt_t *)buf)->payload = buf + sizeof(pkt_t);
@@ -712,8 +452,8 @@ store(void * self, void *efh, char *buf)
     pkt = (pkt_t *)buf;
     
     COMO(ts) = ex->ts;      /* latest timestamp */
-    COMO(len) += ex->len;   /* length was only the headers - add the data */
-    COMO(caplen) += ex->len;
+    COMO(len) += len;       /* length was only the headers - add the data */
+    COMO(caplen) += len;
     
     /* 
      * change IP header accordingly.
@@ -878,6 +618,7 @@ MODULE(flow-reassembly) =
     hash: hash,
     match: NULL,
     update: update,
+    flush: flush,
     ematch: ematch,
     export: export,
     compare: NULL,
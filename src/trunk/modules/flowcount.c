@@ -37,20 +37,25 @@
  * The user can decide what the exact definition of a flow is (e.g. the
  * 5-tuple, or the pair of src and dst addresses)
  * 
- * It uses a techinque called "probabilistic counting" (see "A Linear-Time
- * Probabilistic Counting Algorithm for Database applications", by Kyu-Young
- * Whang, Brad T. Vander-Zanden and Howard M. Taylor) to provide an accurate
+ * It uses a HyperLogLog sketch (see hll.h) to provide an accurate
  * estimation of the number of flows, without the overhead of maintaining
- * per-flow entries in a hash table.
+ * per-flow entries in a hash table. The memory used does not depend on
+ * the number of flows: 2^precision bytes at most (16KB by default).
+ *
+ * If the "sketch" argument is given the sketch of each interval is
+ * stored together with the estimate. Queries with a granularity larger
+ * than the measurement interval then report the number of distinct
+ * flows over the whole granularity period (the union of the sketches)
+ * instead of the average of the per-interval counts.
  *
  */
 
 #include <stdio.h>
 #include <time.h>
-#include <stdlib.h> /* strtoul */
+#include <stdlib.h> /* random */
 #include "module.h"
-#include "bitmap.h"
-#include "uhash.h"
+#include "hll.h"
+#include "hashfn.h"
 
 #define FLOWDESC    struct _flows
 FLOWDESC {
@@ -59,15 +64,20 @@ FLOWDESC {
 
 #define STATE struct _state
 STATE {
-    bitmap_t *bm; /* bitmap used to estimate number of flows */
+    hll_t *hll; /* sketch used to estimate number of flows */
 };
 
 #define RECORD  struct _flows_record
 RECORD {
     int ts;
     uint32_t count;
+    uint32_t sketch_len;	/* bytes of serialized sketch that follow */
+    char sketch[0];
 };
 
+#define DEFAULT_PRECISION	14	/* 0.8% standard error */
+#define MAX_PRECISION		14
+
 #define USE_SRC     0x01
 #define USE_DST     0x02
 #define USE_SPORT   0x04
@@ -77,9 +87,10 @@ RECORD {
 
 typedef struct {
     int  meas_ivl; 		/* measurement interval */
-    size_t max_keys; 		/* max unique keys we expect */ 
+    int precision; 		/* sketch precision */
+    int store_sketch;		/* store sketches with the counts */
     int flow_fields;
-    uhash_t hfunc; 		/* universal hash function */
+    uint64_t seed; 		/* seed of the hash function */
 } config_t;
 
 
@@ -93,9 +104,10 @@ init(void * self, char * args[])
 
     cf = mem_mdl_malloc(self, sizeof(config_t));
     cf->meas_ivl = 1;
-    cf->max_keys = 2000000;  	/* by default expect max 2M keys */
+    cf->precision = DEFAULT_PRECISION;
+    cf->store_sketch = 0;
     cf->flow_fields = 0;
-    uhash_initialize(&cf->hfunc);
+    cf->seed = (uint64_t) random();
 
     /*
      * parse input arguments
@@ -116,8 +128,10 @@ init(void * self, char * args[])
             cf->flow_fields |= strstr(value, "src_port") ? USE_SPORT : 0;
             cf->flow_fields |= strstr(value, "dst_port") ? USE_DPORT : 0;
             cf->flow_fields |= strstr(value, "proto") ? USE_PROTO : 0;
-        } else if (have_kw(args[i], "maxflows")) {
-            cf->max_keys = strtoul(value, NULL, 0);
+        } else if (have_kw(args[i], "precision")) {
+            cf->precision = atoi(value);
+        } else if (have_kw(args[i], "sketch")) {
+            cf->store_sketch = 1;
         }
 #undef has_kw
     }
@@ -129,6 +143,11 @@ init(void * self, char * args[])
     if (cf->flow_fields == 0)
         cf->flow_fields = USE_ALL; 
 
+    if (cf->precision < HLL_MIN_PRECISION)
+        cf->precision = HLL_MIN_PRECISION;
+    if (cf->precision > MAX_PRECISION)
+        cf->precision = MAX_PRECISION;
+
     /* setup indesc */
     inmd = metadesc_define_in(self, 0);
     inmd->ts_resolution = TIME2TS(cf->meas_ivl, 0);
@@ -162,35 +181,27 @@ update(void * self, pkt_t *pkt, void *fh, int isnew)
     FLOWDESC *x = F(fh);
     config_t * cf = CONFIG(self);
     STATE *st = FSTATE(self);
-    uint32_t hash;
+    hkey_tuple4_t key;
 
     if (isnew)
 	x->ts = TS2SEC(pkt->ts);
 
     /*
-     * incrementally hash relevant fields
+     * build the flow key with the relevant fields only and hash it.
+     * the fields not in the flow definition are left to zero.
      */
-    hash = uhash(&cf->hfunc, NULL, 0, UHASH_NEW);
-    if (cf->flow_fields & USE_SRC)
-        hash = uhash(&cf->hfunc, (uint8_t *) &IP(src_ip), 4, UHASH_APPEND);
-    if (cf->flow_fields & USE_DST)
-        hash = uhash(&cf->hfunc, (uint8_t *) &IP(dst_ip), 4, UHASH_APPEND);
-    if (cf->flow_fields & USE_PROTO)
-        hash = uhash(&cf->hfunc, (uint8_t *) &IP(proto), 1, UHASH_APPEND);
-    if (cf->flow_fields & USE_SPORT) {
-        if (isTCP)
-            hash = uhash(&cf->hfunc,(uint8_t*) &TCP(src_port),2,UHASH_APPEND);
-        else if (isUDP)
-            hash = uhash(&cf->hfunc,(uint8_t*) &UDP(src_port),2,UHASH_APPEND);
-    }
-    if (cf->flow_fields & USE_DPORT) {
-        if (isTCP)
-            hash = uhash(&cf->hfunc, (uint8_t *) &TCP(dst_port),2,UHASH_APPEND);
-        else if (isUDP)
-            hash = uhash(&cf->hfunc, (uint8_t *) &UDP(dst_port),2,UHASH_APPEND);
-    }
-
-    set_bit(st->bm, hash);  		/* update bitmap */
+    key = PKTKEY(pkt)->tuple;
+    if (!(cf->flow_fields & USE_SRC))
+        key.src_ip = 0;
+    if (!(cf->flow_fields & USE_DST))
+        key.dst_ip = 0;
+    if (!(cf->flow_fields & USE_PROTO))
+        key.proto = 0;
+    if (!(cf->flow_fields & USE_SPORT))
+        key.src_port = 0;
+    if (!(cf->flow_fields & USE_DPORT))
+        key.dst_port = 0;
+    hll_add(st->hll, hashfn_xx64_lanes(cf->seed, &key, 2));
 
     return 0;
 }
@@ -202,7 +213,8 @@ flush(void *self)
     STATE *st;
 
     st = mem_mdl_malloc(self, sizeof(STATE));
-    st->bm = mdl_new_bitmap(self, cf->max_keys);
+    /* shared memory is released with the whole map (see hll.h) */
+    st->hll = hll_new_arena(&((module_t *) self)->alc, cf->precision);
     return st;
 }
 
@@ -210,12 +222,19 @@ static ssize_t
 store(void * self, void *rp, char *buf)
 {
     FLOWDESC *x = F(rp);
+    config_t * cf = CONFIG(self);
     STATE *st = FSTATE(self);
+    size_t len = 0;
 
     PUTH32(buf, x->ts);
-    PUTH32(buf, (uint32_t) estimate_unique_keys(st->bm));
-
-    return sizeof(RECORD);
+    PUTH32(buf, (uint32_t) (hll_estimate(st->hll) + 0.5));
+    if (cf->store_sketch)
+        len = hll_serialized_size(st->hll);
+    PUTH32(buf, len);
+    if (len > 0)
+        hll_serialize(st->hll, buf, len);
+
+    return sizeof(RECORD) + len;
 }
 
 static size_t
@@ -223,13 +242,13 @@ load(void * self, char * buf, size_t len, timestamp_t * ts)
 {
     RECORD *r = (RECORD *) buf;
 
-    if (len < sizeof(RECORD)) {
+    if (len < sizeof(RECORD) || len < sizeof(RECORD) + ntohl(r->sketch_len)) {
         *ts = 0;
         return 0;
     }
 
     *ts = TIME2TS(ntohl(r->ts), 0);
-    return sizeof(RECORD);
+    return sizeof(RECORD) + ntohl(r->sketch_len);
 }
 
 #define GNUPLOTHDR                                              \
@@ -254,6 +273,7 @@ print(void * self, char *buf, size_t *len, char * const args[])
     static int granularity = 1;
     static int count = 0; 
     static int no_records = 0; 
+    static hll_t * window = NULL;
     config_t * config = CONFIG(self);
     RECORD *x; 
 
@@ -277,12 +297,28 @@ print(void * self, char *buf, size_t *len, char * const args[])
     } 
 
     if (buf == NULL && args == NULL) { 
+        if (window != NULL) {
+            hll_destroy(window);
+            window = NULL;
+        }
         *len = 0; 
         return s; 
     } 
 
     x = (RECORD *) buf;
 
+    /*
+     * if the records carry a sketch, merge them to count the distinct
+     * flows in the granularity period. otherwise average the counts.
+     */
+    if (ntohl(x->sketch_len) > 0) {
+        if (window == NULL)
+            window = hll_deserialize(allocator_safe(), x->sketch,
+                                     ntohl(x->sketch_len), NULL);
+        else
+            hll_merge_serialized(window, x->sketch, ntohl(x->sketch_len));
+    }
+
     count += ntohl(x->count); 
     no_records++;
     if (no_records % granularity != 0) {
@@ -291,6 +327,10 @@ print(void * self, char *buf, size_t *len, char * const args[])
     }
 
     count /= granularity; 
+    if (window != NULL) {
+        count = (int) (hll_estimate(window) + 0.5);
+        hll_reset(window);
+    }
     *len = sprintf(s, GNUPLOTFMT, (uint) ntohl(x->ts), count); 
     count = 0; 
     return s;
@@ -298,7 +338,7 @@ print(void * self, char *buf, size_t *len, char * const args[])
 
 MODULE(flowcount) = {
     ca_recordsize: sizeof(FLOWDESC),
-    st_recordsize: sizeof(RECORD), 
+    st_recordsize: sizeof(RECORD) + HLL_SERIALIZED_MAX(MAX_PRECISION), 
     capabilities: {has_flexible_flush: 0, 0},
     init: init,
     check: NULL,
@@ -35,7 +35,11 @@
  * Pattern search module
  *
  * This module collects a packet level trace, only with the packets
- * that contain a predefined pattern inside their data
+ * that contain one of a set of predefined patterns inside their data. 
+ *
+ * Patterns are given with one or more "pattern=" arguments or in a 
+ * file ("patterns=<file>", one pattern per line). All patterns are 
+ * searched in a single pass over the payload. 
  *
  * The packet is dumped as it is layed out in pkt_t. 
  *
@@ -46,12 +50,15 @@
 #include <sys/types.h>
 #include <string.h>		/* bcopy */
 #include <stdio.h>		/* fprintf, stderr */
+#include <ctype.h>		/* isxdigit */
+#include <errno.h>
 
 #include "module.h"
+#include "como.h"		/* logmsg */
 #include "stdpkt.h"		/* ethernet headers, etc. */
 #include "pcap.h"		/* bpf_int32, etc. */
 #include "printpkt.h"
-#include "pattern_search.h"              /* Boyer-Moore pattern search */
+#include "ac_search.h"			/* multi-pattern search */
 
 /* 
  * FLOWDESC just contains one packet. 
@@ -69,35 +76,109 @@ FLOWDESC {
 
 #define SNAPLEN_MAX (BUFSIZE - sizeof(pkt_t))
 
+#define MAX_PATTERN_SIZE 1024
+
 #define CONFIGDESC      struct _pattern_search_config
 CONFIGDESC {
     unsigned snaplen; /* bytes to capture in each packet */
-    pattern_search_t psearch; /* pattern search info */
+    ac_search_t * ac; /* patterns to search */
     int fmt;          /* query format */
 };
 
+/* 
+ * -- add_pattern 
+ * 
+ * add a pattern to the search, decoding \xHH escapes so that 
+ * binary patterns can be used. 
+ */
+static void
+add_pattern(ac_search_t * ac, char * pat)
+{
+    char buf[MAX_PATTERN_SIZE]; 
+    size_t len; 
+
+    for (len = 0; *pat != '\0' && len < sizeof(buf); len++) { 
+	if (pat[0] == '\\' && pat[1] == 'x' && 
+	    isxdigit((unsigned char) pat[2]) && 
+	    isxdigit((unsigned char) pat[3])) { 
+	    char hex[3] = { pat[2], pat[3], '\0' }; 
+
+	    buf[len] = (char) strtol(hex, NULL, 16); 
+	    pat += 4; 
+	} else { 
+	    buf[len] = *pat++; 
+	} 
+    } 
+
+    if (ac_search_add(ac, buf, len, ac_search_count(ac)) < 0) 
+	logmsg(LOGWARN, "pattern-search: invalid pattern, ignoring\n"); 
+}
+
+/* 
+ * -- load_patterns
+ * 
+ * read the patterns from a file, one per line. empty lines 
+ * and lines starting with '#' are ignored. 
+ */
+static void
+load_patterns(ac_search_t * ac, char * file)
+{
+    char line[MAX_PATTERN_SIZE + 2]; 
+    FILE * fp; 
+
+    fp = fopen(file, "r"); 
+    if (fp == NULL) { 
+	logmsg(LOGWARN, "pattern-search: cannot open %s: %s\n", 
+	       file, strerror(errno)); 
+	return; 
+    } 
+
+    while (fgets(line, sizeof(line), fp) != NULL) { 
+	line[strcspn(line, "\r\n")] = '\0'; 
+	if (line[0] == '\0' || line[0] == '#') 
+	    continue; 
+	add_pattern(ac, line); 
+    } 
+
+    fclose(fp); 
+}
+
 static timestamp_t 
 init(void * self, char * args[])
 {
     CONFIGDESC *config;
     metadesc_t *inmd, *outmd;
     pkt_t *pkt;
+    int nocase = 0; 
     int i;
 
     config = mem_mdl_malloc(self, sizeof(CONFIGDESC));
     config->snaplen = SNAPLEN_MAX;
-    pattern_search_initialize(&config->psearch, "");
 
     for (i = 0; args && args[i]; i++) {
 	if (strstr(args[i], "snaplen=")) { 
 	    char * len = index(args[i], '=') + 1; 
 	    config->snaplen = atoi(len);    /* set the snaplen */
 	} 
+	if (!strcmp(args[i], "nocase")) 
+	    nocase = 1; 
+    }
+
+    /* 
+     * the automaton is used by CAPTURE, allocate it in the 
+     * module memory. 
+     */
+    config->ac = ac_search_new(&((module_t *) self)->alc, nocase); 
+    for (i = 0; args && args[i]; i++) {
 	if (strstr(args[i], "pattern=")) { 
 	    char * pat = index(args[i], '=') + 1;
-            pattern_search_initialize(&config->psearch, pat);
+	    add_pattern(config->ac, pat); 
+	} else if (strstr(args[i], "patterns=")) { 
+	    char * file = index(args[i], '=') + 1;
+	    load_patterns(config->ac, file); 
 	} 
     }
+    ac_search_compile(config->ac); 
 
     /* setup indesc */
     inmd = metadesc_define_in(self, 0);
@@ -118,7 +199,7 @@ check(void * self, pkt_t *pkt)
 {
     CONFIGDESC *config = CONFIG(self);
 
-    return pattern_search(&config->psearch, COMO(payload), COMO(caplen), NULL);
+    return (ac_search(config->ac, COMO(payload), COMO(caplen), NULL, NULL) > 0);
 }
 
 static int
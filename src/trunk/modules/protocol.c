@@ -160,6 +160,28 @@ load(void * self, char * buf, size_t len, timestamp_t * ts)
 }
 
 
+static int
+rollup(__attribute__((__unused__)) void * self, char * dst, char * src, 
+       int n)
+{
+    FLOWDESC *x = (FLOWDESC *) dst; 
+    FLOWDESC *y = (FLOWDESC *) src; 
+    int i; 
+
+    for (i = 0; i < IPPROTO_MAX; i++) { 
+	if (src != NULL) { 
+	    x->bytes[i] = HTONLL(NTOHLL(x->bytes[i]) + NTOHLL(y->bytes[i])); 
+	    x->pkts[i] = htonl(ntohl(x->pkts[i]) + ntohl(y->pkts[i])); 
+	} else { 
+	    x->bytes[i] = HTONLL(NTOHLL(x->bytes[i]) / n); 
+	    x->pkts[i] = htonl(ntohl(x->pkts[i]) / n); 
+	} 
+    } 
+
+    return 0;
+}
+
+
 
 #define PRINT_PLAIN		0
 #define PRINT_PRETTY		1
@@ -425,6 +447,7 @@ MODULE(protocol) = {
     load: load,
     print: print,
     replay: NULL,
+    rollup: rollup,
     formats: "plain pretty gnuplot"
 };
 
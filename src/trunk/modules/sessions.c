@@ -44,21 +44,8 @@
 #include <time.h>
 #include "comofunc.h"
 #include "module.h"
-
-#define FLOWDESC    struct _tuple_stat
-FLOWDESC {
-    timestamp_t start_ts; 
-    timestamp_t last_ts; 
-    n32_t src_ip;
-    n32_t dst_ip;
-    n16_t src_port;
-    n16_t dst_port;
-    uint8_t proto;
-    char padding;
-    uint16_t sampling;
-    uint64_t bytes;
-    uint64_t pkts;
-};
+#include "tuple.h"		/* FLOWDESC */
+#include "hashfn.h"
 
 #define EFLOWDESC   struct _session
 EFLOWDESC {
@@ -191,42 +178,21 @@ init(void * self, char *args[])
 static uint32_t
 hash(void * self, pkt_t *pkt)
 {
-    uint sport, dport; 
-
-    if (isTCP) { 
-	sport = N16(TCP(src_port)); 
-	dport = N16(TCP(dst_port)); 
-    } else if (isUDP) { 
-	sport = N16(UDP(src_port)); 
-	dport = N16(UDP(dst_port)); 
-    } else { 
-	sport = dport = 0;
-    } 
-
-    return (N32(IP(src_ip)) ^ N32(IP(dst_ip)) ^ (sport << 3) ^ (dport << 3));
+    return PKTKEY(pkt)->h_tuple;
 }
 
 static int
 match(void * self, pkt_t *pkt, void *fh)
 {
     FLOWDESC *x = F(fh);
-    uint sport, dport; 
-    
-    if (isTCP) { 
-        sport = N16(TCP(src_port));
-        dport = N16(TCP(dst_port));
-    } else if (isUDP) { 
-        sport = N16(UDP(src_port));
-        dport = N16(UDP(dst_port));
-    } else {
-        sport = dport = 0;
-    }
+    hkey_tuple4_t *k = &PKTKEY(pkt)->tuple;
 
     return (
-         N32(IP(src_ip)) == N32(x->src_ip) &&
-         N32(IP(dst_ip)) == N32(x->dst_ip) &&
-         sport == N16(x->src_port) && dport == N16(x->dst_port) &&
-         IP(proto) == x->proto
+         k->src_ip == N32(x->src_ip) &&
+         k->dst_ip == N32(x->dst_ip) &&
+         k->src_port == N16(x->src_port) && 
+         k->dst_port == N16(x->dst_port) &&
+         k->proto == x->proto
     );
 }
 
@@ -298,11 +264,17 @@ ematch(void *self, void *efh, void *fh)
 static int
 export(void * self, void *efh, void *fh, int isnew)
 {
+    CONFIGDESC * config = CONFIG(self);
     FLOWDESC *x = F(fh);
     EFLOWDESC *ex = EF(efh);
 
     if (isnew) { 
 	bcopy(x, ex, sizeof(EFLOWDESC));
+	/* 
+	 * arm the timer only once. when it fires action() checks 
+	 * last_ts and re-arms it if the session is still active.
+	 */
+	expiry_set(self, efh, ex->last_ts + TIME2TS(config->timeout + 1, 0));
     } else { 
 	ex->pkts += x->pkts; 
 	ex->bytes += x->bytes; 
@@ -329,6 +301,7 @@ action(void *self, void *efh, timestamp_t ivl,
     if (TS2SEC(current_time - ex->last_ts) > config->timeout) 
 	return (ACT_STORE | ACT_DISCARD); 
 
+    expiry_set(self, efh, ex->last_ts + TIME2TS(config->timeout + 1, 0));
     return ACT_GO; 
 }
 
@@ -637,7 +610,7 @@ MODULE(tuple) = {
     ca_recordsize: sizeof(FLOWDESC),
     ex_recordsize: sizeof(FLOWDESC),
     st_recordsize: sizeof(FLOWDESC), 
-    capabilities: {has_flexible_flush: 0, 0},
+    capabilities: {has_flexible_flush: 0, has_expiry: 1, 0},
     init: init,
     check: NULL,
     hash: hash,
@@ -652,5 +625,6 @@ MODULE(tuple) = {
     load: load,
     print: print,
     replay: replay,
+    schema: tuple_schema,
     formats: "plain pretty html"
 };
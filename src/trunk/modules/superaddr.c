@@ -33,7 +33,10 @@
  * et al.
  * 
  * This module mantains a meter of the number of destinations
- * per source or vice versa.
+ * per source or vice versa. The distinct peers of each address are
+ * counted with a HyperLogLog sketch (see hll.h) that starts sparse and
+ * takes at most 2^precision bytes, so that millions of addresses can
+ * be tracked with little memory.
  */
 
 #include <stdio.h>
@@ -42,21 +45,21 @@
 
 #include "module.h"
 #include "printpkt.h"
-#include "uhash.h"
-#include "hash.h"
-#include "bitmap.h"
+#include "hashfn.h"
+#include "hll.h"
 
 #define FLOWDESC    struct _saddr_fd
 FLOWDESC{
     timestamp_t ts;             /* timestamp */
     uint32_t ip_addr;           /* ip address */
-    double meter;               /* number of sources/destinations */
+    hll_t * peers;              /* sketch of sources/destinations */
 };
 
 #define EFLOWDESC   struct _saddr_efd
 EFLOWDESC {
     uint32_t stamp;             /* timestamp */
     uint32_t ip_addr;           /* ip address */
+    hll_t * peers;              /* sketch of sources/destinations */
     double meter;               /*  number of sources/destinations */
 };
 
@@ -73,18 +76,14 @@ CONFIGDESC{
     uint32_t meas_ivl;          /* measurement interval (secs) */
     uint32_t last_export;       /* last export time */
     int use_dst;                /* reporting sources or destinations */
-    uhash_t hfunc;              /* universal hash function */
+    int precision;              /* precision of the sketches */
+    uint64_t seed;              /* seed of the hash function */
     uint32_t threshold;         /* minimum number of src's/dst's to consider
                                    an ip address as a supersrc/superdst */
     uint32_t mask;              /* privacy mask */
 };
 
-#define STATE struct _state
-STATE {
-    bitmap_t *bm;               /* bitmap used to estimate number of flows */
-};
-
-#define UNIQUE_ELEMENTS 1894900u
+#define DEFAULT_PRECISION 10    /* 1KB per address at most, 3% error */
 
 
 /*
@@ -107,6 +106,7 @@ init(void *self, char *args[])
     config->use_dst = 0;
     config->threshold = 15;
     config->mask = ~0;
+    config->precision = DEFAULT_PRECISION;
 
     /*
      * process input arguments
@@ -126,8 +126,15 @@ init(void *self, char *args[])
             config->threshold = atoi(x);
         else if (strstr(args[i], "mask"))
             config->mask = (uint32_t) strtoll(x, NULL, 0);
+        else if (strstr(args[i], "precision"))
+            config->precision = atoi(x);
     }
 
+    if (config->precision < HLL_MIN_PRECISION)
+        config->precision = HLL_MIN_PRECISION;
+    if (config->precision > HLL_MAX_PRECISION)
+        config->precision = HLL_MAX_PRECISION;
+
     /* setup indesc */
     inmd = metadesc_define_in(self, 0);
     inmd->ts_resolution = TIME2TS(config->meas_ivl, 0);
@@ -148,33 +155,11 @@ init(void *self, char *args[])
     CONFIG(self) = config; 
 
     /* initialize hash function */
-    uhash_initialize(&config->hfunc);
+    config->seed = (uint64_t) random();
 
     return TIME2TS(config->meas_ivl, 0);
 }
 
-/*
- * -- check
- */
-static int
-check(void * self, pkt_t * pkt) 
-{
-    CONFIGDESC * config = CONFIG(self);
-    int bit_value;
-    uint32_t h;
-    STATE * state = FSTATE(self);
-
-    /* source and destination ip addresses  hash */
-    h = uhash(&config->hfunc, (uint8_t *) &IP(src_ip), 4, UHASH_NEW);
-    h = uhash(&config->hfunc, (uint8_t *) &IP(dst_ip), 4, UHASH_APPEND);
-    bit_value = test_and_set_bit(state->bm, h);
-
-    if (bit_value)  /* this flow has already been seen */
-        return 0;
-
-    return 1;       /* the flow is new, so we allow the packet to continue */
-}
-
 /*
  * -- hash
  */
@@ -184,9 +169,9 @@ hash(void * self, pkt_t *pkt)
     CONFIGDESC * config = CONFIG(self);
 
     if (config->use_dst)
-        return uhash(&config->hfunc, (uint8_t *) &IP(dst_ip), 4, UHASH_NEW);
+        return PKTKEY(pkt)->h_dst;
 
-    return uhash(&config->hfunc, (uint8_t *) &IP(src_ip), 4, UHASH_NEW);
+    return PKTKEY(pkt)->h_src;
 }
 
 
@@ -200,9 +185,9 @@ match(void * self, pkt_t *pkt, void *fh)
     CONFIGDESC * config = CONFIG(self);
 
     if (config->use_dst)
-        return H32(IP(dst_ip)) == fd->ip_addr;
+        return ntohl(PKTKEY(pkt)->tuple.dst_ip) == fd->ip_addr;
     else
-        return H32(IP(src_ip)) == fd->ip_addr;
+        return ntohl(PKTKEY(pkt)->tuple.src_ip) == fd->ip_addr;
 }
 
 
@@ -216,40 +201,27 @@ update(void *self, pkt_t *pkt, void *fh, int isnew)
 {
     FLOWDESC * fd = F(fh);
     CONFIGDESC * config = CONFIG(self);
-    STATE * state = FSTATE(self);
+    hkey_addrpair_t peer;
 
     if (isnew) {
         fd->ip_addr = config->use_dst? H32(IP(dst_ip)): H32(IP(src_ip));
         fd->ts = pkt->ts;
-        fd->meter = 0;
+        /* 
+         * the sketch lives in the module shared map that is released
+         * as a whole, it must not free its blocks (see hll.h)
+         */
+        fd->peers = hll_new_arena(&((module_t *) self)->alc, 
+				  config->precision);
     }
 
-    /* 
-     * the load factor of the bitmap serves to estimate how
-     * many new flows should be attributed to the addr.
-     */
-    double load_factor = (double) (get_nbits(state->bm)) / 
-                         (double) (count_zeros(state->bm));
-    fd->meter += load_factor;
+    /* add the other end to the sketch of this address */
+    peer.src_ip = config->use_dst? N32(IP(src_ip)): N32(IP(dst_ip));
+    peer.dst_ip = 0;
+    hll_add(fd->peers, hashfn_xx64_lanes(config->seed, &peer, 1));
 
     return 0;
 }
 
-/*
- * -- flush
- */
-static void *
-flush(void *self)
-{
-    CONFIGDESC * config = CONFIG(self);
-    STATE *st;
-
-    uhash_initialize(&config->hfunc);
-    st = mem_mdl_malloc(self, sizeof(STATE));
-    st->bm = mdl_new_bitmap(self, UNIQUE_ELEMENTS);
-    return st;
-}
-
 /*
  * -- ematch
  */
@@ -272,14 +244,22 @@ ematch(void *self, void *efh, void *fh)
 static int
 export(void * self, void *efh, void *fh, int isnew)
 {
+    CONFIGDESC * config = CONFIG(self);
     FLOWDESC *fd = F(fh);
     EFLOWDESC *efd = EF(efh);
 
     if (isnew) {
         bzero(efd, sizeof (EFLOWDESC));
         efd->ip_addr = fd->ip_addr;
+        efd->peers = hll_new(allocator_safe(), config->precision);
     }
-    efd->meter += fd->meter;
+
+    /* 
+     * merge the sketch of this interval. the estimate is cached 
+     * for compare() that is called several times per record.
+     */
+    hll_merge(efd->peers, fd->peers);
+    efd->meter = hll_estimate(efd->peers);
 
     return 0;
 }
@@ -340,7 +320,14 @@ store(void *self, void *efh, char *buf)
 
     PUTH32(buf, config->last_export);
     PUTH32(buf, efd->ip_addr);
-    PUTH32(buf, (uint32_t) efd->meter);
+    PUTH32(buf, (uint32_t) (efd->meter + 0.5));
+
+    /* 
+     * action() always discards the records after storing them. 
+     * the sketch is not needed anymore.
+     */
+    hll_destroy(efd->peers);
+    efd->peers = NULL;
 
     return sizeof(DISK_RECORD);
 }
@@ -573,11 +560,11 @@ MODULE(superaddrs) = {
     st_recordsize: sizeof(DISK_RECORD),
     capabilities: {has_flexible_flush: 0, 0},
     init: init,
-    check: check,
+    check: NULL,
     hash: hash,  
     match: match,
     update: update,
-    flush: flush,
+    flush: NULL,
     ematch: ematch,
     export: export,
     compare: compare,
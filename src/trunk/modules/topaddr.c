@@ -33,11 +33,20 @@
 /*
  * This module ranks addresses in terms of bytes.
  * The IP addresses can be destination or sources. 
+ *
+ * With the "counters" argument the module does not keep one record per 
+ * address but a heavy hitters summary (see topk.h) with a fixed number
+ * of counters. Memory does not depend on the number of addresses and 
+ * EXPORT only processes one record per interval. 
  */
 
 #include <stdio.h>
 #include <time.h>
 #include "module.h"
+#include "hashfn.h"
+#include "topk.h"
+
+#define HH_MAX_TOPN	256	/* max records per interval with counters */
 
 #define FLOWDESC	struct _ranking
 #define EFLOWDESC	FLOWDESC
@@ -46,6 +55,14 @@ FLOWDESC {
     uint32_t addr;  	/* src/dst address */ 
     uint64_t bytes;	/* number of bytes */
     uint32_t pkts;	/* number of packets */
+    topk_t * hh;	/* heavy hitters summary (counters mode) */
+};
+
+struct disk_record { 
+    uint32_t ts; 
+    uint32_t addr;  	/* src/dst address */ 
+    uint64_t bytes;	/* number of bytes */
+    uint32_t pkts;	/* number of packets */
 };
 
 #define CONFIGDESC   struct _ranking_config
@@ -55,6 +72,7 @@ CONFIGDESC {
     uint32_t meas_ivl;		/* interval (secs) */
     uint32_t mask; 		/* privacy mask */
     uint32_t last_export;	/* last export time */
+    uint32_t counters;		/* size of heavy hitters summary (0 = off) */
 };
 
 
@@ -72,6 +90,7 @@ init(void * self, char *args[])
     config->topn = 20;
     config->mask = ~0;
     config->last_export = 0; 
+    config->counters = 0; 
     
     /* 
      * process input arguments 
@@ -92,9 +111,23 @@ init(void * self, char *args[])
 	    config->use_dst = 1;
 	} else if (!strncmp(args[i], "use-src", 7)) {
 	    config->use_dst = 0;
+	} else if (!strncmp(args[i], "counters", 8)) {
+	    config->counters = atoi(wh);
 	}
     }
 
+    if (config->counters > 0) { 
+	if (config->topn > HH_MAX_TOPN) 
+	    config->topn = HH_MAX_TOPN; 
+	if (config->counters < (uint32_t) config->topn) 
+	    config->counters = config->topn; 
+    } 
+
+    /* with counters store() writes all top-n records at once */
+    ST_RECORDSIZE(self) = sizeof(struct disk_record); 
+    if (config->counters > 0) 
+	ST_RECORDSIZE(self) *= config->topn; 
+
     /* setup indesc */
     inmd = metadesc_define_in(self, 0);
     inmd->ts_resolution = TIME2TS(config->meas_ivl, 0);
@@ -115,7 +148,10 @@ static uint32_t
 hash(void * self, pkt_t *pkt)
 {
     CONFIGDESC * config = CONFIG(self);
-    return config->use_dst? H32(IP(dst_ip)) : H32(IP(src_ip));
+
+    if (config->counters > 0) 
+	return 0;	/* one record holds the summary */ 
+    return config->use_dst? PKTKEY(pkt)->h_dst : PKTKEY(pkt)->h_src;
 }
 
 static int
@@ -123,8 +159,12 @@ match(void * self, pkt_t *pkt, void *fh)
 {
     FLOWDESC *x = F(fh);
     CONFIGDESC * config = CONFIG(self);
-    uint32_t addr = config->use_dst? H32(IP(dst_ip)) : H32(IP(src_ip)); 
-    return (addr == x->addr);
+    pktkey_t *k = PKTKEY(pkt);
+    uint32_t addr = config->use_dst? k->tuple.dst_ip : k->tuple.src_ip; 
+
+    if (config->counters > 0) 
+	return 1; 
+    return (ntohl(addr) == x->addr);
 }
 
 static int
@@ -132,6 +172,7 @@ update(void * self, pkt_t *pkt, void *fh, int isnew)
 {
     FLOWDESC *x = F(fh);
     CONFIGDESC * config = CONFIG(self);
+    uint64_t bytes, pkts;
 
     if (isnew) {
 	/* 
@@ -142,17 +183,29 @@ update(void * self, pkt_t *pkt, void *fh, int isnew)
         x->addr = config->use_dst? H32(IP(dst_ip)) : H32(IP(src_ip)); 
         x->bytes = 0;
         x->pkts = 0;
+	x->hh = NULL; 
+	if (config->counters > 0) 
+	    x->hh = topk_new(&((module_t *) self)->alc, config->counters, 
+			     sizeof(uint32_t)); 
     }
 
     if (COMO(type) == COMOTYPE_NF) { 
-	x->bytes += H32(NF(pktcount)) * COMO(len) * H16(NF(sampling));
-	x->pkts += H32(NF(pktcount)) * H16(NF(sampling)); 
+	bytes = H32(NF(pktcount)) * COMO(len) * H16(NF(sampling));
+	pkts = H32(NF(pktcount)) * H16(NF(sampling)); 
     } else if (COMO(type) == COMOTYPE_SFLOW) {
-	x->bytes += (uint64_t) COMO(len) * (uint64_t) H32(SFLOW(sampling_rate));
-	x->pkts += H32(SFLOW(sampling_rate));
+	bytes = (uint64_t) COMO(len) * (uint64_t) H32(SFLOW(sampling_rate));
+	pkts = H32(SFLOW(sampling_rate));
+    } else { 
+	bytes = H16(IP(len));
+	pkts = 1;
+    } 
+
+    if (x->hh != NULL) { 
+	uint32_t addr = config->use_dst? H32(IP(dst_ip)) : H32(IP(src_ip)); 
+	topk_update(x->hh, &addr, hashfn_u32(0, addr), bytes, pkts); 
     } else { 
-	x->bytes += H16(IP(len));
-	x->pkts++;
+	x->bytes += bytes; 
+	x->pkts += pkts; 
     } 
 
     return 0;
@@ -164,6 +217,8 @@ ematch(void * self, void *efh, void *fh)
     FLOWDESC *x = F(fh);
     EFLOWDESC *ex = EF(efh);
 
+    if (x->hh != NULL) 
+	return 1; 
     return (x->addr == ex->addr);
 }
 
@@ -172,13 +227,23 @@ export(void * self, void *efh, void *fh, int isnew)
 {
     FLOWDESC *x = F(fh);
     EFLOWDESC *ex = EF(efh);
+    CONFIGDESC * config = CONFIG(self);
 
     if (isnew) {
         ex->addr = x->addr;
         ex->bytes = 0;
         ex->pkts = 0;
+	ex->hh = NULL; 
+	if (x->hh != NULL) 
+	    ex->hh = topk_new(allocator_safe(), config->counters, 
+			      sizeof(uint32_t)); 
     }
 
+    if (x->hh != NULL) { 
+	topk_merge(ex->hh, x->hh); 
+	return 0; 
+    } 
+
     ex->bytes += x->bytes;
     ex->pkts += x->pkts;
 
@@ -218,19 +283,36 @@ action(void * self, void *efh, timestamp_t ivl, timestamp_t current_time,
 }
 
 
-struct disk_record { 
-    uint32_t ts; 
-    uint32_t addr;  	/* src/dst address */ 
-    uint64_t bytes;	/* number of bytes */
-    uint32_t pkts;	/* number of packets */
-};
-
 static ssize_t
 store(void * self, void *efh, char *buf)
 {
     EFLOWDESC *ex = EF(efh);
     CONFIGDESC *config = CONFIG(self); 
 
+    if (ex->hh != NULL) { 
+	/* 
+	 * write the top-n addresses of the summary, all at once. 
+	 * the addresses will be sorted in the file as in the 
+	 * normal mode. 
+	 */
+	topk_entry_t * top[HH_MAX_TOPN]; 
+	uint32_t n, i, addr; 
+	char * base = buf; 
+
+	n = topk_sorted(ex->hh, top, config->topn); 
+	for (i = 0; i < n; i++) { 
+	    memcpy(&addr, top[i]->key, sizeof(uint32_t)); 
+	    buf = base + i * sizeof(struct disk_record); 
+	    PUTH32(buf, config->last_export); 
+	    PUTH32(buf, addr); 
+	    PUTH64(buf, top[i]->count); 
+	    PUTH32(buf, (uint32_t) top[i]->aux); 
+	} 
+	topk_destroy(ex->hh); 
+	ex->hh = NULL; 
+	return n * sizeof(struct disk_record); 
+    } 
+
     PUTH32(buf, config->last_export); 
     PUTH32(buf, ex->addr);
     PUTH64(buf, ex->bytes);
@@ -430,7 +512,7 @@ print(void * self, char *buf, size_t *len, char * const args[])
 MODULE(topaddr) = {
     ca_recordsize: sizeof(FLOWDESC),
     ex_recordsize: sizeof(EFLOWDESC),
-    st_recordsize: sizeof(struct disk_record),
+    st_recordsize: HH_MAX_TOPN * sizeof(struct disk_record),
     capabilities: {has_flexible_flush: 1, 0},
     init: init,
     check: NULL,
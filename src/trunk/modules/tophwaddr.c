@@ -33,6 +33,10 @@
 /*
  * This module ranks addresses in terms of bytes.
  * The HW addresses can be destination or sources. 
+ *
+ * With the "counters" argument the module keeps a single record with a 
+ * heavy hitters summary (see topk.h) of fixed size instead of one record 
+ * per address. 
  */
 
 #include <stdio.h>
@@ -40,6 +44,8 @@
 #include <string.h>
 #include "module.h"
 #include "uhash.h"
+#include "hashfn.h"
+#include "topk.h"
 
 #define FLOWDESC	struct _ranking
 #define EFLOWDESC	FLOWDESC
@@ -53,12 +59,25 @@ FLOWDESC {
     uint8_t	addr[HW_ADDR_SIZE];	/* src/dst address */ 
 };
 
+/* 
+ * capture and export record used with the heavy hitters summary 
+ */
+#define HHDESC		struct _ranking_hh
+#define HH(x)		((HHDESC *) (x))
+#define HH_MAX_TOPN	256	/* max records per interval with counters */
+
+HHDESC {
+    uint32_t	ts;			/* timestamp of measurement interval */
+    topk_t *	hh;			/* heavy hitters summary */
+};
+
 #define CONFIGDESC   struct _ranking_config
 CONFIGDESC {
     int		use_dst; 	/* set if we should use destination address */ 
     int		topn;		/* number of top addresses */
     uint32_t	meas_ivl;	/* interval (secs) */
     uint32_t	last_export;	/* last export time */
+    uint32_t	counters;	/* size of heavy hitters summary (0 = off) */
     uhash_t	hfunc;
 };
 
@@ -76,6 +95,7 @@ init(void * self, char *args[])
     config->meas_ivl = 5;
     config->topn = 20;
     config->last_export = 0; 
+    config->counters = 0; 
     
     /* 
      * process input arguments 
@@ -94,8 +114,22 @@ init(void * self, char *args[])
 	    config->use_dst = 1;
 	} else if (!strncmp(args[i], "use-src", 7)) {
 	    config->use_dst = 0;
+	} else if (!strncmp(args[i], "counters", 8)) {
+	    config->counters = atoi(wh);
 	}
     }
+
+    if (config->counters > 0) { 
+	if (config->topn > HH_MAX_TOPN) 
+	    config->topn = HH_MAX_TOPN; 
+	if (config->counters < (uint32_t) config->topn) 
+	    config->counters = config->topn; 
+    } 
+
+    /* with counters store() writes all top-n records at once */
+    ST_RECORDSIZE(self) = sizeof(EFLOWDESC); 
+    if (config->counters > 0) 
+	ST_RECORDSIZE(self) *= config->topn; 
     
     uhash_initialize(&config->hfunc);
     
@@ -119,6 +153,9 @@ hash(void * self, pkt_t *pkt)
 {
     CONFIGDESC * config = CONFIG(self);
     uint32_t h;
+
+    if (config->counters > 0) 
+	return 0;	/* one record holds the summary */ 
     if (config->use_dst) {
 	h = uhash(&config->hfunc, (uint8_t *) &ETH(dst),
 		  HW_ADDR_SIZE, UHASH_NEW);
@@ -135,6 +172,9 @@ match(void * self, pkt_t *pkt, void *fh)
     FLOWDESC *x = F(fh);
     CONFIGDESC * config = CONFIG(self);
     uint32_t res;
+
+    if (config->counters > 0) 
+	return 1; 
     if (config->use_dst) {
 	res = memcmp(&ETH(dst), &x->addr, HW_ADDR_SIZE);
     } else {
@@ -149,6 +189,32 @@ update(void * self, pkt_t *pkt, void *fh, int isnew)
     FLOWDESC *x = F(fh);
     CONFIGDESC * config = CONFIG(self);
 
+    if (config->counters > 0) { 
+	HHDESC *hx = HH(F(fh)); 
+	hkey_mac_t key; 
+
+	if (isnew) { 
+	    hx->ts = TS2SEC(pkt->ts) - (TS2SEC(pkt->ts) % config->meas_ivl);
+	    hx->hh = topk_new(&((module_t *) self)->alc, config->counters, 
+			      sizeof(hkey_mac_t)); 
+	} 
+
+	memset(&key, 0, sizeof(key)); 
+	if (config->use_dst) 
+	    memcpy(key.addr, &ETH(dst), HW_ADDR_SIZE);
+	else 
+	    memcpy(key.addr, &ETH(src), HW_ADDR_SIZE);
+
+	if (COMO(type) == COMOTYPE_SFLOW) 
+	    topk_update(hx->hh, &key, hashfn_mac(0, &key), 
+			(uint64_t) COMO(len) * 
+			(uint64_t) H32(SFLOW(sampling_rate)), 
+			H32(SFLOW(sampling_rate))); 
+	else 
+	    topk_update(hx->hh, &key, hashfn_mac(0, &key), COMO(len), 1); 
+	return 0; 
+    } 
+
     if (isnew) {
 	x->ts = TS2SEC(pkt->ts) - (TS2SEC(pkt->ts) % config->meas_ivl);
 	if (config->use_dst) {
@@ -177,7 +243,10 @@ ematch(void * self, void *efh, void *fh)
 {
     FLOWDESC *x = F(fh);
     EFLOWDESC *ex = EF(efh);
+    CONFIGDESC * config = CONFIG(self);
 
+    if (config->counters > 0) 
+	return 1; 
     return (memcpy(&x->addr, &ex->addr, HW_ADDR_SIZE) == 0);
 }
 
@@ -186,6 +255,17 @@ export(void * self, void *efh, void *fh, int isnew)
 {
     FLOWDESC *x = F(fh);
     EFLOWDESC *ex = EF(efh);
+    CONFIGDESC * config = CONFIG(self);
+
+    if (config->counters > 0) { 
+	if (isnew) { 
+	    HH(ex)->ts = HH(x)->ts; 
+	    HH(ex)->hh = topk_new(allocator_safe(), config->counters, 
+				  sizeof(hkey_mac_t)); 
+	} 
+	topk_merge(HH(ex)->hh, HH(x)->hh); 
+	return 0; 
+    } 
 
     if (isnew) {
 	ex->ts = x->ts; 
@@ -236,6 +316,29 @@ static ssize_t
 store(void * self, void *efh, char *buf)
 {
     EFLOWDESC *ex = EF(efh);
+    CONFIGDESC * config = CONFIG(self);
+
+    if (config->counters > 0) { 
+	/* 
+	 * write the top-n addresses of the summary, all at once, 
+	 * sorted as in the normal mode. 
+	 */
+	topk_entry_t * top[HH_MAX_TOPN]; 
+	char * base = buf; 
+	uint32_t n, i; 
+
+	n = topk_sorted(HH(ex)->hh, top, config->topn); 
+	for (i = 0; i < n; i++) { 
+	    buf = base + i * sizeof(EFLOWDESC); 
+	    PUTH32(buf, HH(ex)->ts);
+	    PUTH64(buf, top[i]->count);
+	    PUTH32(buf, (uint32_t) top[i]->aux);
+	    memcpy(buf, top[i]->key, HW_ADDR_SIZE);
+	} 
+	topk_destroy(HH(ex)->hh); 
+	HH(ex)->hh = NULL; 
+	return n * sizeof(EFLOWDESC); 
+    } 
 
     PUTH32(buf, ex->ts);
     PUTH64(buf, ex->bytes);
@@ -435,9 +538,9 @@ print(void * self, char *buf, size_t *len, char * const args[])
 
 
 MODULE(tophwaddr) = {
-    ca_recordsize: sizeof(FLOWDESC),
-    ex_recordsize: sizeof(EFLOWDESC),
-    st_recordsize: sizeof(EFLOWDESC),
+    ca_recordsize: MAX(sizeof(FLOWDESC), sizeof(HHDESC)),
+    ex_recordsize: MAX(sizeof(EFLOWDESC), sizeof(HHDESC)),
+    st_recordsize: HH_MAX_TOPN * sizeof(EFLOWDESC),
     capabilities: {has_flexible_flush: 1, 0},
     init: init,
     check: NULL,
@@ -36,12 +36,19 @@
  * This module finds the top N port numbers (source or destination) with the 
  * largest number of bytes sent during a given interval. 
  *
+ * With the "counters" argument the per-port arrays are replaced by a 
+ * heavy hitters summary (see topk.h) with a fixed number of counters. 
+ * EXPORT then merges the summaries instead of scanning all port numbers. 
+ *
  */
 
 #include <stdio.h>
+#include <stddef.h>	/* offsetof */
 #include <time.h>
 #include <assert.h>
 #include "module.h"
+#include "hashfn.h"
+#include "topk.h"
 
 #define FLOWDESC	struct _topports
 #define EFLOWDESC	struct _topports
@@ -50,17 +57,28 @@ FLOWDESC {
     uint32_t ts;			/* timestamp of first packet */
     uint16_t maxtcpport;		/* max TCP port used */
     uint16_t maxudpport;		/* max UDP port used */
+    topk_t * hh;			/* heavy hitters summary (counters) */
     uint64_t tcpbytes[65536];		/* TCP bytes per port number */
     uint32_t tcppkts[65536];		/* TCP pkts per port number */
     uint64_t udpbytes[65536];		/* UDP bytes per port number */
     uint32_t udppkts[65536];		/* UDP pkts per port number */
 };
 
+struct topports {
+    uint32_t ts; 		/* timestamp */
+    uint8_t  proto;		/* protocol */
+    uint8_t  reserved;		/* padding */
+    uint16_t port; 		/* port number */
+    uint64_t bytes; 		/* bytes/port number */
+    uint32_t pkts;		/* pkts/port number */
+};
+
 #define CONFIGDESC   struct _topports_config
 CONFIGDESC {
     uint16_t topn;    			/* number of top ports */
     uint32_t meas_ivl;			/* interval (secs) */
     uint32_t last_export;       	/* last export time */
+    uint32_t counters;			/* size of summary (0 = off) */
     char * tcp_service[65536]; 		/* TCP application names */ 
     char * udp_service[65536];		/* UDP application names */
 };
@@ -91,6 +109,8 @@ init(void * self, char *args[])
             config->topn = atoi(wh);
         } else if (!strncmp(args[i], "align-to", 8)) {
             config->last_export = atoi(wh);
+        } else if (!strncmp(args[i], "counters", 8)) {
+            config->counters = atoi(wh);
         } else if (strstr(args[i], "udp")) {
             int port = atoi(args[i]);
 	    char *z;
@@ -110,6 +130,19 @@ init(void * self, char *args[])
         }
     }
     
+    if (config->counters > 0 && config->counters < config->topn) 
+	config->counters = config->topn; 
+
+    /* 
+     * with counters the records do not need the port arrays. 
+     * store() writes at most topn entries in both modes. 
+     */
+    CA_RECORDSIZE(self) = sizeof(FLOWDESC); 
+    if (config->counters > 0) 
+	CA_RECORDSIZE(self) = offsetof(FLOWDESC, tcpbytes); 
+    EX_RECORDSIZE(self) = CA_RECORDSIZE(self); 
+    ST_RECORDSIZE(self) = config->topn * sizeof(struct topports); 
+
     /* setup indesc */
     inmd = metadesc_define_in(self, 0);
     inmd->ts_resolution = TIME2TS(config->meas_ivl, 0);
@@ -136,7 +169,14 @@ update(void * self, pkt_t *pkt, void *rp, int isnew)
     uint32_t newpkts = 1; 
 
     if (isnew) {
-	bzero(x, sizeof(FLOWDESC)); 
+	if (config->counters > 0) { 
+	    /* no need to touch the port arrays */ 
+	    x->maxtcpport = x->maxudpport = 0; 
+	    x->hh = topk_new(&((module_t *) self)->alc, config->counters, 
+			     sizeof(uint32_t)); 
+	} else { 
+	    bzero(x, sizeof(FLOWDESC)); 
+	} 
 	x->ts = TS2SEC(pkt->ts) - (TS2SEC(pkt->ts) % config->meas_ivl);
     }
 
@@ -148,6 +188,24 @@ update(void * self, pkt_t *pkt, void *rp, int isnew)
 	newpkts = H32(SFLOW(sampling_rate));
     } 
 
+    if (x->hh != NULL) { 
+	/* the key is the protocol and the port number */ 
+	uint32_t key; 
+
+	if (isTCP) { 
+	    key = IPPROTO_TCP << 16 | H16(TCP(src_port)); 
+	    topk_update(x->hh, &key, hashfn_u32(0, key), newbytes, newpkts); 
+	    key = IPPROTO_TCP << 16 | H16(TCP(dst_port)); 
+	    topk_update(x->hh, &key, hashfn_u32(0, key), newbytes, newpkts); 
+	} else if (isUDP) { 
+	    key = IPPROTO_UDP << 16 | H16(UDP(src_port)); 
+	    topk_update(x->hh, &key, hashfn_u32(0, key), newbytes, newpkts); 
+	    key = IPPROTO_UDP << 16 | H16(UDP(dst_port)); 
+	    topk_update(x->hh, &key, hashfn_u32(0, key), newbytes, newpkts); 
+	} 
+	return 0; 
+    } 
+
     if (isTCP) {
 	uint sport = H16(TCP(src_port)); 
 	uint dport = H16(TCP(dst_port)); 
@@ -183,10 +241,22 @@ update(void * self, pkt_t *pkt, void *rp, int isnew)
 static int
 export(void * self, void *efh, void *fh, int isnew)
 {
+    CONFIGDESC * config = CONFIG(self);
     FLOWDESC *x = F(fh);
     EFLOWDESC *ex = EF(efh);
     int i;
 
+    if (x->hh != NULL) { 
+	if (isnew) { 
+	    ex->ts = x->ts; 
+	    ex->maxtcpport = ex->maxudpport = 0; 
+	    ex->hh = topk_new(allocator_safe(), config->counters, 
+			      sizeof(uint32_t)); 
+	} 
+	topk_merge(ex->hh, x->hh); 
+	return 0; 
+    } 
+
     if (isnew) {
 	bcopy(x, ex, sizeof(EFLOWDESC)); 
 	return 0;
@@ -232,15 +302,6 @@ action(void * self, void *efh,  timestamp_t ivl,
 }
 
 
-struct topports {
-    uint32_t ts; 		/* timestamp */
-    uint8_t  proto;		/* protocol */
-    uint8_t  reserved;		/* padding */
-    uint16_t port; 		/* port number */
-    uint64_t bytes; 		/* bytes/port number */
-    uint32_t pkts;		/* pkts/port number */
-};
-
 static ssize_t
 store(void * self, void *rp, char *buf)
 {
@@ -249,6 +310,31 @@ store(void * self, void *rp, char *buf)
     struct topports * tp; 
     int i, j;
     
+    if (x->hh != NULL) { 
+	/* 
+	 * the summary gives us the top ports directly. the key 
+	 * is the protocol and the port number. 
+	 */
+	topk_entry_t ** top; 
+	uint32_t n, key; 
+
+	top = mem_mdl_malloc(self, config->topn * sizeof(topk_entry_t *)); 
+	n = topk_sorted(x->hh, top, config->topn); 
+	for (i = 0; i < (int) n; i++) { 
+	    memcpy(&key, top[i]->key, sizeof(uint32_t)); 
+	    PUTH32(buf, x->ts);
+	    PUTH8(buf, key >> 16); 
+	    PUTH8(buf, 0); 		/* padding */
+	    PUTH16(buf, key & 0xffff); 
+	    PUTH64(buf, top[i]->count); 
+	    PUTH32(buf, (uint32_t) top[i]->aux); 
+	} 
+	mem_mdl_free(self, top);
+	topk_destroy(x->hh); 
+	x->hh = NULL; 
+	return (i * sizeof(struct topports)); 
+    } 
+
     /* allocate the array with the results */
     tp = mem_mdl_calloc(self, config->topn + 1, sizeof(struct topports)); 
 
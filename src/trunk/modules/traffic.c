@@ -150,6 +150,49 @@ load(void * self, char * buf, size_t len, timestamp_t * ts)
 }
 
 
+static int
+merge(__attribute__((__unused__)) void * self, char * dst, char * src)
+{
+    FLOWDESC *x = (FLOWDESC *) dst; 
+    FLOWDESC *y = (FLOWDESC *) src; 
+    int i; 
+
+    /* one record per interval, just add the counters */
+    for (i = 0; i < 2; i++) { 
+	x->bytes[i] = HTONLL(NTOHLL(x->bytes[i]) + NTOHLL(y->bytes[i])); 
+	x->pkts[i] = htonl(ntohl(x->pkts[i]) + ntohl(y->pkts[i])); 
+    } 
+
+    /* keep the timestamp of the first packet */
+    if (NTOHLL(y->ts) < NTOHLL(x->ts)) 
+	x->ts = y->ts; 
+
+    return 1;
+}
+
+
+static int
+rollup(__attribute__((__unused__)) void * self, char * dst, char * src, 
+       int n)
+{
+    FLOWDESC *x = (FLOWDESC *) dst; 
+    FLOWDESC *y = (FLOWDESC *) src; 
+    int i; 
+
+    for (i = 0; i < 2; i++) { 
+	if (src != NULL) { 
+	    x->bytes[i] = HTONLL(NTOHLL(x->bytes[i]) + NTOHLL(y->bytes[i])); 
+	    x->pkts[i] = htonl(ntohl(x->pkts[i]) + ntohl(y->pkts[i])); 
+	} else { 
+	    x->bytes[i] = HTONLL(NTOHLL(x->bytes[i]) / n); 
+	    x->pkts[i] = htonl(ntohl(x->pkts[i]) / n); 
+	} 
+    } 
+
+    return 0;
+}
+
+
 #define PRETTYHDR		\
     "Date                     Timestamp          Input      Output\n"
 
@@ -282,5 +325,7 @@ MODULE(traffic) = {
     load: load,
     print: print,
     replay: NULL,
+    merge: merge,
+    rollup: rollup,
     formats: "gnuplot plain pretty",
 };
@@ -43,24 +43,11 @@
 #include <time.h>
 #include "comofunc.h"
 #include "module.h"
+#include "tuple.h"		/* FLOWDESC */
+#include "hashfn.h"
 
-#define FLOWDESC    struct _tuple_stat
 #define EFLOWDESC   FLOWDESC
 
-FLOWDESC {
-    timestamp_t start_ts; 
-    timestamp_t last_ts; 
-    n32_t src_ip;
-    n32_t dst_ip;
-    n16_t src_port;
-    n16_t dst_port;
-    uint8_t proto;
-    char padding;
-    uint16_t sampling;
-    uint64_t bytes;
-    uint64_t pkts;
-};
-
 #define CONFIGDESC   struct _tuple_config
 CONFIGDESC {
     /*
@@ -181,42 +168,21 @@ init(void * self, char *args[])
 static uint32_t
 hash(void * self, pkt_t *pkt)
 {
-    uint sport, dport; 
-
-    if (isTCP) { 
-	sport = N16(TCP(src_port)); 
-	dport = N16(TCP(dst_port)); 
-    } else if (isUDP) { 
-	sport = N16(UDP(src_port)); 
-	dport = N16(UDP(dst_port)); 
-    } else { 
-	sport = dport = 0;
-    } 
-
-    return (N32(IP(src_ip)) ^ N32(IP(dst_ip)) ^ (sport << 3) ^ (dport << 3));
+    return PKTKEY(pkt)->h_tuple;
 }
 
 static int
 match(void * self, pkt_t *pkt, void *fh)
 {
     FLOWDESC *x = F(fh);
-    uint sport, dport; 
-    
-    if (isTCP) { 
-        sport = N16(TCP(src_port));
-        dport = N16(TCP(dst_port));
-    } else if (isUDP) { 
-        sport = N16(UDP(src_port));
-        dport = N16(UDP(dst_port));
-    } else {
-        sport = dport = 0;
-    }
+    hkey_tuple4_t *k = &PKTKEY(pkt)->tuple;
 
     return (
-         N32(IP(src_ip)) == N32(x->src_ip) &&
-         N32(IP(dst_ip)) == N32(x->dst_ip) &&
-         sport == N16(x->src_port) && dport == N16(x->dst_port) &&
-         IP(proto) == x->proto
+         k->src_ip == N32(x->src_ip) &&
+         k->dst_ip == N32(x->dst_ip) &&
+         k->src_port == N16(x->src_port) && 
+         k->dst_port == N16(x->dst_port) &&
+         k->proto == x->proto
     );
 }
 
@@ -629,5 +595,6 @@ MODULE(tuple) = {
     load: load,
     print: print,
     replay: replay,
+    schema: tuple_schema,
     formats: "plain pretty html"
 };
@@ -54,188 +54,18 @@
         
 #include "module.h"
 #include "hash.h"
-#include <openssl/md5.h>
+#include "cdc.h"
+#include "hashfn.h"
 
 /* CoMo module structures */
 #define FLOWDESC    struct _signature_cap
 #define EFLOWDESC   struct _signature_exp
 #define CONFIGDESC  struct _signature_config
 
-/* defines for fingerprinting */
-#define POLY 0xbfe6b8a5bf378d83LL
-#define WINDOW_SIZE 16
-#define BREAKPOINT 0x07
-
 #define MAX_STORE 10000
 
-
-
-/*
- * Polynomial fingerprinting library
- *
- * Library necessary for generating Rabin string fingerprints
- */
-
-struct _window
-{
-    uint64_t polynomial;
-    uint64_t fingerprint;
-    int winpos;
-    uint64_t U[256];
-    unsigned char *buffer;
-    int winsize;
-    int shiftvalue;
-    uint64_t T[256];
-};
-typedef struct _window window;
-
-
-void init_window(window *this_w, uint64_t poly, int size, void *);
-uint64_t appendbyte (window *w, uint64_t polyact, unsigned char byte);
-uint64_t slidebyte (window *w, unsigned char byte);
-
-uint64_t mod (uint64_t xh, uint64_t xl, uint64_t divd);
-void mult (uint64_t *resh, uint64_t *resl, uint64_t x, uint64_t y);
-int degree (uint64_t p);    
-int hbs (uint64_t p);
-
-void precalculateT(window *);
-
-
-void init_window(window *this_w, uint64_t poly, int size, void *this_mod)
-{
-    uint64_t sizeshift=1;
-    uint64_t auxh, auxl;
-    int i;
-    
-    this_w->shiftvalue = degree(poly) - 8;
-    this_w->polynomial = poly;
-    this_w->winsize = size;
-    this_w->buffer = (unsigned char *)mem_mdl_malloc(this_mod, sizeof(unsigned
-                    char) * (size+1));
-    bzero(this_w->buffer, sizeof(unsigned char) * (size+1));
-
-    this_w->winpos = -1;
-
-    for (i = 1; i < size; i++) {
-        sizeshift = appendbyte(this_w, sizeshift, 0);
-    }
-
-    for (i = 0; i < 256; i++) {
-        mult(&auxh, &auxl, i, sizeshift);
-        this_w->U[i] = mod(auxh, auxl, poly);
-    }
-    
-    precalculateT(this_w);
-}
-
-uint64_t appendbyte (window *w, uint64_t polyact, unsigned char byte)
-{
-    return ((polyact << 8) | byte) ^ w->T[polyact >> w->shiftvalue];
-}
-
-uint64_t slidebyte (window *w, unsigned char byte)
-{
-    unsigned char oldbyte;
-    if (w->winpos++ >= w->winsize) {
-        w->winpos = 0;
-    }
-    oldbyte = w->buffer[w->winpos];
-    w->buffer[w->winpos] = byte;
-    w->fingerprint = appendbyte(w, w->fingerprint ^ w->U[oldbyte], byte);
-    
-    return w->fingerprint;
-}
-
-uint64_t mod (uint64_t xh, uint64_t xl, uint64_t divd)
-{
-    /*
-     * calculates x % div where xh are the 64 highest bits of x, and xl are the
-     * lowest 64.
-     */
-    int i;
-    int k = degree(divd);   /* degree of div */
-    divd <<= 63 - k;
-    
-    if (xh) {
-        if (xh & 0x8000000000000000LL) {
-            xh ^= divd;
-        }
-
-        for (i = 62; i >= 0; i--) {
-            if (xh & ((uint64_t) 1) << i) {
-                xh ^= divd >> (63 - i);
-                xl ^= divd << (i + 1);
-            }
-        }
-    }
-    
-    for (i = 63; i >= k; i--) {  
-        if (xl & 1LL << i) {
-            xl ^= divd >> (63 - i);
-        }
-    }
-    return xl;
-}
-
-void mult (uint64_t *resh, uint64_t *resl, uint64_t x, uint64_t y)
-{
-    int i;
-    uint64_t rh = 0, rl = 0;
-    if (x & 1) {
-        rl = y;
-    }
-    for (i = 1; i < 64; i++) {
-        if (x & (1LL << i)) {
-            rh ^= y >> (64 - i);
-            rl ^= y << i;
-        }
-    }
-    if (resh) {
-        *resh = rh;
-    }
-    if (resl) {
-        *resl = rl;
-    }
-}
-
-int degree (uint64_t p)
-{
-    return hbs(p) -1;
-}
-
-int hbs (uint64_t p)     /* highest bit set */
-{
-    int i = 0;
-    uint64_t mask = 0x8000000000000000LL;
-    
-    if (p) {
-        for (i=64; i>0; i--) {
-            if (p & mask) {
-                break;
-            }
-            mask >>= 1;
-        }
-    }
-    
-    return i;
-}
-
-void precalculateT(window *w)
-{
-    int i;
-    int kp = degree(w->polynomial);
-
-    uint64_t auxh, auxl;
-    uint64_t T_1;
-    
-    T_1 = mod (0, 1LL << kp, w->polynomial);
-    
-    for (i = 0; i < 256; i++) {
-        mult(&auxh, &auxl, i, T_1);
-        w->T[i] = mod(auxh, auxl, w->polynomial) | (uint64_t) i << kp;
-    }
-}
+/* seed for the content block fingerprints */
+#define FP_SEED     0x5eed
 
 /*
  * List
@@ -413,10 +243,13 @@ typedef struct _flowitem flowitem;
 /* info of content block */
 struct _content_block 
 {
-    /* MD5 of the content */
-    char *md5digest;
+    /* 64 bit fingerprint of the content */
+    uint64_t fp;
     
-    /* content (maybe not necessary) and length of data */
+    /* 
+     * content and length of data. content points into the flow buffer 
+     * of the first flow where the block was found (no copy). 
+     */
     char *content;
     size_t len;
     
@@ -440,7 +273,7 @@ typedef struct _content_block content_block;
 
 void init_cb(content_block *cb)
 {
-    cb->md5digest = 0;
+    cb->fp = 0;
     cb->content = NULL;
     cb->len = 0;
     
@@ -467,19 +300,94 @@ struct _signature
 };
 typedef struct _signature signature;
 
-uint hash_function(const void *key)
+/*
+ * Content block table
+ *
+ * Open addressing table of content blocks indexed by their fingerprint
+ * (linear probing). The fingerprints come from hashfn_xx64() and are 
+ * used directly as hash values. 
+ */
+
+typedef struct _cb_table
 {
-    return (uint) (*((uint64_t*)key));
+    content_block **slots;
+    uint32_t size;              /* always a power of 2 */
+    uint32_t count;
+} cb_table;
+
+#define CB_TABLE_MINSIZE    1024
+
+static void
+cb_table_init(cb_table *t, void *mdl, uint32_t size)
+{
+    t->size = CB_TABLE_MINSIZE;
+    while (t->size < size)
+        t->size <<= 1;
+    t->count = 0;
+    t->slots = (content_block **) mem_mdl_malloc(mdl, 
+                                        t->size * sizeof(content_block *));
+    bzero(t->slots, t->size * sizeof(content_block *));
 }
 
-int key_cmp_function(const void *key1, const void *key2)
+static content_block *
+cb_table_lookup(cb_table *t, uint64_t fp, size_t len)
 {
-    if (*(uint64_t*)key1 == *(uint64_t*)key2) {
-        return 0;
+    uint32_t mask = t->size - 1;
+    uint32_t i;
+    
+    for (i = (uint32_t) fp & mask; t->slots[i] != NULL; i = (i + 1) & mask) {
+        if (t->slots[i]->fp == fp && t->slots[i]->len == len)
+            return t->slots[i];
     }
-    else {
-        return -1;
+    return NULL;
+}
+
+static void
+cb_table_insert(cb_table *t, content_block *cb, void *mdl)
+{
+    uint32_t mask, i;
+    
+    if (2 * (t->count + 1) > t->size) {
+        /* keep the load below 50%: double the table and rehash */
+        content_block **old = t->slots;
+        uint32_t oldsize = t->size;
+        
+        cb_table_init(t, mdl, oldsize * 2);
+        for (i = 0; i < oldsize; i++) {
+            if (old[i] != NULL)
+                cb_table_insert(t, old[i], mdl);
+        }
+        mem_mdl_free(mdl, old);
+    }
+    
+    mask = t->size - 1;
+    for (i = (uint32_t) cb->fp & mask; t->slots[i] != NULL; i = (i + 1) & mask)
+        ;
+    t->slots[i] = cb;
+    t->count++;
+}
+
+static void
+cb_table_remove(cb_table *t, content_block *cb)
+{
+    uint32_t mask = t->size - 1;
+    uint32_t i, j, k;
+    
+    for (i = (uint32_t) cb->fp & mask; t->slots[i] != cb; i = (i + 1) & mask) {
+        if (t->slots[i] == NULL)
+            return;
+    }
+    
+    /* backward shift the entries that follow so that no tombstone is needed */
+    for (j = (i + 1) & mask; t->slots[j] != NULL; j = (j + 1) & mask) {
+        k = (uint32_t) t->slots[j]->fp & mask;
+        if (((j - k) & mask) >= ((j - i) & mask)) {
+            t->slots[i] = t->slots[j];
+            i = j;
+        }
     }
+    t->slots[i] = NULL;
+    t->count--;
 }
 
 FLOWDESC 
@@ -503,7 +411,7 @@ EFLOWDESC
     flowitem* flowlist;
     
     /* histogram of content blocks */
-    hash_t *htable;
+    cb_table cbs;
     
     /* list of content blocks that currently appear in most flows */
     content_block *max;
@@ -547,6 +455,9 @@ CONFIGDESC
     /* maximum content block size */
     uint32_t max_cb_size;
     
+    /* content-defined chunker (see cdc.h) */
+    cdc_t chunker;
+    
     /* hash table containing the signatures */
     list * signatures;
     
@@ -646,8 +557,8 @@ int analyze_histogram(void *mod_p, EFLOWDESC* ex, int min_prevalence)
     curr_cb = ex->max;
     total_flows = 0;    
     
-    /* hash iterator to search for new CB of max prevalence */
-    hash_iter_t iterator;
+    /* to search for new CB of max prevalence */
+    uint32_t i;
     int max_value = 0;
 
     if (curr_cb->orig_num_flows < min_prevalence) {
@@ -723,8 +634,8 @@ int analyze_histogram(void *mod_p, EFLOWDESC* ex, int min_prevalence)
         curr_cb = curr_cb->max_next;
 
         /* destroy the CB */
-        /* first remove from hash table */
-        hash_remove_string(ex->htable, (char *)remove_cb->md5digest);
+        /* first remove from the table */
+        cb_table_remove(&ex->cbs, remove_cb);
         
         /* then destroy object */
         destroy_list(mod_p, &(remove_cb->flows));
@@ -732,13 +643,14 @@ int analyze_histogram(void *mod_p, EFLOWDESC* ex, int min_prevalence)
     }
     
     /* regenerate sg->max (CB with highest prevalence) */
-    hash_iter_init(ex->htable, &iterator);
     max_value = 0;
     ex->max = NULL;
     
-    while (hash_iter_next (&iterator)) {
+    for (i = 0; i < ex->cbs.size; i++) {
         
-        curr_cb = (content_block *)hash_iter_get_value (&iterator);
+        curr_cb = ex->cbs.slots[i];
+        if (curr_cb == NULL)
+            continue;
         curr_cb->max_next = NULL;
         if (curr_cb->orig_num_flows > max_value) {
             ex->max = curr_cb;
@@ -764,35 +676,22 @@ void analyze_flows(EFLOWDESC *ex, double percentage, int min_prevalence, void
     
     /* fingerprint */
     uint64_t fp;    
-    /* sliding window for calculating fingerprints */
-    window polyWindow;
-    /* index of the content of current flow being analysed */
-    uint32_t idx;
-    /* last breakpoint, current breakpoint, size of partition */
+    /* start and size of current partition */
     uint32_t last, size;            
     /* current flow in loop */
     flowitem *curr_flow;
     /* content block */
     content_block *cb;
-    /* content of flow */
-    char *curr_content;
-    /* key for hash (md5 of content block) */
-    char *key;
     /* flows used so far for signature generation */
     int num_flows, total_flows = 0;     
-    
-    curr_content = NULL;
+    uint32_t i;
     
     CONFIGDESC *config = CONFIG(mod_p);
     
-    module_t *mdl = mod_p;
-    
-    init_window(&polyWindow, POLY, WINDOW_SIZE, mod_p);
-    
     curr_flow = ex->flowlist;
-    ex->htable = hash_new(&(mdl->alc), HASHKEYS_STRING, hash_function, NULL);
+    cb_table_init(&ex->cbs, mod_p, 0);
     
-    while (curr_flow != NULL) {
+    for (; curr_flow != NULL; curr_flow = curr_flow->next) {
         
         if (curr_flow->expire == 1) {
             /* this should never happen */
@@ -800,124 +699,82 @@ void analyze_flows(EFLOWDESC *ex, double percentage, int min_prevalence, void
         }
         
         /*
-         * loop of signature generations: create the hash table with all the
+         * loop of signature generations: create the table with all the
          * content blocks
          */
-        last = 0;
         
         /* initialize the list of this flows content blocks.*/
         curr_flow->content_blocks = (list *) mem_mdl_malloc(mod_p,
         sizeof(list));
         list_new(curr_flow->content_blocks);
         
-        for(idx=0; idx<(curr_flow->flow_content_len); idx++) {
+        for (last = 0; last < curr_flow->flow_content_len; last += size) {
 
-            size = (idx - last)+1;
+            size = cdc_chunk(&config->chunker, &curr_flow->flow_content[last],
+                             curr_flow->flow_content_len - last);
 
-            fp = slidebyte(&polyWindow, curr_flow->flow_content[idx]);
+            fp = hashfn_xx64(FP_SEED, &curr_flow->flow_content[last], size);
 
-            if (((fp % config->avg_cb_size) == BREAKPOINT && size >
-                config->min_cb_size)  /* normal breakpoint */
-                || size >= config->max_cb_size  /* block is getting too big */
-                || ((curr_flow->flow_content_len - last) < config->min_cb_size)
-                || idx+1 == curr_flow->flow_content_len) /* not enough */
-            {
-                if ((curr_flow->flow_content_len - last) < config->min_cb_size)
-                {
-                    /*
-                     * if it is this case, skip calculating rabin until the end
-                     * - just take the last piece as a content block.
-                     */
-                    
-                    idx = (curr_flow->flow_content_len-1);
-                    size = (idx-last)+1;
-                    if (size <= 0) {
-                        break;
-                    }
-                }
+            cb = cb_table_lookup(&ex->cbs, fp, size);
                 
-                /* create a new content block */
-                curr_content = (char *)mem_mdl_malloc(mod_p, size);
-                memcpy(curr_content, &(curr_flow->flow_content[last]), size);
-
-                key = (char *) mem_mdl_malloc(mod_p, 16);
+            /* check if this content block already exists */
+            if (cb == NULL) {
+                /* not already in the table, so create new entry */
                 
-                MD5((unsigned char *)curr_content, size, (unsigned char *)key);
-
-                cb = (content_block *)hash_lookup_string(ex->htable, key);
+                cb = (content_block *)mem_mdl_malloc(mod_p,
+                sizeof(content_block));
                 
-                /* check if this content block already exists */
-                if(cb == NULL) {
-                    /* not already in hash table, so create new entry */
-                    
-                    cb = (content_block *)mem_mdl_malloc(mod_p,
-                    sizeof(content_block));
-                    
-                    init_cb(cb);
-                    
-                    cb->content = curr_content;
-                    cb->len = size;
-                    cb->md5digest = key;
+                init_cb(cb);
+                
+                cb->content = &curr_flow->flow_content[last];
+                cb->len = size;
+                cb->fp = fp;
 
-                    hash_insert_string(ex->htable, (char *)key, cb);
-                }
-                else {
-                    /*
-                     * the content block is already in the hash table, so no
-                     * need to keep it in memory
-                     */
-                    mem_mdl_free(mod_p, curr_content);
-                    mem_mdl_free(mod_p, key);
-                }
+                cb_table_insert(&ex->cbs, cb, mod_p);
+            }
 
-                if ((flowitem **)list_get_content(cb->flows.first) !=
-                    &curr_flow)
+            if ((flowitem *)list_get_content(cb->flows.first) != curr_flow)
+            /* 
+             * only add information about the flow if it has not already
+             * been added
+             * (this happens if the same content block is twice in the same
+             * flow)
+             */
+            {
                 /* 
-                 * only add information about the flow if it has not already
-                 * been added
-                 * (this happens if the same content block is twice in the same
-                 * flow)
+                 * the content block has a list of pointer to the flows 
+                 * that contain it - insert curr_flow
                  */
-                {
-                    /* 
-                     * the content block has a list of pointer to the flows 
-                     * that contain it - insert curr_flow
-                     */
-                    
-                    list_insert(&(cb->flows), (void*)curr_flow, mod_p);
-                    cb->num_flows++;
-                    cb->orig_num_flows++;
-                    
-                    /*
-                     * the flow has a list of pointers to the content blocks
-                     * that it contains - insert cb
-                     */
-                    list_insert(curr_flow->content_blocks, (void *)cb, mod_p);
-                    curr_flow->num_blocks++;
-                    
-                    if (ex->max == NULL || ex->max == cb) {
-                        ex->max = cb;
-                        cb->max_next = NULL;
-                    }
-                    else {
-                        if (cb->num_flows >= ex->max->num_flows) {
-                            if (cb->num_flows == ex->max->num_flows) {
-                                cb->max_next = ex->max;
-                                ex->max = cb;
-                            }
-                            else {
-                                ex->max = cb;
-                                cb->max_next = NULL;
-                            }
+                
+                list_insert(&(cb->flows), (void*)curr_flow, mod_p);
+                cb->num_flows++;
+                cb->orig_num_flows++;
+                
+                /*
+                 * the flow has a list of pointers to the content blocks
+                 * that it contains - insert cb
+                 */
+                list_insert(curr_flow->content_blocks, (void *)cb, mod_p);
+                curr_flow->num_blocks++;
+                
+                if (ex->max == NULL || ex->max == cb) {
+                    ex->max = cb;
+                    cb->max_next = NULL;
+                }
+                else {
+                    if (cb->num_flows >= ex->max->num_flows) {
+                        if (cb->num_flows == ex->max->num_flows) {
+                            cb->max_next = ex->max;
+                            ex->max = cb;
+                        }
+                        else {
+                            ex->max = cb;
+                            cb->max_next = NULL;
                         }
                     }
                 }
-                
-                last = idx+1;
             }
         }
-
-        curr_flow = curr_flow->next;
     }
         
     /*
@@ -928,7 +785,7 @@ void analyze_flows(EFLOWDESC *ex, double percentage, int min_prevalence, void
     int num_initial_flows = ex->num;
     total_flows = 0;
 
-    while ((num_initial_flows * percentage > total_flows)) {       
+    while (ex->max != NULL && (num_initial_flows * percentage > total_flows)) {
         if((num_flows = analyze_histogram(mod_p, ex, min_prevalence))<0) {
             break;
         }
@@ -937,7 +794,29 @@ void analyze_flows(EFLOWDESC *ex, double percentage, int min_prevalence, void
         }
     }
     
-    hash_destroy(ex->htable);
+    /* 
+     * release the content blocks and the per-flow lists that point to 
+     * them. they are rebuilt from scratch at the next generation. 
+     */
+    for (i = 0; i < ex->cbs.size; i++) {
+        cb = ex->cbs.slots[i];
+        if (cb != NULL) {
+            destroy_list(mod_p, &(cb->flows));
+            mem_mdl_free(mod_p, cb);
+        }
+    }
+    mem_mdl_free(mod_p, ex->cbs.slots);
+    ex->cbs.slots = NULL;
+    ex->cbs.size = ex->cbs.count = 0;
+    
+    for (curr_flow = ex->flowlist; curr_flow; curr_flow = curr_flow->next) {
+        if (curr_flow->content_blocks != NULL) {
+            destroy_list(mod_p, curr_flow->content_blocks);
+            mem_mdl_free(mod_p, curr_flow->content_blocks);
+            curr_flow->content_blocks = NULL;
+        }
+        curr_flow->num_blocks = 0;
+    }
     ex->max = NULL;
 
 }
@@ -1099,6 +978,9 @@ static timestamp_t init(void * self, char *args[])
         }
     }
 
+    cdc_init(&config->chunker, config->min_cb_size, config->avg_cb_size,
+             config->max_cb_size);
+
     CONFIG(self) = config;
     
     return TIME2TS(1,0);
@@ -1178,7 +1060,8 @@ static int export(void * self, void *efh, void *fh, int isnew)
         ex->dst_port = H16(TCP(dst_port));
         ex->flowlist = NULL;
         ex->max = NULL;
-        ex->htable = NULL;
+        ex->cbs.slots = NULL;
+        ex->cbs.size = ex->cbs.count = 0;
         ex->ts = COMO(ts);
     }
     
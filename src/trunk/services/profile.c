@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2006, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <assert.h>
+
+#include "como.h"
+#include "comopriv.h"
+#include "query.h"
+
+/* global state */
+extern struct _como map;
+
+
+/* 
+ * -- service_profile
+ * 
+ * send the callback latency histograms (see cbhist.c) of the modules 
+ * running for this node. for each module and callback that has been 
+ * called at least once, one line reports the number of calls, the 
+ * average, median, 90th and 99th percentiles and the maximum, all in 
+ * TSC cycles:
+ * 
+ *   Profile: <module> | <callback> | n | avg | p50 | p90 | p99 | max
+ * 
+ * query arguments: 
+ *   module=<name>   only report this module 
+ *   buckets         also send the non-empty buckets, one per line, 
+ *                   as "Bucket: <module> | <callback> | <from> | <count>"
+ */
+int
+service_profile(int client_fd, int node_id, qreq_t * qreq) 
+{
+    char buf[2048]; 
+    char * httpstr;
+    char * name = NULL;
+    int buckets = 0;
+    int ret, len, idx, cb, b, i;
+
+    assert(node_id < map.node_count); 
+
+    for (i = 0; qreq->args != NULL && qreq->args[i] != NULL; i++) {
+	if (strncmp(qreq->args[i], "module=", 7) == 0) 
+	    name = qreq->args[i] + 7; 
+	else if (strcmp(qreq->args[i], "buckets") == 0) 
+	    buckets = 1; 
+    }
+
+    /* send HTTP header */
+    httpstr = "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\n\r\n";
+    ret = como_writen(client_fd, httpstr, strlen(httpstr)); 
+    if (ret < 0) 
+	err(EXIT_FAILURE, "sending profile to the client [%d]", client_fd);
+
+    for (idx = 0; idx <= map.module_last; idx++) {
+	module_t * mdl = &map.modules[idx]; 
+
+	if (mdl->status == MDL_UNUSED) 
+	    continue; 
+
+	if (mdl->node != node_id)
+	    continue; 
+
+	if (name != NULL && strcmp(mdl->name, name) != 0) 
+	    continue; 
+
+	for (cb = 0; cb < CB_MAX; cb++) { 
+	    cbhist_t * h = cbhist_get(map.stats, mdl, cb); 
+
+	    if (h == NULL || h->n == 0) 
+		continue; 
+
+	    len = sprintf(buf, 
+		"Profile: %-15s | %-6s | %llu | %llu | %llu | %llu | %llu | %llu\n",
+		mdl->name, cbhist_name(cb), 
+		(unsigned long long) h->n, 
+		(unsigned long long) (h->total / h->n), 
+		(unsigned long long) cbhist_percentile(h, 50), 
+		(unsigned long long) cbhist_percentile(h, 90), 
+		(unsigned long long) cbhist_percentile(h, 99), 
+		(unsigned long long) h->max); 
+
+	    ret = como_writen(client_fd, buf, len);
+	    if (ret < 0)
+		err(EXIT_FAILURE, "sending profile to the client [%d]", 
+		    client_fd);
+
+	    if (!buckets) 
+		continue; 
+
+	    for (b = 0; b < CBH_BUCKETS; b++) { 
+		if (h->bucket[b] == 0) 
+		    continue; 
+
+		len = sprintf(buf, "Bucket: %-15s | %-6s | %llu | %u\n",
+		    mdl->name, cbhist_name(cb), 
+		    (unsigned long long) cbhist_lower(b), h->bucket[b]); 
+
+		ret = como_writen(client_fd, buf, len);
+		if (ret < 0)
+		    err(EXIT_FAILURE, "sending profile to the client [%d]", 
+			client_fd);
+	    } 
+	}
+    }
+
+    return 0;
+}
@@ -153,6 +153,28 @@ service_status(int client_fd, int node_id,
 	len += sprintf(buf + len, "Load: %llu | %llu | %llu | %llu\n",
 		       ld_15m, ld_1h, ld_6h, ld_1d);
     }
+
+    /* query cache lookups, hits and hit rate */
+    if (map.qcache_size > 0) { 
+	uint64_t lookups = map.stats->qc_lookups; 
+	uint64_t hits = map.stats->qc_hits; 
+
+	len += sprintf(buf + len, "Query cache: %llu | %llu | %.1f%%\n", 
+		       (unsigned long long) lookups, 
+		       (unsigned long long) hits, 
+		       lookups ? 100.0 * hits / lookups : 0.0); 
+    }
+
+    /* storage mappings: requests, new mmaps and remap rate */
+    if (map.stats->cs_maps > 0) { 
+	uint64_t maps = map.stats->cs_maps; 
+	uint64_t remaps = map.stats->cs_remaps; 
+
+	len += sprintf(buf + len, "Storage maps: %llu | %llu | %.1f%%\n", 
+		       (unsigned long long) maps, 
+		       (unsigned long long) remaps, 
+		       100.0 * remaps / maps); 
+    }
     
     /* add comments if any */
     if (node->comment != NULL) 
@@ -251,6 +273,70 @@ service_status(int client_fd, int node_id,
 	 } 
     } 
 
+    /* 
+     * memory used by each module in EXPORT: live records, current 
+     * and peak usage in KB (see update_exmem() in export.c) 
+     */
+    for (idx = 0; idx <= map.module_last; idx++) {
+	exmem_t * em; 
+
+	mdl = &map.modules[idx]; 
+	if (mdl->status == MDL_UNUSED || mdl->node != node_id) 
+	    continue; 
+	if (mdl->index >= map.stats->exmem_max) 
+	    continue; 
+
+	em = &map.stats->exmem[mdl->index]; 
+	len = sprintf(buf, "Export memory: %-15s | %llu | %llu | %llu\n", 
+		      mdl->name, (unsigned long long) em->records, 
+		      (unsigned long long) (em->bytes / 1024), 
+		      (unsigned long long) (em->peak / 1024)); 
+
+	ret = como_writen(client_fd, buf, len);
+	if (ret < 0)
+	    err(EXIT_FAILURE, "sending status to the client [%d]", client_fd);
+    }
+
+    /* 
+     * hardware counters of the modules, if enabled. one line for 
+     * CAPTURE and one for EXPORT with IPC, cycles, LLC misses and 
+     * branch misses per packet. EXPORT uses the packets seen by 
+     * CAPTURE so that the two lines can be added up. 
+     */
+    for (idx = 0; map.stats->pmc != NULL && idx <= map.module_last; idx++) {
+	pmcstat_t * pmc;
+	uint64_t pkts;
+	int p;
+
+	mdl = &map.modules[idx]; 
+	if (mdl->status == MDL_UNUSED || mdl->node != node_id) 
+	    continue; 
+	if (mdl->index >= map.stats->pmc_max) 
+	    continue; 
+
+	pmc = &map.stats->pmc[mdl->index * PMC_PROCS];
+	pkts = pmc[PMC_CAPTURE].pkts; 
+	if (pkts == 0) 
+	    continue; 
+
+	for (p = 0; p < PMC_PROCS; p++) { 
+	    uint64_t * c = pmc[p].count; 
+
+	    len = sprintf(buf, 
+		"Counters: %-15s | %s | %.2f | %.1f | %.3f | %.3f\n", 
+		mdl->name, (p == PMC_CAPTURE)? "capture" : "export", 
+		c[PMC_CYCLES]? (double) c[PMC_INSTRUCTIONS] / c[PMC_CYCLES] : 0, 
+		(double) c[PMC_CYCLES] / pkts, 
+		(double) c[PMC_LLC_MISSES] / pkts, 
+		(double) c[PMC_BRANCH_MISSES] / pkts); 
+
+	    ret = como_writen(client_fd, buf, len);
+	    if (ret < 0)
+		err(EXIT_FAILURE, "sending status to the client [%d]", 
+		    client_fd);
+	}
+    }
+
     /* print version and copyright information */
     len = sprintf(buf, "\n-- CoMo v%s (built: %s %s)\n", COMO_VERSION, 
 		__DATE__, __TIME__); 
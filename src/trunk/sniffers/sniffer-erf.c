@@ -135,7 +135,7 @@ sniffer_init(const char * device, const char * args)
     me = safe_calloc(1, sizeof(struct erf_me));
 
     me->sniff.max_pkts = 8192;
-    me->sniff.flags = SNIFF_FILE | SNIFF_SELECT;
+    me->sniff.flags = SNIFF_FILE | SNIFF_SELECT | SNIFF_SHARDS;
     me->map_size = ERF_DEFAULT_MAPSIZE;
 
     if (args) { 
@@ -230,6 +230,7 @@ sniffer_start(sniffer_t * s)
     
     me->sniff.fd = -1;
     me->file_idx = 0;
+    sniffer_shard_files(&me->files);
     if (open_next_file(me) < 0)
 	return -1;
 
@@ -423,6 +424,7 @@ sniffer_finish(sniffer_t * s)
     struct erf_me *me = (struct erf_me *) s;
 
     capbuf_finish(&me->capbuf);
+    globfree(&me->files);
     free(me);
 }
 
@@ -62,6 +62,11 @@ typedef void (*pcap_close_fn)(pcap_t *);
 typedef int (*pcap_setnonblock_fn)(pcap_t *, int, char *); 
 typedef int (*pcap_fileno_fn)(pcap_t *); 
 typedef int (*pcap_datalink_fn)(pcap_t *); 
+typedef int (*pcap_compile_fn)(pcap_t *, struct bpf_program *, const char *,
+			       int, bpf_u_int32);
+typedef int (*pcap_setfilter_fn)(pcap_t *, struct bpf_program *);
+typedef void (*pcap_freecode_fn)(struct bpf_program *);
+typedef char * (*pcap_geterr_fn)(pcap_t *);
 
 /*
  * This data structure will be stored in the source_t structure and 
@@ -374,6 +379,61 @@ sniffer_stop(sniffer_t * s)
 }
 
 
+/*
+ * -- sniffer_setfilter
+ *
+ * compile the filter expression with libpcap and attach it to the 
+ * capture handle. on Ethernet the expression is also applied to 
+ * VLAN tagged frames as CoMo looks inside them. 
+ */
+static int
+sniffer_setfilter(sniffer_t * s, const char * expr)
+{
+    struct libpcap_me *me = (struct libpcap_me *) s;
+    pcap_compile_fn sp_compile;
+    pcap_setfilter_fn sp_setfilter;
+    pcap_freecode_fn sp_freecode;
+    pcap_geterr_fn sp_geterr;
+    struct bpf_program prog;
+    char *str;
+    int ret;
+
+    sp_compile = (pcap_compile_fn) SYMBOL("pcap_compile");
+    sp_setfilter = (pcap_setfilter_fn) SYMBOL("pcap_setfilter");
+    sp_freecode = (pcap_freecode_fn) SYMBOL("pcap_freecode");
+    sp_geterr = (pcap_geterr_fn) SYMBOL("pcap_geterr");
+
+    if (me->pcap == NULL || sp_compile == NULL || sp_setfilter == NULL ||
+	sp_freecode == NULL || sp_geterr == NULL)
+	return -1;
+
+    if (expr == NULL)
+	str = safe_strdup("");		/* accept all packets */
+    else if (me->l2type == LINKTYPE_ETH)
+	asprintf(&str, "(%s) or (vlan and (%s))", expr, expr);
+    else
+	str = safe_strdup(expr);
+
+    ret = -1;
+    if (sp_compile(me->pcap, &prog, str, 1, 0) < 0) {
+	logmsg(LOGWARN, "sniffer-libpcap: cannot compile filter: %s\n",
+	       sp_geterr(me->pcap));
+    } else {
+	if (sp_setfilter(me->pcap, &prog) < 0) 
+	    logmsg(LOGWARN, "sniffer-libpcap: cannot set filter: %s\n",
+		   sp_geterr(me->pcap));
+	else 
+	    ret = 0;
+	sp_freecode(&prog);
+    }
+
+    logmsg(V_LOGSNIFFER, "sniffer-libpcap: filter \"%s\" %s\n", str,
+	   (ret == 0)? "installed" : "not installed");
+    free(str);
+    return ret;
+}
+
+
 static void
 sniffer_finish(sniffer_t * s)
 {
@@ -393,5 +453,6 @@ SNIFFER(libpcap) = {
     start: sniffer_start,
     next: sniffer_next,
     stop: sniffer_stop,
-    usage: sniffer_usage
+    usage: sniffer_usage,
+    setfilter: sniffer_setfilter
 };
@@ -38,6 +38,8 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <net/if.h>
@@ -55,6 +57,13 @@
  *
  * Reads pcap trace files. 
  *
+ * The files are read one window of mapsize bytes at a time, either 
+ * with mmap() (the default) or with read() into a buffer ("read" 
+ * option). When a window is loaded, the kernel is asked to start 
+ * reading the next one (or the beginning of the next file if this 
+ * is the last window) so that the disk works while we process the 
+ * packets. The throughput of each file is logged when it is done. 
+ *
  */
 
 #define PCAP_MIN_BUFSIZE	(me->sniff.max_pkts * sizeof(pkt_t))
@@ -82,6 +91,15 @@ struct pcap_me {
     off_t		off;
     off_t		remap_sz;
     off_t		remap;
+    int			use_read;	/* read() windows instead of mmap() */
+    char *		buf;		/* read buffer (use_read only) */
+    size_t		valid;		/* valid bytes in the window */
+    int			next_fd;	/* next file, opened in advance */
+    uint64_t		file_pkts;	/* packets read from current file */
+    uint64_t		tot_bytes;	/* bytes read from all files */
+    uint64_t		tot_pkts;	/* packets read from all files */
+    struct timeval	file_start;	/* when we opened the current file */
+    struct timeval	start;		/* when we opened the first file */
     capbuf_t		capbuf;
 };
 
@@ -118,6 +136,97 @@ swaps(uint16_t x)
 }
 
 
+/* 
+ * -- pcap_fadvise 
+ * 
+ * give a hint to the kernel about how we are going to access 
+ * a file. the hints that are not supported are silently ignored. 
+ */
+static void
+pcap_fadvise(int fd, off_t ofs, off_t len, int advice)
+{
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(fd, ofs, len, advice); 
+#endif
+}
+
+#ifndef POSIX_FADV_WILLNEED
+#define POSIX_FADV_WILLNEED	0
+#define POSIX_FADV_SEQUENTIAL	0
+#endif
+
+
+/* 
+ * -- trace_stats
+ * 
+ * log the throughput (in MB/s and packets/s) since a given time.
+ */
+static void
+trace_stats(const char * what, uint64_t bytes, uint64_t pkts, 
+	   struct timeval * since)
+{
+    struct timeval now; 
+    double secs; 
+
+    gettimeofday(&now, NULL); 
+    secs = (now.tv_sec - since->tv_sec) + 
+	   (now.tv_usec - since->tv_usec) / 1000000.0; 
+    if (secs <= 0) 
+	secs = 0.000001; 
+
+    logmsg(LOGSNIFFER, 
+	   "sniffer-pcap: %s: %llu bytes, %llu pkts in %.2fs "
+	   "(%.1f MB/s, %.0f pkts/s)\n", what, 
+	   (unsigned long long) bytes, (unsigned long long) pkts, secs, 
+	   bytes / secs / (1024 * 1024), pkts / secs); 
+}
+
+
+/* 
+ * -- prefetch_next 
+ * 
+ * start reading the window after the one just loaded. if this is 
+ * the last window of the file, open the next file and start reading 
+ * its first window instead. 
+ */
+static void
+prefetch_next(struct pcap_me * me)
+{
+    char * device; 
+
+    if (me->remap < me->file_size) { 
+	pcap_fadvise(me->sniff.fd, me->remap, me->map_size, 
+		     POSIX_FADV_WILLNEED); 
+	return; 
+    } 
+
+    if (me->next_fd >= 0 || me->file_idx + 1 >= (size_t) me->files.gl_pathc)
+	return; 
+
+    device = me->files.gl_pathv[me->file_idx + 1];
+    me->next_fd = open(device, O_RDONLY);
+    if (me->next_fd < 0) 
+	return; 	/* open_next_file() will complain */ 
+    pcap_fadvise(me->next_fd, 0, 0, POSIX_FADV_SEQUENTIAL); 
+    pcap_fadvise(me->next_fd, 0, me->map_size, POSIX_FADV_WILLNEED); 
+}
+
+
+/* 
+ * -- release_region 
+ * 
+ * unmap the current window. the read buffer is kept for the 
+ * next window. 
+ */
+static void
+release_region(struct pcap_me * me)
+{
+    if (me->base != NULL && !me->use_read) 
+	munmap(me->base, me->map_size);
+    me->base = NULL; 
+}
+
+
 static int
 open_next_file(struct pcap_me * me)
 {
@@ -128,16 +237,24 @@ open_next_file(struct pcap_me * me)
 
     if (me->sniff.fd >= 0) {
 	me->sniff.flags |= SNIFF_TOUCHED;
+	trace_stats(me->files.gl_pathv[me->file_idx], me->nread, 
+		   me->file_pkts, &me->file_start); 
 	me->file_idx++;
 	if (me->file_idx >= (size_t) me->files.gl_pathc)
 	    goto error;
 	close(me->sniff.fd);
     }
 
-    /* open the trace file */
+    /* open the trace file (unless prefetch_next() already did) */
     device = me->files.gl_pathv[me->file_idx];
     logmsg(LOGSNIFFER, "sniffer-pcap: opening file %s\n", device);
-    me->sniff.fd = open(device, O_RDONLY);
+    if (me->next_fd >= 0) { 
+	me->sniff.fd = me->next_fd; 
+	me->next_fd = -1; 
+    } else { 
+	me->sniff.fd = open(device, O_RDONLY);
+	pcap_fadvise(me->sniff.fd, 0, 0, POSIX_FADV_SEQUENTIAL); 
+    } 
     if (me->sniff.fd < 0) {
 	logmsg(LOGWARN, "sniffer-pcap: error while opening file %s: %s\n",
 	       device, strerror(errno));
@@ -151,14 +268,12 @@ open_next_file(struct pcap_me * me)
 	goto error;
     }
 
-    if (me->base) {
-	munmap(me->base, me->map_size);
-    }
-
-    me->base = NULL;
+    release_region(me); 
     me->nread = me->off = sizeof(struct pcap_file_header);
     me->remap = 0;
     me->file_size = trace_stat.st_size;
+    me->file_pkts = 0;
+    gettimeofday(&me->file_start, NULL); 
 
     /* read the pcap file header */    
     sz = sizeof(struct pcap_file_header);
@@ -237,6 +352,27 @@ error:
 }
 
 
+/* 
+ * -- has_option 
+ * 
+ * check if the arguments contain the given option as a whole word, 
+ * so that e.g. "read" is not matched by "readahead" or "thread=". 
+ */
+static int
+has_option(const char * args, const char * opt)
+{
+    size_t len = strlen(opt); 
+    const char * p; 
+
+    for (p = strstr(args, opt); p != NULL; p = strstr(p + 1, opt)) { 
+	if ((p == args || strchr(" \t,", p[-1]) != NULL) && 
+	    (p[len] == '\0' || strchr(" \t,", p[len]) != NULL)) 
+	    return 1; 
+    } 
+    return 0; 
+}
+
+
 /*
  * -- sniffer_init
  * 
@@ -249,8 +385,9 @@ sniffer_init(const char * device, const char * args)
     me = safe_calloc(1, sizeof(struct pcap_me));
 
     me->sniff.max_pkts = 8192;
-    me->sniff.flags = SNIFF_FILE | SNIFF_SELECT;
+    me->sniff.flags = SNIFF_FILE | SNIFF_SELECT | SNIFF_SHARDS;
     me->map_size = PCAP_DEFAULT_MAPSIZE;
+    me->next_fd = -1;
 
     if (args) { 
 	/* process input arguments */
@@ -266,8 +403,17 @@ sniffer_init(const char * device, const char * args)
 		me->map_size = PCAP_MAX_MAPSIZE;
 	    }
 	}
+	if (has_option(args, "read")) 
+	    me->use_read = 1; 
     }
 
+    /* 
+     * with the read option the windows are copied in a buffer 
+     * instead of being mmapped. 
+     */
+    if (me->use_read) 
+	me->buf = safe_malloc(me->map_size); 
+
     /* 
      * list all files that match the given pattern. 
      */
@@ -324,17 +470,51 @@ sniffer_setup_metadesc(sniffer_t * s)
 static int
 mmap_next_region(struct pcap_me * me)
 {
-    if (me->base != NULL) {
-	munmap(me->base, me->map_size);
-    }
+    release_region(me); 
+
+    if (me->use_read) { 
+	/* 
+	 * read the window. it can be shorter at the end of the file, 
+	 * in that case the file ends where the data ends (it may have 
+	 * been truncated since we opened it). 
+	 */
+	me->valid = 0; 
+	while (me->valid < me->map_size) { 
+	    ssize_t r; 
+
+	    r = pread(me->sniff.fd, me->buf + me->valid, 
+		      me->map_size - me->valid, me->remap + me->valid); 
+	    if (r < 0 && errno == EINTR) 
+		continue; 
+	    if (r < 0) { 
+		logmsg(LOGWARN, "sniffer-pcap: read failed: %s\n",
+		       strerror(errno));
+		return -1;
+	    } 
+	    if (r == 0) 
+		break; 
+	    me->valid += r; 
+	} 
+	if (me->valid < me->map_size && 
+	    me->file_size > me->remap + (off_t) me->valid) 
+	    me->file_size = me->remap + me->valid; 
+	me->base = me->buf; 
+	return 0; 
+    } 
+
     /* mmap the trace file */
     me->base = (char *) mmap(NULL, me->map_size, PROT_READ, MAP_PRIVATE,
 			     me->sniff.fd, me->remap);
     if (me->base == MAP_FAILED) {
 	logmsg(LOGWARN, "sniffer-pcap: mmap failed: %s\n",
 	       strerror(errno));
+	me->base = NULL; 
 	return -1;
     }
+    me->valid = me->map_size; 
+#ifdef MADV_SEQUENTIAL
+    madvise(me->base, me->map_size, MADV_SEQUENTIAL); 
+#endif
     return 0;
 }
 
@@ -356,6 +536,8 @@ sniffer_start(sniffer_t * s)
     
     me->sniff.fd = -1;
     me->file_idx = 0;
+    sniffer_shard_files(&me->files);
+    gettimeofday(&me->start, NULL); 
     if (open_next_file(me) < 0)
 	return -1;
 
@@ -374,6 +556,7 @@ sniffer_start(sniffer_t * s)
     }
     me->remap_sz = (off_t) (me->map_size - r);
     me->remap = me->remap_sz;
+    prefetch_next(me); 
     
     return 0;
 }
@@ -418,6 +601,7 @@ sniffer_next(sniffer_t * s, int max_pkts, timestamp_t max_ivl,
 	    return -1;
 	me->off = me->nread - me->remap;
 	me->remap += me->remap_sz;
+	prefetch_next(me); 
     }
 
     npkts = 0;
@@ -437,6 +621,10 @@ sniffer_next(sniffer_t * s, int max_pkts, timestamp_t max_ivl,
 	if (me->nread > me->remap)
 	    break;
 
+	/* never parse beyond the data in the window */
+	if (left > (off_t) me->valid - me->off)
+	    left = (off_t) me->valid - me->off;
+
 	/* do we have a pcap header? */
 	if (left < sizeof(pcap_hdr_t))
 	    break;
@@ -585,12 +773,34 @@ sniffer_next(sniffer_t * s, int max_pkts, timestamp_t max_ivl,
 	}
 	me->off += sizeof(pcap_hdr_t) + ph->caplen;
 	me->nread += sizeof(pcap_hdr_t) + ph->caplen;
+	me->tot_bytes += sizeof(pcap_hdr_t) + ph->caplen;
     }
 
+    me->file_pkts += npkts; 
+    me->tot_pkts += npkts; 
     return 0;
 }
 
 
+/*
+ * -- sniffer_usage
+ *
+ * fraction of the capture buffer used by the packets between 
+ * first and last. 
+ */
+static float
+sniffer_usage(sniffer_t * s, pkt_t * first, pkt_t * last)
+{
+    struct pcap_me *me = (struct pcap_me *) s;
+    size_t sz;
+    void * y;
+    
+    y = ((void *) last) + sizeof(pkt_t);
+    sz = capbuf_region_size(&me->capbuf, first, y);
+    return (float) sz / (float) me->capbuf.size;
+}
+
+
 /* 
  * -- sniffer_stop
  * 
@@ -601,10 +811,11 @@ sniffer_stop(sniffer_t * s)
 {
     struct pcap_me *me = (struct pcap_me *) s;
     
-    if (me->base) {
-    	munmap(me->base, me->map_size);
-    }
+    trace_stats("all files", me->tot_bytes, me->tot_pkts, &me->start); 
+    release_region(me); 
     close(me->sniff.fd);
+    if (me->next_fd >= 0) 
+	close(me->next_fd); 
 }
 
 
@@ -614,6 +825,8 @@ sniffer_finish(sniffer_t * s)
     struct pcap_me *me = (struct pcap_me *) s;
 
     capbuf_finish(&me->capbuf);
+    globfree(&me->files);
+    free(me->buf); 
     free(me);
 }
 
@@ -626,4 +839,5 @@ SNIFFER(pcap) = {
     start: sniffer_start,
     next: sniffer_next,
     stop: sniffer_stop,
+    usage: sniffer_usage
 };
@@ -0,0 +1,673 @@
+/*
+ * Copyright (c) 2006, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the distribution.
+ * * Neither the name of Intel Corporation nor the names of its contributors
+ *   may be used to endorse or promote products derived from this software
+ *   without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * $Id$
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/time.h>
+#include <assert.h>
+
+#include "como.h"
+#include "sniffers.h"
+
+#include "capbuf.c"
+
+/*
+ * SNIFFER  ---    synth
+ *
+ * Synthetic traffic generator. Packets are built directly in the 
+ * capture buffer, there is no I/O, so that CAPTURE and the modules 
+ * can be loaded as much as the CPU allows. The same seed always 
+ * produces the same packets. 
+ *
+ * The traffic is made of a number of IPv4 TCP, UDP and ICMP flows 
+ * whose popularity follows a Zipf distribution. Packet sizes are 
+ * drawn from a list of sizes with weights. A share of the packets 
+ * can belong to an attack: a SYN scan from a single source, or a 
+ * flood of SYN packets with spoofed sources to a single victim. 
+ *
+ * Arguments (device is just a label): 
+ *
+ *   seed=<n>		PRNG seed (default 1)
+ *   flows=<n>		number of flows (default 10000)
+ *   zipf=<s>		Zipf parameter of flow popularity (default 1.0)
+ *   tcp=<pct>		percentage of TCP flows (default 60)
+ *   udp=<pct>		percentage of UDP flows (default 35), ICMP the rest
+ *   sizes=<len:w,...>	packet sizes and weights (default 64:7,576:4,1500:1)
+ *   attack=<type>	synscan or flood (default none)
+ *   attack-share=<pct> percentage of attack packets (default 10)
+ *   rate=<pps>		packets per second of traffic time (default 100000)
+ *   packets=<n>	stop after n packets (default 0, i.e. never)
+ *   snaplen=<n>	bytes captured per packet (default 64)
+ *   start=<secs>	timestamp of the first packet (default 1167609600,
+ *			i.e. 2007-01-01 00:00 UTC)
+ *   realtime		generate the packets at rate pps of wall clock time
+ *			instead of as fast as possible. the timestamps 
+ *			then follow the wall clock and start is ignored
+ */
+
+#define SYNTH_MAX_SIZES		8
+#define SYNTH_HDRLEN		54	/* ethernet + ip + tcp */
+#define SYNTH_MAXLEN		1514
+#define SYNTH_MIN_BUFSIZE	(me->sniff.max_pkts * (sizeof(pkt_t) + me->snaplen))
+#define SYNTH_MAX_BUFSIZE	(SYNTH_MIN_BUFSIZE + (2*1024*1024))
+#define SYNTH_EPOCH		1167609600	/* 2007-01-01 00:00 UTC */
+
+enum synth_attack {
+    ATTACK_NONE = 0,
+    ATTACK_SYNSCAN,
+    ATTACK_FLOOD
+};
+
+/* 
+ * a flow. the headers are prepared in advance, only the lengths, 
+ * checksum and flags change from packet to packet. 
+ */
+typedef struct synth_flow {
+    uint8_t		hdr[SYNTH_HDRLEN];
+    int			hdrlen;		/* ethernet + ip + l4 header */
+    uint8_t		proto;
+} synth_flow_t;
+
+struct synth_me {
+    sniffer_t		sniff;		/* common fields, must be the first */
+    uint64_t		seed;
+    uint64_t		rnd;		/* PRNG state (xorshift64*) */
+    int			nflows;
+    double		zipf;
+    int			tcp;
+    int			udp;
+    synth_flow_t *	flows;
+    float *		prob;		/* alias method tables for the */
+    uint32_t *		alias;		/* Zipf distribution of flows */
+    int			sizes[SYNTH_MAX_SIZES];
+    int			weights[SYNTH_MAX_SIZES]; /* cumulative */
+    int			nsizes;
+    enum synth_attack	attack;
+    int			attack_share;
+    synth_flow_t	attack_flow;	/* template of attack packets */
+    uint32_t		rate;
+    uint64_t		packets;	/* packets to generate (0: no limit) */
+    uint64_t		count;		/* packets generated so far */
+    int			snaplen;
+    int			realtime;
+    uint32_t		epoch;		/* first timestamp (not realtime) */
+    timestamp_t		ts;		/* timestamp of the next packet */
+    timestamp_t		ivl;		/* time between two packets */
+    struct timeval	start;		/* wall clock time at start */
+    capbuf_t		capbuf;
+};
+
+
+static __inline__ uint64_t
+synth_rnd(struct synth_me * me)
+{
+    me->rnd ^= me->rnd >> 12;
+    me->rnd ^= me->rnd << 25;
+    me->rnd ^= me->rnd >> 27;
+    return me->rnd * 0x2545F4914F6CDD1DULL;
+}
+
+static __inline__ double
+synth_rnd_double(struct synth_me * me)
+{
+    return (synth_rnd(me) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static __inline__ void
+put16(uint8_t * p, uint16_t x)
+{
+    p[0] = x >> 8;
+    p[1] = x & 0xff;
+}
+
+static __inline__ void
+put32(uint8_t * p, uint32_t x)
+{
+    p[0] = x >> 24;
+    p[1] = (x >> 16) & 0xff;
+    p[2] = (x >> 8) & 0xff;
+    p[3] = x & 0xff;
+}
+
+
+/*
+ * -- ip_cksum
+ *
+ * checksum of the 20 bytes IP header at p
+ */
+static __inline__ uint16_t
+ip_cksum(const uint8_t * p)
+{
+    uint32_t sum = 0;
+    int i;
+
+    for (i = 0; i < 20; i += 2)
+	sum += (p[i] << 8) | p[i + 1];
+    while (sum >> 16)
+	sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t) ~sum;
+}
+
+
+/*
+ * -- flow_init
+ *
+ * prepare the headers of a flow
+ */
+static void
+flow_init(synth_flow_t * fl, uint8_t proto, uint32_t src, uint32_t dst,
+	  uint16_t sport, uint16_t dport)
+{
+    uint8_t * h = fl->hdr;
+
+    memset(h, 0, SYNTH_HDRLEN);
+    fl->proto = proto;
+
+    /* ethernet */
+    h[0] = 0x02; h[5] = 0x01;
+    h[6] = 0x02; h[11] = 0x02;
+    put16(h + 12, 0x0800);
+
+    /* ipv4 */
+    h[14] = 0x45;
+    h[22] = 64;
+    h[23] = proto;
+    put32(h + 26, src);
+    put32(h + 30, dst);
+
+    switch (proto) {
+    case IPPROTO_TCP:
+	put16(h + 34, sport);
+	put16(h + 36, dport);
+	h[46] = 0x50;
+	h[47] = 0x10;		/* ACK */
+	put16(h + 48, 65535);
+	fl->hdrlen = 14 + 20 + 20;
+	break;
+    case IPPROTO_UDP:
+	put16(h + 34, sport);
+	put16(h + 36, dport);
+	fl->hdrlen = 14 + 20 + 8;
+	break;
+    default:
+	h[34] = 8;		/* ICMP echo request */
+	fl->hdrlen = 14 + 20 + 8;
+	break;
+    }
+}
+
+
+/*
+ * -- zipf_init
+ *
+ * build the tables of the alias method (Vose) for the Zipf 
+ * distribution of the flows, so that a flow is drawn in constant 
+ * time whatever the number of flows. 
+ */
+static void
+zipf_init(struct synth_me * me)
+{
+    int n = me->nflows;
+    double * p, sum;
+    uint32_t * small, * large;
+    int ns, nl, i;
+
+    p = safe_calloc(n, sizeof(double));
+    small = safe_calloc(n, sizeof(uint32_t));
+    large = safe_calloc(n, sizeof(uint32_t));
+    me->prob = safe_calloc(n, sizeof(float));
+    me->alias = safe_calloc(n, sizeof(uint32_t));
+
+    sum = 0;
+    for (i = 0; i < n; i++) {
+	p[i] = 1.0 / pow(i + 1, me->zipf);
+	sum += p[i];
+    }
+
+    ns = nl = 0;
+    for (i = 0; i < n; i++) {
+	p[i] = p[i] * n / sum;
+	if (p[i] < 1.0)
+	    small[ns++] = i;
+	else
+	    large[nl++] = i;
+    }
+
+    while (ns > 0 && nl > 0) {
+	uint32_t s = small[--ns];
+	uint32_t l = large[--nl];
+
+	me->prob[s] = p[s];
+	me->alias[s] = l;
+	p[l] = (p[l] + p[s]) - 1.0;
+	if (p[l] < 1.0)
+	    small[ns++] = l;
+	else
+	    large[nl++] = l;
+    }
+    while (nl > 0)
+	me->prob[large[--nl]] = 1.0;
+    while (ns > 0)
+	me->prob[small[--ns]] = 1.0;
+
+    free(p);
+    free(small);
+    free(large);
+}
+
+
+/*
+ * -- parse_sizes
+ *
+ * parse a list of len:weight pairs
+ */
+static int
+parse_sizes(struct synth_me * me, const char * s)
+{
+    int n = 0, total = 0;
+
+    while (n < SYNTH_MAX_SIZES && *s != '\0' && *s != ' ') {
+	int len, w = 1;
+	char * end;
+
+	len = strtol(s, &end, 10);
+	if (end == s)
+	    return -1;
+	s = end;
+	if (*s == ':') {
+	    w = strtol(s + 1, &end, 10);
+	    s = end;
+	}
+	if (len < 60)
+	    len = 60;
+	if (len > SYNTH_MAXLEN)
+	    len = SYNTH_MAXLEN;
+	total += w;
+	me->sizes[n] = len;
+	me->weights[n] = total;
+	n++;
+	if (*s == ',')
+	    s++;
+    }
+
+    if (n == 0 || total == 0)
+	return -1;
+    me->nsizes = n;
+    return 0;
+}
+
+
+/*
+ * -- sniffer_init
+ * 
+ */
+static sniffer_t *
+sniffer_init(const char * device, const char * args)
+{
+    struct synth_me *me;
+    
+    me = safe_calloc(1, sizeof(struct synth_me));
+
+    me->sniff.fd = -1;
+    me->sniff.max_pkts = 8192;
+    me->sniff.flags = SNIFF_FILE | SNIFF_POLL;
+    me->seed = 1;
+    me->nflows = 10000;
+    me->zipf = 1.0;
+    me->tcp = 60;
+    me->udp = 35;
+    me->attack_share = 10;
+    me->rate = 100000;
+    me->snaplen = 64;
+    me->epoch = SYNTH_EPOCH;
+    parse_sizes(me, "64:7,576:4,1500:1");
+
+    if (args) { 
+	/* process input arguments */
+	char *p;
+
+	if ((p = strstr(args, "seed=")) != NULL) 
+	    me->seed = strtoull(p + 5, NULL, 0);
+	if ((p = strstr(args, "flows=")) != NULL) 
+	    me->nflows = atoi(p + 6);
+	if ((p = strstr(args, "zipf=")) != NULL) 
+	    me->zipf = atof(p + 5);
+	if ((p = strstr(args, "tcp=")) != NULL) 
+	    me->tcp = atoi(p + 4);
+	if ((p = strstr(args, "udp=")) != NULL) 
+	    me->udp = atoi(p + 4);
+	if ((p = strstr(args, "sizes=")) != NULL) {
+	    if (parse_sizes(me, p + 6) < 0) {
+		logmsg(LOGWARN, "sniffer-synth: invalid sizes %s\n", p + 6);
+		goto error;
+	    }
+	}
+	if ((p = strstr(args, "attack=")) != NULL) {
+	    if (strncmp(p + 7, "synscan", 7) == 0) {
+		me->attack = ATTACK_SYNSCAN;
+	    } else if (strncmp(p + 7, "flood", 5) == 0) {
+		me->attack = ATTACK_FLOOD;
+	    } else {
+		logmsg(LOGWARN, "sniffer-synth: unknown attack %s\n", p + 7);
+		goto error;
+	    }
+	}
+	if ((p = strstr(args, "attack-share=")) != NULL) 
+	    me->attack_share = atoi(p + 13);
+	if ((p = strstr(args, "rate=")) != NULL) 
+	    me->rate = atoi(p + 5);
+	if ((p = strstr(args, "packets=")) != NULL) 
+	    me->packets = strtoull(p + 8, NULL, 10);
+	if ((p = strstr(args, "snaplen=")) != NULL) 
+	    me->snaplen = atoi(p + 8);
+	if ((p = strstr(args, "start=")) != NULL) 
+	    me->epoch = strtoul(p + 6, NULL, 10);
+	if (strstr(args, "realtime") != NULL) 
+	    me->realtime = 1;
+    }
+
+    if (me->nflows < 1 || me->rate < 1 || me->tcp + me->udp > 100) {
+	logmsg(LOGWARN, "sniffer-synth: invalid flows, rate or mix\n");
+	goto error;
+    }
+    if (me->snaplen < SYNTH_HDRLEN)
+	me->snaplen = SYNTH_HDRLEN;
+    if (me->snaplen > SYNTH_MAXLEN)
+	me->snaplen = SYNTH_MAXLEN;
+    me->ivl = TIME2TS(1, 0) / me->rate;
+
+    /* in realtime mode wake up every millisecond */
+    if (me->realtime) 
+	me->sniff.polling = TIME2TS(0, 1000); 
+
+    /* create the capture buffer */
+    if (capbuf_init(&me->capbuf, args, NULL, SYNTH_MIN_BUFSIZE,
+		    SYNTH_MAX_BUFSIZE) < 0)
+	goto error;
+
+    logmsg(LOGSNIFFER, "sniffer-synth: %s, %d flows, %u pps, seed %llu\n",
+	   device, me->nflows, me->rate, (unsigned long long) me->seed);
+    return (sniffer_t *) me;
+
+error:
+    free(me);
+    return NULL;
+}
+
+
+static void
+sniffer_setup_metadesc(sniffer_t * s)
+{
+    struct synth_me *me = (struct synth_me *) s;
+    metadesc_t *outmd;
+    pkt_t *pkt;
+
+    /* setup output descriptor */
+    outmd = metadesc_define_sniffer_out(s, 0);
+    pkt = metadesc_tpl_add(outmd, "link:eth:any:any");
+    COMO(caplen) = me->snaplen;
+}
+
+
+/* 
+ * -- sniffer_start
+ * 
+ * Build the flows from the seed. It returns 0 on success and -1 
+ * on failure.
+ *
+ */
+static int
+sniffer_start(sniffer_t * s) 
+{
+    struct synth_me *me = (struct synth_me *) s;
+    int i;
+
+    me->rnd = me->seed ? me->seed : 1;
+    me->flows = safe_calloc(me->nflows, sizeof(synth_flow_t));
+
+    for (i = 0; i < me->nflows; i++) {
+	int x = synth_rnd(me) % 100;
+	uint8_t proto;
+
+	proto = (x < me->tcp)? IPPROTO_TCP : 
+		(x < me->tcp + me->udp)? IPPROTO_UDP : IPPROTO_ICMP;
+	flow_init(&me->flows[i], proto, 
+		  0x0a000000 | (synth_rnd(me) & 0xffffff),	/* 10/8 */
+		  0xc0a80000 | (synth_rnd(me) & 0xffff),	/* 192.168/16 */
+		  1024 + synth_rnd(me) % 64000, 
+		  1 + synth_rnd(me) % 1024);
+    }
+    zipf_init(me);
+
+    /* attack packets: SYN from 172.16.0.1 or to 192.168.0.1 port 80 */
+    flow_init(&me->attack_flow, IPPROTO_TCP, 0xac100001, 0xc0a80001, 
+	      40000, 80);
+    me->attack_flow.hdr[47] = 0x02;	/* SYN */
+
+    /* 
+     * the timestamps only depend on the arguments, so that two runs 
+     * with the same seed have the same flush intervals, unless they 
+     * have to follow the wall clock. 
+     */
+    gettimeofday(&me->start, NULL);
+    if (me->realtime) 
+	me->ts = TIME2TS(me->start.tv_sec, me->start.tv_usec);
+    else 
+	me->ts = TIME2TS(me->epoch, 0);
+    return 0;
+}
+
+
+/*
+ * -- sniffer_next
+ *
+ * Generate the next batch of packets. 
+ *
+ */
+static int
+sniffer_next(sniffer_t * s, int max_pkts, timestamp_t max_ivl,
+	     __attribute__((__unused__)) pkt_t * first_ref_pkt, 
+	     __attribute__((__unused__)) int * dropped_pkts) 
+{
+    struct synth_me *me = (struct synth_me *) s;
+    timestamp_t first_ts = me->ts;
+    int npkts;
+
+    if (me->packets > 0 && me->count >= me->packets) {
+	if (ppbuf_get_count(me->sniff.ppbuf) > 0)
+	    return 0;		/* wait for the ppbuf to be empty */
+	return -1;		/* done */
+    }
+
+    /* in realtime mode do not go past the wall clock */
+    if (me->realtime) {
+	struct timeval now;
+	int64_t usecs;
+	uint64_t due;
+
+	/* elapsed time in signed microseconds, tv_usec can go back */
+	gettimeofday(&now, NULL);
+	usecs = (int64_t) (now.tv_sec - me->start.tv_sec) * 1000000LL + 
+		(int64_t) (now.tv_usec - me->start.tv_usec);
+	if (usecs <= 0)
+	    return 0;
+	due = (uint64_t) usecs * me->rate / 1000000;
+	if (due <= me->count)
+	    return 0;
+	if (due - me->count < (uint64_t) max_pkts)
+	    max_pkts = due - me->count;
+    }
+
+    if (me->packets > 0 && me->packets - me->count < (uint64_t) max_pkts)
+	max_pkts = me->packets - me->count;
+
+    capbuf_begin(&me->capbuf, NULL);
+
+    for (npkts = 0; npkts < max_pkts; npkts++) {
+	synth_flow_t * fl;
+	uint8_t * h;
+	pkt_t * pkt;
+	int len, caplen, w, i;
+	uint32_t r;
+
+	/* never return more than max_ivl of traffic */
+	if (me->ts - first_ts >= max_ivl && npkts > 0)
+	    break;
+
+	/* pick the flow and the size */
+	r = synth_rnd(me);
+	if (me->attack != ATTACK_NONE && 
+	    (int) (r % 100) < me->attack_share) { 
+	    fl = &me->attack_flow; 
+	    len = 60; 
+	} else { 
+	    i = synth_rnd(me) % me->nflows; 
+	    if (synth_rnd_double(me) >= me->prob[i]) 
+		i = me->alias[i]; 
+	    fl = &me->flows[i]; 
+	    w = (r >> 8) % me->weights[me->nsizes - 1]; 
+	    for (i = 0; w >= me->weights[i]; i++) 
+		; 
+	    len = me->sizes[i]; 
+	} 
+	if (len < fl->hdrlen)
+	    len = fl->hdrlen;
+	caplen = (len < me->snaplen)? len : me->snaplen;
+
+	/* build the packet in the capture buffer */
+	pkt = (pkt_t *) capbuf_reserve_space(&me->capbuf, sizeof(pkt_t));
+	h = capbuf_reserve_space(&me->capbuf, caplen);
+	memcpy(h, fl->hdr, fl->hdrlen);
+	if (caplen > fl->hdrlen)
+	    memset(h + fl->hdrlen, 0, caplen - fl->hdrlen);
+
+	if (fl == &me->attack_flow) {
+	    uint32_t x = synth_rnd(me);
+
+	    if (me->attack == ATTACK_SYNSCAN) {
+		/* one source, random destinations and ports */
+		put32(h + 30, 0xc0a80000 | (x & 0xffff));
+		put16(h + 36, 1 + (x >> 16) % 1024);
+	    } else {
+		/* spoofed sources, one destination */
+		put32(h + 26, x);
+		put16(h + 34, 1024 + (x >> 16) % 64000);
+	    }
+	}
+
+	put16(h + 16, len - 14);
+	put16(h + 24, 0);
+	put16(h + 24, ip_cksum(h + 14));
+	if (fl->proto == IPPROTO_UDP)
+	    put16(h + 38, len - 34);
+
+	COMO(ts) = me->ts;
+	COMO(len) = len;
+	COMO(type) = COMOTYPE_LINK;
+	COMO(caplen) = caplen;
+	COMO(payload) = (char *) h;
+	updateofs(pkt, L2, LINKTYPE_ETH);
+	ppbuf_capture(me->sniff.ppbuf, pkt);
+
+	me->ts += me->ivl;
+	me->count++;
+    }
+
+    return 0;
+}
+
+
+/*
+ * -- sniffer_usage
+ *
+ * fraction of the capture buffer used by the packets between 
+ * first and last. 
+ */
+static float
+sniffer_usage(sniffer_t * s, pkt_t * first, pkt_t * last)
+{
+    struct synth_me *me = (struct synth_me *) s;
+    size_t sz;
+    void * y;
+    
+    y = ((void *) last->payload) + last->caplen;
+    sz = capbuf_region_size(&me->capbuf, first, y);
+    return (float) sz / (float) me->capbuf.size;
+}
+
+
+/* 
+ * -- sniffer_stop
+ * 
+ */
+static void
+sniffer_stop(sniffer_t * s)
+{
+    struct synth_me *me = (struct synth_me *) s;
+    struct timeval now;
+    double secs;
+
+    gettimeofday(&now, NULL);
+    secs = (now.tv_sec - me->start.tv_sec) + 
+	   (now.tv_usec - me->start.tv_usec) / 1000000.0;
+    logmsg(LOGSNIFFER, "sniffer-synth: %llu packets in %.1fs (%.0f pkts/s)\n",
+	   (unsigned long long) me->count, secs, 
+	   secs > 0 ? me->count / secs : 0);
+}
+
+
+static void
+sniffer_finish(sniffer_t * s)
+{
+    struct synth_me *me = (struct synth_me *) s;
+
+    capbuf_finish(&me->capbuf);
+    free(me->flows);
+    free(me->prob);
+    free(me->alias);
+    free(me);
+}
+
+
+SNIFFER(synth) = {
+    name: "synth",
+    init: sniffer_init,
+    finish: sniffer_finish,
+    setup_metadesc: sniffer_setup_metadesc,
+    start: sniffer_start,
+    next: sniffer_next,
+    stop: sniffer_stop,
+    usage: sniffer_usage
+};